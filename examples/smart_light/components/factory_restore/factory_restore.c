@@ -173,6 +173,17 @@ int nvs_kv_set(const char *key, const void *val, int len, int sync)
     return ret;
 }
 
+/* key-value storage of the SDK, ESP_OK is QCLOUD_RET_SUCCESS */
+int HAL_Kv_Get(const char *key, void *val, int *buffer_len)
+{
+    return nvs_kv_get(key, val, buffer_len);
+}
+
+int HAL_Kv_Set(const char *key, const void *val, int len)
+{
+    return nvs_kv_set(key, val, len, 0);
+}
+
 static esp_err_t factory_restore_handle(void)
 {
     esp_err_t ret = ESP_OK;
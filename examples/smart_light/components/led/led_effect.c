@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2020 Tencent Cloud. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "led_effect.h"
+
+#define LED_EFFECT_TASK_STACK 2048
+#define LED_EFFECT_TASK_PRIO  4
+
+static const char *TAG = "led_effect";
+
+// gamma 2.2, from perceived brightness to PWM duty of WS2812
+static const uint8_t led_gamma[256] = {
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,
+      1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+      3,   3,   3,   3,   3,   4,   4,   4,   4,   5,   5,   5,   5,   6,   6,   6,
+      6,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,  10,  11,  11,  11,  12,
+     12,  13,  13,  13,  14,  14,  15,  15,  16,  16,  17,  17,  18,  18,  19,  19,
+     20,  20,  21,  22,  22,  23,  23,  24,  25,  25,  26,  26,  27,  28,  28,  29,
+     30,  30,  31,  32,  33,  33,  34,  35,  35,  36,  37,  38,  39,  39,  40,  41,
+     42,  43,  43,  44,  45,  46,  47,  48,  49,  49,  50,  51,  52,  53,  54,  55,
+     56,  57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,
+     73,  74,  75,  76,  77,  78,  79,  81,  82,  83,  84,  85,  87,  88,  89,  90,
+     91,  93,  94,  95,  97,  98,  99, 100, 102, 103, 105, 106, 107, 109, 110, 111,
+    113, 114, 116, 117, 119, 120, 121, 123, 124, 126, 127, 129, 130, 132, 133, 135,
+    137, 138, 140, 141, 143, 145, 146, 148, 149, 151, 153, 154, 156, 158, 159, 161,
+    163, 165, 166, 168, 170, 172, 173, 175, 177, 179, 181, 182, 184, 186, 188, 190,
+    192, 194, 196, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
+    223, 225, 227, 229, 231, 234, 236, 238, 240, 242, 244, 246, 248, 251, 253, 255,
+};
+
+static led_strip_t *s_strip;
+static uint32_t s_led_num;
+static uint32_t s_frame_ms;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static led_effect_t s_effect = {LED_EFFECT_SOLID, 0, 0, 0, 0};
+static bool s_effect_changed = true;
+
+void led_hsv2rgb(uint16_t h, uint8_t s, uint8_t v, uint8_t *r, uint8_t *g, uint8_t *b)
+{
+    h %= 360;
+    s = s > 100 ? 100 : s;
+    v = v > 100 ? 100 : v;
+
+    uint32_t rgb_max = v * 255 / 100;
+    uint32_t rgb_min = rgb_max * (100 - s) / 100;
+    // RGB adjustment amount by hue
+    uint32_t rgb_adj = (rgb_max - rgb_min) * (h % 60) / 60;
+    uint32_t red, green, blue;
+
+    switch (h / 60) {
+    case 0:
+        red = rgb_max;
+        green = rgb_min + rgb_adj;
+        blue = rgb_min;
+        break;
+    case 1:
+        red = rgb_max - rgb_adj;
+        green = rgb_max;
+        blue = rgb_min;
+        break;
+    case 2:
+        red = rgb_min;
+        green = rgb_max;
+        blue = rgb_min + rgb_adj;
+        break;
+    case 3:
+        red = rgb_min;
+        green = rgb_max - rgb_adj;
+        blue = rgb_max;
+        break;
+    case 4:
+        red = rgb_min + rgb_adj;
+        green = rgb_min;
+        blue = rgb_max;
+        break;
+    default:
+        red = rgb_max;
+        green = rgb_min;
+        blue = rgb_max - rgb_adj;
+        break;
+    }
+
+    *r = led_gamma[red];
+    *g = led_gamma[green];
+    *b = led_gamma[blue];
+}
+
+static void led_effect_fill(uint16_t h, uint8_t s, uint8_t v)
+{
+    uint8_t red, green, blue;
+
+    led_hsv2rgb(h, s, v, &red, &green, &blue);
+    for (uint32_t i = 0; i < s_led_num; i++) {
+        s_strip->set_pixel(s_strip, i, red, green, blue);
+    }
+}
+
+static void led_effect_draw(const led_effect_t *effect, uint32_t elapsed_ms)
+{
+    uint32_t phase = effect->period_ms ? elapsed_ms % effect->period_ms : 0;
+    uint32_t half = effect->period_ms / 2;
+    uint8_t red, green, blue;
+
+    switch (effect->type) {
+    case LED_EFFECT_BREATH:
+        // triangle wave of brightness, 0 at the start and end of period
+        if (half) {
+            phase = phase < half ? phase : effect->period_ms - phase;
+            led_effect_fill(effect->hue, effect->saturation, effect->value * phase / half);
+            break;
+        }
+        // fall through
+    case LED_EFFECT_SOLID:
+        led_effect_fill(effect->hue, effect->saturation, effect->value);
+        break;
+    case LED_EFFECT_BLINK:
+        led_effect_fill(effect->hue, effect->saturation, phase < half || !half ? effect->value : 0);
+        break;
+    case LED_EFFECT_RAINBOW: {
+        uint32_t offset = effect->period_ms ? phase * 360 / effect->period_ms : 0;
+        for (uint32_t i = 0; i < s_led_num; i++) {
+            led_hsv2rgb(effect->hue + i * 360 / s_led_num + offset, effect->saturation, effect->value, &red, &green,
+                        &blue);
+            s_strip->set_pixel(s_strip, i, red, green, blue);
+        }
+        break;
+    }
+    }
+}
+
+static void led_effect_task(void *arg)
+{
+    TickType_t wake = xTaskGetTickCount();
+    TickType_t start = wake;
+    led_effect_t effect;
+    bool changed;
+
+    for (;;) {
+        portENTER_CRITICAL(&s_lock);
+        effect = s_effect;
+        changed = s_effect_changed;
+        s_effect_changed = false;
+        portEXIT_CRITICAL(&s_lock);
+
+        if (changed) {
+            start = xTaskGetTickCount();
+        }
+
+        // a solid color is drawn once, the strip sends only the pixels changed anyway
+        if (changed || effect.type != LED_EFFECT_SOLID) {
+            led_effect_draw(&effect, (xTaskGetTickCount() - start) * portTICK_PERIOD_MS);
+            if (s_strip->refresh(s_strip, s_frame_ms) != ESP_OK) {
+                ESP_LOGW(TAG, "refresh strip timeout");
+            }
+        }
+
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(s_frame_ms) ? pdMS_TO_TICKS(s_frame_ms) : 1);
+    }
+}
+
+esp_err_t led_effect_start(led_strip_t *strip, uint32_t led_num, uint32_t frame_ms)
+{
+    if (strip == NULL || led_num == 0 || frame_ms == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    s_strip = strip;
+    s_led_num = led_num;
+    s_frame_ms = frame_ms;
+
+    if (xTaskCreate(led_effect_task, "led_effect_task", LED_EFFECT_TASK_STACK, NULL, LED_EFFECT_TASK_PRIO, NULL) !=
+        pdPASS) {
+        ESP_LOGE(TAG, "create led effect task failed");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+void led_effect_set(const led_effect_t *effect)
+{
+    portENTER_CRITICAL(&s_lock);
+    s_effect = *effect;
+    s_effect_changed = true;
+    portEXIT_CRITICAL(&s_lock);
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2020 Tencent Cloud. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __LED_EFFECT_H__
+#define __LED_EFFECT_H__
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "led_strip.h"
+
+typedef enum {
+    LED_EFFECT_SOLID = 0, // one color on all pixels
+    LED_EFFECT_BREATH,    // color fading in and out once a period
+    LED_EFFECT_BLINK,     // color on for the first half of period
+    LED_EFFECT_RAINBOW,   // hue wheel along the strip, turning once a period
+} led_effect_type_t;
+
+typedef struct {
+    led_effect_type_t type;
+    uint16_t hue;        // 0 ~ 359
+    uint8_t saturation;  // 0 ~ 100
+    uint8_t value;       // 0 ~ 100, perceived brightness
+    uint32_t period_ms;  // period of animated effects
+} led_effect_t;
+
+/**
+ * @brief Convert HSV to gamma corrected RGB with integer math only
+ */
+void led_hsv2rgb(uint16_t h, uint8_t s, uint8_t v, uint8_t *r, uint8_t *g, uint8_t *b);
+
+/**
+ * @brief Start the task drawing the effects on strip, one frame every frame_ms
+ */
+esp_err_t led_effect_start(led_strip_t *strip, uint32_t led_num, uint32_t frame_ms);
+
+/**
+ * @brief Change the effect, the animation restarts from its beginning
+ */
+void led_effect_set(const led_effect_t *effect);
+
+#endif
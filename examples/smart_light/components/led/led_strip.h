@@ -65,6 +65,8 @@ struct led_strip_s {
     *
     * @note:
     *      After updating the LED colors in the memory, a following invocation of this API is needed to flush colors to strip.
+    *      The colors are sent in background from a second buffer, the call waits only for the previous refresh
+    *      and sends nothing when no color has changed.
     */
     esp_err_t (*refresh)(led_strip_t *strip, uint32_t timeout_ms);
 
@@ -11,6 +11,7 @@
 // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and
 // limitations under the License.
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/cdefs.h>
@@ -42,10 +43,17 @@ static uint32_t ws2812_t1h_ticks = 0;
 static uint32_t ws2812_t0l_ticks = 0;
 static uint32_t ws2812_t1l_ticks = 0;
 
+// RMT symbols of every byte value, MSB first, read by the translator in ISR
+static DRAM_ATTR rmt_item32_t ws2812_byte_items[256][8];
+
 typedef struct {
     led_strip_t parent;
     rmt_channel_t rmt_channel;
     uint32_t strip_len;
+    uint32_t dirty_len; // pixels from the start of strip to send on next refresh
+    bool tx_pending;    // front buffer is being sent
+    uint8_t *front;     // GRB data being sent by RMT
+    uint8_t *back;      // GRB data written by set_pixel
     uint8_t buffer[0];
 } ws2812_t;
 
@@ -69,23 +77,17 @@ static void IRAM_ATTR ws2812_rmt_adapter(const void *src, rmt_item32_t *dest, si
         *item_num = 0;
         return;
     }
-    const rmt_item32_t bit0 = {{{ ws2812_t0h_ticks, 1, ws2812_t0l_ticks, 0 }}}; //Logical 0
-    const rmt_item32_t bit1 = {{{ ws2812_t1h_ticks, 1, ws2812_t1l_ticks, 0 }}}; //Logical 1
     size_t size = 0;
     size_t num = 0;
     uint8_t *psrc = (uint8_t *)src;
     rmt_item32_t *pdest = dest;
     while (size < src_size && num < wanted_num) {
+        const rmt_item32_t *items = ws2812_byte_items[*psrc];
         for (int i = 0; i < 8; i++) {
-            // MSB first
-            if (*psrc & (1 << (7 - i))) {
-                pdest->val =  bit1.val;
-            } else {
-                pdest->val =  bit0.val;
-            }
-            num++;
-            pdest++;
+            pdest[i].val = items[i].val;
         }
+        num += 8;
+        pdest += 8;
         size++;
         psrc++;
     }
@@ -98,11 +100,16 @@ static esp_err_t ws2812_set_pixel(led_strip_t *strip, uint32_t index, uint32_t r
     esp_err_t ret = ESP_OK;
     ws2812_t *ws2812 = __containerof(strip, ws2812_t, parent);
     STRIP_CHECK(index < ws2812->strip_len, "index out of the maximum number of leds", err, ESP_ERR_INVALID_ARG);
-    uint32_t start = index * 3;
+    uint8_t *pixel = ws2812->back + index * 3;
     // In thr order of GRB
-    ws2812->buffer[start + 0] = green & 0xFF;
-    ws2812->buffer[start + 1] = red & 0xFF;
-    ws2812->buffer[start + 2] = blue & 0xFF;
+    if (pixel[0] != (green & 0xFF) || pixel[1] != (red & 0xFF) || pixel[2] != (blue & 0xFF)) {
+        pixel[0] = green & 0xFF;
+        pixel[1] = red & 0xFF;
+        pixel[2] = blue & 0xFF;
+        if (ws2812->dirty_len < index + 1) {
+            ws2812->dirty_len = index + 1;
+        }
+    }
     return ESP_OK;
 err:
     return ret;
@@ -112,9 +119,28 @@ static esp_err_t ws2812_refresh(led_strip_t *strip, uint32_t timeout_ms)
 {
     esp_err_t ret = ESP_OK;
     ws2812_t *ws2812 = __containerof(strip, ws2812_t, parent);
-    STRIP_CHECK(rmt_write_sample(ws2812->rmt_channel, ws2812->buffer, ws2812->strip_len * 3, true) == ESP_OK,
+    uint8_t *sent = NULL;
+    if (ws2812->tx_pending) {
+        ret = rmt_wait_tx_done(ws2812->rmt_channel, pdMS_TO_TICKS(timeout_ms));
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        ws2812->tx_pending = false;
+    }
+    // pixels are chained, the ones after the last pixel sent keep their colors
+    if (ws2812->dirty_len == 0) {
+        return ESP_OK;
+    }
+    STRIP_CHECK(rmt_write_sample(ws2812->rmt_channel, ws2812->back, ws2812->dirty_len * 3, false) == ESP_OK,
                 "transmit RMT samples failed", err, ESP_FAIL);
-    return rmt_wait_tx_done(ws2812->rmt_channel, pdMS_TO_TICKS(timeout_ms));
+    ws2812->tx_pending = true;
+    ws2812->dirty_len = 0;
+    // the next frame is drawn over a copy of this one while it is being sent
+    sent = ws2812->back;
+    ws2812->back = ws2812->front;
+    ws2812->front = sent;
+    memcpy(ws2812->back, ws2812->front, ws2812->strip_len * 3);
+    return ESP_OK;
 err:
     return ret;
 }
@@ -123,13 +149,18 @@ static esp_err_t ws2812_clear(led_strip_t *strip, uint32_t timeout_ms)
 {
     ws2812_t *ws2812 = __containerof(strip, ws2812_t, parent);
     // Write zero to turn off all leds
-    memset(ws2812->buffer, 0, ws2812->strip_len * 3);
+    memset(ws2812->back, 0, ws2812->strip_len * 3);
+    ws2812->dirty_len = ws2812->strip_len;
     return ws2812_refresh(strip, timeout_ms);
 }
 
 static esp_err_t ws2812_del(led_strip_t *strip)
 {
     ws2812_t *ws2812 = __containerof(strip, ws2812_t, parent);
+    // RMT may still read the front buffer
+    if (ws2812->tx_pending) {
+        rmt_wait_tx_done(ws2812->rmt_channel, portMAX_DELAY);
+    }
     free(ws2812);
     return ESP_OK;
 }
@@ -139,8 +170,8 @@ led_strip_t *led_strip_new_rmt_ws2812(const led_strip_config_t *config)
     led_strip_t *ret = NULL;
     STRIP_CHECK(config, "configuration can't be null", err, NULL);
 
-    // 24 bits per led
-    uint32_t ws2812_size = sizeof(ws2812_t) + config->max_leds * 3;
+    // 24 bits per led, double buffered
+    uint32_t ws2812_size = sizeof(ws2812_t) + config->max_leds * 3 * 2;
     ws2812_t *ws2812 = calloc(1, ws2812_size);
     STRIP_CHECK(ws2812, "request memory for ws2812 failed", err, NULL);
 
@@ -154,11 +185,24 @@ led_strip_t *led_strip_new_rmt_ws2812(const led_strip_config_t *config)
     ws2812_t1h_ticks = (uint32_t)(ratio * WS2812_T1H_NS);
     ws2812_t1l_ticks = (uint32_t)(ratio * WS2812_T1L_NS);
 
+    const rmt_item32_t bit0 = {{{ ws2812_t0h_ticks, 1, ws2812_t0l_ticks, 0 }}}; //Logical 0
+    const rmt_item32_t bit1 = {{{ ws2812_t1h_ticks, 1, ws2812_t1l_ticks, 0 }}}; //Logical 1
+    for (int byte = 0; byte < 256; byte++) {
+        for (int i = 0; i < 8; i++) {
+            // MSB first
+            ws2812_byte_items[byte][i].val = (byte & (1 << (7 - i))) ? bit1.val : bit0.val;
+        }
+    }
+
     // set ws2812 to rmt adapter
     rmt_translator_init((rmt_channel_t)config->dev, ws2812_rmt_adapter);
 
     ws2812->rmt_channel = (rmt_channel_t)config->dev;
     ws2812->strip_len = config->max_leds;
+    ws2812->front = ws2812->buffer;
+    ws2812->back = ws2812->buffer + config->max_leds * 3;
+    // the pixels are in unknown state after power on
+    ws2812->dirty_len = config->max_leds;
 
     ws2812->parent.set_pixel = ws2812_set_pixel;
     ws2812->parent.refresh = ws2812_refresh;
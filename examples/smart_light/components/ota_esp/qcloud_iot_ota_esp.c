@@ -38,6 +38,7 @@
 #define OTA_CLIENT_TASK_NAME        "ota_esp_task"
 #define OTA_CLIENT_TASK_STACK_BYTES 5120
 #define OTA_CLIENT_TASK_PRIO        3
+#define OTA_CLIENT_TASK_CORE        tskNO_AFFINITY
 
 #define ESP_OTA_BUF_LEN   2048
 #define MAX_OTA_RETRY_CNT 3
@@ -491,8 +492,9 @@ int enable_ota_task(DeviceInfo *dev_info, void *mqtt_client, char *version)
         sg_ota_ctx.mqtt_client = mqtt_client;
         sg_ota_ctx.ota_handle  = ota_handle;
 
-        int ret = xTaskCreate(_ota_update_task, OTA_CLIENT_TASK_NAME, OTA_CLIENT_TASK_STACK_BYTES, (void *)&sg_ota_ctx,
-                              OTA_CLIENT_TASK_PRIO, &sg_ota_ctx.task_handle);
+        int ret = xTaskCreatePinnedToCore(_ota_update_task, OTA_CLIENT_TASK_NAME, OTA_CLIENT_TASK_STACK_BYTES,
+                                          (void *)&sg_ota_ctx, OTA_CLIENT_TASK_PRIO, &sg_ota_ctx.task_handle,
+                                          OTA_CLIENT_TASK_CORE);
         if (ret != pdPASS) {
             Log_e("create ota task failed: %d", ret);
             IOT_OTA_Destroy(sg_ota_ctx.ota_handle);
@@ -179,10 +179,10 @@ static void update_events_timestamp(sEvent *pEvents, int count)
             Log_e("null event pointer");
             return;
         }
-#ifdef EVENT_TIMESTAMP_USED
+#if defined(EVENT_TIMESTAMP_USED) && !defined(SYSTEM_COMM)
         pEvents[i].timestamp = HAL_Timer_current_sec(); // should be UTC and accurate
 #else
-        pEvents[i].timestamp = 0;
+        pEvents[i].timestamp = 0; // stamped by SDK with the time synced from server if SYSTEM_COMM enabled
 #endif
     }
 }
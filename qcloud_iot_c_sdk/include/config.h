@@ -37,4 +37,17 @@
 #undef AT_OS_USED
 #undef AT_DEBUG
 //#define OTA_USE_HTTPS
-#define MULTITHREAD_ENABLED
\ No newline at end of file
+#define MULTITHREAD_ENABLED
+//#define JSON_SIMD_SCAN
+//#define HASH_USE_MBEDTLS
+//#define HASH_CPU_ACCEL
+//#define BASE64_SIMD_CODEC
+//#define MQTT_ASYNC_DISPATCH
+//#define DNS_CACHE_PERSIST
+//#define HEAP_ACCOUNTING
+//#define IOT_STATIC_MEMORY
+//#define PROPERTY_SERIES_ENABLED
+//#define GATEWAY_SUBDEV_OTA
+//#define OTA_MQTT_FETCH
+//#define MQTT_RX_READ_AHEAD
+//#define IOT_TRACE_ENABLED
\ No newline at end of file
@@ -301,12 +301,115 @@ void *IOT_Template_Get_DataTemplate(void *handle);
 
 int IOT_Template_Set_DataTemplate(void *handle, void *data_template, DataTemplateDestroyCb cb);
 
+/**
+ * @brief Typed bindings of the product properties, generated by tools/codegen.py
+ *
+ * The properties are numbered by their order in the data template, and a set of
+ * them is passed as a bit mask of these numbers.
+ */
+typedef struct {
+    /* update data from the params object of a control message, return the mask of updated properties */
+    uint32_t (*decode)(void *data, char *params, int params_len);
+    /* write the properties in mask as "key":value pairs with a trailing comma, return the length or err code */
+    int (*encode)(const void *data, uint32_t mask, char *buf, size_t size);
+} TemplateCodec;
+
+typedef void (*OnTemplateControlCallback)(void *handle, uint32_t changed_mask, void *data);
+
+/**
+ * @brief Register the generated bindings of the properties
+ *
+ * Control messages are then decoded into data in one pass, without the lookup of
+ * every registered property. Properties registered by IOT_Template_Register_Property
+ * are still handled after it.
+ *
+ * @param handle        handle to data_template client
+ * @param codec         generated bindings
+ * @param data          property struct of the bindings
+ * @param callback      called with the mask of properties updated by a control message
+ * @return              QCLOUD_RET_SUCCESS when success, or err code for failure
+ */
+int IOT_Template_Register_Codec(void *handle, const TemplateCodec *codec, void *data,
+                                OnTemplateControlCallback callback);
+
+/**
+ * @brief Construct a report of the properties in mask with the registered bindings
+ *
+ * @param handle        handle to data_template client
+ * @param jsonBuffer    string buffer to store JSON document
+ * @param sizeOfBuffer  size of string buffer
+ * @param mask          properties to report
+ * @return              QCLOUD_RET_SUCCESS when success, or err code for failure
+ */
+int IOT_Template_JSON_ConstructReportMask(void *handle, char *jsonBuffer, size_t sizeOfBuffer, uint32_t mask);
+
 #ifdef ACTION_ENABLED
 int IOT_Template_Register_Action(void *handle, DeviceAction *pAction, OnActionHandleCallback callback);
 
 int IOT_Template_UnRegister_Action(void *handle, DeviceAction *pAction);
 #endif
 
+#ifdef PROPERTY_SERIES_ENABLED
+/**
+ * @brief Define a series buffering the samples of a high-rate property
+ *
+ * A batch is reported as "key":{"t":utc_ms,"dt":[...],"v":[...]}, dt being the
+ * delta in ms of each point from the previous one (the first is 0). With
+ * downsampling each point is the min/max/avg of the samples folded into it, and
+ * "v" is replaced by "min", "max" and "avg" arrays.
+ */
+typedef struct {
+    const char *key;               // key the batch is reported under
+    uint16_t    capacity;          // points buffered, flushed when full, the oldest is dropped if it fails;
+                                   // a full batch must fit in QCLOUD_IOT_MQTT_TX_BUF_LEN, about 65 points,
+                                   // or 30 with downsampling, for a short key
+    uint16_t    downsample;        // samples folded into one point, 0 or 1 to keep every sample
+    uint32_t    max_delay_ms;      // flushed when the oldest point is that old, 0 to disable
+    float       change_threshold;  // flushed when a sample is that far from the last reported, 0 to disable
+} SeriesInitParams;
+
+/**
+ * @brief Create a sample buffer of a property
+ *
+ * @param handle        handle to data_template client
+ * @param pParams       series parameters
+ * @param pSeries       the created series
+ * @return              QCLOUD_RET_SUCCESS when success, or err code for failure
+ */
+int IOT_Template_Series_Create(void *handle, const SeriesInitParams *pParams, void **pSeries);
+
+/**
+ * @brief Add a sample taken now, a flush may be triggered in the caller's context
+ *
+ * @param handle        handle to data_template client
+ * @param series        series created by IOT_Template_Series_Create
+ * @param value         sample value
+ * @return              QCLOUD_RET_SUCCESS when success, or err code of a triggered flush
+ */
+int IOT_Template_Series_Add(void *handle, void *series, float value);
+
+/**
+ * @brief Report the buffered samples in one message now
+ *
+ * The samples are kept when the report fails. It is done by IOT_Template_Yield
+ * as well when max_delay_ms is reached.
+ *
+ * @param handle        handle to data_template client
+ * @param series        series created by IOT_Template_Series_Create
+ * @return              QCLOUD_RET_SUCCESS when success, or err code for failure
+ */
+int IOT_Template_Series_Flush(void *handle, void *series);
+
+/**
+ * @brief Destroy a series, the samples not reported yet are dropped
+ *
+ * @param handle        handle to data_template client
+ * @param series        series created by IOT_Template_Series_Create
+ * @return              QCLOUD_RET_SUCCESS when success, or err code for failure
+ */
+int IOT_Template_Series_Destroy(void *handle, void *series);
+#endif
+
 /**
  * @brief Add reported fields array in JSON document, don't overwrite
  *
@@ -348,6 +451,30 @@ int IOT_Template_Report(void *handle, char *pJsonDoc, size_t sizeOfBuffer, OnRep
  */
 int IOT_Template_Report_Sync(void *handle, char *pJsonDoc, size_t sizeOfBuffer, uint32_t timeout_ms);
 
+/**
+ * @brief report data_template data without waiting for the reply, so that several
+ * reports can be in flight at the same time
+ *
+ * @param pClient           handle to data_template client
+ * @param pJsonDoc          source JSON document for report
+ * @param sizeOfBuffer      length of JSON document
+ * @param timeout_ms        timeout value for this operation (unit: ms)
+ * @param pReply            reply handle to pass to IOT_Template_Wait_Reply
+ * @return                  QCLOUD_RET_SUCCESS when success, or err code for
+ * failure
+ */
+int IOT_Template_Report_Async(void *handle, char *pJsonDoc, size_t sizeOfBuffer, uint32_t timeout_ms, void **pReply);
+
+/**
+ * @brief wait for the reply of IOT_Template_Report_Async and release the reply handle
+ *
+ * @param pClient           handle to data_template client
+ * @param pReply            reply handle from IOT_Template_Report_Async
+ * @return                  QCLOUD_RET_SUCCESS when accepted, or err code the
+ * same as IOT_Template_Report_Sync
+ */
+int IOT_Template_Wait_Reply(void *handle, void *pReply);
+
 /**
  * @brief Get data_template state from server in asynchronized way.
  * Generally it's a way to sync data_template data during offline
@@ -27,6 +27,7 @@ extern "C" {
 #endif
 
 #include "qcloud_iot_export_mqtt.h"
+#include "qcloud_iot_export_ota.h"
 
 /* Gateway and sub-device parameter */
 typedef struct {
@@ -194,6 +195,97 @@ void IOT_Gateway_Stop_Yield_Thread(void *pClient);
 bool IOT_Gateway_Get_Yield_Status(void *pClient, int *exit_code);
 #endif
 
+#ifdef GATEWAY_SUBDEV_OTA
+/**
+ * @brief Callbacks of the gateway to cache firmware and upgrade sub-devices
+ *
+ * Firmware pushed to several sub-devices with the same product, version and md5
+ * is downloaded once into a cache keyed by its md5, then handed to every
+ * sub-device over the local link. All are called from IOT_Gateway_Subdev_OTA_Process.
+ */
+typedef struct {
+    void *context;  // user context of the callbacks
+
+    /* true if an image with the md5 is complete in the cache */
+    bool (*cache_lookup)(void *context, const char *md5, uint32_t size);
+
+    /* write a chunk of the image being downloaded at the offset */
+    int (*cache_write)(void *context, const char *md5, uint32_t offset, const char *buf, uint32_t len);
+
+    /* end the download, keep the image if valid, or else drop it */
+    void (*cache_commit)(void *context, const char *md5, bool valid);
+
+    /* start to upgrade a sub-device with the cached image, QCLOUD_RET_SUCCESS if started,
+     * its progress and result are reported by IOT_Gateway_Subdev_OTA_Report */
+    int (*upgrade)(void *context, const char *product_id, const char *device_name, const char *version,
+                   const char *md5, uint32_t size);
+} GatewaySubdevOTAParams;
+
+/**
+ * @brief Enable OTA of sub-devices through the gateway
+ *
+ * @param client    handle to gateway client
+ * @param params    firmware cache and upgrade callbacks
+ *
+ * @return QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int IOT_Gateway_Subdev_OTA_Init(void *client, const GatewaySubdevOTAParams *params);
+
+/**
+ * @brief Receive firmware updates of a sub-device and report the version it runs
+ *
+ * Every sub-device takes one subscription of the MQTT client.
+ *
+ * @param client        handle to gateway client
+ * @param product_id    product id of sub-device
+ * @param device_name   device name of sub-device
+ * @param version       firmware version running on sub-device
+ *
+ * @return QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int IOT_Gateway_Subdev_OTA_Add(void *client, const char *product_id, const char *device_name, const char *version);
+
+/**
+ * @brief Stop receiving firmware updates of a sub-device
+ *
+ * @param client        handle to gateway client
+ * @param product_id    product id of sub-device
+ * @param device_name   device name of sub-device
+ *
+ * @return QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int IOT_Gateway_Subdev_OTA_Remove(void *client, const char *product_id, const char *device_name);
+
+/**
+ * @brief Report progress or result of a sub-device upgrade
+ *
+ * Reports are sent by IOT_Gateway_Subdev_OTA_Process once a second, only the
+ * latest of a sub-device is sent. IOT_OTAR_UPGRADE_SUCCESS or a failure ends the upgrade.
+ *
+ * @param client        handle to gateway client
+ * @param product_id    product id of sub-device
+ * @param device_name   device name of sub-device
+ * @param type          report type
+ * @param progress      percentage for IOT_OTAR_DOWNLOADING
+ *
+ * @return QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int IOT_Gateway_Subdev_OTA_Report(void *client, const char *product_id, const char *device_name,
+                                  IOT_OTAReportType type, int progress);
+
+/**
+ * @brief Download the firmware pushed, upgrade the sub-devices and send the reports
+ *
+ * To be called in a loop by one thread, it blocks up to a few seconds while a
+ * firmware is downloaded.
+ *
+ * @param client    handle to gateway client
+ *
+ * @return QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int IOT_Gateway_Subdev_OTA_Process(void *client);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
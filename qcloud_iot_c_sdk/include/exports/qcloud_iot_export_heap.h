@@ -0,0 +1,94 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub
+ available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file
+ except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software
+ distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ KIND,
+ * either express or implied. See the License for the specific language
+ governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef QCLOUD_IOT_EXPORT_HEAP_H_
+#define QCLOUD_IOT_EXPORT_HEAP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* subsystem which owns the memory allocated by SDK */
+typedef enum {
+    IOT_HEAP_MQTT = 0,
+    IOT_HEAP_TEMPLATE,
+    IOT_HEAP_EVENT,
+    IOT_HEAP_ACTION,
+    IOT_HEAP_OTA,
+    IOT_HEAP_HTTPC,
+    IOT_HEAP_TLS,
+    IOT_HEAP_JSON,
+    IOT_HEAP_OTHER,
+    IOT_HEAP_TAG_MAX
+} IotHeapTag;
+
+#ifdef HEAP_ACCOUNTING
+
+/* allocation sizes are counted in buckets of <=32, <=64, ... <=4096 and >4096 bytes */
+#define IOT_HEAP_HIST_BUCKETS (9)
+
+typedef struct {
+    uint32_t live_bytes;                       // bytes in use now
+    uint32_t peak_bytes;                       // max of live_bytes since boot or IOT_Heap_Reset_Peak
+    uint32_t alloc_count;                      // successful allocations
+    uint32_t free_count;                       // frees
+    uint32_t fail_count;                       // failed allocations
+    uint32_t size_hist[IOT_HEAP_HIST_BUCKETS];  // successful allocations by size
+} IotHeapStats;
+
+/**
+ * @brief Get the heap usage of a subsystem
+ *
+ * @param tag       subsystem, or IOT_HEAP_TAG_MAX for the sum of all of them
+ * @param pStats    stats output
+ * @return          QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int IOT_Heap_Get_Stats(IotHeapTag tag, IotHeapStats *pStats);
+
+/**
+ * @brief Get the name of a subsystem, as printed in the report
+ *
+ * @param tag       subsystem
+ * @return          name of the subsystem
+ */
+const char *IOT_Heap_Tag_Name(IotHeapTag tag);
+
+/**
+ * @brief Restart the peak tracking from the current usage of every subsystem
+ */
+void IOT_Heap_Reset_Peak(void);
+
+/**
+ * @brief Log the heap usage of every subsystem
+ *
+ * It is also done by the MQTT yield every HEAP_REPORT_INTERVAL_MS. The report
+ * is only logged, not published, use IOT_Heap_Get_Stats to send it to cloud.
+ */
+void IOT_Heap_Report(void);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QCLOUD_IOT_EXPORT_HEAP_H_ */
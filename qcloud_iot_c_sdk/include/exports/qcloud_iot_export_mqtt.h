@@ -40,6 +40,17 @@ typedef enum _QoS {
     QOS2 = 2   // Exactly once delivery. NOT supported currently
 } QoS;
 
+/**
+ * @brief Priority class of outbound message, higher classes are sent first
+ */
+typedef enum {
+    MQTT_PRIO_TELEMETRY = 0,  // property reports and other periodic data, the default
+    MQTT_PRIO_CONTROL   = 1,  // replies to control and action, sent before everything else
+    MQTT_PRIO_EVENT     = 2,  // events
+    MQTT_PRIO_LOG       = 3,  // logs and other bulk data, sent last
+    MQTT_PRIO_MAX
+} MQTTPriority;
+
 /**
  * @brief MQTT message parameter for pub/sub
  */
@@ -52,15 +63,17 @@ typedef struct {
     const char *ptopic;     // MQTT topic
     size_t      topic_len;  // topic length
 
-    void * payload;      // MQTT msg payload
+    void * payload;      // MQTT msg payload, followed by '\0' when received
     size_t payload_len;  // MQTT length of msg payload
+
+    MQTTPriority priority;  // outbound priority class, only for publish
 } MQTTMessage;
 
 typedef MQTTMessage PublishParams;
 
-#define DEFAULT_PUB_PARAMS              \
-    {                                   \
-        QOS0, 0, 0, 0, NULL, 0, NULL, 0 \
+#define DEFAULT_PUB_PARAMS                                   \
+    {                                                        \
+        QOS0, 0, 0, 0, NULL, 0, NULL, 0, MQTT_PRIO_TELEMETRY \
     }
 
 typedef enum {
@@ -250,6 +263,21 @@ int IOT_MQTT_Yield(void *pClient, uint32_t timeout_ms);
  */
 int IOT_MQTT_Publish(void *pClient, char *topicName, PublishParams *pParams);
 
+/**
+ * @brief Limit the publish rate of a priority class with a token bucket
+ *
+ * Messages over the limit stay queued and are sent when tokens are refilled,
+ * while messages of other classes go ahead of them.
+ *
+ * @param pClient       handle to MQTT client
+ * @param priority      priority class
+ * @param rate          messages per second, 0 for no limit
+ * @param burst         max messages sent back to back, at least 1 when rate is not 0
+ *
+ * @return QCLOUD_RET_SUCCESS when success, or err code for failure
+ */
+int IOT_MQTT_SetPublishRateLimit(void *pClient, MQTTPriority priority, uint32_t rate, uint32_t burst);
+
 /**
  * @brief Subscribe MQTT topic
  *
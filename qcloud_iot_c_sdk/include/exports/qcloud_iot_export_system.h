@@ -28,6 +28,9 @@ extern "C" {
 /**
  * @brief Get system timestamp from MQTT server
  *
+ * Computed from the synchronized local clock, it only waits for the server when
+ * the clock has never been synced.
+ *
  * @param pClient           MQTTClient pointer
  * @param time              timestamp value return from server
  * @return                  QCLOUD_RET_SUCCESS for success
@@ -35,6 +38,19 @@ extern "C" {
  */
 int IOT_Get_SysTime(void *pClient, long *time);
 
+/**
+ * @brief Get current UTC time from the local clock synchronized with MQTT server
+ *
+ * The client syncs its clock after connected and then on a schedule, compensated
+ * by the round trip time and the drift of the local clock. It does not block.
+ *
+ * @param pClient           MQTTClient pointer
+ * @param time_ms           UTC timestamp in millisecond
+ * @return                  QCLOUD_RET_SUCCESS for success
+ *                          otherwise, failure if the clock is not synced yet
+ */
+int IOT_Get_SysTime_Ms(void *pClient, uint64_t *time_ms);
+
 #ifdef __cplusplus
 }
 #endif
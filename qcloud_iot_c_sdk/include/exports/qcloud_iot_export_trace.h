@@ -0,0 +1,140 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub
+ available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file
+ except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software
+ distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ KIND,
+ * either express or implied. See the License for the specific language
+ governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef QCLOUD_IOT_EXPORT_TRACE_H_
+#define QCLOUD_IOT_EXPORT_TRACE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef IOT_TRACE_ENABLED
+
+/*
+ * Trace points of the SDK record spans of the network, TLS, MQTT, template,
+ * OTA and HTTP stages into a ring of the last IOT_TRACE_RING_SIZE events,
+ * timed by HAL_GetTimeUs. The category and name of an event are kept by
+ * pointer, so they must be string literals or live as long as the trace.
+ */
+
+/**
+ * @brief Define the output of trace events
+ *
+ * @param context   user context
+ * @param data      text to output, not terminated by '\0'
+ * @param len       length of the text
+ */
+typedef void (*TraceOutputFun)(void *context, const char *data, size_t len);
+
+/**
+ * @brief Pause or resume the recording of trace events, it is on at start
+ *
+ * @param enable    true to record
+ */
+void IOT_Trace_Enable(bool enable);
+
+/**
+ * @brief Drop the events in the ring
+ */
+void IOT_Trace_Reset(void);
+
+/**
+ * @brief Record a span from start_us to now
+ *
+ * @param category  stage of the span, e.g. "mqtt"
+ * @param name      name of the span
+ * @param start_us  start time got by HAL_GetTimeUs
+ * @param result    result code of the span
+ */
+void IOT_Trace_Span(const char *category, const char *name, uint64_t start_us, int32_t result);
+
+/**
+ * @brief Record the begin of a span which ends in another function or thread
+ *
+ * @param category  stage of the span
+ * @param name      name of the span
+ * @param id        id to match the end, e.g. a packet id or IOT_Trace_Id of a token
+ */
+void IOT_Trace_Async_Begin(const char *category, const char *name, uint32_t id);
+
+/**
+ * @brief Record the end of a span begun by IOT_Trace_Async_Begin
+ *
+ * @param category  stage of the span
+ * @param name      name of the span
+ * @param id        id given to the begin
+ * @param result    result code of the span
+ */
+void IOT_Trace_Async_End(const char *category, const char *name, uint32_t id, int32_t result);
+
+/**
+ * @brief Record an event without duration
+ *
+ * @param category  stage of the event
+ * @param name      name of the event
+ * @param result    result code or value of the event
+ */
+void IOT_Trace_Instant(const char *category, const char *name, int32_t result);
+
+/**
+ * @brief Get the id of an async span from a string, e.g. a clientToken
+ *
+ * @param str       string terminated by '\0'
+ * @return          the id
+ */
+uint32_t IOT_Trace_Id(const char *str);
+
+/**
+ * @brief Output the events in the ring as a Chrome trace-event JSON object
+ *
+ * The output is loaded by chrome://tracing or Perfetto as is. Recording is
+ * not stopped, events overwritten during the dump are skipped.
+ *
+ * @param output    output of the JSON text
+ * @param context   user context of output
+ * @return          number of events output
+ */
+int IOT_Trace_Dump_Chrome(TraceOutputFun output, void *context);
+
+/**
+ * @brief Output the events recorded since the last call, one line each
+ *
+ * Every line is "TRACE " followed by a Chrome trace event and a comma, so it
+ * can share a UART with the log: the lines grepped from the console without
+ * the prefix, after a "[", are a trace in the Chrome JSON array format.
+ * Call it periodically from a low priority task to stream the trace.
+ *
+ * @param output    output of the lines, or NULL for HAL_Printf
+ * @param context   user context of output
+ * @return          number of events output
+ */
+int IOT_Trace_Stream(TraceOutputFun output, void *context);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QCLOUD_IOT_EXPORT_TRACE_H_ */
@@ -66,6 +66,7 @@ void  LITE_replace_substr(char orig[], char key[], char swap[]);
 void  LITE_str_strip_char(char *src, char destCh);
 
 char *       LITE_json_value_of(char *key, char *src);
+char *       LITE_json_value_span_of(char *key, char *src, int *value_len, int *value_type);
 list_head_t *LITE_json_keys_of(char *src, char *prefix);
 void         LITE_json_keys_release(list_head_t *keylist);
 char *       LITE_json_string_value_strip_transfer(char *key, char *src);
@@ -81,6 +82,10 @@ int LITE_get_double(double *value, char *src);
 int LITE_get_boolean(bool *value, char *src);
 int LITE_get_string(int8_t *value, char *src, uint16_t max_len);
 
+int LITE_span_get_integer(const char *src, int len, int64_t min, int64_t max, int64_t *value);
+int LITE_span_get_double(const char *src, int len, double *value);
+int LITE_span_get_boolean(const char *src, int len, bool *value);
+
 typedef struct _json_key_t {
     char *      key;
     list_head_t list;
@@ -104,6 +104,9 @@ typedef struct {
 #include "qcloud_iot_export_ota.h"
 #include "qcloud_iot_export_gateway.h"
 #include "qcloud_iot_export_dynreg.h"
+#include "qcloud_iot_export_system.h"
+#include "qcloud_iot_export_heap.h"
+#include "qcloud_iot_export_trace.h"
 
 #ifdef __cplusplus
 }
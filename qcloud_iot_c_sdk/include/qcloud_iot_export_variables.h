@@ -39,6 +39,12 @@
 /* default MQTT Rx buffer size, MAX: 16*1024 */
 #define QCLOUD_IOT_MQTT_RX_BUF_LEN (2048)
 
+/* size of the read ahead buffer under the MQTT packet framing, with MQTT_RX_READ_AHEAD */
+#define MQTT_RX_AHEAD_LEN (1024)
+
+/* cores the SDK threads run on, bit n for core n, 0 for any core */
+#define QCLOUD_IOT_THREAD_CORE_MASK (0)
+
 /* default COAP Tx buffer size, MAX: 1*1024 */
 #define COAP_SENDMSG_MAX_BUFLEN (512)
 
@@ -54,6 +54,17 @@ extern "C" {
 
 typedef void (*ThreadRunFunc)(void *arg);
 
+/**
+ * @brief Priority classes of thread, mapped to the native priorities by HAL
+ */
+typedef enum {
+    THREAD_PRIO_NATIVE = 0,  // use the priority of ThreadParams as it is
+    THREAD_PRIO_BACKGROUND,  // log upload, OTA download
+    THREAD_PRIO_APP,         // application work
+    THREAD_PRIO_DISPATCH,    // MQTT message callbacks
+    THREAD_PRIO_NETWORK,     // MQTT yield which keeps the connection alive
+} ThreadPriorityClass;
+
 typedef struct ThreadParams {
     char *        thread_name;
     size_t        thread_id;
@@ -61,11 +72,17 @@ typedef struct ThreadParams {
     void *        user_arg;
     uint16_t      priority;
     uint32_t      stack_size;
+    uint8_t       priority_class;  // ThreadPriorityClass, priority is ignored unless THREAD_PRIO_NATIVE
+    uint8_t       core_mask;       // cores the thread may run on, bit n for core n, 0 for any core
+    void *        stack;           // stack of stack_size bytes from caller, NULL to allocate it
 } ThreadParams;
 
 /**
  * @brief Create a thread/task
  *
+ * A stack from caller must stay valid until the thread exits, it holds the
+ * task control block as well on FreeRTOS.
+ *
  * @param params    thread parameters
  * @return 0 when success, or error code otherwise
  */
@@ -194,6 +211,24 @@ int HAL_Vsnprintf(_OU_ char *str, _IN_ const int len, _IN_ const char *fmt, _IN_
  */
 uint32_t HAL_GetTimeMs(void);
 
+#ifdef IOT_TRACE_ENABLED
+/**
+ * @brief Get monotonic time in microsecond, for the timestamps of trace
+ *
+ * @return   time in microsecond since an arbitrary point, e.g. boot
+ */
+uint64_t HAL_GetTimeUs(void);
+#endif
+
+#if defined(IOT_TRACE_ENABLED) || defined(MQTT_ASYNC_DISPATCH)
+/**
+ * @brief Get id of the calling thread, for the trace and the MQTT dispatch threads
+ *
+ * @return   thread id
+ */
+size_t HAL_ThreadGetId(void);
+#endif
+
 /**
  * @brief Delay operation in blocking way
  *
@@ -251,6 +286,28 @@ int HAL_GetGwDevInfo(void *pgwDeviceInfo);
  */
 int HAL_SetDevInfoFile(const char *file_name);
 
+#ifdef DNS_CACHE_PERSIST
+/**
+ * @brief Read a value from key-value storage which survives reboot
+ *
+ * @param key           key of the value
+ * @param val           buffer of the value
+ * @param buffer_len    size of the buffer, set to the length of the value when success
+ * @return              QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int HAL_Kv_Get(const char *key, void *val, int *buffer_len);
+
+/**
+ * @brief Write a value to key-value storage which survives reboot
+ *
+ * @param key           key of the value, at most 15 characters
+ * @param val           the value
+ * @param len           length of the value
+ * @return              QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int HAL_Kv_Set(const char *key, const void *val, int len);
+#endif
+
 /**
  * Define timer structure, platform dependant
  */
@@ -399,7 +456,7 @@ int HAL_TLS_Write(uintptr_t handle, unsigned char *data, size_t totalLen, uint32
  * @param handle        TLS connect handle
  * @param data          destination data buffer where to put data
  * @param totalLen      length of data
- * @param timeout_ms    timeout value in millisecond
+ * @param timeout_ms    timeout value in millisecond, 0 to take only the data already received
  * @param read_len      length of data read successfully
  * @return              QCLOUD_RET_SUCCESS for success, or err code for failure
  */
@@ -463,6 +520,18 @@ int HAL_DTLS_Read(uintptr_t handle, unsigned char *data, size_t datalen, uint32_
  */
 uintptr_t HAL_TCP_Connect(const char *host, uint16_t port);
 
+/**
+ * @brief Setup TCP connection with server and return the raw socket, for TLS
+ *
+ * Resolved addresses are cached, and persisted with HAL_Kv_Set if DNS_CACHE_PERSIST
+ * is defined. All the addresses of host race to connect with a short stagger.
+ *
+ * @host    server address
+ * @port    server port
+ * @return  socket (value>=0) in blocking mode when success, or err code for failure
+ */
+int HAL_TCP_Connect_Socket(const char *host, uint16_t port);
+
 /**
  * @brief Disconnect with server and release resource
  *
@@ -489,7 +558,7 @@ int HAL_TCP_Write(uintptr_t fd, const unsigned char *data, uint32_t len, uint32_
  * @param fd            TCP socket handle
  * @param data          destination data buffer where to put data
  * @param len           length of data
- * @param timeout_ms    timeout value in millisecond
+ * @param timeout_ms    timeout value in millisecond, 0 to take only the data already received
  * @param read_len      length of data read successfully
  * @return              QCLOUD_RET_SUCCESS for success, or err code for failure
  */
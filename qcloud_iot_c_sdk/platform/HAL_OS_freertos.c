@@ -84,10 +84,51 @@ void HAL_Free(_IN_ void *ptr)
         vPortFree(ptr);
 }
 
+#if defined(IOT_STATIC_MEMORY) && defined(MULTITHREAD_ENABLED)
+
+/* max number of mutexes and semaphores alive at the same time */
+#ifndef HAL_STATIC_SEM_COUNT
+#define HAL_STATIC_SEM_COUNT (24)
+#endif
+
+/* mutexes and semaphores are created in place here, instead of the FreeRTOS heap */
+static StaticSemaphore_t sg_static_sems[HAL_STATIC_SEM_COUNT];
+static uint8_t           sg_static_sem_used[HAL_STATIC_SEM_COUNT];
+
+static StaticSemaphore_t *_static_sem_get(void)
+{
+    int i;
+
+    for (i = 0; i < HAL_STATIC_SEM_COUNT; i++) {
+        if (0 == __atomic_exchange_n(&sg_static_sem_used[i], 1, __ATOMIC_ACQUIRE)) {
+            return &sg_static_sems[i];
+        }
+    }
+
+    HAL_Printf("%s: all %d static semaphores are in use\n", __FUNCTION__, HAL_STATIC_SEM_COUNT);
+    return NULL;
+}
+
+static void _static_sem_put(void *sem)
+{
+    int i = (StaticSemaphore_t *)sem - sg_static_sems;
+
+    if (i >= 0 && i < HAL_STATIC_SEM_COUNT) {
+        __atomic_store_n(&sg_static_sem_used[i], 0, __ATOMIC_RELEASE);
+    }
+}
+
+#endif
+
 void *HAL_MutexCreate(void)
 {
 #ifdef MULTITHREAD_ENABLED
+#ifdef IOT_STATIC_MEMORY
+    StaticSemaphore_t *buffer = _static_sem_get();
+    SemaphoreHandle_t  mutex  = buffer ? xSemaphoreCreateMutexStatic(buffer) : NULL;
+#else
     SemaphoreHandle_t mutex = xSemaphoreCreateMutex();
+#endif
     if (NULL == mutex) {
         HAL_Printf("%s: xSemaphoreCreateMutex failed\n", __FUNCTION__);
         return NULL;
@@ -107,6 +148,9 @@ void HAL_MutexDestroy(_IN_ void *mutex)
     }
 
     vSemaphoreDelete(mutex);
+#ifdef IOT_STATIC_MEMORY
+    _static_sem_put(mutex);
+#endif
 #else
     return;
 #endif
@@ -177,6 +221,36 @@ static void _HAL_thread_func_wrapper_(void *ptr)
     vTaskDelete(NULL);
 }
 
+/* native priorities of the thread priority classes */
+#ifndef HAL_THREAD_PRIO_BACKGROUND
+#define HAL_THREAD_PRIO_BACKGROUND (2)
+#endif
+#ifndef HAL_THREAD_PRIO_APP
+#define HAL_THREAD_PRIO_APP (4)
+#endif
+#ifndef HAL_THREAD_PRIO_DISPATCH
+#define HAL_THREAD_PRIO_DISPATCH (5)
+#endif
+#ifndef HAL_THREAD_PRIO_NETWORK
+#define HAL_THREAD_PRIO_NETWORK (6)
+#endif
+
+static UBaseType_t _HAL_thread_priority_(ThreadParams *params)
+{
+    switch (params->priority_class) {
+        case THREAD_PRIO_BACKGROUND:
+            return HAL_THREAD_PRIO_BACKGROUND;
+        case THREAD_PRIO_APP:
+            return HAL_THREAD_PRIO_APP;
+        case THREAD_PRIO_DISPATCH:
+            return HAL_THREAD_PRIO_DISPATCH;
+        case THREAD_PRIO_NETWORK:
+            return HAL_THREAD_PRIO_NETWORK;
+        default:
+            return params->priority;
+    }
+}
+
 // platform-dependant thread create function
 int HAL_ThreadCreate(ThreadParams *params)
 {
@@ -188,18 +262,76 @@ int HAL_ThreadCreate(ThreadParams *params)
         return QCLOUD_ERR_INVAL;
     }
 
-    int ret = xTaskCreate(_HAL_thread_func_wrapper_, params->thread_name, params->stack_size, (void *)params,
-                          params->priority, (void *)&params->thread_id);
-    if (ret != pdPASS) {
-        HAL_Printf("%s: xTaskCreate failed: %d\n", __FUNCTION__, ret);
-        return QCLOUD_ERR_FAILURE;
+    UBaseType_t  priority = _HAL_thread_priority_(params);
+    TaskHandle_t task     = NULL;
+
+#ifdef ESP_PLATFORM
+    // a task is pinned to one core or floats on all of them
+    BaseType_t core = tskNO_AFFINITY;
+    if (params->core_mask && 0 == (params->core_mask & (params->core_mask - 1))) {
+        core = __builtin_ctz(params->core_mask);
+        if (core >= portNUM_PROCESSORS) {
+            HAL_Printf("%s: no core %d\n", __FUNCTION__, (int)core);
+            return QCLOUD_ERR_INVAL;
+        }
+    }
+#endif
+
+    if (params->stack) {
+#if configSUPPORT_STATIC_ALLOCATION
+        // the task control block is kept at the start of the stack from caller
+        size_t tcb_size = (sizeof(StaticTask_t) + portBYTE_ALIGNMENT - 1) & ~(size_t)(portBYTE_ALIGNMENT - 1);
+        if (params->stack_size <= tcb_size) {
+            HAL_Printf("%s: stack too small\n", __FUNCTION__);
+            return QCLOUD_ERR_INVAL;
+        }
+
+        StaticTask_t *tcb   = (StaticTask_t *)params->stack;
+        StackType_t * stack = (StackType_t *)((char *)params->stack + tcb_size);
+        uint32_t      depth = (params->stack_size - tcb_size) / sizeof(StackType_t);
+#ifdef ESP_PLATFORM
+        task = xTaskCreateStaticPinnedToCore(_HAL_thread_func_wrapper_, params->thread_name, depth, (void *)params,
+                                             priority, stack, tcb, core);
+#else
+        task = xTaskCreateStatic(_HAL_thread_func_wrapper_, params->thread_name, depth, (void *)params, priority,
+                                 stack, tcb);
+#endif
+        if (task == NULL) {
+            HAL_Printf("%s: xTaskCreateStatic failed\n", __FUNCTION__);
+            return QCLOUD_ERR_FAILURE;
+        }
+#else
+        HAL_Printf("%s: static stack requires configSUPPORT_STATIC_ALLOCATION\n", __FUNCTION__);
+        return QCLOUD_ERR_INVAL;
+#endif
+    } else {
+#ifdef ESP_PLATFORM
+        int ret = xTaskCreatePinnedToCore(_HAL_thread_func_wrapper_, params->thread_name, params->stack_size,
+                                          (void *)params, priority, &task, core);
+#else
+        int ret = xTaskCreate(_HAL_thread_func_wrapper_, params->thread_name, params->stack_size, (void *)params,
+                              priority, &task);
+#endif
+        if (ret != pdPASS) {
+            HAL_Printf("%s: xTaskCreate failed: %d\n", __FUNCTION__, ret);
+            return QCLOUD_ERR_FAILURE;
+        }
     }
 
+    params->thread_id = (size_t)task;
+
     return QCLOUD_RET_SUCCESS;
 }
 
 #endif
 
+#if defined(IOT_TRACE_ENABLED) || defined(MQTT_ASYNC_DISPATCH)
+size_t HAL_ThreadGetId(void)
+{
+    return (size_t)xTaskGetCurrentTaskHandle();
+}
+#endif
+
 #if defined(PLATFORM_HAS_CMSIS) && defined(AT_TCP_ENABLED)
 
 void *HAL_SemaphoreCreate(void)
@@ -232,4 +364,46 @@ int HAL_SemaphoreWait(void *sem, uint32_t timeout_ms)
 {
     return osSemaphoreWait((osSemaphoreId)sem, timeout_ms);
 }
+
+#elif defined(MULTITHREAD_ENABLED)
+
+void *HAL_SemaphoreCreate(void)
+{
+#ifdef IOT_STATIC_MEMORY
+    StaticSemaphore_t *buffer = _static_sem_get();
+    SemaphoreHandle_t  sem    = buffer ? xSemaphoreCreateCountingStatic(0x7FFF, 0, buffer) : NULL;
+#else
+    SemaphoreHandle_t sem = xSemaphoreCreateCounting(0x7FFF, 0);
+#endif
+    if (NULL == sem) {
+        HAL_Printf("%s: xSemaphoreCreateCounting failed\n", __FUNCTION__);
+        return NULL;
+    }
+
+    return sem;
+}
+
+void HAL_SemaphoreDestroy(void *sem)
+{
+    vSemaphoreDelete((SemaphoreHandle_t)sem);
+#ifdef IOT_STATIC_MEMORY
+    _static_sem_put(sem);
+#endif
+}
+
+void HAL_SemaphorePost(void *sem)
+{
+    if (xSemaphoreGive((SemaphoreHandle_t)sem) != pdTRUE) {
+        HAL_Printf("%s: xSemaphoreGive failed\n", __FUNCTION__);
+    }
+}
+
+int HAL_SemaphoreWait(void *sem, uint32_t timeout_ms)
+{
+    if (xSemaphoreTake((SemaphoreHandle_t)sem, timeout_ms / portTICK_PERIOD_MS) != pdTRUE) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
 #endif
@@ -30,6 +30,7 @@
 #include "qcloud_iot_export_error.h"
 #include "qcloud_iot_export_log.h"
 #include "qcloud_iot_import.h"
+#include "utils_trace.h"
 
 /* lwIP socket handle start from 0 */
 #define LWIP_SOCKET_FD_SHIFT 3
@@ -47,13 +48,152 @@ static uint32_t _time_left(uint32_t t_end, uint32_t t_now)
     return t_left;
 }
 
-uintptr_t HAL_TCP_Connect(const char *host, uint16_t port)
+/* number of hosts kept in the resolver cache */
+#define DNS_CACHE_SIZE 4
+
+/* max addresses kept and raced for a host */
+#define DNS_CACHE_MAX_ADDRS 4
+
+/* time a resolved or persisted address list is used without resolving again */
+#define DNS_CACHE_TTL_MS (10 * 60 * 1000)
+
+/* delay before the next address joins the race if no connect has finished */
+#define TCP_CONNECT_STAGGER_MS 250
+
+/* max time for all the addresses to connect */
+#define TCP_CONNECT_TIMEOUT_MS (10 * 1000)
+
+typedef struct {
+    char                    host[HOST_STR_LENGTH];
+    uint8_t                 count;
+    uint8_t                 preferred;  // index of the address connected last time
+    uint32_t                expire_ms;
+    struct sockaddr_storage addrs[DNS_CACHE_MAX_ADDRS];
+} DNSCacheEntry;
+
+static DNSCacheEntry sg_dns_cache[DNS_CACHE_SIZE];
+static uint8_t       sg_dns_cache_next;  // entry to be replaced when cache is full
+static void *        sg_dns_cache_lock;
+
+static void _dns_cache_lock(void)
+{
+    void *lock;
+
+    if (NULL == __atomic_load_n(&sg_dns_cache_lock, __ATOMIC_ACQUIRE)) {
+        /* created on first connect, the loser of a creation race drops its own */
+        lock = HAL_MutexCreate();
+        void *expected = NULL;
+        if (!__atomic_compare_exchange_n(&sg_dns_cache_lock, &expected, lock, false, __ATOMIC_ACQ_REL,
+                                         __ATOMIC_ACQUIRE)) {
+            HAL_MutexDestroy(lock);
+        }
+    }
+    HAL_MutexLock(sg_dns_cache_lock);
+}
+
+static void _dns_cache_unlock(void)
+{
+    HAL_MutexUnlock(sg_dns_cache_lock);
+}
+
+static bool _dns_entry_expired(const DNSCacheEntry *entry)
+{
+    return (int32_t)(HAL_GetTimeMs() - entry->expire_ms) >= 0;
+}
+
+#ifdef DNS_CACHE_PERSIST
+static void _dns_kv_key(const char *host, char *key, size_t len)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*host) {
+        hash = (hash ^ (unsigned char)*host++) * 16777619u;
+    }
+    HAL_Snprintf(key, len, "dns_%08x", (unsigned)hash);
+}
+#endif
+
+/* the cached entry of host, loaded from KV if not in memory, caller holds the lock */
+static DNSCacheEntry *_dns_cache_find(const char *host)
+{
+    int i;
+
+    for (i = 0; i < DNS_CACHE_SIZE; i++) {
+        if (sg_dns_cache[i].count && 0 == strncmp(sg_dns_cache[i].host, host, HOST_STR_LENGTH)) {
+            return &sg_dns_cache[i];
+        }
+    }
+
+#ifdef DNS_CACHE_PERSIST
+    /* read aside, a miss or a bad record must not evict the entry to be replaced */
+    DNSCacheEntry  loaded;
+    DNSCacheEntry *entry;
+    char           key[16];
+    int            len = sizeof(DNSCacheEntry);
+
+    _dns_kv_key(host, key, sizeof(key));
+    if (QCLOUD_RET_SUCCESS == HAL_Kv_Get(key, &loaded, &len) && len == sizeof(DNSCacheEntry) && loaded.count &&
+        loaded.count <= DNS_CACHE_MAX_ADDRS && 0 == strncmp(loaded.host, host, HOST_STR_LENGTH)) {
+        /* trusted for one TTL, saves the lookup on cold boot */
+        loaded.expire_ms  = HAL_GetTimeMs() + DNS_CACHE_TTL_MS;
+        entry             = &sg_dns_cache[sg_dns_cache_next];
+        *entry            = loaded;
+        sg_dns_cache_next = (sg_dns_cache_next + 1) % DNS_CACHE_SIZE;
+        return entry;
+    }
+#endif
+
+    return NULL;
+}
+
+static void _dns_cache_store(const DNSCacheEntry *resolved)
+{
+    DNSCacheEntry *entry;
+    bool           changed = true;
+
+    _dns_cache_lock();
+    entry = _dns_cache_find(resolved->host);
+    if (NULL == entry) {
+        entry             = &sg_dns_cache[sg_dns_cache_next];
+        sg_dns_cache_next = (sg_dns_cache_next + 1) % DNS_CACHE_SIZE;
+    } else {
+        changed = entry->count != resolved->count ||
+                  0 != memcmp(entry->addrs, resolved->addrs, resolved->count * sizeof(struct sockaddr_storage));
+    }
+    *entry = *resolved;
+    _dns_cache_unlock();
+
+#ifdef DNS_CACHE_PERSIST
+    if (changed) {
+        char key[16];
+        _dns_kv_key(resolved->host, key, sizeof(key));
+        if (QCLOUD_RET_SUCCESS != HAL_Kv_Set(key, resolved, sizeof(DNSCacheEntry))) {
+            Log_w("save dns cache of %s failed", resolved->host);
+        }
+    }
+#else
+    (void)changed;
+#endif
+}
+
+static void _dns_cache_set_preferred(const char *host, int index)
+{
+    DNSCacheEntry *entry;
+
+    _dns_cache_lock();
+    entry = _dns_cache_find(host);
+    if (NULL != entry && index < entry->count) {
+        entry->preferred = (uint8_t)index;
+    }
+    _dns_cache_unlock();
+}
+
+static int _dns_resolve(const char *host, uint16_t port, DNSCacheEntry *entry)
 {
-    int             ret;
     struct addrinfo hints, *addr_list, *cur;
-    int             fd = 0;
+    char            port_str[6];
+    int             ret;
 
-    char port_str[6];
     HAL_Snprintf(port_str, 6, "%d", port);
 
     memset(&hints, 0x00, sizeof(hints));
@@ -64,38 +204,222 @@ uintptr_t HAL_TCP_Connect(const char *host, uint16_t port)
     ret = getaddrinfo(host, port_str, &hints, &addr_list);
     if (ret) {
         Log_e("getaddrinfo(%s:%s) error", host, port_str);
-        return 0;
+        return QCLOUD_ERR_TCP_UNKNOWN_HOST;
     }
 
-    for (cur = addr_list; cur != NULL; cur = cur->ai_next) {
-        fd = (int)socket(cur->ai_family, cur->ai_socktype, cur->ai_protocol);
-        if (fd < 0) {
-            ret = 0;
-            continue;
+    memset(entry, 0, sizeof(DNSCacheEntry));
+    strncpy(entry->host, host, HOST_STR_LENGTH - 1);
+    for (cur = addr_list; cur != NULL && entry->count < DNS_CACHE_MAX_ADDRS; cur = cur->ai_next) {
+        if (cur->ai_addrlen <= sizeof(struct sockaddr_storage)) {
+            memcpy(&entry->addrs[entry->count++], cur->ai_addr, cur->ai_addrlen);
         }
+    }
+    entry->expire_ms = HAL_GetTimeMs() + DNS_CACHE_TTL_MS;
+
+    freeaddrinfo(addr_list);
+
+    return entry->count ? QCLOUD_RET_SUCCESS : QCLOUD_ERR_TCP_UNKNOWN_HOST;
+}
 
-        if (connect(fd, cur->ai_addr, cur->ai_addrlen) == 0) {
-            ret = fd + LWIP_SOCKET_FD_SHIFT;
+static socklen_t _sockaddr_len(const struct sockaddr_storage *addr)
+{
+#if LWIP_IPV6
+    if (AF_INET6 == addr->ss_family) {
+        return sizeof(struct sockaddr_in6);
+    }
+#endif
+    return sizeof(struct sockaddr_in);
+}
+
+/* start a non-blocking connect, return the socket or -1 */
+static int _tcp_connect_start(const struct sockaddr_storage *addr, uint16_t port)
+{
+    struct sockaddr_storage target = *addr;
+    int                     fd;
+
+    /* the host may be cached for another port, sin6_port is at the same offset */
+    ((struct sockaddr_in *)&target)->sin_port = port;
+
+    fd = socket(target.ss_family, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0) {
+        return -1;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    if (connect(fd, (struct sockaddr *)&target, _sockaddr_len(&target)) == 0 || EINPROGRESS == errno) {
+        return fd;
+    }
+
+    close(fd);
+    return -1;
+}
+
+/**
+ * @brief race the addresses, happy eyeballs style
+ *
+ * The preferred address starts first, each next one joins when no connect has
+ * finished within the stagger, or at once when a connect fails. The first socket
+ * connected wins and the others are closed.
+ *
+ * @return the connected socket in blocking mode with the index of its address, or -1
+ */
+static int _tcp_connect_race(const DNSCacheEntry *entry, uint16_t port, int *index)
+{
+    int            fds[DNS_CACHE_MAX_ADDRS];
+    int            started = 0, pending = 0, winner = -1;
+    int            i, ret, max_fd, err;
+    socklen_t      len;
+    uint32_t       t_end = HAL_GetTimeMs() + TCP_CONNECT_TIMEOUT_MS;
+    uint32_t       t_left, wait_ms;
+    fd_set         sets;
+    struct timeval timeout;
+
+    while (winner < 0) {
+        /* one more address joins on every stagger timeout or failure */
+        if (started < entry->count) {
+            i            = (entry->preferred + started) % entry->count;
+            fds[started] = _tcp_connect_start(&entry->addrs[i], htons(port));
+            if (fds[started] >= 0) {
+                pending++;
+            }
+            started++;
+            if (0 == pending) {
+                continue;
+            }
+        } else if (0 == pending) {
             break;
         }
 
-        close(fd);
-        ret = 0;
+        t_left = _time_left(t_end, HAL_GetTimeMs());
+        if (0 == t_left) {
+            break;
+        }
+        wait_ms = (started < entry->count && t_left > TCP_CONNECT_STAGGER_MS) ? TCP_CONNECT_STAGGER_MS : t_left;
+
+        FD_ZERO(&sets);
+        max_fd = -1;
+        for (i = 0; i < started; i++) {
+            if (fds[i] >= 0) {
+                FD_SET(fds[i], &sets);
+                max_fd = fds[i] > max_fd ? fds[i] : max_fd;
+            }
+        }
+
+        timeout.tv_sec  = wait_ms / 1000;
+        timeout.tv_usec = (wait_ms % 1000) * 1000;
+
+        ret = select(max_fd + 1, NULL, &sets, NULL, &timeout);
+        if (ret < 0 && EINTR != errno) {
+            Log_e("select-connect fail: %s", strerror(errno));
+            break;
+        }
+
+        for (i = 0; ret > 0 && i < started; i++) {
+            if (fds[i] < 0 || !FD_ISSET(fds[i], &sets)) {
+                continue;
+            }
+
+            err = 0;
+            len = sizeof(err);
+            getsockopt(fds[i], SOL_SOCKET, SO_ERROR, &err, &len);
+            if (0 == err && winner < 0) {
+                winner = i;
+                continue;
+            }
+
+            /* failed, the next address joins at once */
+            close(fds[i]);
+            fds[i] = -1;
+            pending--;
+        }
+    }
+
+    for (i = 0; i < started; i++) {
+        if (fds[i] >= 0 && i != winner) {
+            close(fds[i]);
+        }
+    }
+
+    if (winner < 0) {
+        return -1;
+    }
+
+    fcntl(fds[winner], F_SETFL, fcntl(fds[winner], F_GETFL, 0) & ~O_NONBLOCK);
+    *index = (entry->preferred + winner) % entry->count;
+
+    return fds[winner];
+}
+
+int HAL_TCP_Connect_Socket(const char *host, uint16_t port)
+{
+    DNSCacheEntry  entry;
+    DNSCacheEntry *cached;
+    bool           hit = false, fresh = false;
+    int            fd, index, rc;
+
+    _dns_cache_lock();
+    cached = _dns_cache_find(host);
+    if (NULL != cached) {
+        entry = *cached;
+        hit   = true;
+        fresh = !_dns_entry_expired(cached);
+    }
+    _dns_cache_unlock();
+
+    /* a fresh entry skips the lookup, and a failure of all its addresses forces one */
+    if (fresh) {
+        IOT_TRACE_BEGIN(t_cached);
+        fd = _tcp_connect_race(&entry, port, &index);
+        IOT_TRACE_END(t_cached, "net", "tcp_connect", fd < 0 ? QCLOUD_ERR_TCP_CONNECT : QCLOUD_RET_SUCCESS);
+        if (fd >= 0) {
+            _dns_cache_set_preferred(host, index);
+            return fd;
+        }
+        Log_w("cached addresses of %s failed, resolve again", host);
     }
 
-    if (ret == 0) {
-        Log_e("failed to connect with TCP server: %s:%s", host, port_str);
+    IOT_TRACE_BEGIN(t_dns);
+    rc = _dns_resolve(host, port, &entry);
+    IOT_TRACE_END(t_dns, "net", "dns", rc);
+    if (QCLOUD_RET_SUCCESS == rc) {
+        _dns_cache_store(&entry);
+    } else if (!hit) {
+        return rc;
+    } else if (fresh) {
+        return QCLOUD_ERR_TCP_CONNECT;
     } else {
-        /* reduce log print due to frequent log server connect/disconnect */
-        if (0 == strncmp(host, LOG_UPLOAD_SERVER_DOMAIN, HOST_STR_LENGTH))
-            UPLOAD_DBG("connected with TCP server: %s:%s", host, port_str);
-        else
-            Log_i("connected with TCP server: %s:%s", host, port_str);
+        /* resolver unavailable, the expired addresses are still worth a try */
+        Log_w("resolve %s failed, use expired addresses", host);
     }
 
-    freeaddrinfo(addr_list);
+    IOT_TRACE_BEGIN(t_connect);
+    fd = _tcp_connect_race(&entry, port, &index);
+    IOT_TRACE_END(t_connect, "net", "tcp_connect", fd < 0 ? QCLOUD_ERR_TCP_CONNECT : QCLOUD_RET_SUCCESS);
+    if (fd < 0) {
+        return QCLOUD_ERR_TCP_CONNECT;
+    }
+    _dns_cache_set_preferred(host, index);
 
-    return (uintptr_t)ret;
+    return fd;
+}
+
+uintptr_t HAL_TCP_Connect(const char *host, uint16_t port)
+{
+    int fd;
+
+    fd = HAL_TCP_Connect_Socket(host, port);
+    if (fd < 0) {
+        Log_e("failed to connect with TCP server: %s:%d", host, port);
+        return 0;
+    }
+
+    /* reduce log print due to frequent log server connect/disconnect */
+    if (0 == strncmp(host, LOG_UPLOAD_SERVER_DOMAIN, HOST_STR_LENGTH))
+        UPLOAD_DBG("connected with TCP server: %s:%d", host, port);
+    else
+        Log_i("connected with TCP server: %s:%d", host, port);
+
+    return (uintptr_t)(fd + LWIP_SOCKET_FD_SHIFT);
 }
 
 int HAL_TCP_Disconnect(uintptr_t fd)
@@ -209,8 +533,9 @@ int HAL_TCP_Read(uintptr_t fd, unsigned char *buf, uint32_t len, uint32_t timeou
     err_code = 0;
 
     do {
+        /* timeout_ms of 0 only takes what has arrived already */
         t_left = _time_left(t_end, HAL_GetTimeMs());
-        if (0 == t_left) {
+        if (0 == t_left && 0 != timeout_ms) {
             err_code = QCLOUD_ERR_TCP_READ_TIMEOUT;
             break;
         }
@@ -251,7 +576,9 @@ int HAL_TCP_Read(uintptr_t fd, unsigned char *buf, uint32_t len, uint32_t timeou
                 break;
             }
         } else if (0 == ret) {
-            Log_e("select-recv timeout!");
+            if (0 != timeout_ms) {
+                Log_e("select-recv timeout!");
+            }
             err_code = QCLOUD_ERR_TCP_READ_TIMEOUT;
             break;
         } else {
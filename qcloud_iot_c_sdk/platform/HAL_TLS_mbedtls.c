@@ -40,6 +40,10 @@ extern "C" {
 #include "qcloud_iot_export_log.h"
 #include "utils_param_check.h"
 #include "utils_timer.h"
+#include "utils_trace.h"
+
+#define IOT_HEAP_TAG IOT_HEAP_TLS
+#include "utils_heap.h"
 
 #ifndef AUTH_MODE_CERT
 static const int ciphersuites[] = {MBEDTLS_TLS_PSK_WITH_AES_128_CBC_SHA, MBEDTLS_TLS_PSK_WITH_AES_256_CBC_SHA, 0};
@@ -174,27 +178,17 @@ static int _mbedtls_client_init(TLSDataParams *pDataParams, TLSConnectParams *pC
  */
 int _mbedtls_tcp_connect(mbedtls_net_context *socket_fd, const char *host, int port)
 {
-    int  ret = 0;
-    char port_str[6];
-    HAL_Snprintf(port_str, 6, "%d", port);
-    if ((ret = mbedtls_net_connect(socket_fd, host, port_str, MBEDTLS_NET_PROTO_TCP)) != 0) {
-        Log_e("tcp connect failed returned 0x%04x errno: %d", ret < 0 ? -ret : ret, errno);
-
-        switch (ret) {
-            case MBEDTLS_ERR_NET_SOCKET_FAILED:
-                return QCLOUD_ERR_TCP_SOCKET_FAILED;
-            case MBEDTLS_ERR_NET_UNKNOWN_HOST:
-                return QCLOUD_ERR_TCP_UNKNOWN_HOST;
-            default:
-                return QCLOUD_ERR_TCP_CONNECT;
-        }
-    }
+    int fd;
 
-    if ((ret = mbedtls_net_set_block(socket_fd)) != 0) {
-        Log_e("set block faliled returned 0x%04x", ret < 0 ? -ret : ret);
-        return QCLOUD_ERR_TCP_CONNECT;
+    /* shares the resolver cache and address racing of HAL_TCP_Connect */
+    fd = HAL_TCP_Connect_Socket(host, (uint16_t)port);
+    if (fd < 0) {
+        Log_e("tcp connect failed returned %d", fd);
+        return fd;
     }
 
+    socket_fd->fd = fd;
+
     return QCLOUD_RET_SUCCESS;
 }
 
@@ -216,7 +210,11 @@ uintptr_t HAL_TLS_Connect(TLSConnectParams *pConnectParams, const char *host, in
 
     TLSDataParams *pDataParams = (TLSDataParams *)HAL_Malloc(sizeof(TLSDataParams));
 
-    if ((ret = _mbedtls_client_init(pDataParams, pConnectParams)) != QCLOUD_RET_SUCCESS) {
+    // seeding the DRBG and parsing the credentials may take a while on device
+    IOT_TRACE_BEGIN(t_init);
+    ret = _mbedtls_client_init(pDataParams, pConnectParams);
+    IOT_TRACE_END(t_init, "tls", "init", ret);
+    if (ret != QCLOUD_RET_SUCCESS) {
         goto error;
     }
 
@@ -268,15 +266,18 @@ uintptr_t HAL_TLS_Connect(TLSConnectParams *pConnectParams, const char *host, in
         goto error;
     }
 
+    IOT_TRACE_BEGIN(t_handshake);
     while ((ret = mbedtls_ssl_handshake(&(pDataParams->ssl))) != 0) {
         if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
             Log_e("mbedtls_ssl_handshake failed returned 0x%04x", ret < 0 ? -ret : ret);
             if (ret == MBEDTLS_ERR_X509_CERT_VERIFY_FAILED) {
                 Log_e("Unable to verify the server's certificate");
             }
+            IOT_TRACE_END(t_handshake, "tls", "handshake", QCLOUD_ERR_SSL_CONNECT);
             goto error;
         }
     }
+    IOT_TRACE_END(t_handshake, "tls", "handshake", QCLOUD_RET_SUCCESS);
 
     if ((ret = mbedtls_ssl_get_verify_result(&(pDataParams->ssl))) != 0) {
         Log_e("mbedtls_ssl_get_verify_result failed returned 0x%04x", ret < 0 ? -ret : ret);
@@ -367,6 +368,12 @@ int HAL_TLS_Read(uintptr_t handle, unsigned char *msg, size_t totalLen, uint32_t
 
     TLSDataParams *pParams = (TLSDataParams *)handle;
 
+    /* timeout_ms of 0 only takes what has arrived already */
+    if (0 == timeout_ms && 0 == mbedtls_ssl_get_bytes_avail(&(pParams->ssl)) &&
+        0 == mbedtls_net_poll(&(pParams->socket_fd), MBEDTLS_NET_POLL_READ, 0)) {
+        return QCLOUD_ERR_SSL_NOTHING_TO_READ;
+    }
+
     do {
         int read_rc = 0;
         read_rc     = mbedtls_ssl_read(&(pParams->ssl), msg + *read_len, totalLen - *read_len);
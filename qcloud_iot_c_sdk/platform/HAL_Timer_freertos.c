@@ -43,6 +43,10 @@ extern "C" {
 #include "stm32l4xx_hal.h"
 #endif
 
+#if defined(IOT_TRACE_ENABLED) && defined(ESP_PLATFORM)
+#include "esp_timer.h"
+#endif
+
 uint32_t HAL_GetTimeMs(void)
 {
 #if defined PLATFORM_HAS_TIME_FUNCS
@@ -55,6 +59,22 @@ uint32_t HAL_GetTimeMs(void)
 #endif
 }
 
+#ifdef IOT_TRACE_ENABLED
+uint64_t HAL_GetTimeUs(void)
+{
+#if defined ESP_PLATFORM
+    // microseconds since boot, not changed by the time sync like gettimeofday
+    return (uint64_t)esp_timer_get_time();
+#elif defined PLATFORM_HAS_CMSIS
+    return (uint64_t)HAL_GetTick() * 1000;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+#endif
+
 /*Get timestamp*/
 long HAL_Timer_current_sec(void)
 {
@@ -21,6 +21,7 @@
 #include "config.h"
 
 #if defined(ACTION_ENABLED)
+#include <float.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -33,10 +34,17 @@
 #include "data_template_client_json.h"
 #include "qcloud_iot_export_data_template.h"
 
+#define IOT_HEAP_TAG IOT_HEAP_ACTION
+#include "utils_heap.h"
+
 // Action Subscribe
 static int _parse_action_input(DeviceAction *pAction, char *pInput)
 {
     int             i;
+    int             rc;
+    int             value_len;
+    int64_t         v;
+    double          d;
     char *          temp;
     DeviceProperty *pActionInput = pAction->pInput;
 
@@ -49,31 +57,37 @@ static int _parse_action_input(DeviceAction *pAction, char *pInput)
                 return -1;
             }
         } else {
-            temp = LITE_json_value_of(pActionInput[i].key, pInput);
+            temp = LITE_json_value_span_of(pActionInput[i].key, pInput, &value_len, NULL);
             if (NULL == temp) {
                 Log_e("action input data [%s] not found!", pActionInput[i].key);
                 return -1;
             }
+
+            rc = QCLOUD_RET_SUCCESS;
             if (JINT32 == pActionInput[i].type) {
-                if (sscanf(temp, "%" SCNi32, (int32_t *)pActionInput[i].data) != 1) {
-                    HAL_Free(temp);
-                    Log_e("parse code failed, errCode: %d", QCLOUD_ERR_JSON_PARSE);
-                    return -1;
+                rc = LITE_span_get_integer(temp, value_len, INT32_MIN, INT32_MAX, &v);
+                if (rc == QCLOUD_RET_SUCCESS) {
+                    *(int32_t *)pActionInput[i].data = (int32_t)v;
                 }
             } else if (JFLOAT == pActionInput[i].type) {
-                if (sscanf(temp, "%f", (float *)pActionInput[i].data) != 1) {
-                    HAL_Free(temp);
-                    Log_e("parse code failed, errCode: %d", QCLOUD_ERR_JSON_PARSE);
-                    return -1;
+                rc = LITE_span_get_double(temp, value_len, &d);
+                if (rc == QCLOUD_RET_SUCCESS && (d > FLT_MAX || d < -FLT_MAX)) {
+                    rc = QCLOUD_ERR_FAILURE;
+                }
+                if (rc == QCLOUD_RET_SUCCESS) {
+                    *(float *)pActionInput[i].data = (float)d;
                 }
             } else if (JUINT32 == pActionInput[i].type) {
-                if (sscanf(temp, "%" SCNu32, (uint32_t *)pActionInput[i].data) != 1) {
-                    HAL_Free(temp);
-                    Log_e("parse code failed, errCode: %d", QCLOUD_ERR_JSON_PARSE);
-                    return -1;
+                rc = LITE_span_get_integer(temp, value_len, 0, UINT32_MAX, &v);
+                if (rc == QCLOUD_RET_SUCCESS) {
+                    *(uint32_t *)pActionInput[i].data = (uint32_t)v;
                 }
             }
-            HAL_Free(temp);
+
+            if (rc != QCLOUD_RET_SUCCESS) {
+                Log_e("parse code failed, errCode: %d", QCLOUD_ERR_JSON_PARSE);
+                return -1;
+            }
         }
     }
 
@@ -370,23 +384,16 @@ static int _iot_construct_action_json(void *handle, char *jsonBuffer, size_t siz
 static int _publish_action_to_cloud(void *c, char *pJsonDoc)
 {
     IOT_FUNC_ENTRY;
-    int                  rc                             = QCLOUD_RET_SUCCESS;
-    char                 topic[MAX_SIZE_OF_CLOUD_TOPIC] = {0};
-    Qcloud_IoT_Template *ptemplate                      = (Qcloud_IoT_Template *)c;
-
-    int size = HAL_Snprintf(topic, MAX_SIZE_OF_CLOUD_TOPIC, "$thing/up/action/%s/%s", ptemplate->device_info.product_id,
-                            ptemplate->device_info.device_name);
-    if (size < 0 || size > sizeof(topic) - 1) {
-        Log_e("topic content length not enough! content size:%d  buf size:%d", size, (int)sizeof(topic));
-        return QCLOUD_ERR_FAILURE;
-    }
+    int                  rc        = QCLOUD_RET_SUCCESS;
+    Qcloud_IoT_Template *ptemplate = (Qcloud_IoT_Template *)c;
 
     PublishParams pubParams = DEFAULT_PUB_PARAMS;
     pubParams.qos           = QOS1;
     pubParams.payload_len   = strlen(pJsonDoc);
     pubParams.payload       = (char *)pJsonDoc;
+    pubParams.priority      = MQTT_PRIO_CONTROL;
 
-    rc = IOT_MQTT_Publish(ptemplate->mqtt, topic, &pubParams);
+    rc = template_publish_upstream(ptemplate, MQTT_TOPIC_ACTION_UP, &pubParams);
 
     IOT_FUNC_EXIT_RC(rc);
 }
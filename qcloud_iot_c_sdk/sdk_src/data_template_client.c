@@ -31,10 +31,15 @@ extern "C" {
 #include "data_template_action.h"
 #include "data_template_client_common.h"
 #include "data_template_client_json.h"
+#include "data_template_series.h"
+#include "utils_completion.h"
 #include "qcloud_iot_export.h"
 #include "qcloud_iot_import.h"
 #include "utils_param_check.h"
 
+#define IOT_HEAP_TAG IOT_HEAP_TEMPLATE
+#include "utils_heap.h"
+
 static void _init_request_params(RequestParams *pParams, Method method, OnReplyCallback callback, void *userContext,
                                  uint8_t timeout_sec)
 {
@@ -187,10 +192,42 @@ static void _copy_template_init_params_to_mqtt(MQTTInitParams *pMqttInitParams,
     pMqttInitParams->auto_connect_enable    = templateInitParams->auto_connect_enable;
 }
 
+/* how long a sync request blocks at a time before checking the reply timeout */
+#define TEMPLATE_REPLY_WAIT_SLICE_MS (200)
+
+/* how long a sync request yields at a time when it drives the yield loop itself */
+#define TEMPLATE_REPLY_YIELD_SLICE_MS (20)
+
+/**
+ * @brief a request waiting for its reply, handed to the reply handler as user context
+ */
+typedef struct {
+    ReplyAck      ack;  // keep it first, the get status reply handler sets it through user_context
+    IotCompletion done;
+} TemplateReplyFuture;
+
+static int _template_reply_future_init(TemplateReplyFuture *future)
+{
+    future->ack = ACK_NONE;
+    return iot_completion_init(&future->done);
+}
+
+static int _reply_ack_to_rc(Method method, ReplyAck replyAck)
+{
+    if (ACK_ACCEPTED == replyAck) {
+        return QCLOUD_RET_SUCCESS;
+    } else if (ACK_TIMEOUT == replyAck) {
+        return (GET == method) ? QCLOUD_ERR_GET_TIMEOUT : QCLOUD_ERR_REPORT_TIMEOUT;
+    } else {
+        return (GET == method) ? QCLOUD_ERR_GET_REJECTED : QCLOUD_ERR_REPORT_REJECTED;
+    }
+}
+
 static void _reply_ack_cb(void *pClient, Method method, ReplyAck replyAck, const char *pReceivedJsonDocument,
                           void *pUserdata)
 {
-    Request *request = (Request *)pUserdata;
+    Request *            request = (Request *)pUserdata;
+    TemplateReplyFuture *future  = (TemplateReplyFuture *)request->user_context;
     Log_d("replyAck=%d", replyAck);
 
     if (NULL != pReceivedJsonDocument) {
@@ -199,30 +236,54 @@ static void _reply_ack_cb(void *pClient, Method method, ReplyAck replyAck, const
         Log_d("Received Json Document is NULL");
     }
 
-    *((ReplyAck *)(request->user_context)) = replyAck;
+    future->ack = replyAck;
+    iot_completion_complete(&future->done, _reply_ack_to_rc(method, replyAck));
 }
 
 /*control data may be for get status replay*/
 static void _get_status_reply_ack_cb(void *pClient, Method method, ReplyAck replyAck, const char *pReceivedJsonDocument,
                                      void *pUserdata)
 {
-    Request *request = (Request *)pUserdata;
+    Request *            request = (Request *)pUserdata;
+    TemplateReplyFuture *future  = (TemplateReplyFuture *)request->user_context;
 
-    Log_d("replyAck=%d", replyAck);
-    if (NULL == pReceivedJsonDocument) {
-        Log_d("Received Json Document is NULL");
-    } else {
-        Log_d("Received Json Document=%s", pReceivedJsonDocument);
+    if (future->ack == ACK_ACCEPTED) {
+        IOT_Template_ClearControl(pClient, request->client_token, NULL, QCLOUD_IOT_MQTT_COMMAND_TIMEOUT);
     }
 
-    if (*((ReplyAck *)request->user_context) == ACK_ACCEPTED) {
-        IOT_Template_ClearControl(pClient, request->client_token, NULL, QCLOUD_IOT_MQTT_COMMAND_TIMEOUT);
-    } else {
-        *((ReplyAck *)request->user_context) = replyAck;
+    _reply_ack_cb(pClient, method, replyAck, pReceivedJsonDocument, pUserdata);
+}
+
+/**
+ * @brief wait until the reply handler or the reply timeout completes the future
+ *
+ * The request holds a pointer to the future until then, so this never returns
+ * early, the request timeout bounds the wait.
+ */
+static int _template_wait_reply(Qcloud_IoT_Template *pTemplate, TemplateReplyFuture *future)
+{
+    int rc;
+
+    while (!iot_completion_is_done(&future->done)) {
+#ifdef MULTITHREAD_ENABLED
+        if (pTemplate->yield_thread_running) {
+            /* woken by the yield thread as soon as the reply is handled */
+            if (!iot_completion_wait(&future->done, TEMPLATE_REPLY_WAIT_SLICE_MS)) {
+                handle_template_expired_reply(pTemplate);
+            }
+            continue;
+        }
+#endif
+        IOT_Template_Yield(pTemplate, TEMPLATE_REPLY_YIELD_SLICE_MS);
     }
+
+    rc = future->done.result;
+    iot_completion_deinit(&future->done);
+
+    return rc;
 }
 
-static int _template_ConstructControlReply(char *jsonBuffer, size_t sizeOfBuffer, sReplyPara *replyPara)
+static int _template_ConstructControlReply(Qcloud_IoT_Template *pTemplate, char *jsonBuffer, size_t sizeOfBuffer, sReplyPara *replyPara)
 {
     POINTER_SANITY_CHECK(jsonBuffer, QCLOUD_ERR_INVAL);
 
@@ -230,14 +291,7 @@ static int _template_ConstructControlReply(char *jsonBuffer, size_t sizeOfBuffer
     size_t  remain_size = 0;
     int32_t rc_of_snprintf;
 
-    if ((remain_size = sizeOfBuffer - strlen(jsonBuffer)) <= 1) {
-        return QCLOUD_ERR_JSON_BUFFER_TOO_SMALL;
-    }
-
-    rc_of_snprintf = HAL_Snprintf(jsonBuffer, remain_size, "{\"code\":%d, \"clientToken\":\"%s\",", replyPara->code,
-                                  get_control_clientToken());
-    rc             = check_snprintf_return(rc_of_snprintf, remain_size);
-
+    rc = build_template_json_header_with_token(jsonBuffer, sizeOfBuffer, REPLY, get_control_clientToken(pTemplate));
     if (rc != QCLOUD_RET_SUCCESS) {
         return rc;
     }
@@ -247,10 +301,10 @@ static int _template_ConstructControlReply(char *jsonBuffer, size_t sizeOfBuffer
     }
 
     if (strlen(replyPara->status_msg) > 0) {
-        rc_of_snprintf =
-            HAL_Snprintf(jsonBuffer + strlen(jsonBuffer), remain_size, "\"status\":\"%s\"}", replyPara->status_msg);
+        rc_of_snprintf = HAL_Snprintf(jsonBuffer + strlen(jsonBuffer), remain_size, ",\"code\":%d,\"status\":\"%s\"}",
+                                      replyPara->code, replyPara->status_msg);
     } else {
-        rc_of_snprintf = HAL_Snprintf(jsonBuffer + strlen(jsonBuffer) - 1, remain_size, "}");
+        rc_of_snprintf = HAL_Snprintf(jsonBuffer + strlen(jsonBuffer), remain_size, ",\"code\":%d}", replyPara->code);
     }
 
     rc = check_snprintf_return(rc_of_snprintf, remain_size);
@@ -309,12 +363,17 @@ int IOT_Template_JSON_ConstructReportArray(void *pClient, char *jsonBuffer, size
     int     rc;
     int8_t  i;
 
-    build_empty_json(&(pTemplate->inner_data.token_num), jsonBuffer, pTemplate->device_info.product_id);
+    rc = build_template_json_header(&(pTemplate->inner_data.token_num), jsonBuffer, sizeOfBuffer, REPORT,
+                                    pTemplate->device_info.product_id);
+    if (rc != QCLOUD_RET_SUCCESS) {
+        return rc;
+    }
+
     if ((remain_size = sizeOfBuffer - strlen(jsonBuffer)) <= 1) {
         return QCLOUD_ERR_JSON_BUFFER_TOO_SMALL;
     }
 
-    rc_of_snprintf = HAL_Snprintf(jsonBuffer + strlen(jsonBuffer) - 1, remain_size, ", \"params\":{");
+    rc_of_snprintf = HAL_Snprintf(jsonBuffer + strlen(jsonBuffer), remain_size, ",\"params\":{");
     rc             = check_snprintf_return(rc_of_snprintf, remain_size);
 
     if (rc != QCLOUD_RET_SUCCESS) {
@@ -348,6 +407,75 @@ int IOT_Template_JSON_ConstructReportArray(void *pClient, char *jsonBuffer, size
     return rc;
 }
 
+int IOT_Template_Register_Codec(void *handle, const TemplateCodec *codec, void *data,
+                                OnTemplateControlCallback callback)
+{
+    POINTER_SANITY_CHECK(handle, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(codec, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(data, QCLOUD_ERR_INVAL);
+
+    Qcloud_IoT_Template *pTemplate = (Qcloud_IoT_Template *)handle;
+
+    HAL_MutexLock(pTemplate->mutex);
+    pTemplate->codec          = codec;
+    pTemplate->codec_data     = data;
+    pTemplate->codec_callback = callback;
+    HAL_MutexUnlock(pTemplate->mutex);
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+int IOT_Template_JSON_ConstructReportMask(void *handle, char *jsonBuffer, size_t sizeOfBuffer, uint32_t mask)
+{
+    POINTER_SANITY_CHECK(jsonBuffer, QCLOUD_ERR_INVAL);
+
+    Qcloud_IoT_Template *pTemplate = (Qcloud_IoT_Template *)handle;
+    POINTER_SANITY_CHECK(pTemplate, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(pTemplate->codec, QCLOUD_ERR_INVAL);
+
+    size_t  remain_size    = 0;
+    int32_t rc_of_snprintf = 0;
+    int     rc;
+
+    rc = build_template_json_header(&(pTemplate->inner_data.token_num), jsonBuffer, sizeOfBuffer, REPORT,
+                                    pTemplate->device_info.product_id);
+    if (rc != QCLOUD_RET_SUCCESS) {
+        return rc;
+    }
+
+    if ((remain_size = sizeOfBuffer - strlen(jsonBuffer)) <= 1) {
+        return QCLOUD_ERR_JSON_BUFFER_TOO_SMALL;
+    }
+
+    rc_of_snprintf = HAL_Snprintf(jsonBuffer + strlen(jsonBuffer), remain_size, ",\"params\":{");
+    rc             = check_snprintf_return(rc_of_snprintf, remain_size);
+    if (rc != QCLOUD_RET_SUCCESS) {
+        return rc;
+    }
+
+    if ((remain_size = sizeOfBuffer - strlen(jsonBuffer)) <= 1) {
+        return QCLOUD_ERR_JSON_BUFFER_TOO_SMALL;
+    }
+
+    rc = pTemplate->codec->encode(pTemplate->codec_data, mask, jsonBuffer + strlen(jsonBuffer), remain_size);
+    if (rc < 0) {
+        return rc;
+    }
+
+    if ((remain_size = sizeOfBuffer - strlen(jsonBuffer)) <= 1) {
+        return QCLOUD_ERR_JSON_BUFFER_TOO_SMALL;
+    }
+
+    /* overwrite the trailing comma of the last property, if there is one */
+    rc_of_snprintf = HAL_Snprintf(jsonBuffer + strlen(jsonBuffer) - (rc > 0), remain_size + (rc > 0), "}}");
+    rc             = check_snprintf_return(rc_of_snprintf, remain_size);
+    if (rc != QCLOUD_RET_SUCCESS) {
+        Log_e("construct datatemplate report mask failed: %d", rc);
+    }
+
+    return rc;
+}
+
 int IOT_Template_ClearControl(void *pClient, char *pClientToken, OnReplyCallback callback, uint32_t timeout_ms)
 {
     IOT_FUNC_ENTRY;
@@ -373,11 +501,11 @@ int IOT_Template_ClearControl(void *pClient, char *pClientToken, OnReplyCallback
     }
 
     memset(JsonDoc, 0, MAX_CLEAE_DOC_LEN);
-    int rc_of_snprintf = HAL_Snprintf(JsonDoc, MAX_CLEAE_DOC_LEN, "{\"clientToken\":\"%s\"}", pClientToken);
-    rc                 = check_snprintf_return(rc_of_snprintf, MAX_CLEAE_DOC_LEN);
+    rc = build_template_json_header_with_token(JsonDoc, MAX_CLEAE_DOC_LEN - 1, CLEAR, pClientToken);
     if (rc != QCLOUD_RET_SUCCESS) {
         return rc;
     }
+    strcat(JsonDoc, "}");
 
     RequestParams request_params = DEFAULT_REQUEST_PARAMS;
     _init_request_params(&request_params, CLEAR, callback, NULL, timeout_ms / 1000);
@@ -436,22 +564,61 @@ int IOT_Template_Report_Sync(void *pClient, char *pJsonDoc, size_t sizeOfBuffer,
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_MQTT_NO_CONN);
     }
 
-    ReplyAck ack_report = ACK_NONE;
-    rc                  = IOT_Template_Report(pClient, pJsonDoc, sizeOfBuffer, _reply_ack_cb, &ack_report, timeout_ms);
-    if (rc != QCLOUD_RET_SUCCESS)
+    TemplateReplyFuture future;
+    if (_template_reply_future_init(&future) != QCLOUD_RET_SUCCESS)
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
+
+    rc = IOT_Template_Report(pClient, pJsonDoc, sizeOfBuffer, _reply_ack_cb, &future, timeout_ms);
+    if (rc != QCLOUD_RET_SUCCESS) {
+        iot_completion_deinit(&future.done);
         IOT_FUNC_EXIT_RC(rc);
-    while (ACK_NONE == ack_report) {
-        IOT_Template_Yield(pClient, 200);
     }
 
-    if (ACK_ACCEPTED == ack_report) {
-        rc = QCLOUD_RET_SUCCESS;
-    } else if (ACK_TIMEOUT == ack_report) {
-        rc = QCLOUD_ERR_REPORT_TIMEOUT;
-    } else if (ACK_REJECTED == ack_report) {
-        rc = QCLOUD_ERR_REPORT_REJECTED;
+    rc = _template_wait_reply(template, &future);
+    IOT_FUNC_EXIT_RC(rc);
+}
+
+int IOT_Template_Report_Async(void *pClient, char *pJsonDoc, size_t sizeOfBuffer, uint32_t timeout_ms, void **pReply)
+{
+    IOT_FUNC_ENTRY;
+    int rc;
+
+    POINTER_SANITY_CHECK(pReply, QCLOUD_ERR_INVAL);
+    *pReply = NULL;
+
+    TemplateReplyFuture *future = (TemplateReplyFuture *)HAL_Malloc(sizeof(TemplateReplyFuture));
+    if (NULL == future) {
+        Log_e("memory malloc failed!");
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_MALLOC);
+    }
+
+    if (_template_reply_future_init(future) != QCLOUD_RET_SUCCESS) {
+        HAL_Free(future);
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
+    }
+
+    rc = IOT_Template_Report(pClient, pJsonDoc, sizeOfBuffer, _reply_ack_cb, future, timeout_ms);
+    if (rc != QCLOUD_RET_SUCCESS) {
+        iot_completion_deinit(&future->done);
+        HAL_Free(future);
+        IOT_FUNC_EXIT_RC(rc);
     }
 
+    *pReply = future;
+    IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
+}
+
+int IOT_Template_Wait_Reply(void *pClient, void *pReply)
+{
+    IOT_FUNC_ENTRY;
+    int rc;
+
+    POINTER_SANITY_CHECK(pClient, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(pReply, QCLOUD_ERR_INVAL);
+
+    rc = _template_wait_reply((Qcloud_IoT_Template *)pClient, (TemplateReplyFuture *)pReply);
+    HAL_Free(pReply);
+
     IOT_FUNC_EXIT_RC(rc);
 }
 
@@ -468,12 +635,17 @@ int IOT_Template_JSON_ConstructSysInfo(void *pClient, char *jsonBuffer, size_t s
     int32_t rc_of_snprintf = 0;
     int     rc;
 
-    build_empty_json(&(pTemplate->inner_data.token_num), jsonBuffer, pTemplate->device_info.product_id);
+    rc = build_template_json_header(&(pTemplate->inner_data.token_num), jsonBuffer, sizeOfBuffer, RINFO, 
+                                    pTemplate->device_info.product_id);
+    if (rc != QCLOUD_RET_SUCCESS) {
+        return rc;
+    }
+
     if ((remain_size = sizeOfBuffer - strlen(jsonBuffer)) <= 1) {
         return QCLOUD_ERR_JSON_BUFFER_TOO_SMALL;
     }
 
-    rc_of_snprintf = HAL_Snprintf(jsonBuffer + strlen(jsonBuffer) - 1, remain_size, ", \"params\":{");
+    rc_of_snprintf = HAL_Snprintf(jsonBuffer + strlen(jsonBuffer), remain_size, ",\"params\":{");
     rc             = check_snprintf_return(rc_of_snprintf, remain_size);
 
     if (rc != QCLOUD_RET_SUCCESS) {
@@ -589,23 +761,17 @@ int IOT_Template_Report_SysInfo_Sync(void *pClient, char *pJsonDoc, size_t sizeO
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_MQTT_NO_CONN);
     }
 
-    ReplyAck ack_report = ACK_NONE;
-    rc = IOT_Template_Report_SysInfo(pClient, pJsonDoc, sizeOfBuffer, _reply_ack_cb, &ack_report, timeout_ms);
+    TemplateReplyFuture future;
+    if (_template_reply_future_init(&future) != QCLOUD_RET_SUCCESS)
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
 
-    if (rc != QCLOUD_RET_SUCCESS)
+    rc = IOT_Template_Report_SysInfo(pClient, pJsonDoc, sizeOfBuffer, _reply_ack_cb, &future, timeout_ms);
+    if (rc != QCLOUD_RET_SUCCESS) {
+        iot_completion_deinit(&future.done);
         IOT_FUNC_EXIT_RC(rc);
-    while (ACK_NONE == ack_report) {
-        IOT_Template_Yield(pClient, 200);
-    }
-
-    if (ACK_ACCEPTED == ack_report) {
-        rc = QCLOUD_RET_SUCCESS;
-    } else if (ACK_TIMEOUT == ack_report) {
-        rc = QCLOUD_ERR_REPORT_TIMEOUT;
-    } else if (ACK_REJECTED == ack_report) {
-        rc = QCLOUD_ERR_REPORT_REJECTED;
     }
 
+    rc = _template_wait_reply(template, &future);
     IOT_FUNC_EXIT_RC(rc);
 }
 
@@ -632,15 +798,20 @@ int IOT_Template_GetStatus(void *pClient, OnReplyCallback callback, void *userCo
         }
     }
 
-    char getRequestJsonDoc[MAX_SIZE_OF_JSON_WITH_CLIENT_TOKEN];
-    build_empty_json(&(pTemplate->inner_data.token_num), getRequestJsonDoc, pTemplate->device_info.product_id);
+    char getRequestJsonDoc[MAX_SIZE_OF_JSON_WITH_METHOD];
+    rc = build_template_json_header(&(pTemplate->inner_data.token_num), getRequestJsonDoc,
+                                    MAX_SIZE_OF_JSON_WITH_METHOD - 1, GET, pTemplate->device_info.product_id);
+    if (rc != QCLOUD_RET_SUCCESS) {
+        IOT_FUNC_EXIT_RC(rc);
+    }
+    strcat(getRequestJsonDoc, "}");
 
     // Log_d("GET Status Document: %s", getRequestJsonDoc);
 
     RequestParams request_params = DEFAULT_REQUEST_PARAMS;
     _init_request_params(&request_params, GET, callback, userContext, timeout_ms / 1000);
 
-    rc = send_template_request(pTemplate, &request_params, getRequestJsonDoc, MAX_SIZE_OF_JSON_WITH_CLIENT_TOKEN);
+    rc = send_template_request(pTemplate, &request_params, getRequestJsonDoc, MAX_SIZE_OF_JSON_WITH_METHOD);
     IOT_FUNC_EXIT_RC(rc);
 }
 
@@ -658,22 +829,17 @@ int IOT_Template_GetStatus_sync(void *pClient, uint32_t timeout_ms)
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_MQTT_NO_CONN);
     }
 
-    ReplyAck ack_request = ACK_NONE;
-    rc                   = IOT_Template_GetStatus(pClient, _get_status_reply_ack_cb, &ack_request, timeout_ms);
-    if (rc != QCLOUD_RET_SUCCESS)
-        IOT_FUNC_EXIT_RC(rc);
-    while (ACK_NONE == ack_request) {
-        IOT_Template_Yield(pClient, 200);
-    }
+    TemplateReplyFuture future;
+    if (_template_reply_future_init(&future) != QCLOUD_RET_SUCCESS)
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
 
-    if (ACK_ACCEPTED == ack_request) {
-        rc = QCLOUD_RET_SUCCESS;
-    } else if (ACK_TIMEOUT == ack_request) {
-        rc = QCLOUD_ERR_GET_TIMEOUT;
-    } else if (ACK_REJECTED == ack_request) {
-        rc = QCLOUD_ERR_GET_REJECTED;
+    rc = IOT_Template_GetStatus(pClient, _get_status_reply_ack_cb, &future, timeout_ms);
+    if (rc != QCLOUD_RET_SUCCESS) {
+        iot_completion_deinit(&future.done);
+        IOT_FUNC_EXIT_RC(rc);
     }
 
+    rc = _template_wait_reply(pTemplate, &future);
     IOT_FUNC_EXIT_RC(rc);
 }
 
@@ -700,7 +866,7 @@ int IOT_Template_ControlReply(void *pClient, char *pJsonDoc, size_t sizeOfBuffer
         }
     }
 
-    rc = _template_ConstructControlReply(pJsonDoc, sizeOfBuffer, replyPara);
+    rc = _template_ConstructControlReply(pTemplate, pJsonDoc, sizeOfBuffer, replyPara);
     if (rc != QCLOUD_RET_SUCCESS) {
         Log_e("Construct ControlReply fail,rc=%d", rc);
         return rc;
@@ -752,7 +918,8 @@ int IOT_Template_Start_Yield_Thread(void *pClient)
     thread_params.thread_name       = "template_yield_thread";
     thread_params.user_arg          = pClient;
     thread_params.stack_size        = 4096;
-    thread_params.priority          = 1;
+    thread_params.priority_class    = THREAD_PRIO_NETWORK;
+    thread_params.core_mask         = QCLOUD_IOT_THREAD_CORE_MASK;
     pTemplate->yield_thread_running = true;
 
     int rc = HAL_ThreadCreate(&thread_params);
@@ -804,6 +971,10 @@ int IOT_Template_Destroy_Except_MQTT(void *pClient)
     Qcloud_IoT_Template *pTemplate = (Qcloud_IoT_Template *)pClient;
     qcloud_iot_template_reset(pClient);
 
+#ifdef PROPERTY_SERIES_ENABLED
+    template_series_destroy_all(pTemplate);
+#endif
+
     if (NULL != pTemplate->DataTemplateDestroyCb) {
         pTemplate->DataTemplateDestroyCb(pClient);
     }
@@ -839,6 +1010,10 @@ int IOT_Template_Yield(void *pClient, uint32_t timeout_ms)
     handle_template_expired_event(pTemplate);
 #endif
 
+#ifdef PROPERTY_SERIES_ENABLED
+    handle_template_series(pTemplate);
+#endif
+
 #ifdef MULTITHREAD_ENABLED
     /* only one instance of yield is allowed in running state*/
     if (pTemplate->yield_thread_running) {
@@ -897,12 +1072,20 @@ void *IOT_Template_Construct(TemplateInitParams *pParams, void *pMqttClient)
     pTemplate->yield_thread_running = false;
 #endif
 
-    pTemplate->mqtt                        = mqtt_client;
-    pTemplate->event_handle                = pParams->event_handle;
-    pTemplate->inner_data.upstream_topic   = NULL;
-    pTemplate->inner_data.downstream_topic = NULL;
-    pTemplate->inner_data.token_num        = 0;
-    pTemplate->inner_data.eventflags       = 0;
+    pTemplate->mqtt                               = mqtt_client;
+    pTemplate->event_handle                       = pParams->event_handle;
+    pTemplate->inner_data.upstream_topic          = NULL;
+    pTemplate->inner_data.downstream_topic        = NULL;
+    pTemplate->inner_data.token_num               = 0;
+    pTemplate->inner_data.eventflags              = 0;
+    pTemplate->inner_data.control_client_token[0] = '\0';
+    pTemplate->codec                              = NULL;
+    pTemplate->codec_data                         = NULL;
+    pTemplate->codec_callback                     = NULL;
+#ifdef PROPERTY_SERIES_ENABLED
+    pTemplate->series_lock = NULL;
+    pTemplate->series_list = NULL;
+#endif
 
     rc = qcloud_iot_template_init(pTemplate);
     if (rc != QCLOUD_RET_SUCCESS) {
@@ -968,6 +1151,10 @@ int IOT_Template_Destroy(void *pClient)
     Qcloud_IoT_Template *pTemplate = (Qcloud_IoT_Template *)pClient;
     qcloud_iot_template_reset(pTemplate);
 
+#ifdef PROPERTY_SERIES_ENABLED
+    template_series_destroy_all(pTemplate);
+#endif
+
     IOT_MQTT_Destroy(&pTemplate->mqtt);
 
     if (NULL != pTemplate->mutex) {
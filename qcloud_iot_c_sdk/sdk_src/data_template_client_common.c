@@ -26,6 +26,9 @@ extern "C" {
 
 #include "qcloud_iot_import.h"
 
+#define IOT_HEAP_TAG IOT_HEAP_TEMPLATE
+#include "utils_heap.h"
+
 /**
  * @brief add registered propery's call back to data_template handle list
  */
@@ -24,12 +24,14 @@ extern "C" {
 
 #include "data_template_client_json.h"
 
+#include <float.h>
 #include <inttypes.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 
+#include "json_parser.h"
 #include "lite-utils.h"
 #include "qcloud_iot_device.h"
 #include "qcloud_iot_export_method.h"
@@ -59,34 +61,112 @@ void insert_str(char *pDestStr, char *pSourceStr, int pos)
     *(pDestStr + len + nlen) = 0;
 }
 
-static int _direct_update_value(char *value, DeviceProperty *pProperty)
+static int _direct_update_integer(const char *value, int value_len, DeviceProperty *pProperty)
 {
-    int rc = QCLOUD_RET_SUCCESS;
-
-    if (pProperty->type == JBOOL) {
-        rc = LITE_get_boolean(pProperty->data, value);
-    } else if (pProperty->type == JINT32) {
-        rc = LITE_get_int32(pProperty->data, value);
-    } else if (pProperty->type == JINT16) {
-        rc = LITE_get_int16(pProperty->data, value);
-    } else if (pProperty->type == JINT8) {
-        rc = LITE_get_int8(pProperty->data, value);
-    } else if (pProperty->type == JUINT32) {
-        rc = LITE_get_uint32(pProperty->data, value);
-    } else if (pProperty->type == JUINT16) {
-        rc = LITE_get_uint16(pProperty->data, value);
-    } else if (pProperty->type == JUINT8) {
-        rc = LITE_get_uint8(pProperty->data, value);
-    } else if (pProperty->type == JFLOAT) {
-        rc = LITE_get_float(pProperty->data, value);
-    } else if (pProperty->type == JDOUBLE) {
-        rc = LITE_get_double(pProperty->data, value);
-    } else if (pProperty->type == JSTRING) {
-        rc = LITE_get_string(pProperty->data, value, pProperty->data_buff_len);
-    } else if (pProperty->type == JOBJECT) {
-        Log_d("Json type wait to be deal,%s", value);
-    } else {
-        Log_e("pProperty type unknow,%d", pProperty->type);
+    int64_t min, max, v;
+    int     rc;
+
+    switch (pProperty->type) {
+        case JINT32:
+            min = INT32_MIN;
+            max = INT32_MAX;
+            break;
+        case JINT16:
+            min = INT16_MIN;
+            max = INT16_MAX;
+            break;
+        case JINT8:
+            min = INT8_MIN;
+            max = INT8_MAX;
+            break;
+        case JUINT32:
+            min = 0;
+            max = UINT32_MAX;
+            break;
+        case JUINT16:
+            min = 0;
+            max = UINT16_MAX;
+            break;
+        default:
+            min = 0;
+            max = UINT8_MAX;
+            break;
+    }
+
+    rc = LITE_span_get_integer(value, value_len, min, max, &v);
+    if (rc != QCLOUD_RET_SUCCESS) {
+        Log_e("property %s value %.*s invalid or out of range", pProperty->key, value_len, value);
+        return rc;
+    }
+
+    switch (pProperty->type) {
+        case JINT32:
+            *(int32_t *)pProperty->data = (int32_t)v;
+            break;
+        case JINT16:
+            *(int16_t *)pProperty->data = (int16_t)v;
+            break;
+        case JINT8:
+            *(int8_t *)pProperty->data = (int8_t)v;
+            break;
+        case JUINT32:
+            *(uint32_t *)pProperty->data = (uint32_t)v;
+            break;
+        case JUINT16:
+            *(uint16_t *)pProperty->data = (uint16_t)v;
+            break;
+        default:
+            *(uint8_t *)pProperty->data = (uint8_t)v;
+            break;
+    }
+
+    return rc;
+}
+
+static int _direct_update_value(const char *value, int value_len, DeviceProperty *pProperty)
+{
+    int    rc = QCLOUD_RET_SUCCESS;
+    double d;
+
+    switch (pProperty->type) {
+        case JBOOL:
+            rc = LITE_span_get_boolean(value, value_len, pProperty->data);
+            break;
+        case JINT32:
+        case JINT16:
+        case JINT8:
+        case JUINT32:
+        case JUINT16:
+        case JUINT8:
+            rc = _direct_update_integer(value, value_len, pProperty);
+            break;
+        case JFLOAT:
+            rc = LITE_span_get_double(value, value_len, &d);
+            if (rc == QCLOUD_RET_SUCCESS && (d > FLT_MAX || d < -FLT_MAX)) {
+                rc = QCLOUD_ERR_FAILURE;
+            }
+            if (rc == QCLOUD_RET_SUCCESS) {
+                *(float *)pProperty->data = (float)d;
+            }
+            break;
+        case JDOUBLE:
+            rc = LITE_span_get_double(value, value_len, pProperty->data);
+            break;
+        case JSTRING:
+            value_len = min(value_len, pProperty->data_buff_len);
+            memcpy(pProperty->data, value, value_len);
+            ((char *)pProperty->data)[value_len] = '\0';
+            break;
+        case JOBJECT:
+            Log_d("Json type wait to be deal,%.*s", value_len, value);
+            break;
+        default:
+            Log_e("pProperty type unknow,%d", pProperty->type);
+            break;
+    }
+
+    if (rc != QCLOUD_RET_SUCCESS) {
+        Log_e("property %s parse value %.*s failed", pProperty->key, value_len, value);
     }
 
     return rc;
@@ -218,6 +298,97 @@ void build_empty_json(uint32_t *tokenNumber, char *pJsonBuffer, char *tokenPrefi
                  (*tokenNumber)++);
 }
 
+const char *template_method_str(Method method)
+{
+    switch (method) {
+        case GET:
+            return GET_STATUS;
+        case REPORT:
+            return REPORT_CMD;
+        case RINFO:
+            return INFO_CMD;
+        case REPLY:
+            return CONTROL_CMD_REPLY;
+        case CLEAR:
+            return CLEAR_CONTROL;
+        default:
+            return NULL;
+    }
+}
+
+int build_template_json_header(uint32_t *tokenNumber, char *pJsonBuffer, size_t sizeOfBuffer, Method method,
+                               char *tokenPrefix)
+{
+    const char *method_str = template_method_str(method);
+    if (NULL == method_str) {
+        return QCLOUD_ERR_INVAL;
+    }
+
+    int32_t rc_of_snprintf = HAL_Snprintf(pJsonBuffer, sizeOfBuffer, "{\"%s\":\"%s\",\"%s\":\"%s-%u\"", METHOD_FIELD,
+                                          method_str, CLIENT_TOKEN_FIELD, tokenPrefix, *tokenNumber);
+    int rc = check_snprintf_return(rc_of_snprintf, sizeOfBuffer);
+    if (rc == QCLOUD_RET_SUCCESS) {
+        (*tokenNumber)++;
+    }
+
+    return rc;
+}
+
+int build_template_json_header_with_token(char *pJsonBuffer, size_t sizeOfBuffer, Method method,
+                                          const char *pClientToken)
+{
+    const char *method_str = template_method_str(method);
+    if (NULL == method_str) {
+        return QCLOUD_ERR_INVAL;
+    }
+
+    int32_t rc_of_snprintf = HAL_Snprintf(pJsonBuffer, sizeOfBuffer, "{\"%s\":\"%s\",\"%s\":\"%s\"", METHOD_FIELD,
+                                          method_str, CLIENT_TOKEN_FIELD, pClientToken);
+
+    return check_snprintf_return(rc_of_snprintf, sizeOfBuffer);
+}
+
+bool parse_template_json_header(const char *pJsonDoc, Method method, char *pClientToken, size_t tokenBufLen)
+{
+    const char *method_str = template_method_str(method);
+    const char *pos        = pJsonDoc;
+    size_t      len;
+
+    if (NULL == method_str) {
+        return false;
+    }
+
+    // the header always sits at a fixed offset, so compare in place rather than reparsing the document
+    len = sizeof("{\"" METHOD_FIELD "\":\"") - 1;
+    if (strncmp(pos, "{\"" METHOD_FIELD "\":\"", len)) {
+        return false;
+    }
+    pos += len;
+
+    len = strlen(method_str);
+    if (strncmp(pos, method_str, len)) {
+        return false;
+    }
+    pos += len;
+
+    len = sizeof("\",\"" CLIENT_TOKEN_FIELD "\":\"") - 1;
+    if (strncmp(pos, "\",\"" CLIENT_TOKEN_FIELD "\":\"", len)) {
+        return false;
+    }
+    pos += len;
+
+    for (len = 0; pos[len] != '"'; len++) {
+        if (pos[len] == '\0' || len + 1 >= tokenBufLen) {
+            return false;
+        }
+    }
+
+    memcpy(pClientToken, pos, len);
+    pClientToken[len] = '\0';
+
+    return true;
+}
+
 bool parse_client_token(char *pJsonDoc, char **pClientToken)
 {
     *pClientToken = LITE_json_value_of(CLIENT_TOKEN_FIELD, pJsonDoc);
@@ -232,21 +403,20 @@ bool parse_action_id(char *pJsonDoc, char **pActionID)
 
 bool parse_time_stamp(char *pJsonDoc, int32_t *pTimestamp)
 {
-    bool ret = false;
+    int     value_len = 0;
+    int64_t v;
 
-    char *timestamp = LITE_json_value_of(TIME_STAMP_FIELD, pJsonDoc);
+    char *timestamp = LITE_json_value_span_of(TIME_STAMP_FIELD, pJsonDoc, &value_len, NULL);
     if (timestamp == NULL)
         return false;
 
-    if (sscanf(timestamp, "%" SCNu32, pTimestamp) != 1) {
+    if (LITE_span_get_integer(timestamp, value_len, 0, UINT32_MAX, &v) != QCLOUD_RET_SUCCESS) {
         Log_e("parse code failed, errCode: %d", QCLOUD_ERR_JSON_PARSE);
-    } else {
-        ret = true;
+        return false;
     }
 
-    HAL_Free(timestamp);
-
-    return ret;
+    *pTimestamp = (int32_t)v;
+    return true;
 }
 
 bool parse_action_input(char *pJsonDoc, char **pActionInput)
@@ -257,21 +427,20 @@ bool parse_action_input(char *pJsonDoc, char **pActionInput)
 
 bool parse_code_return(char *pJsonDoc, int32_t *pCode)
 {
-    bool ret = false;
+    int     value_len = 0;
+    int64_t v;
 
-    char *code = LITE_json_value_of(REPLY_CODE, pJsonDoc);
+    char *code = LITE_json_value_span_of(REPLY_CODE, pJsonDoc, &value_len, NULL);
     if (code == NULL)
         return false;
 
-    if (sscanf(code, "%" SCNi32, pCode) != 1) {
+    if (LITE_span_get_integer(code, value_len, INT32_MIN, INT32_MAX, &v) != QCLOUD_RET_SUCCESS) {
         Log_e("parse code failed, errCode: %d", QCLOUD_ERR_JSON_PARSE);
-    } else {
-        ret = true;
+        return false;
     }
 
-    HAL_Free(code);
-
-    return ret;
+    *pCode = (int32_t)v;
+    return true;
 }
 
 bool parse_status_return(char *pJsonDoc, char **pStatus)
@@ -282,17 +451,18 @@ bool parse_status_return(char *pJsonDoc, char **pStatus)
 
 bool update_value_if_key_match(char *pJsonDoc, DeviceProperty *pProperty)
 {
-    bool ret = false;
+    int value_len  = 0;
+    int value_type = JSNONE;
 
-    char *property_data = LITE_json_value_of(pProperty->key, pJsonDoc);
-    if ((property_data == NULL) || !(strncmp(property_data, "null", 4)) || !(strncmp(property_data, "NULL", 4))) {
-    } else {
-        _direct_update_value(property_data, pProperty);
-        ret = true;
-        HAL_Free(property_data);
+    // null value is returned as NULL when value type is asked
+    char *property_data = LITE_json_value_span_of(pProperty->key, pJsonDoc, &value_len, &value_type);
+    if (property_data == NULL) {
+        return false;
     }
 
-    return ret;
+    _direct_update_value(property_data, value_len, pProperty);
+
+    return true;
 }
 
 bool parse_template_method_type(char *pJsonDoc, char **pMethod)
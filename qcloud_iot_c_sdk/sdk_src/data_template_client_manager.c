@@ -33,11 +33,11 @@ extern "C" {
 #include "utils_list.h"
 #include "utils_param_check.h"
 
-typedef void (*TraverseTemplateHandle)(Qcloud_IoT_Template *pTemplate, ListNode **node, List *list,
-                                       const char *pClientToken, const char *pType);
+#define IOT_HEAP_TAG IOT_HEAP_TEMPLATE
+#include "utils_heap.h"
 
-static char sg_template_cloud_rcv_buf[CLOUD_IOT_JSON_RX_BUF_LEN];
-static char sg_template_clientToken[MAX_SIZE_OF_CLIENT_TOKEN];
+typedef void (*TraverseTemplateHandle)(Qcloud_IoT_Template *pTemplate, ListNode **node, List *list,
+                                       const char *pClientToken, const char *pType, char *pJsonDoc);
 
 /**
  * @brief unsubsribe topic:  $thing/down/property/{ProductId}/{DeviceName}
@@ -68,7 +68,7 @@ static int _unsubscribe_template_downstream_topic(Qcloud_IoT_Template *pTemplate
  * @brief add request to data_template request wait for reply list
  */
 static int _add_request_to_template_list(Qcloud_IoT_Template *pTemplate, const char *pClientToken,
-                                         RequestParams *pParams)
+                                         RequestParams *pParams, Request **pRequest)
 {
     IOT_FUNC_ENTRY;
 
@@ -102,12 +102,28 @@ static int _add_request_to_template_list(Qcloud_IoT_Template *pTemplate, const c
     }
 
     list_rpush(pTemplate->inner_data.reply_list, node);
+    *pRequest = request;
 
     HAL_MutexUnlock(pTemplate->mutex);
 
     IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
 }
 
+/**
+ * @brief drop a request whose publish failed, unless it has been expired already
+ */
+static void _remove_request_from_template_list(Qcloud_IoT_Template *pTemplate, Request *request)
+{
+    ListNode *node;
+
+    HAL_MutexLock(pTemplate->mutex);
+    node = list_find(pTemplate->inner_data.reply_list, request);
+    if (NULL != node) {
+        list_remove(pTemplate->inner_data.reply_list, node);
+    }
+    HAL_MutexUnlock(pTemplate->mutex);
+}
+
 /**
  * @brief publish operation to server
  *
@@ -121,29 +137,63 @@ int _publish_to_template_upstream_topic(Qcloud_IoT_Template *pTemplate, Method m
     IOT_FUNC_ENTRY;
     int rc = QCLOUD_RET_SUCCESS;
 
-    char topic[MAX_SIZE_OF_CLOUD_TOPIC] = {0};
-    int  size;
-
-    size = HAL_Snprintf(topic, MAX_SIZE_OF_CLOUD_TOPIC, "$thing/up/property/%s/%s", pTemplate->device_info.product_id,
-                        pTemplate->device_info.device_name);
-
-    if (size < 0 || size > MAX_SIZE_OF_CLOUD_TOPIC - 1) {
-        Log_e("buf size < topic length!");
-        IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
-    }
-
     PublishParams pubParams = DEFAULT_PUB_PARAMS;
     pubParams.qos           = QOS0;
     pubParams.payload_len   = strlen(pJsonDoc);
     pubParams.payload       = (char *)pJsonDoc;
+    pubParams.priority      = (REPLY == method) ? MQTT_PRIO_CONTROL : MQTT_PRIO_TELEMETRY;
 
-    rc = IOT_MQTT_Publish(pTemplate->mqtt, topic, &pubParams);
+    rc = template_publish_upstream(pTemplate, MQTT_TOPIC_PROPERTY_UP, &pubParams);
 
     IOT_FUNC_EXIT_RC(rc);
 }
 
+/* upstream topics of a template that is not the MQTT client's own device, e.g. a gateway's subdev */
+static int _init_template_upstream_topic(Qcloud_IoT_Template *pTemplate)
+{
+    static const char *topic_type[MQTT_TOPIC_ACTION_UP + 1] = {"property", "event", "action"};
+
+    int i, size;
+
+    if (qcloud_iot_mqtt_topic_owned(pTemplate->mqtt, pTemplate->device_info.product_id,
+                                    pTemplate->device_info.device_name)) {
+        return QCLOUD_RET_SUCCESS;
+    }
+
+    pTemplate->inner_data.upstream_topic = (char *)HAL_Malloc((MQTT_TOPIC_ACTION_UP + 1) * MQTT_TOPIC_ENTRY_MAX_LEN);
+    if (NULL == pTemplate->inner_data.upstream_topic) {
+        Log_e("no memory to allocate upstream_topic");
+        return QCLOUD_ERR_MALLOC;
+    }
+
+    for (i = 0; i <= MQTT_TOPIC_ACTION_UP; i++) {
+        size = HAL_Snprintf(pTemplate->inner_data.upstream_topic + i * MQTT_TOPIC_ENTRY_MAX_LEN,
+                            MQTT_TOPIC_ENTRY_MAX_LEN, "$thing/up/%s/%s/%s", topic_type[i],
+                            pTemplate->device_info.product_id, pTemplate->device_info.device_name);
+        if (size < 0 || size > MQTT_TOPIC_ENTRY_MAX_LEN - 1) {
+            Log_e("buf size < topic length!");
+            HAL_Free(pTemplate->inner_data.upstream_topic);
+            pTemplate->inner_data.upstream_topic = NULL;
+            return QCLOUD_ERR_MAX_TOPIC_LENGTH;
+        }
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+int template_publish_upstream(Qcloud_IoT_Template *pTemplate, MQTTTopicHandle topic, PublishParams *pParams)
+{
+    if (NULL == pTemplate->inner_data.upstream_topic) {
+        return qcloud_iot_mqtt_publish_handle(pTemplate->mqtt, topic, pParams);
+    }
+
+    return IOT_MQTT_Publish(pTemplate->mqtt, pTemplate->inner_data.upstream_topic + topic * MQTT_TOPIC_ENTRY_MAX_LEN,
+                            pParams);
+}
+
 /**
- * @brief fill method json filed with the value of RequestParams and Method
+ * @brief fill method json filed with the value of RequestParams and Method,
+ * only for document not built with build_template_json_header
  */
 static int _set_template_json_type(char *pJsonDoc, size_t sizeOfBuffer, Method method)
 {
@@ -152,30 +202,11 @@ static int _set_template_json_type(char *pJsonDoc, size_t sizeOfBuffer, Method m
     int rc = QCLOUD_RET_SUCCESS;
 
     POINTER_SANITY_CHECK(pJsonDoc, QCLOUD_ERR_INVAL);
-    char *method_str = NULL;
-    switch (method) {
-        case GET:
-            method_str = GET_STATUS;
-            break;
-        case REPORT:
-            method_str = REPORT_CMD;
-            break;
-        case RINFO:
-            method_str = INFO_CMD;
-            break;
-        case REPLY:
-            method_str = CONTROL_CMD_REPLY;
-            break;
-        case CLEAR:
-            method_str = CLEAR_CONTROL;
-            break;
-        default:
-            Log_e("unexpected method!");
-            rc = QCLOUD_ERR_INVAL;
-            break;
-    }
-    if (rc != QCLOUD_RET_SUCCESS)
-        IOT_FUNC_EXIT_RC(rc);
+    const char *method_str = template_method_str(method);
+    if (NULL == method_str) {
+        Log_e("unexpected method!");
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_INVAL);
+    }
 
     size_t json_len    = strlen(pJsonDoc);
     size_t remain_size = sizeOfBuffer - json_len;
@@ -197,7 +228,7 @@ static int _set_template_json_type(char *pJsonDoc, size_t sizeOfBuffer, Method m
  * @brief iterator list and call traverseHandle for each node
  */
 static void _traverse_template_list(Qcloud_IoT_Template *pTemplate, List *list, const char *pClientToken,
-                                    const char *pType, TraverseTemplateHandle traverseHandle)
+                                    const char *pType, char *pJsonDoc, TraverseTemplateHandle traverseHandle)
 {
     IOT_FUNC_ENTRY;
 
@@ -223,7 +254,7 @@ static void _traverse_template_list(Qcloud_IoT_Template *pTemplate, List *list,
                 continue;
             }
 
-            traverseHandle(pTemplate, &node, list, pClientToken, pType);
+            traverseHandle(pTemplate, &node, list, pClientToken, pType, pJsonDoc);
         }
 
         list_iterator_destroy(iter);
@@ -237,7 +268,7 @@ static void _traverse_template_list(Qcloud_IoT_Template *pTemplate, List *list,
  * @brief handle the timeout request wait for reply
  */
 static void _handle_template_expired_reply_callback(Qcloud_IoT_Template *pTemplate, ListNode **node, List *list,
-                                                    const char *pClientToken, const char *pType)
+                                                    const char *pClientToken, const char *pType, char *pJsonDoc)
 {
     IOT_FUNC_ENTRY;
 
@@ -246,8 +277,11 @@ static void _handle_template_expired_reply_callback(Qcloud_IoT_Template *pTempla
         IOT_FUNC_EXIT;
 
     if (expired(&request->timer)) {
+        IOT_TRACE_ASYNC_END("template", "request", IOT_Trace_Id(request->client_token),
+                            QCLOUD_ERR_MQTT_REQUEST_TIMEOUT);
         if (request->callback != NULL) {
-            request->callback(pTemplate, request->method, ACK_TIMEOUT, sg_template_cloud_rcv_buf, request);
+            // there is no reply document on timeout
+            request->callback(pTemplate, request->method, ACK_TIMEOUT, "", request);
         }
 
         list_remove(list, *node);
@@ -257,15 +291,15 @@ static void _handle_template_expired_reply_callback(Qcloud_IoT_Template *pTempla
     IOT_FUNC_EXIT;
 }
 
-static void _set_control_clientToken(const char *pClientToken)
+static void _set_control_clientToken(Qcloud_IoT_Template *pTemplate, const char *pClientToken)
 {
-    memset(sg_template_clientToken, '\0', MAX_SIZE_OF_CLIENT_TOKEN);
-    strncpy(sg_template_clientToken, pClientToken, MAX_SIZE_OF_CLIENT_TOKEN);
+    strncpy(pTemplate->inner_data.control_client_token, pClientToken, MAX_SIZE_OF_CLIENT_TOKEN - 1);
+    pTemplate->inner_data.control_client_token[MAX_SIZE_OF_CLIENT_TOKEN - 1] = '\0';
 }
 
-char *get_control_clientToken(void)
+char *get_control_clientToken(Qcloud_IoT_Template *pTemplate)
 {
-    return sg_template_clientToken;
+    return pTemplate->inner_data.control_client_token;
 }
 
 void qcloud_iot_template_reset(void *pClient)
@@ -295,6 +329,11 @@ void qcloud_iot_template_reset(void *pClient)
         list_destroy(template_client->inner_data.action_handle_list);
         template_client->inner_data.action_handle_list = NULL;
     }
+
+    if (NULL != template_client->inner_data.upstream_topic) {
+        HAL_Free(template_client->inner_data.upstream_topic);
+        template_client->inner_data.upstream_topic = NULL;
+    }
 }
 
 int qcloud_iot_template_init(Qcloud_IoT_Template *pTemplate)
@@ -339,14 +378,14 @@ int qcloud_iot_template_init(Qcloud_IoT_Template *pTemplate)
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
     }
 
-    IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
+    IOT_FUNC_EXIT_RC(_init_template_upstream_topic(pTemplate));
 }
 
 void handle_template_expired_reply(Qcloud_IoT_Template *pTemplate)
 {
     IOT_FUNC_ENTRY;
 
-    _traverse_template_list(pTemplate, pTemplate->inner_data.reply_list, NULL, NULL,
+    _traverse_template_list(pTemplate, pTemplate->inner_data.reply_list, NULL, NULL, NULL,
                             _handle_template_expired_reply_callback);
 
     IOT_FUNC_EXIT;
@@ -361,30 +400,43 @@ int send_template_request(Qcloud_IoT_Template *pTemplate, RequestParams *pParams
     POINTER_SANITY_CHECK(pJsonDoc, QCLOUD_ERR_INVAL);
     POINTER_SANITY_CHECK(pParams, QCLOUD_ERR_INVAL);
 
-    char *client_token = NULL;
-
-    // parse clientToken in pJsonDoc, return err if parse failed
-    if (!parse_client_token(pJsonDoc, &client_token)) {
-        Log_e("fail to parse client token!");
-        IOT_FUNC_EXIT_RC(QCLOUD_ERR_INVAL);
-    }
+    char client_token[MAX_SIZE_OF_CLIENT_TOKEN];
 
-    if (rc != QCLOUD_RET_SUCCESS)
-        IOT_FUNC_EXIT_RC(rc);
+    // document built with the request header already carries method and clientToken
+    if (!parse_template_json_header(pJsonDoc, pParams->method, client_token, MAX_SIZE_OF_CLIENT_TOKEN)) {
+        char *token = NULL;
 
-    rc = _set_template_json_type(pJsonDoc, sizeOfBuffer, pParams->method);
-    if (rc != QCLOUD_RET_SUCCESS)
-        IOT_FUNC_EXIT_RC(rc);
+        // parse clientToken in pJsonDoc, return err if parse failed
+        if (!parse_client_token(pJsonDoc, &token)) {
+            Log_e("fail to parse client token!");
+            IOT_FUNC_EXIT_RC(QCLOUD_ERR_INVAL);
+        }
+        strncpy(client_token, token, MAX_SIZE_OF_CLIENT_TOKEN - 1);
+        client_token[MAX_SIZE_OF_CLIENT_TOKEN - 1] = '\0';
+        HAL_Free(token);
 
-    if (rc == QCLOUD_RET_SUCCESS) {
-        rc = _publish_to_template_upstream_topic(pTemplate, pParams->method, pJsonDoc);
+        rc = _set_template_json_type(pJsonDoc, sizeOfBuffer, pParams->method);
+        if (rc != QCLOUD_RET_SUCCESS)
+            IOT_FUNC_EXIT_RC(rc);
     }
 
-    if ((rc == QCLOUD_RET_SUCCESS) && (NULL != pParams->request_callback)) {
-        rc = _add_request_to_template_list(pTemplate, client_token, pParams);
+    // register before publish, the reply may be handled by the yield thread before publish returns
+    Request *request = NULL;
+    if (NULL != pParams->request_callback) {
+        rc = _add_request_to_template_list(pTemplate, client_token, pParams, &request);
+        if (rc != QCLOUD_RET_SUCCESS)
+            IOT_FUNC_EXIT_RC(rc);
+        // from the request to its reply, or timeout
+        IOT_TRACE_ASYNC_BEGIN("template", "request", IOT_Trace_Id(client_token));
     }
 
-    HAL_Free(client_token);
+    IOT_TRACE_BEGIN(t_publish);
+    rc = _publish_to_template_upstream_topic(pTemplate, pParams->method, pJsonDoc);
+    IOT_TRACE_END(t_publish, "template", "publish", rc);
+    if ((rc != QCLOUD_RET_SUCCESS) && (NULL != request)) {
+        _remove_request_from_template_list(pTemplate, request);
+        IOT_TRACE_ASYNC_END("template", "request", IOT_Trace_Id(client_token), rc);
+    }
 
     IOT_FUNC_EXIT_RC(rc);
 }
@@ -392,6 +444,13 @@ int send_template_request(Qcloud_IoT_Template *pTemplate, RequestParams *pParams
 static void _handle_control(Qcloud_IoT_Template *pTemplate, char *control_str)
 {
     IOT_FUNC_ENTRY;
+    if (NULL != pTemplate->codec) {
+        uint32_t changed_mask = pTemplate->codec->decode(pTemplate->codec_data, control_str, strlen(control_str));
+        if (changed_mask && NULL != pTemplate->codec_callback) {
+            pTemplate->codec_callback(pTemplate, changed_mask, pTemplate->codec_data);
+        }
+    }
+
     if (pTemplate->inner_data.property_handle_list->len) {
         ListIterator *   iter;
         ListNode *       node            = NULL;
@@ -432,7 +491,7 @@ static void _handle_control(Qcloud_IoT_Template *pTemplate, char *control_str)
 }
 
 static void _handle_template_reply_callback(Qcloud_IoT_Template *pTemplate, ListNode **node, List *list,
-                                            const char *pClientToken, const char *pType)
+                                            const char *pClientToken, const char *pType, char *pJsonDoc)
 {
     IOT_FUNC_ENTRY;
 
@@ -446,7 +505,10 @@ static void _handle_template_reply_callback(Qcloud_IoT_Template *pTemplate, List
         // check operation success or not according to code field of reply message
         int32_t reply_code = 0;
 
-        bool parse_success = parse_code_return(sg_template_cloud_rcv_buf, &reply_code);
+        bool parse_success = parse_code_return(pJsonDoc, &reply_code);
+        IOT_TRACE_ASYNC_END("template", "request", IOT_Trace_Id(request->client_token),
+                            parse_success ? reply_code : QCLOUD_ERR_JSON_PARSE);
+        IOT_TRACE_BEGIN(t_reply);
         if (parse_success) {
             if (reply_code == 0) {
                 status = ACK_ACCEPTED;
@@ -456,9 +518,9 @@ static void _handle_template_reply_callback(Qcloud_IoT_Template *pTemplate, List
 
             if (strcmp(pType, GET_STATUS_REPLY) == 0 && status == ACK_ACCEPTED) {
                 char *control_str = NULL;
-                if (parse_template_get_control(sg_template_cloud_rcv_buf, &control_str)) {
+                if (parse_template_get_control(pJsonDoc, &control_str)) {
                     Log_d("control data from get_status_reply");
-                    _set_control_clientToken(pClientToken);
+                    _set_control_clientToken(pTemplate, pClientToken);
                     _handle_control(pTemplate, control_str);
                     HAL_Free(control_str);
                     *((ReplyAck *)request->user_context) = ACK_ACCEPTED;  // prepare for clear_control
@@ -466,11 +528,16 @@ static void _handle_template_reply_callback(Qcloud_IoT_Template *pTemplate, List
             }
 
             if (request->callback != NULL) {
-                request->callback(pTemplate, request->method, status, sg_template_cloud_rcv_buf, request);
+                request->callback(pTemplate, request->method, status, pJsonDoc, request);
             }
         } else {
             Log_e("parse template operation result code failed.");
+            // still finish the request, a sync caller is waiting for it
+            if (request->callback != NULL) {
+                request->callback(pTemplate, request->method, ACK_REJECTED, pJsonDoc, request);
+            }
         }
+        IOT_TRACE_END(t_reply, "template", "reply", parse_success ? reply_code : QCLOUD_ERR_JSON_PARSE);
 
         list_remove(list, *node);
         *node = NULL;
@@ -500,25 +567,18 @@ static void _on_template_downstream_topic_handler(void *pClient, MQTTMessage *me
     char *client_token = NULL;
     char *type_str     = NULL;
 
-    if (message->payload_len > CLOUD_IOT_JSON_RX_BUF_LEN) {
-        Log_e("The length of the received message exceeds the specified length!");
-        goto End;
-    }
-
-    int cloud_rcv_len = min(CLOUD_IOT_JSON_RX_BUF_LEN - 1, message->payload_len);
-    memset(sg_template_cloud_rcv_buf, 0, sizeof(sg_template_cloud_rcv_buf));
-    memcpy(sg_template_cloud_rcv_buf, message->payload, cloud_rcv_len + 1);
-    sg_template_cloud_rcv_buf[cloud_rcv_len] = '\0';  // jsmn_parse relies on a string
-    Log_d("recv:%s", sg_template_cloud_rcv_buf);
+    // parsed in place, the client delivers payload terminated with '\0' for jsmn_parse
+    char *json_doc = (char *)message->payload;
+    Log_d("recv:%s", json_doc);
 
     // parse the message type from topic $thing/down/property
-    if (!parse_template_method_type(sg_template_cloud_rcv_buf, &type_str)) {
+    if (!parse_template_method_type(json_doc, &type_str)) {
         Log_e("Fail to parse method!");
         goto End;
     }
 
-    if (!parse_client_token(sg_template_cloud_rcv_buf, &client_token)) {
-        Log_e("Fail to parse client token! Json=%s", sg_template_cloud_rcv_buf);
+    if (!parse_client_token(json_doc, &client_token)) {
+        Log_e("Fail to parse client token! Json=%s", json_doc);
         goto End;
     }
 
@@ -526,10 +586,12 @@ static void _on_template_downstream_topic_handler(void *pClient, MQTTMessage *me
     if (!strcmp(type_str, CONTROL_CMD)) {
         HAL_MutexLock(template_client->mutex);
         char *control_str = NULL;
-        if (parse_template_cmd_control(sg_template_cloud_rcv_buf, &control_str)) {
+        if (parse_template_cmd_control(json_doc, &control_str)) {
             Log_d("control_str:%s", control_str);
-            _set_control_clientToken(client_token);
+            _set_control_clientToken(template_client, client_token);
+            IOT_TRACE_BEGIN(t_control);
             _handle_control(template_client, control_str);
+            IOT_TRACE_END(t_control, "template", "control", QCLOUD_RET_SUCCESS);
             HAL_Free(control_str);
         }
 
@@ -539,7 +601,7 @@ static void _on_template_downstream_topic_handler(void *pClient, MQTTMessage *me
 
     if (template_client != NULL)
         _traverse_template_list(template_client, template_client->inner_data.reply_list, client_token, type_str,
-                                _handle_template_reply_callback);
+                                json_doc, _handle_template_reply_callback);
 
 End:
     HAL_Free(type_str);
@@ -37,6 +37,9 @@ extern "C" {
 #include "qcloud_iot_import.h"
 #include "utils_param_check.h"
 
+#define IOT_HEAP_TAG IOT_HEAP_EVENT
+#include "utils_heap.h"
+
 /**
  * @brief iterator event list and call traverseHandle for each node
  */
@@ -211,12 +214,41 @@ static int _iot_event_json_init(void *handle, char *jsonBuffer, size_t sizeOfBuf
     return check_snprintf_return(rc_of_snprintf, sizeOfBuffer);
 }
 
+/* longest UTC timestamp in ms, 10 digits of second and 3 of ms */
+#define EVENT_TIMESTAMP_STR_LEN 16
+
+/**
+ * @brief event timestamp in ms, from the event if the user set it, or else
+ * from the synchronized system time, 0 if there is no accurate UTC time
+ */
+static void _event_timestamp_str(Qcloud_IoT_Template *pTemplate, sEvent *pEvent, char *buf, size_t len)
+{
+#ifdef SYSTEM_COMM
+    uint64_t time_ms;
+#endif
+
+    if (0 != pEvent->timestamp) {  // accurate UTC time is second,change to ms
+        HAL_Snprintf(buf, len, "%u000", (unsigned)pEvent->timestamp);
+        return;
+    }
+
+#ifdef SYSTEM_COMM
+    if (QCLOUD_RET_SUCCESS == IOT_Get_SysTime_Ms(pTemplate->mqtt, &time_ms)) {
+        HAL_Snprintf(buf, len, "%u%03u", (unsigned)(time_ms / 1000), (unsigned)(time_ms % 1000));
+        return;
+    }
+#endif
+
+    HAL_Snprintf(buf, len, "0");
+}
+
 static int _iot_construct_event_json(void *handle, char *jsonBuffer, size_t sizeOfBuffer, uint8_t event_count,
                                      sEvent *pEventArry[], OnEventReplyCallback replyCb, uint32_t reply_timeout_ms)
 {
     size_t               remain_size    = 0;
     int32_t              rc_of_snprintf = 0;
     uint8_t              i, j;
+    char                 timestamp[EVENT_TIMESTAMP_STR_LEN];
     Qcloud_IoT_Template *ptemplate = (Qcloud_IoT_Template *)handle;
 
     POINTER_SANITY_CHECK(ptemplate, QCLOUD_ERR_INVAL);
@@ -253,17 +285,11 @@ static int _iot_construct_event_json(void *handle, char *jsonBuffer, size_t size
                 return QCLOUD_ERR_INVAL;
             }
 
-            if (0 == pEvent->timestamp) {  // no accurate UTC time, set 0
-                rc_of_snprintf = HAL_Snprintf(jsonBuffer + strlen(jsonBuffer), remain_size,
-                                              "{\"eventId\":\"%s\", \"type\":\"%s\", "
-                                              "\"timestamp\":0, \"params\":{",
-                                              pEvent->event_name, pEvent->type);
-            } else {  // accurate UTC time is second,change to ms
-                rc_of_snprintf = HAL_Snprintf(jsonBuffer + strlen(jsonBuffer), remain_size,
-                                              "{\"eventId\":\"%s\", \"type\":\"%s\", "
-                                              "\"timestamp\":%u000, \"params\":{",
-                                              pEvent->event_name, pEvent->type, pEvent->timestamp);
-            }
+            _event_timestamp_str(ptemplate, pEvent, timestamp, sizeof(timestamp));
+            rc_of_snprintf = HAL_Snprintf(jsonBuffer + strlen(jsonBuffer), remain_size,
+                                          "{\"eventId\":\"%s\", \"type\":\"%s\", "
+                                          "\"timestamp\":%s, \"params\":{",
+                                          pEvent->event_name, pEvent->type, timestamp);
 
             rc = check_snprintf_return(rc_of_snprintf, remain_size);
             if (rc != QCLOUD_RET_SUCCESS) {
@@ -314,16 +340,10 @@ static int _iot_construct_event_json(void *handle, char *jsonBuffer, size_t size
 
     } else {  // single
         sEvent *pEvent = pEventArry[0];
-        if (0 == pEvent->timestamp) {  // no accurate UTC time, set 0
-            rc_of_snprintf = HAL_Snprintf(jsonBuffer + strlen(jsonBuffer), remain_size,
-                                          "\"eventId\":\"%s\", \"type\":\"%s\", \"timestamp\":0, \"params\":{",
-                                          pEvent->event_name, pEvent->type);
-        } else {  // accurate UTC time is second,change to ms
-            rc_of_snprintf = HAL_Snprintf(jsonBuffer + strlen(jsonBuffer), remain_size,
-                                          "\"eventId\":\"%s\", \"type\":\"%s\", "
-                                          "\"timestamp\":%u000, \"params\":{",
-                                          pEvent->event_name, pEvent->type, pEvent->timestamp);
-        }
+        _event_timestamp_str(ptemplate, pEvent, timestamp, sizeof(timestamp));
+        rc_of_snprintf = HAL_Snprintf(jsonBuffer + strlen(jsonBuffer), remain_size,
+                                      "\"eventId\":\"%s\", \"type\":\"%s\", \"timestamp\":%s, \"params\":{",
+                                      pEvent->event_name, pEvent->type, timestamp);
 
         rc = check_snprintf_return(rc_of_snprintf, remain_size);
         if (rc != QCLOUD_RET_SUCCESS) {
@@ -372,23 +392,16 @@ static int _iot_construct_event_json(void *handle, char *jsonBuffer, size_t size
 static int _publish_event_to_cloud(void *c, char *pJsonDoc)
 {
     IOT_FUNC_ENTRY;
-    int                  rc                             = QCLOUD_RET_SUCCESS;
-    char                 topic[MAX_SIZE_OF_CLOUD_TOPIC] = {0};
-    Qcloud_IoT_Template *pTemplate                      = (Qcloud_IoT_Template *)c;
-
-    int size = HAL_Snprintf(topic, MAX_SIZE_OF_CLOUD_TOPIC, "$thing/up/event/%s/%s", pTemplate->device_info.product_id,
-                            pTemplate->device_info.device_name);
-    if (size < 0 || size > sizeof(topic) - 1) {
-        Log_e("topic content length not enough! content size:%d  buf size:%d", size, (int)sizeof(topic));
-        return QCLOUD_ERR_FAILURE;
-    }
+    int                  rc        = QCLOUD_RET_SUCCESS;
+    Qcloud_IoT_Template *pTemplate = (Qcloud_IoT_Template *)c;
 
     PublishParams pubParams = DEFAULT_PUB_PARAMS;
     pubParams.qos           = QOS1;
     pubParams.payload_len   = strlen(pJsonDoc);
     pubParams.payload       = (char *)pJsonDoc;
+    pubParams.priority      = MQTT_PRIO_EVENT;
 
-    rc = IOT_MQTT_Publish(pTemplate->mqtt, topic, &pubParams);
+    rc = template_publish_upstream(pTemplate, MQTT_TOPIC_EVENT_UP, &pubParams);
 
     IOT_FUNC_EXIT_RC(rc);
 }
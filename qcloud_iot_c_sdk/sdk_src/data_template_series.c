@@ -0,0 +1,465 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub
+ available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file
+ except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software
+ distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ KIND,
+ * either express or implied. See the License for the specific language
+ governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "data_template_series.h"
+#include "data_template_client_json.h"
+#include "qcloud_iot_export.h"
+#include "qcloud_iot_import.h"
+#include "utils_param_check.h"
+
+#define IOT_HEAP_TAG IOT_HEAP_TEMPLATE
+#include "utils_heap.h"
+
+#ifdef PROPERTY_SERIES_ENABLED
+
+static void *_series_list_lock(Qcloud_IoT_Template *pTemplate)
+{
+    void *lock;
+
+    if (NULL == __atomic_load_n(&pTemplate->series_lock, __ATOMIC_ACQUIRE)) {
+        /* created with the first series, the loser of a creation race drops its own */
+        lock = HAL_MutexCreate();
+        if (NULL == lock) {
+            return NULL;
+        }
+        void *expected = NULL;
+        if (!__atomic_compare_exchange_n(&pTemplate->series_lock, &expected, lock, false, __ATOMIC_ACQ_REL,
+                                         __ATOMIC_ACQUIRE)) {
+            HAL_MutexDestroy(lock);
+        }
+    }
+
+    return pTemplate->series_lock;
+}
+
+static inline SeriesPoint *_series_point(TemplateSeries *series, uint16_t i)
+{
+    return &series->points[(series->head + i) % series->params.capacity];
+}
+
+static inline float _series_abs(float v)
+{
+    return v < 0 ? -v : v;
+}
+
+/**
+ * @brief UTC time in ms of a local time, 0 if there is no synchronized UTC time
+ */
+static uint64_t _series_utc_ms(Qcloud_IoT_Template *pTemplate, uint32_t local_ms)
+{
+#ifdef SYSTEM_COMM
+    uint64_t now_ms;
+
+    if (QCLOUD_RET_SUCCESS == IOT_Get_SysTime_Ms(pTemplate->mqtt, &now_ms)) {
+        return now_ms - (uint32_t)(HAL_GetTimeMs() - local_ms);
+    }
+#endif
+
+    return 0;
+}
+
+static int _series_append(char *buf, size_t size, size_t *len, const char *fmt, ...)
+{
+    va_list args;
+    int     rc;
+
+    if (*len >= size) {
+        return QCLOUD_ERR_JSON_BUFFER_TOO_SMALL;
+    }
+
+    va_start(args, fmt);
+    rc = HAL_Vsnprintf(buf + *len, size - *len, fmt, args);
+    va_end(args);
+    if (rc < 0 || (size_t)rc >= size - *len) {
+        return QCLOUD_ERR_JSON_BUFFER_TOO_SMALL;
+    }
+    *len += rc;
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+/* "name":[v0,v1,...] of a field of the buffered points */
+static int _series_append_array(TemplateSeries *series, size_t *len, const char *name, size_t offset)
+{
+    size_t   size = series->json_buf_len;
+    char *   buf  = series->json_buf;
+    uint16_t i;
+    int      rc;
+
+    rc = _series_append(buf, size, len, ",\"%s\":[", name);
+    for (i = 0; i < series->count && QCLOUD_RET_SUCCESS == rc; i++) {
+        rc = _series_append(buf, size, len, i ? ",%g" : "%g",
+                            (double)*(float *)((char *)_series_point(series, i) + offset));
+    }
+    if (QCLOUD_RET_SUCCESS == rc) {
+        rc = _series_append(buf, size, len, "]");
+    }
+
+    return rc;
+}
+
+/**
+ * @brief build the batch report in json_buf:
+ * {"method":"report","clientToken":"...","params":{"key":{"t":..,"dt":[..],"v":[..]}}}
+ */
+static int _series_build_report(Qcloud_IoT_Template *pTemplate, TemplateSeries *series)
+{
+    char *   buf  = series->json_buf;
+    size_t   size = series->json_buf_len;
+    size_t   len;
+    uint64_t utc_ms;
+    uint32_t prev;
+    uint16_t i;
+    int      rc;
+
+    rc = build_template_json_header(&(pTemplate->inner_data.token_num), buf, size, REPORT,
+                                    pTemplate->device_info.product_id);
+    if (rc != QCLOUD_RET_SUCCESS) {
+        return rc;
+    }
+    len = strlen(buf);
+
+    utc_ms = _series_utc_ms(pTemplate, _series_point(series, 0)->time_ms);
+    rc     = _series_append(buf, size, &len, ",\"params\":{\"%s\":{\"t\":", series->params.key);
+    if (QCLOUD_RET_SUCCESS == rc) {
+        rc = utc_ms ? _series_append(buf, size, &len, "%u%03u", (unsigned)(utc_ms / 1000), (unsigned)(utc_ms % 1000))
+                    : _series_append(buf, size, &len, "0");
+    }
+
+    if (QCLOUD_RET_SUCCESS == rc) {
+        rc = _series_append(buf, size, &len, ",\"dt\":[");
+    }
+    prev = _series_point(series, 0)->time_ms;
+    for (i = 0; i < series->count && QCLOUD_RET_SUCCESS == rc; i++) {
+        rc   = _series_append(buf, size, &len, i ? ",%u" : "%u", (unsigned)(_series_point(series, i)->time_ms - prev));
+        prev = _series_point(series, i)->time_ms;
+    }
+    if (QCLOUD_RET_SUCCESS == rc) {
+        rc = _series_append(buf, size, &len, "]");
+    }
+
+    if (series->params.downsample > 1) {
+        if (QCLOUD_RET_SUCCESS == rc) {
+            rc = _series_append_array(series, &len, "min", offsetof(SeriesPoint, min));
+        }
+        if (QCLOUD_RET_SUCCESS == rc) {
+            rc = _series_append_array(series, &len, "max", offsetof(SeriesPoint, max));
+        }
+        if (QCLOUD_RET_SUCCESS == rc) {
+            rc = _series_append_array(series, &len, "avg", offsetof(SeriesPoint, avg));
+        }
+    } else if (QCLOUD_RET_SUCCESS == rc) {
+        rc = _series_append_array(series, &len, "v", offsetof(SeriesPoint, avg));
+    }
+
+    if (QCLOUD_RET_SUCCESS == rc) {
+        rc = _series_append(buf, size, &len, "}}}");
+    }
+
+    return rc;
+}
+
+/* close the downsampling bucket into a point, the oldest point is dropped if the ring is full */
+static void _series_push_bucket(TemplateSeries *series)
+{
+    if (0 == series->bucket_count) {
+        return;
+    }
+
+    series->bucket.avg = series->bucket_sum / series->bucket_count;
+    if (series->count == series->params.capacity) {
+        series->head = (series->head + 1) % series->params.capacity;
+        series->count--;
+        series->dropped++;
+    }
+    *_series_point(series, series->count) = series->bucket;
+    series->count++;
+    series->bucket_count = 0;
+}
+
+/* called with the series locked */
+static int _series_flush(Qcloud_IoT_Template *pTemplate, TemplateSeries *series)
+{
+    RequestParams request_params = DEFAULT_REQUEST_PARAMS;
+    int           rc;
+
+    series->flush_pending = false;
+    _series_push_bucket(series);
+    if (0 == series->count) {
+        return QCLOUD_RET_SUCCESS;
+    }
+
+    if (series->dropped) {
+        Log_w("series %s dropped %u points not reported", series->params.key, (unsigned)series->dropped);
+        series->dropped = 0;
+    }
+
+    rc = _series_build_report(pTemplate, series);
+    if (rc != QCLOUD_RET_SUCCESS) {
+        Log_e("series %s build report failed: %d", series->params.key, rc);
+        return rc;
+    }
+
+    /* the batch is not resent, so its reply is not waited for */
+    request_params.method      = REPORT;
+    request_params.timeout_sec = SERIES_REPORT_TIMEOUT_MS / 1000;
+    rc = send_template_request(pTemplate, &request_params, series->json_buf, series->json_buf_len);
+    if (rc != QCLOUD_RET_SUCCESS) {
+        Log_e("series %s report %u points failed: %d", series->params.key, (unsigned)series->count, rc);
+        return rc;
+    }
+
+    series->last_reported = _series_point(series, series->count - 1)->avg;
+    series->has_reported  = true;
+    series->head          = 0;
+    series->count         = 0;
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+int IOT_Template_Series_Create(void *handle, const SeriesInitParams *pParams, void **pSeries)
+{
+    IOT_FUNC_ENTRY;
+
+    POINTER_SANITY_CHECK(handle, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(pParams, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(pParams->key, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(pSeries, QCLOUD_ERR_INVAL);
+    NUMBERIC_SANITY_CHECK(pParams->capacity, QCLOUD_ERR_INVAL);
+
+    Qcloud_IoT_Template *pTemplate = (Qcloud_IoT_Template *)handle;
+    TemplateSeries *     series;
+    void *               list_lock;
+    size_t               key_len = strlen(pParams->key);
+    size_t               json_buf_len;
+    char *               key;
+
+    /* a batch that can not be published would fail every flush and keep the ring full */
+    json_buf_len = SERIES_JSON_HEADER_LEN + key_len +
+                   (size_t)pParams->capacity *
+                       (pParams->downsample > 1 ? SERIES_JSON_DOWN_POINT_LEN : SERIES_JSON_RAW_POINT_LEN);
+    if (json_buf_len + SERIES_MQTT_OVERHEAD_LEN > QCLOUD_IOT_MQTT_TX_BUF_LEN) {
+        Log_e("capacity %u of series %s does not fit in the MQTT write buffer", pParams->capacity, pParams->key);
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_INVAL);
+    }
+
+    list_lock = _series_list_lock(pTemplate);
+    if (NULL == list_lock) {
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
+    }
+
+    series = (TemplateSeries *)HAL_Malloc(sizeof(TemplateSeries) + key_len + 1);
+    if (NULL == series) {
+        Log_e("malloc series %s failed", pParams->key);
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_MALLOC);
+    }
+    memset(series, 0, sizeof(TemplateSeries));
+    key = (char *)(series + 1);
+    memcpy(key, pParams->key, key_len + 1);
+    series->params     = *pParams;
+    series->params.key = key;
+
+    series->json_buf_len = json_buf_len;
+    series->points   = (SeriesPoint *)HAL_Malloc(sizeof(SeriesPoint) * pParams->capacity);
+    series->json_buf = (char *)HAL_Malloc(series->json_buf_len);
+    series->lock     = HAL_MutexCreate();
+    if (NULL == series->points || NULL == series->json_buf || NULL == series->lock) {
+        Log_e("init series %s failed", pParams->key);
+        HAL_Free(series->points);
+        HAL_Free(series->json_buf);
+        if (NULL != series->lock) {
+            HAL_MutexDestroy(series->lock);
+        }
+        HAL_Free(series);
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_MALLOC);
+    }
+
+    HAL_MutexLock(list_lock);
+    series->next           = pTemplate->series_list;
+    pTemplate->series_list = series;
+    HAL_MutexUnlock(list_lock);
+
+    *pSeries = series;
+
+    IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
+}
+
+int IOT_Template_Series_Add(void *handle, void *series, float value)
+{
+    IOT_FUNC_ENTRY;
+
+    POINTER_SANITY_CHECK(handle, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(series, QCLOUD_ERR_INVAL);
+
+    Qcloud_IoT_Template *pTemplate = (Qcloud_IoT_Template *)handle;
+    TemplateSeries *     s         = (TemplateSeries *)series;
+    int                  rc        = QCLOUD_RET_SUCCESS;
+
+    HAL_MutexLock(s->lock);
+
+    if (0 == s->bucket_count) {
+        s->bucket.time_ms = HAL_GetTimeMs();
+        s->bucket.min     = value;
+        s->bucket.max     = value;
+        s->bucket_sum     = 0;
+    } else if (value < s->bucket.min) {
+        s->bucket.min = value;
+    } else if (value > s->bucket.max) {
+        s->bucket.max = value;
+    }
+    s->bucket_sum += value;
+    s->bucket_count++;
+
+    if (s->params.change_threshold > 0 &&
+        (!s->has_reported || _series_abs(value - s->last_reported) >= s->params.change_threshold)) {
+        s->flush_pending = true;
+    }
+
+    if (s->bucket_count >= s->params.downsample) {
+        /* flush before the push would drop the oldest point */
+        if (s->count == s->params.capacity) {
+            rc = _series_flush(pTemplate, s);
+        } else {
+            _series_push_bucket(s);
+            if (s->count == s->params.capacity || s->flush_pending) {
+                rc = _series_flush(pTemplate, s);
+            }
+        }
+    }
+
+    HAL_MutexUnlock(s->lock);
+
+    IOT_FUNC_EXIT_RC(rc);
+}
+
+int IOT_Template_Series_Flush(void *handle, void *series)
+{
+    IOT_FUNC_ENTRY;
+
+    POINTER_SANITY_CHECK(handle, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(series, QCLOUD_ERR_INVAL);
+
+    TemplateSeries *s = (TemplateSeries *)series;
+    int             rc;
+
+    HAL_MutexLock(s->lock);
+    rc = _series_flush((Qcloud_IoT_Template *)handle, s);
+    HAL_MutexUnlock(s->lock);
+
+    IOT_FUNC_EXIT_RC(rc);
+}
+
+static void _series_free(TemplateSeries *series)
+{
+    HAL_MutexDestroy(series->lock);
+    HAL_Free(series->points);
+    HAL_Free(series->json_buf);
+    HAL_Free(series);
+}
+
+int IOT_Template_Series_Destroy(void *handle, void *series)
+{
+    IOT_FUNC_ENTRY;
+
+    POINTER_SANITY_CHECK(handle, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(series, QCLOUD_ERR_INVAL);
+
+    Qcloud_IoT_Template *pTemplate = (Qcloud_IoT_Template *)handle;
+    TemplateSeries **    pp;
+    bool                 found;
+
+    if (NULL == pTemplate->series_lock) {
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_INVAL);
+    }
+
+    HAL_MutexLock(pTemplate->series_lock);
+    for (pp = &pTemplate->series_list; NULL != *pp && *pp != series; pp = &(*pp)->next) {
+    }
+    found = NULL != *pp;
+    if (found) {
+        *pp = ((TemplateSeries *)series)->next;
+    }
+    HAL_MutexUnlock(pTemplate->series_lock);
+
+    if (!found) {
+        Log_e("series is not created by this client");
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_INVAL);
+    }
+
+    _series_free((TemplateSeries *)series);
+
+    IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
+}
+
+void handle_template_series(Qcloud_IoT_Template *pTemplate)
+{
+    TemplateSeries *series;
+    uint32_t        now;
+
+    if (NULL == pTemplate->series_lock) {
+        return;
+    }
+
+    HAL_MutexLock(pTemplate->series_lock);
+    for (series = pTemplate->series_list; NULL != series; series = series->next) {
+        if (0 == series->params.max_delay_ms || QCLOUD_RET_SUCCESS != HAL_MutexTryLock(series->lock)) {
+            continue;
+        }
+
+        now = HAL_GetTimeMs();
+        if ((series->count && now - _series_point(series, 0)->time_ms >= series->params.max_delay_ms) ||
+            (!series->count && series->bucket_count && now - series->bucket.time_ms >= series->params.max_delay_ms)) {
+            _series_flush(pTemplate, series);
+        }
+        HAL_MutexUnlock(series->lock);
+    }
+    HAL_MutexUnlock(pTemplate->series_lock);
+}
+
+void template_series_destroy_all(Qcloud_IoT_Template *pTemplate)
+{
+    TemplateSeries *series;
+
+    while (NULL != (series = pTemplate->series_list)) {
+        pTemplate->series_list = series->next;
+        _series_free(series);
+    }
+
+    if (NULL != pTemplate->series_lock) {
+        HAL_MutexDestroy(pTemplate->series_lock);
+        pTemplate->series_lock = NULL;
+    }
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
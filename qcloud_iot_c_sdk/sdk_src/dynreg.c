@@ -40,6 +40,9 @@ extern "C" {
 #include "utils_hmac.h"
 #include "utils_httpc.h"
 
+#define IOT_HEAP_TAG IOT_HEAP_HTTPC
+#include "utils_heap.h"
+
 #ifdef DEV_DYN_REG_ENABLED
 
 #define REG_URL_MAX_LEN             (128)
@@ -25,6 +25,9 @@
 #include "mqtt_client.h"
 #include "utils_param_check.h"
 
+#define IOT_HEAP_TAG IOT_HEAP_MQTT
+#include "utils_heap.h"
+
 #ifdef MULTITHREAD_ENABLED
 /**
  * gateway yield thread runner
@@ -66,7 +69,8 @@ int IOT_Gateway_Start_Yield_Thread(void *pClient)
     thread_params.thread_name      = "gateway_yield_thread";
     thread_params.user_arg         = pClient;
     thread_params.stack_size       = 4096;
-    thread_params.priority         = 1;
+    thread_params.priority_class   = THREAD_PRIO_NETWORK;
+    thread_params.core_mask        = QCLOUD_IOT_THREAD_CORE_MASK;
     pGateway->yield_thread_running = true;
 
     int rc = HAL_ThreadCreate(&thread_params);
@@ -161,6 +165,14 @@ void *IOT_Gateway_Construct(GatewayInitParam *init_param)
 
     memset(gateway, 0, sizeof(Gateway));
 
+    if (QCLOUD_RET_SUCCESS != iot_completion_init(&gateway->gateway_data.online.done) ||
+        QCLOUD_RET_SUCCESS != iot_completion_init(&gateway->gateway_data.offline.done)) {
+        Log_e("gateway completion init failed");
+        iot_completion_deinit(&gateway->gateway_data.online.done);
+        HAL_Free(gateway);
+        IOT_FUNC_EXIT_RC(NULL);
+    }
+
     /* replace user event handle */
     gateway->event_handle.h_fp    = init_param->init_param.event_handle.h_fp;
     gateway->event_handle.context = init_param->init_param.event_handle.context;
@@ -173,6 +185,8 @@ void *IOT_Gateway_Construct(GatewayInitParam *init_param)
     gateway->mqtt = IOT_MQTT_Construct(&init_param->init_param);
     if (NULL == gateway->mqtt) {
         Log_e("construct MQTT failed");
+        iot_completion_deinit(&gateway->gateway_data.online.done);
+        iot_completion_deinit(&gateway->gateway_data.offline.done);
         HAL_Free(gateway);
         IOT_FUNC_EXIT_RC(NULL);
     }
@@ -229,11 +243,14 @@ int IOT_Gateway_Subdev_Online(void *client, GatewayParam *param)
         }
     }
 
-    size = HAL_Snprintf(topic, MAX_SIZE_OF_CLOUD_TOPIC + 1, GATEWAY_TOPIC_OPERATION_FMT, param->product_id,
-                        param->device_name);
-    if (size < 0 || size > MAX_SIZE_OF_CLOUD_TOPIC) {
-        Log_e("buf size < topic length!");
-        IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
+    /* operation topic of the gateway itself is already in the MQTT client topic table */
+    if (!qcloud_iot_mqtt_topic_owned(gateway->mqtt, param->product_id, param->device_name)) {
+        size = HAL_Snprintf(topic, MAX_SIZE_OF_CLOUD_TOPIC + 1, GATEWAY_TOPIC_OPERATION_FMT, param->product_id,
+                            param->device_name);
+        if (size < 0 || size > MAX_SIZE_OF_CLOUD_TOPIC) {
+            Log_e("buf size < topic length!");
+            IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
+        }
     }
 
     size = HAL_Snprintf(payload, GATEWAY_PAYLOAD_BUFFER_LEN + 1, GATEWAY_PAYLOAD_STATUS_FMT, "online",
@@ -256,7 +273,7 @@ int IOT_Gateway_Subdev_Online(void *client, GatewayParam *param)
     params.payload     = (char *)payload;
 
     /* publish packet */
-    rc = gateway_publish_sync(gateway, topic, &params, &gateway->gateway_data.online.result);
+    rc = gateway_publish_sync(gateway, topic[0] ? topic : NULL, &params, &gateway->gateway_data.online);
     if (QCLOUD_RET_SUCCESS != rc) {
         subdev_remove_session(gateway, param->subdev_product_id, param->subdev_device_name);
         IOT_FUNC_EXIT_RC(rc);
@@ -295,11 +312,14 @@ int IOT_Gateway_Subdev_Offline(void *client, GatewayParam *param)
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_GATEWAY_SUBDEV_OFFLINE);
     }
 
-    size = HAL_Snprintf(topic, MAX_SIZE_OF_CLOUD_TOPIC + 1, GATEWAY_TOPIC_OPERATION_FMT, param->product_id,
-                        param->device_name);
-    if (size < 0 || size > MAX_SIZE_OF_CLOUD_TOPIC) {
-        Log_e("buf size < topic length!");
-        IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
+    /* operation topic of the gateway itself is already in the MQTT client topic table */
+    if (!qcloud_iot_mqtt_topic_owned(gateway->mqtt, param->product_id, param->device_name)) {
+        size = HAL_Snprintf(topic, MAX_SIZE_OF_CLOUD_TOPIC + 1, GATEWAY_TOPIC_OPERATION_FMT, param->product_id,
+                            param->device_name);
+        if (size < 0 || size > MAX_SIZE_OF_CLOUD_TOPIC) {
+            Log_e("buf size < topic length!");
+            IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
+        }
     }
 
     size = HAL_Snprintf(payload, GATEWAY_PAYLOAD_BUFFER_LEN + 1, GATEWAY_PAYLOAD_STATUS_FMT, "offline",
@@ -323,7 +343,7 @@ int IOT_Gateway_Subdev_Offline(void *client, GatewayParam *param)
     params.payload       = (char *)payload;
 
     /* publish packet */
-    rc = gateway_publish_sync(gateway, topic, &params, &gateway->gateway_data.offline.result);
+    rc = gateway_publish_sync(gateway, topic[0] ? topic : NULL, &params, &gateway->gateway_data.offline);
     if (QCLOUD_RET_SUCCESS != rc) {
         IOT_FUNC_EXIT_RC(rc);
     }
@@ -357,7 +377,13 @@ int IOT_Gateway_Destroy(void *client)
         HAL_Free(session);
     }
 
+#ifdef GATEWAY_SUBDEV_OTA
+    gateway_ota_deinit(gateway);
+#endif
+
     IOT_MQTT_Destroy(&gateway->mqtt);
+    iot_completion_deinit(&gateway->gateway_data.online.done);
+    iot_completion_deinit(&gateway->gateway_data.offline.done);
     HAL_Free(client);
 
     IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS)
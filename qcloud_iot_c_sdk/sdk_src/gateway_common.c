@@ -24,7 +24,8 @@
 #include "lite-utils.h"
 #include "mqtt_client.h"
 
-static char cloud_rcv_buf[GATEWAY_RECEIVE_BUFFER_LEN];
+#define IOT_HEAP_TAG IOT_HEAP_MQTT
+#include "utils_heap.h"
 
 static bool get_json_type(char *json, char **v)
 {
@@ -70,7 +71,7 @@ static void _gateway_message_handler(void *client, MQTTMessage *message, void *u
     Gateway *          gateway       = NULL;
     char *             topic         = NULL;
     size_t             topic_len     = 0;
-    int                cloud_rcv_len = 0;
+    char *             cloud_rcv_buf = NULL;
     char *             type          = NULL;
     char *             devices = NULL, *devices_strip = NULL;
     char *             product_id                           = NULL;
@@ -93,15 +94,8 @@ static void _gateway_message_handler(void *client, MQTTMessage *message, void *u
         return;
     }
 
-    if (message->payload_len > GATEWAY_RECEIVE_BUFFER_LEN) {
-        Log_e("message->payload_len > GATEWAY_RECEIVE_BUFFER_LEN.");
-        return;
-    }
-
-    cloud_rcv_len = Min(GATEWAY_RECEIVE_BUFFER_LEN - 1, message->payload_len);
-    memcpy(cloud_rcv_buf, message->payload, cloud_rcv_len + 1);
-    cloud_rcv_buf[cloud_rcv_len] = '\0';  // jsmn_parse relies on a string
-                                          //      Log_d("recv:%s", cloud_rcv_buf);
+    // payload is terminated by '\0', parsed in place so gateways do not share a buffer
+    cloud_rcv_buf = (char *)message->payload;
 
     if (!get_json_type(cloud_rcv_buf, &type)) {
         Log_e("Fail to parse type from msg: %s", cloud_rcv_buf);
@@ -154,11 +148,13 @@ static void _gateway_message_handler(void *client, MQTTMessage *message, void *u
         if (strncmp(client_id, gateway->gateway_data.online.client_id, size) == 0) {
             Log_i("client_id(%s), online result %d", client_id, result);
             gateway->gateway_data.online.result = result;
+            iot_completion_complete(&gateway->gateway_data.online.done, result);
         }
     } else if (strncmp(type, "offline", sizeof("offline") - 1) == 0) {
         if (strncmp(client_id, gateway->gateway_data.offline.client_id, size) == 0) {
             Log_i("client_id(%s), offline result %d", client_id, result);
             gateway->gateway_data.offline.result = result;
+            iot_completion_complete(&gateway->gateway_data.offline.done, result);
         }
     }
 
@@ -326,39 +322,45 @@ int subdev_remove_session(Gateway *gateway, char *product_id, char *device_name)
     IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
 }
 
-int gateway_publish_sync(Gateway *gateway, char *topic, PublishParams *params, int32_t *result)
+int gateway_publish_sync(Gateway *gateway, char *topic, PublishParams *params, ReplyData *reply)
 {
-    int     rc         = 0;
-    int     loop_count = 0;
-    int32_t res        = *result;
+    int   rc = 0;
+    Timer timer;
 
     POINTER_SANITY_CHECK(gateway, QCLOUD_ERR_INVAL);
 
-    rc = IOT_Gateway_Publish(gateway, topic, params);
+    /* re-arm before publish, the reply may be handled by the yield thread before publish returns */
+    iot_completion_reset(&reply->done);
+
+    if (topic) {
+        rc = IOT_Gateway_Publish(gateway, topic, params);
+    } else {
+        rc = qcloud_iot_mqtt_publish_handle(gateway->mqtt, MQTT_TOPIC_GATEWAY_OPERATION, params);
+    }
     if (rc < 0) {
         Log_e("publish fail.");
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
     }
 
     /* wait for response */
-    while (res == *result) {
-        if (loop_count > GATEWAY_LOOP_MAX_COUNT) {
+    InitTimer(&timer);
+    countdown_ms(&timer, GATEWAY_LOOP_MAX_COUNT * GATEWAY_WAIT_SLICE_MS);
+    while (!iot_completion_is_done(&reply->done)) {
+        if (expired(&timer)) {
             Log_i("loop max count, time out.");
             IOT_FUNC_EXIT_RC(QCLOUD_ERR_GATEWAY_SESSION_TIMEOUT);
         }
-#ifdef MULTITHREAD_ENABLED		
-        if((gateway->yield_thread_running)){
-            HAL_SleepMs(200);
-        }else
-#endif        
-        {
-            IOT_Gateway_Yield(gateway, 200);
-		}
-        
-        loop_count++;
+#ifdef MULTITHREAD_ENABLED
+        if (gateway->yield_thread_running) {
+            /* woken by the yield thread as soon as the result is handled */
+            iot_completion_wait(&reply->done, GATEWAY_WAIT_SLICE_MS);
+            continue;
+        }
+#endif
+        IOT_Gateway_Yield(gateway, GATEWAY_YIELD_SLICE_MS);
     }
 
-    if (*result != 0) {
+    if (reply->done.result != 0) {
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
     }
     IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
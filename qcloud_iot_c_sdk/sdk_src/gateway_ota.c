@@ -0,0 +1,716 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub
+ available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file
+ except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software
+ distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ KIND,
+ * either express or implied. See the License for the specific language
+ governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "gateway_common.h"
+#include "mqtt_client.h"
+#include "ota_client.h"
+#include "ota_fetch.h"
+#include "ota_lib.h"
+#include "utils_param_check.h"
+#include "utils_timer.h"
+
+#define IOT_HEAP_TAG IOT_HEAP_OTA
+#include "utils_heap.h"
+
+#ifdef GATEWAY_SUBDEV_OTA
+
+#define GATEWAY_OTA_VERSION_LEN        (32)
+#define GATEWAY_OTA_MD5_LEN            (32)
+#define GATEWAY_OTA_MSG_LEN            (256)
+#define GATEWAY_OTA_FETCH_BUF_LEN      (2048)
+#define GATEWAY_OTA_FETCH_TIMEOUT_S    (5)
+#define GATEWAY_OTA_REPORT_INTERVAL_MS (1000)
+
+/* firmware shared by the sub-devices updated to the same image */
+typedef enum {
+    SUBDEV_FIRMWARE_PENDING,   // not looked up in the cache yet
+    SUBDEV_FIRMWARE_FETCHING,  // being downloaded into the cache
+    SUBDEV_FIRMWARE_CACHED,    // in the cache, fanned out to the sub-devices
+} SubdevFirmwareState;
+
+typedef struct _SubdevFirmware {
+    char                product_id[MAX_SIZE_OF_PRODUCT_ID + 1];
+    char                version[GATEWAY_OTA_VERSION_LEN + 1];
+    char                md5sum[GATEWAY_OTA_MD5_LEN + 1];
+    char *              url;
+    uint32_t            size;
+    uint32_t            size_fetched;
+    SubdevFirmwareState state;
+    uint16_t            refs;   // sub-devices waiting for or upgrading to it
+    void *              fetch;  // download channel, only touched by IOT_Gateway_Subdev_OTA_Process
+    void *              md5;
+
+    struct _SubdevFirmware *next;
+} SubdevFirmware;
+
+typedef enum {
+    SUBDEV_OTA_IDLE,
+    SUBDEV_OTA_WAITING,    // waiting for the firmware in the cache
+    SUBDEV_OTA_UPGRADING,  // upgrading over the local link
+} SubdevOTAState;
+
+typedef struct _SubdevOTA {
+    char            product_id[MAX_SIZE_OF_PRODUCT_ID + 1];
+    char            device_name[MAX_SIZE_OF_DEVICE_NAME + 1];
+    char            version[GATEWAY_OTA_VERSION_LEN + 1];  // version running on the sub-device
+    char            topic_update[OTA_MAX_TOPIC_LEN];
+    SubdevOTAState  state;
+    SubdevFirmware *firmware;
+
+    /* latest report not sent yet, progress reports in between are coalesced */
+    bool              report_pending;
+    IOT_OTAReportType report_type;
+    int               report_progress;
+    char              report_version[GATEWAY_OTA_VERSION_LEN + 1];
+
+    struct _SubdevOTA *next;
+} SubdevOTA;
+
+typedef struct _GatewayOTA {
+    void *                 lock;
+    GatewaySubdevOTAParams params;
+    SubdevOTA *            subdevs;
+    SubdevFirmware *       firmwares;
+    char *                 fetch_buf;
+    Timer                  report_timer;
+} GatewayOTA;
+
+static SubdevOTA *_subdev_ota_find(GatewayOTA *ota, const char *product_id, const char *device_name)
+{
+    SubdevOTA *subdev;
+
+    for (subdev = ota->subdevs; NULL != subdev; subdev = subdev->next) {
+        if (!strcmp(subdev->product_id, product_id) && !strcmp(subdev->device_name, device_name)) {
+            return subdev;
+        }
+    }
+
+    return NULL;
+}
+
+/* called with the lock held, queue a report replacing the one not sent yet */
+static void _subdev_ota_queue_report(SubdevOTA *subdev, IOT_OTAReportType type, int progress, const char *version)
+{
+    subdev->report_pending  = true;
+    subdev->report_type     = type;
+    subdev->report_progress = progress;
+    HAL_Snprintf(subdev->report_version, sizeof(subdev->report_version), "%s", version);
+}
+
+/* called with the lock held, the firmware is freed by IOT_Gateway_Subdev_OTA_Process once unreferenced */
+static void _subdev_ota_detach(SubdevOTA *subdev)
+{
+    if (NULL != subdev->firmware) {
+        subdev->firmware->refs--;
+        subdev->firmware = NULL;
+    }
+    subdev->state = SUBDEV_OTA_IDLE;
+}
+
+/* called with the lock held, end the OTA of all the sub-devices waiting for a firmware */
+static void _subdev_ota_fail_waiting(GatewayOTA *ota, SubdevFirmware *firmware, IOT_OTAReportType type)
+{
+    SubdevOTA *subdev;
+
+    for (subdev = ota->subdevs; NULL != subdev; subdev = subdev->next) {
+        if (subdev->firmware == firmware && SUBDEV_OTA_WAITING == subdev->state) {
+            _subdev_ota_queue_report(subdev, type, 0, firmware->version);
+            _subdev_ota_detach(subdev);
+        }
+    }
+}
+
+static int _subdev_ota_publish(void *mqtt, const char *product_id, const char *device_name, const char *msg, QoS qos)
+{
+    char          topic[OTA_MAX_TOPIC_LEN];
+    PublishParams pub_params = DEFAULT_PUB_PARAMS;
+    int           size;
+
+    size = HAL_Snprintf(topic, OTA_MAX_TOPIC_LEN, "$ota/report/%s/%s", product_id, device_name);
+    if (size < 0 || size >= OTA_MAX_TOPIC_LEN) {
+        Log_e("buf size < topic length!");
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    pub_params.qos         = qos;
+    pub_params.payload     = (void *)msg;
+    pub_params.payload_len = strlen(msg);
+
+    return IOT_MQTT_Publish(mqtt, topic, &pub_params);
+}
+
+/* find the firmware of an update, so sub-devices updated to the same image share one download */
+static SubdevFirmware *_subdev_firmware_get(GatewayOTA *ota, const char *product_id, const char *version,
+                                            const char *md5sum, char **url, uint32_t size)
+{
+    SubdevFirmware *firmware;
+    size_t          product_id_len = strlen(product_id), version_len = strlen(version), md5sum_len = strlen(md5sum);
+
+    if (product_id_len > MAX_SIZE_OF_PRODUCT_ID || version_len > GATEWAY_OTA_VERSION_LEN ||
+        md5sum_len > GATEWAY_OTA_MD5_LEN) {
+        Log_e("product id, version or md5sum is too long");
+        return NULL;
+    }
+
+    for (firmware = ota->firmwares; NULL != firmware; firmware = firmware->next) {
+        if (!strcmp(firmware->md5sum, md5sum) && !strcmp(firmware->version, version) &&
+            !strcmp(firmware->product_id, product_id)) {
+            return firmware;
+        }
+    }
+
+    firmware = (SubdevFirmware *)HAL_Malloc(sizeof(SubdevFirmware));
+    if (NULL == firmware) {
+        Log_e("malloc firmware failed");
+        return NULL;
+    }
+    memset(firmware, 0, sizeof(SubdevFirmware));
+    memcpy(firmware->product_id, product_id, product_id_len + 1);
+    memcpy(firmware->version, version, version_len + 1);
+    memcpy(firmware->md5sum, md5sum, md5sum_len + 1);
+    firmware->url   = *url;
+    firmware->size  = size;
+    firmware->state = SUBDEV_FIRMWARE_PENDING;
+    *url            = NULL;
+
+    firmware->next = ota->firmwares;
+    ota->firmwares = firmware;
+
+    return firmware;
+}
+
+static void _subdev_ota_update_cb(void *pClient, MQTTMessage *message, void *pUserData)
+{
+    GatewayOTA *ota    = (GatewayOTA *)pUserData;
+    SubdevOTA * subdev = NULL;
+    char *      type = NULL, *url = NULL, *version = NULL;
+    char        md5sum[GATEWAY_OTA_MD5_LEN + 1] = {0};
+    uint32_t    size                            = 0;
+    const char *msg                             = (const char *)message->payload;
+
+    Log_d("topic=%.*s, msg=%s", (int)message->topic_len, message->ptopic, msg);
+
+    if (QCLOUD_RET_SUCCESS != qcloud_otalib_get_firmware_type(msg, &type)) {
+        Log_e("Get firmware type failed!");
+        return;
+    }
+
+    if (!strcmp(type, REPORT_VERSION_RSP)) {
+        if (qcloud_otalib_get_report_version_result(msg) < QCLOUD_RET_SUCCESS) {
+            Log_e("sub-device report version failed: %.*s", (int)message->topic_len, message->ptopic);
+        }
+        goto End;
+    }
+
+    if (strcmp(type, UPDATE_FIRMWARE)) {
+        Log_e("Netheir Report version result nor update firmware! type: %s", type);
+        goto End;
+    }
+
+    HAL_Free(type);
+    type = NULL;
+    if (QCLOUD_RET_SUCCESS != qcloud_otalib_get_params(msg, &type, &url, &version, md5sum, &size)) {
+        Log_e("Get firmware parameter failed");
+        goto End;
+    }
+
+    HAL_MutexLock(ota->lock);
+    for (subdev = ota->subdevs; NULL != subdev; subdev = subdev->next) {
+        if (message->topic_len == strlen(subdev->topic_update) &&
+            !strncmp(subdev->topic_update, message->ptopic, message->topic_len)) {
+            break;
+        }
+    }
+
+    if (NULL != subdev) {
+        SubdevFirmware *firmware = _subdev_firmware_get(ota, subdev->product_id, version, md5sum, &url, size);
+
+        if (NULL == firmware) {
+            _subdev_ota_queue_report(subdev, IOT_OTAR_UPGRADE_FAIL, 0, version);
+        } else if (firmware != subdev->firmware) {
+            /* a newer update replaces the one not finished */
+            _subdev_ota_detach(subdev);
+            subdev->firmware = firmware;
+            subdev->state    = SUBDEV_OTA_WAITING;
+            firmware->refs++;
+            Log_i("sub-device %s/%s to update to %s", subdev->product_id, subdev->device_name, version);
+        }
+    }
+    HAL_MutexUnlock(ota->lock);
+
+End:
+    HAL_Free(type);
+    HAL_Free(url);
+    HAL_Free(version);
+}
+
+int IOT_Gateway_Subdev_OTA_Init(void *client, const GatewaySubdevOTAParams *params)
+{
+    Gateway *   gateway = (Gateway *)client;
+    GatewayOTA *ota;
+
+    POINTER_SANITY_CHECK(gateway, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(params, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(params->cache_lookup, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(params->cache_write, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(params->cache_commit, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(params->upgrade, QCLOUD_ERR_INVAL);
+
+    if (NULL != gateway->ota) {
+        Log_e("sub-device OTA is inited already");
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    ota = (GatewayOTA *)HAL_Malloc(sizeof(GatewayOTA));
+    if (NULL == ota) {
+        Log_e("malloc sub-device OTA failed");
+        return QCLOUD_ERR_MALLOC;
+    }
+    memset(ota, 0, sizeof(GatewayOTA));
+
+    ota->params = *params;
+    ota->lock   = HAL_MutexCreate();
+    if (NULL == ota->lock) {
+        HAL_Free(ota);
+        return QCLOUD_ERR_FAILURE;
+    }
+    InitTimer(&ota->report_timer);
+
+    gateway->ota = ota;
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+int IOT_Gateway_Subdev_OTA_Add(void *client, const char *product_id, const char *device_name, const char *version)
+{
+    Gateway *       gateway = (Gateway *)client;
+    GatewayOTA *    ota;
+    SubdevOTA *     subdev;
+    SubscribeParams sub_params = DEFAULT_SUB_PARAMS;
+    char            msg[GATEWAY_OTA_MSG_LEN];
+    int             rc, size;
+
+    POINTER_SANITY_CHECK(gateway, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(gateway->ota, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(product_id, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(device_name, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(version, QCLOUD_ERR_INVAL);
+
+    ota = (GatewayOTA *)gateway->ota;
+    if (strlen(product_id) > MAX_SIZE_OF_PRODUCT_ID || strlen(device_name) > MAX_SIZE_OF_DEVICE_NAME ||
+        strlen(version) > GATEWAY_OTA_VERSION_LEN) {
+        Log_e("product id, device name or version is too long");
+        return QCLOUD_ERR_INVAL;
+    }
+
+    HAL_MutexLock(ota->lock);
+    subdev = _subdev_ota_find(ota, product_id, device_name);
+    HAL_MutexUnlock(ota->lock);
+    if (NULL != subdev) {
+        Log_e("sub-device %s/%s is added already", product_id, device_name);
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    subdev = (SubdevOTA *)HAL_Malloc(sizeof(SubdevOTA));
+    if (NULL == subdev) {
+        Log_e("malloc sub-device OTA failed");
+        return QCLOUD_ERR_MALLOC;
+    }
+    memset(subdev, 0, sizeof(SubdevOTA));
+    strcpy(subdev->product_id, product_id);
+    strcpy(subdev->device_name, device_name);
+    strcpy(subdev->version, version);
+    size = HAL_Snprintf(subdev->topic_update, OTA_MAX_TOPIC_LEN, "$ota/update/%s/%s", product_id, device_name);
+    if (size < 0 || size >= OTA_MAX_TOPIC_LEN) {
+        Log_e("buf size < topic length!");
+        HAL_Free(subdev);
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    HAL_MutexLock(ota->lock);
+    subdev->next = ota->subdevs;
+    ota->subdevs = subdev;
+    HAL_MutexUnlock(ota->lock);
+
+    /* the update topic is matched to the sub-device in the callback, so a removed one is never touched */
+    sub_params.on_message_handler = _subdev_ota_update_cb;
+    sub_params.qos                = QOS1;
+    sub_params.user_data          = ota;
+
+    rc = IOT_MQTT_Subscribe(gateway->mqtt, subdev->topic_update, &sub_params);
+    if (rc < 0) {
+        Log_e("subscribe %s failed: %d", subdev->topic_update, rc);
+        IOT_Gateway_Subdev_OTA_Remove(client, product_id, device_name);
+        return rc;
+    }
+
+    /* the cloud pushes an update once it knows the version running */
+    rc = qcloud_otalib_gen_info_msg(msg, sizeof(msg), 0, version);
+    if (QCLOUD_RET_SUCCESS == rc) {
+        rc = _subdev_ota_publish(gateway->mqtt, product_id, device_name, msg, QOS1);
+    }
+    if (rc < 0) {
+        Log_e("sub-device %s/%s report version failed: %d", product_id, device_name, rc);
+        return rc;
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+int IOT_Gateway_Subdev_OTA_Remove(void *client, const char *product_id, const char *device_name)
+{
+    Gateway *   gateway = (Gateway *)client;
+    GatewayOTA *ota;
+    SubdevOTA **pp, *subdev = NULL;
+
+    POINTER_SANITY_CHECK(gateway, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(gateway->ota, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(product_id, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(device_name, QCLOUD_ERR_INVAL);
+
+    ota = (GatewayOTA *)gateway->ota;
+
+    HAL_MutexLock(ota->lock);
+    for (pp = &ota->subdevs; NULL != *pp; pp = &(*pp)->next) {
+        if (!strcmp((*pp)->product_id, product_id) && !strcmp((*pp)->device_name, device_name)) {
+            subdev = *pp;
+            *pp    = subdev->next;
+            _subdev_ota_detach(subdev);
+            break;
+        }
+    }
+    HAL_MutexUnlock(ota->lock);
+
+    if (NULL == subdev) {
+        return QCLOUD_ERR_GATEWAY_SESSION_NO_EXIST;
+    }
+
+    IOT_MQTT_Unsubscribe(gateway->mqtt, subdev->topic_update);
+    HAL_Free(subdev);
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+int IOT_Gateway_Subdev_OTA_Report(void *client, const char *product_id, const char *device_name,
+                                  IOT_OTAReportType type, int progress)
+{
+    Gateway *   gateway = (Gateway *)client;
+    GatewayOTA *ota;
+    SubdevOTA * subdev;
+
+    POINTER_SANITY_CHECK(gateway, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(gateway->ota, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(product_id, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(device_name, QCLOUD_ERR_INVAL);
+
+    ota = (GatewayOTA *)gateway->ota;
+
+    HAL_MutexLock(ota->lock);
+    subdev = _subdev_ota_find(ota, product_id, device_name);
+    if (NULL == subdev || NULL == subdev->firmware) {
+        HAL_MutexUnlock(ota->lock);
+        Log_e("sub-device %s/%s is not upgrading", product_id, device_name);
+        return QCLOUD_ERR_INVAL;
+    }
+
+    _subdev_ota_queue_report(subdev, type, progress, subdev->firmware->version);
+    if (IOT_OTAR_UPGRADE_SUCCESS == type) {
+        strcpy(subdev->version, subdev->firmware->version);
+        _subdev_ota_detach(subdev);
+    } else if (type < IOT_OTAR_NONE) {
+        _subdev_ota_detach(subdev);
+    }
+    HAL_MutexUnlock(ota->lock);
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+/* send the queued reports, one message on the report topic of each sub-device */
+static void _subdev_ota_flush_reports(Gateway *gateway, GatewayOTA *ota)
+{
+    char       msg[GATEWAY_OTA_MSG_LEN];
+    SubdevOTA *subdev;
+    int        rc, sent = 0;
+
+    /* QoS0 publish does not wait for the yield thread, so it is safe with the lock held */
+    HAL_MutexLock(ota->lock);
+    for (subdev = ota->subdevs; NULL != subdev; subdev = subdev->next) {
+        if (!subdev->report_pending) {
+            continue;
+        }
+        subdev->report_pending = false;
+
+        rc = qcloud_otalib_gen_report_msg(msg, sizeof(msg), 0, subdev->report_version, subdev->report_progress,
+                                          subdev->report_type);
+        if (QCLOUD_RET_SUCCESS == rc) {
+            rc = _subdev_ota_publish(gateway->mqtt, subdev->product_id, subdev->device_name, msg, QOS0);
+        }
+        if (rc < 0) {
+            Log_e("report of %s/%s failed: %d", subdev->product_id, subdev->device_name, rc);
+        } else {
+            sent++;
+        }
+    }
+    HAL_MutexUnlock(ota->lock);
+
+    if (sent) {
+        Log_d("sent %d sub-device OTA reports", sent);
+    }
+}
+
+static void _subdev_firmware_free(SubdevFirmware *firmware)
+{
+    qcloud_ofc_deinit(firmware->fetch);
+    qcloud_otalib_md5_deinit(firmware->md5);
+    HAL_Free(firmware->url);
+    HAL_Free(firmware);
+}
+
+/* download a chunk of the firmware into the cache */
+static void _subdev_firmware_fetch(GatewayOTA *ota, SubdevFirmware *firmware)
+{
+    IOT_OTAReportType fail_type = IOT_OTAR_NONE;
+    char              md5_str[GATEWAY_OTA_MD5_LEN + 1];
+    SubdevOTA *       subdev;
+    uint32_t          percent;
+    int               rc;
+
+    if (NULL == firmware->fetch) {
+        firmware->md5   = qcloud_otalib_md5_init();
+        firmware->fetch = ofc_Init(firmware->url, 0, firmware->size);
+        if (NULL == firmware->md5 || NULL == firmware->fetch ||
+            QCLOUD_RET_SUCCESS != qcloud_ofc_connect(firmware->fetch)) {
+            Log_e("start to download firmware %s failed", firmware->version);
+            fail_type = IOT_OTAR_DOWNLOAD_TIMEOUT;
+            goto End;
+        }
+        Log_i("download firmware %s of %s, %u bytes", firmware->version, firmware->product_id,
+              (unsigned)firmware->size);
+    }
+
+    rc = qcloud_ofc_fetch(firmware->fetch, ota->fetch_buf, GATEWAY_OTA_FETCH_BUF_LEN, GATEWAY_OTA_FETCH_TIMEOUT_S);
+    if (rc < 0) {
+        Log_e("download firmware %s failed: %d", firmware->version, rc);
+        fail_type = (IOT_OTA_ERR_FETCH_AUTH_FAIL == rc)
+                        ? IOT_OTAR_AUTH_FAIL
+                        : (IOT_OTA_ERR_FETCH_NOT_EXIST == rc) ? IOT_OTAR_FILE_NOT_EXIST : IOT_OTAR_DOWNLOAD_TIMEOUT;
+        goto End;
+    }
+
+    if (rc > 0) {
+        if (QCLOUD_RET_SUCCESS !=
+            ota->params.cache_write(ota->params.context, firmware->md5sum, firmware->size_fetched, ota->fetch_buf, rc)) {
+            Log_e("write firmware %s into cache failed", firmware->version);
+            fail_type = IOT_OTAR_UPGRADE_FAIL;
+            goto End;
+        }
+        qcloud_otalib_md5_update(firmware->md5, ota->fetch_buf, rc);
+        firmware->size_fetched += rc;
+    }
+
+    percent = firmware->size ? (uint32_t)((uint64_t)firmware->size_fetched * 100 / firmware->size) : 100;
+    HAL_MutexLock(ota->lock);
+    for (subdev = ota->subdevs; NULL != subdev; subdev = subdev->next) {
+        if (subdev->firmware == firmware) {
+            _subdev_ota_queue_report(subdev, IOT_OTAR_DOWNLOADING, percent, firmware->version);
+        }
+    }
+    HAL_MutexUnlock(ota->lock);
+
+    if (firmware->size_fetched < firmware->size) {
+        return;
+    }
+
+    qcloud_otalib_md5_finalize(firmware->md5, md5_str);
+    if (strcmp(md5_str, firmware->md5sum)) {
+        Log_e("firmware %s md5 %s not match %s", firmware->version, md5_str, firmware->md5sum);
+        fail_type = IOT_OTAR_MD5_NOT_MATCH;
+        goto End;
+    }
+
+End:
+    qcloud_ofc_deinit(firmware->fetch);
+    firmware->fetch = NULL;
+    qcloud_otalib_md5_deinit(firmware->md5);
+    firmware->md5 = NULL;
+    ota->params.cache_commit(ota->params.context, firmware->md5sum, IOT_OTAR_NONE == fail_type);
+
+    HAL_MutexLock(ota->lock);
+    if (IOT_OTAR_NONE == fail_type) {
+        firmware->state = SUBDEV_FIRMWARE_CACHED;
+    } else {
+        /* dropped with its last sub-device, a new update push starts over */
+        _subdev_ota_fail_waiting(ota, firmware, fail_type);
+        firmware->state        = SUBDEV_FIRMWARE_PENDING;
+        firmware->size_fetched = 0;
+    }
+    HAL_MutexUnlock(ota->lock);
+}
+
+/* start the upgrade of the sub-devices waiting for a firmware in the cache */
+static void _subdev_firmware_fan_out(GatewayOTA *ota, SubdevFirmware *firmware)
+{
+    char       product_id[MAX_SIZE_OF_PRODUCT_ID + 1];
+    char       device_name[MAX_SIZE_OF_DEVICE_NAME + 1];
+    SubdevOTA *subdev;
+    int        rc;
+
+    for (;;) {
+        HAL_MutexLock(ota->lock);
+        for (subdev = ota->subdevs; NULL != subdev; subdev = subdev->next) {
+            if (subdev->firmware == firmware && SUBDEV_OTA_WAITING == subdev->state) {
+                break;
+            }
+        }
+        if (NULL == subdev) {
+            HAL_MutexUnlock(ota->lock);
+            return;
+        }
+        subdev->state = SUBDEV_OTA_UPGRADING;
+        strcpy(product_id, subdev->product_id);
+        strcpy(device_name, subdev->device_name);
+        HAL_MutexUnlock(ota->lock);
+
+        /* the callback may report from here, so it is called without the lock */
+        rc = ota->params.upgrade(ota->params.context, product_id, device_name, firmware->version, firmware->md5sum,
+                                 firmware->size);
+        if (QCLOUD_RET_SUCCESS != rc) {
+            Log_e("start to upgrade %s/%s failed: %d", product_id, device_name, rc);
+
+            HAL_MutexLock(ota->lock);
+            subdev = _subdev_ota_find(ota, product_id, device_name);
+            if (NULL != subdev && subdev->firmware == firmware) {
+                _subdev_ota_queue_report(subdev, IOT_OTAR_UPGRADE_FAIL, 0, firmware->version);
+                _subdev_ota_detach(subdev);
+            }
+            HAL_MutexUnlock(ota->lock);
+        }
+    }
+}
+
+int IOT_Gateway_Subdev_OTA_Process(void *client)
+{
+    Gateway *        gateway = (Gateway *)client;
+    GatewayOTA *     ota;
+    SubdevFirmware **pp, *firmware;
+
+    POINTER_SANITY_CHECK(gateway, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(gateway->ota, QCLOUD_ERR_INVAL);
+
+    ota = (GatewayOTA *)gateway->ota;
+
+    /* free the firmwares no sub-device waits for, the one being downloaded is dropped from the cache */
+    HAL_MutexLock(ota->lock);
+    for (pp = &ota->firmwares; NULL != (firmware = *pp);) {
+        if (firmware->refs) {
+            pp = &firmware->next;
+            continue;
+        }
+        *pp = firmware->next;
+        if (SUBDEV_FIRMWARE_FETCHING == firmware->state) {
+            ota->params.cache_commit(ota->params.context, firmware->md5sum, false);
+        }
+        _subdev_firmware_free(firmware);
+    }
+
+    for (firmware = ota->firmwares; NULL != firmware; firmware = firmware->next) {
+        if (SUBDEV_FIRMWARE_PENDING == firmware->state) {
+            firmware->state = ota->params.cache_lookup(ota->params.context, firmware->md5sum, firmware->size)
+                                  ? SUBDEV_FIRMWARE_CACHED
+                                  : SUBDEV_FIRMWARE_FETCHING;
+        }
+        if (SUBDEV_FIRMWARE_CACHED != firmware->state) {
+            break;
+        }
+    }
+    HAL_MutexUnlock(ota->lock);
+
+    /* one download at a time, the firmware is only freed by this function */
+    if (NULL != firmware) {
+        if (NULL == ota->fetch_buf && NULL == (ota->fetch_buf = HAL_Malloc(GATEWAY_OTA_FETCH_BUF_LEN))) {
+            Log_e("malloc fetch buffer failed");
+            return QCLOUD_ERR_MALLOC;
+        }
+        _subdev_firmware_fetch(ota, firmware);
+    } else if (NULL != ota->fetch_buf) {
+        HAL_Free(ota->fetch_buf);
+        ota->fetch_buf = NULL;
+    }
+
+    for (firmware = ota->firmwares; NULL != firmware; firmware = firmware->next) {
+        if (SUBDEV_FIRMWARE_CACHED == firmware->state) {
+            _subdev_firmware_fan_out(ota, firmware);
+        }
+    }
+
+    if (expired(&ota->report_timer)) {
+        _subdev_ota_flush_reports(gateway, ota);
+        countdown_ms(&ota->report_timer, GATEWAY_OTA_REPORT_INTERVAL_MS);
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+void gateway_ota_deinit(Gateway *gateway)
+{
+    GatewayOTA *    ota = (GatewayOTA *)gateway->ota;
+    SubdevOTA *     subdev;
+    SubdevFirmware *firmware;
+
+    if (NULL == ota) {
+        return;
+    }
+
+    /* remove the handlers first, they take ota and walk the sub-devices until unsubscribed */
+    for (subdev = ota->subdevs; NULL != subdev; subdev = subdev->next) {
+        IOT_MQTT_Unsubscribe(gateway->mqtt, subdev->topic_update);
+    }
+
+    while (NULL != (subdev = ota->subdevs)) {
+        ota->subdevs = subdev->next;
+        HAL_Free(subdev);
+    }
+
+    while (NULL != (firmware = ota->firmwares)) {
+        ota->firmwares = firmware->next;
+        if (SUBDEV_FIRMWARE_FETCHING == firmware->state) {
+            ota->params.cache_commit(ota->params.context, firmware->md5sum, false);
+        }
+        _subdev_firmware_free(firmware);
+    }
+
+    HAL_Free(ota->fetch_buf);
+    HAL_MutexDestroy(ota->lock);
+    HAL_Free(ota);
+    gateway->ota = NULL;
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
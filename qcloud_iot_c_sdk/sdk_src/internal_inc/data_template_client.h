@@ -48,8 +48,9 @@ typedef struct _TemplateInnerData {
     List *   reply_list;
     List *   action_handle_list;
     List *   property_handle_list;
-    char *   upstream_topic;    // upstream topic
+    char *   upstream_topic;    // property/event/action upstream topics, NULL if the MQTT client's own
     char *   downstream_topic;  // downstream topic
+    char     control_client_token[MAX_SIZE_OF_CLIENT_TOKEN];  // clientToken of the last control, for control_reply
 } TemplateInnerData;
 
 typedef struct _Template {
@@ -61,6 +62,15 @@ typedef struct _Template {
     TemplateInnerData     inner_data;
     DataTemplateDestroyCb DataTemplateDestroyCb;
 
+    const TemplateCodec *     codec;
+    void *                    codec_data;
+    OnTemplateControlCallback codec_callback;
+
+#ifdef PROPERTY_SERIES_ENABLED
+    void *                   series_lock;
+    struct _TemplateSeries *series_list;
+#endif
+
 #ifdef MULTITHREAD_ENABLED
     bool yield_thread_running;
     int  yield_thread_exit_code;
@@ -92,10 +102,10 @@ void handle_template_expired_reply(Qcloud_IoT_Template *pTemplate);
 /**
  * @brief get the clientToken of control message for control_reply
  *
- * @param void
+ * @param pTemplate   data template client
  * @return clientToken
  */
-char *get_control_clientToken(void);
+char *get_control_clientToken(Qcloud_IoT_Template *pTemplate);
 
 /**
  * @brief all the upstream data by the way of request
@@ -109,6 +119,16 @@ char *get_control_clientToken(void);
  */
 int send_template_request(Qcloud_IoT_Template *pTemplate, RequestParams *pParams, char *pJsonDoc, size_t sizeOfBuffer);
 
+/**
+ * @brief publish to the template's upstream topic of property, event or action
+ *
+ * @param pTemplate     handle to data_template client
+ * @param topic         MQTT_TOPIC_PROPERTY_UP, MQTT_TOPIC_EVENT_UP or MQTT_TOPIC_ACTION_UP
+ * @param pParams       publish params
+ * @return packet id (>= 0) when success, or err code (< 0) for failure
+ */
+int template_publish_upstream(Qcloud_IoT_Template *pTemplate, MQTTTopicHandle topic, PublishParams *pParams);
+
 /**
  * @brief subscribe data_template topic $thing/down/property/%s/%s
  *
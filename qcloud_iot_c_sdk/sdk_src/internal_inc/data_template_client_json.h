@@ -32,15 +32,15 @@ extern "C" {
 /* Max number of requests in appending state */
 #define MAX_APPENDING_REQUEST_AT_ANY_GIVEN_TIME (10)
 
-/* Size of buffer to receive JSON document from server */
-#define CLOUD_IOT_JSON_RX_BUF_LEN (QCLOUD_IOT_MQTT_RX_BUF_LEN + 1)
-
 /* Max size of clientToken */
 #define MAX_SIZE_OF_CLIENT_TOKEN (MAX_SIZE_OF_CLIENT_ID + 10)
 
 /* Max size of JSON string which only contain clientToken field */
 #define MAX_SIZE_OF_JSON_WITH_CLIENT_TOKEN (MAX_SIZE_OF_CLIENT_TOKEN + 20)
 
+/* Max size of JSON string which only contain method and clientToken field */
+#define MAX_SIZE_OF_JSON_WITH_METHOD (MAX_SIZE_OF_JSON_WITH_CLIENT_TOKEN + 32)
+
 #define CLIENT_TOKEN_FIELD "clientToken"
 #define METHOD_FIELD       "method"
 #define TYPE_FIELD         "type"
@@ -170,6 +170,57 @@ int template_put_json_node(char *jsonBuffer, size_t sizeOfBuffer, const char *pK
  */
 void build_empty_json(uint32_t *tokenNumber, char *pJsonBuffer, char *tokenPrefix);
 
+/**
+ * @brief get the method field string of a request method
+ *
+ * @param method        method type
+ * @return              method string, or NULL for unknown method
+ */
+const char *template_method_str(Method method);
+
+/**
+ * @brief write request header {"method":"xxx","clientToken":"prefix-N" to the
+ * start of JSON buffer, caller appends the rest of document after it
+ *
+ * clientToken stays a string: cloud echoes it back as given, control and
+ * clear_control reuse the token sent by cloud, and replies are matched to
+ * requests by comparing it as a string.
+ *
+ * @param tokenNumber   token number, increment every time
+ * @param pJsonBuffer   JSON string buffer
+ * @param sizeOfBuffer  size of buffer
+ * @param method        method type
+ * @param tokenPrefix   prefix of token, like product_id
+ * @return              QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int build_template_json_header(uint32_t *tokenNumber, char *pJsonBuffer, size_t sizeOfBuffer, Method method,
+                               char *tokenPrefix);
+
+/**
+ * @brief write request header {"method":"xxx","clientToken":"token" with a
+ * clientToken given by server
+ *
+ * @param pJsonBuffer   JSON string buffer
+ * @param sizeOfBuffer  size of buffer
+ * @param method        method type
+ * @param pClientToken  clientToken
+ * @return              QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int build_template_json_header_with_token(char *pJsonBuffer, size_t sizeOfBuffer, Method method,
+                                          const char *pClientToken);
+
+/**
+ * @brief check JSON string starts with the request header of method and copy
+ * its clientToken, without parsing the whole document
+ *
+ * @param pJsonDoc       source JSON string
+ * @param method         method type expected
+ * @param pClientToken   buffer for clientToken
+ * @param tokenBufLen    size of clientToken buffer
+ * @return               true if the header is found
+ */
+bool parse_template_json_header(const char *pJsonDoc, Method method, char *pClientToken, size_t tokenBufLen);
+
 /**
  * @brief parse field of clientToken from JSON string
  *
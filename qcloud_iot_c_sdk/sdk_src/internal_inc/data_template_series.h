@@ -0,0 +1,97 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub
+ available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file
+ except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software
+ distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ KIND,
+ * either express or implied. See the License for the specific language
+ governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef _DATA_TEMPLATE_SERIES_H_
+#define _DATA_TEMPLATE_SERIES_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "data_template_client.h"
+
+#ifdef PROPERTY_SERIES_ENABLED
+
+/* reply is not waited for, the batch is not resent anyway */
+#define SERIES_REPORT_TIMEOUT_MS (5000)
+
+/* JSON length reserved for the header and for each point of a batch */
+#define SERIES_JSON_HEADER_LEN     (160)
+#define SERIES_JSON_RAW_POINT_LEN  (26)
+#define SERIES_JSON_DOWN_POINT_LEN (56)
+
+/* MQTT write buffer taken by the publish header and topic, a batch must fit in the rest */
+#define SERIES_MQTT_OVERHEAD_LEN (MAX_SIZE_OF_CLOUD_TOPIC + 8)
+
+/**
+ * @brief a point of series, min/max/avg are the same value for a raw sample
+ */
+typedef struct {
+    uint32_t time_ms;  // local time by HAL_GetTimeMs, mapped to UTC when flushed
+    float    min;
+    float    max;
+    float    avg;
+} SeriesPoint;
+
+typedef struct _TemplateSeries {
+    struct _TemplateSeries *next;
+    void *                  lock;
+    SeriesInitParams        params;
+
+    SeriesPoint *points;  // ring of params.capacity points
+    uint16_t     head;
+    uint16_t     count;
+    uint32_t     dropped;
+
+    SeriesPoint bucket;  // downsampling in progress
+    uint16_t    bucket_count;
+    float       bucket_sum;
+
+    float last_reported;
+    bool  has_reported;
+    bool  flush_pending;  // change threshold crossed
+
+    char * json_buf;
+    size_t json_buf_len;
+} TemplateSeries;
+
+/**
+ * @brief flush the series whose oldest point has waited max_delay_ms, called by yield
+ *
+ * @param pTemplate   data template client
+ */
+void handle_template_series(Qcloud_IoT_Template *pTemplate);
+
+/**
+ * @brief destroy all the series of a data template client
+ *
+ * @param pTemplate   data template client
+ */
+void template_series_destroy_all(Qcloud_IoT_Template *pTemplate);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif  //_DATA_TEMPLATE_SERIES_H_
@@ -23,11 +23,15 @@
 #define IOT_GATEWAY_COMMON_H_
 
 #include "qcloud_iot_export.h"
+#include "utils_completion.h"
 
 #define GATEWAY_PAYLOAD_BUFFER_LEN 1024
-#define GATEWAY_RECEIVE_BUFFER_LEN 1024
 #define GATEWAY_LOOP_MAX_COUNT     100
 
+/* max time to block at a time when waiting for the result of gateway operation */
+#define GATEWAY_WAIT_SLICE_MS  200
+#define GATEWAY_YIELD_SLICE_MS 20
+
 /* The format of operation of gateway topic */
 #define GATEWAY_TOPIC_OPERATION_FMT "$gateway/operation/%s/%s"
 
@@ -67,8 +71,9 @@ typedef struct _SubdevSession {
 
 /* The structure of common reply data */
 typedef struct _ReplyData {
-    int32_t result;
-    char    client_id[MAX_SIZE_OF_CLIENT_ID + 1];
+    int32_t       result;
+    IotCompletion done;
+    char          client_id[MAX_SIZE_OF_CLIENT_ID + 1];
 } ReplyData;
 
 /* The structure of gateway data */
@@ -86,6 +91,10 @@ typedef struct _Gateway {
     MQTTEventHandler event_handle;
     int              is_construct;
 
+#ifdef GATEWAY_SUBDEV_OTA
+    void *ota;  // sub-device OTA
+#endif
+
 #ifdef MULTITHREAD_ENABLED
     bool yield_thread_running;
     int  yield_thread_exit_code;
@@ -103,6 +112,11 @@ int gateway_subscribe_unsubscribe_topic(Gateway *gateway, char *topic_filter, Su
 
 int gateway_subscribe_unsubscribe_default(Gateway *gateway, GatewayParam *param);
 
-int gateway_publish_sync(Gateway *gateway, char *topic, PublishParams *params, int32_t *result);
+/* topic NULL: publish to the gateway operation topic of the MQTT client topic table */
+int gateway_publish_sync(Gateway *gateway, char *topic, PublishParams *params, ReplyData *reply);
+
+#ifdef GATEWAY_SUBDEV_OTA
+void gateway_ota_deinit(Gateway *gateway);
+#endif
 
 #endif /* IOT_GATEWAY_COMMON_H_ */
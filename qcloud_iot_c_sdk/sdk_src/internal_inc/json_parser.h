@@ -70,6 +70,22 @@ int json_parse_name_value(char *p_cJsonStr, int iStrLen, json_parse_cb pfnCB, vo
  **/
 char *json_get_value_by_name(char *p_cJsonStr, int iStrLen, char *p_cName, int *p_iValueLen, int *p_iValueType);
 
+/**
+ * @brief Get the value by a specified key which is not NULL terminated
+ *
+ * @param[in]  p_cJsonStr   @n the JSON string
+ * @param[in]  iStrLen      @n the JSON string length
+ * @param[in]  p_cName      @n the specified key
+ * @param[in]  iNameLen     @n the specified key length
+ * @param[out] p_iValueLen  @n the value length
+ * @param[out] p_iValueType @n the value type
+ * @return A pointer to the value
+ * @see json_get_value_by_name.
+ * @note None.
+ **/
+char *json_get_value_by_name_len(char *p_cJsonStr, int iStrLen, char *p_cName, int iNameLen, int *p_iValueLen,
+                                 int *p_iValueType);
+
 /**
  * @brief Get the JSON object point associate with a given type.
  *
@@ -37,6 +37,7 @@ extern "C" {
 #include "utils_list.h"
 #include "utils_param_check.h"
 #include "utils_timer.h"
+#include "utils_trace.h"
 
 /* packet id, random from [1 - 65536] */
 #define MAX_PACKET_ID (65535)
@@ -50,6 +51,12 @@ extern "C" {
 /* Max number in repub list */
 #define MAX_REPUB_NUM (20)
 
+/* Number of cached packet buffers for the send queue */
+#define MQTT_SEND_POOL_SIZE (4)
+
+/* Max number of packets waiting in the send queue of one priority class */
+#define MQTT_SEND_QUEUE_MAX_LEN (16)
+
 /* Minimal wait interval when reconnect */
 #define MIN_RECONNECT_WAIT_INTERVAL (1000)
 
@@ -67,6 +74,28 @@ extern "C" {
 
 #define MQTT_RMDUP_MSG_ENABLED
 
+#if defined(MQTT_ASYNC_DISPATCH) && !defined(MULTITHREAD_ENABLED)
+#error "MQTT_ASYNC_DISPATCH requires MULTITHREAD_ENABLED"
+#endif
+
+/* Number of threads running message callbacks */
+#define MQTT_DISPATCH_WORKERS (2)
+
+/* Max number of callbacks waiting for one dispatch thread */
+#define MQTT_DISPATCH_QUEUE_LEN (8)
+
+/* Max time the reading thread waits for room in a full dispatch queue (unit: ms) */
+#define MQTT_DISPATCH_PUSH_WAIT_MS (5000)
+
+/* Stack size of dispatch thread */
+#define MQTT_DISPATCH_STACK_SIZE (4096)
+
+/* Time to wait for more bytes when the read ahead buffer is filled, 0 takes only what has arrived (unit: ms) */
+#define MQTT_RX_AHEAD_POLL_MS (0)
+
+/* Max number of buffered packets handled in a row before the housekeeping of yield */
+#define MQTT_RX_AHEAD_BURST (16)
+
 /**
  * @brief MQTT Message Type
  */
@@ -176,15 +205,135 @@ typedef struct SubTopicHandle {
     QoS               qos;                // QoS
 } SubTopicHandle;
 
+/**
+ * @brief subscription entry, shared by every snapshot that contains it
+ */
+typedef struct {
+    uint32_t       ref_cnt;  // number of snapshots holding this entry
+    SubTopicHandle handle;   // handle.topic_filter is owned by the entry
+} SubHandleEntry;
+
+/**
+ * @brief immutable snapshot of the subscriptions, replaced as a whole on change
+ */
+typedef struct SubHandleTable {
+    struct SubHandleTable *retired_next;                   // next snapshot waiting to be freed
+    uint32_t               count;                          // number of entries
+    SubHandleEntry *       entries[MAX_MESSAGE_HANDLERS];  // subscriptions
+} SubHandleTable;
+
+/**
+ * @brief serialized packet waiting in the send queue
+ */
+typedef struct MQTTSendItem {
+    struct MQTTSendItem *next;        // next packet in the queue
+    int                  pool_index;  // slot in send_pool, -1 if allocated for this packet only
+    MQTTPriority         priority;    // priority class of the packet
+    uint32_t             len;         // length of the serialized packet
+    unsigned char *      buf;         // packet buffer of write_buf_size bytes
+} MQTTSendItem;
+
+/**
+ * @brief callback waiting to run in a dispatch thread
+ */
+typedef struct {
+    OnMessageHandler  message_handler;    // message callback, NULL for a subscription event
+    OnSubEventHandler sub_event_handler;  // subscription event callback
+    MQTTEventType     event_type;         // subscription event
+    void *            handler_user_data;  // user context for callback
+    uint32_t          filter_hash;        // hash of the subscription topic filter, selects the thread
+    MQTTMessage       message;            // topic and payload are stored after the job
+} MQTTDispatchJob;
+
+/**
+ * @brief dispatch thread with its bounded callback queue
+ */
+typedef struct {
+    MQTTDispatchJob *jobs[MQTT_DISPATCH_QUEUE_LEN];  // ring buffer of queued callbacks
+    uint32_t         head;                           // index of the oldest callback
+    uint32_t         count;                          // number of queued callbacks
+    uint32_t         pushed;                         // callbacks queued since start
+    uint32_t         finished;                       // callbacks run or dropped since start
+    uint32_t         push_waiters;                   // threads waiting for room in the ring buffer
+    size_t           thread_id;                      // id of the dispatch thread
+    void *           lock;                           // mutex/lock for the ring buffer
+    void *           sem;                            // posted once per queued callback
+    void *           room;                           // posted when a callback leaves a full ring buffer
+    void *           client;                         // owner MQTT client
+    ThreadParams     thread;                         // thread parameters, kept for the thread life
+} MQTTDispatchWorker;
+
+/**
+ * @brief token bucket limiting the publish rate of a priority class
+ */
+typedef struct {
+    uint32_t rate;     // packets per second, 0 for no limit
+    uint32_t burst;    // max packets sent back to back
+    uint32_t tokens;   // available packets, in 1/1000 packet
+    uint32_t last_ms;  // time of the last refill
+} MQTTRateLimit;
+
+/* interval of the scheduled time resync */
+#define SYS_TIME_RESYNC_INTERVAL_MS (3600 * 1000)
+
+/* interval to retry a failed time sync */
+#define SYS_TIME_RETRY_INTERVAL_MS (10 * 1000)
+
+/* error of a sample when the server only gives its time in seconds */
+#define SYS_TIME_SEC_ERROR_MS (500)
+
+/* the drift is measured against a sample at most this old, to follow slow changes of the clock */
+#define SYS_TIME_DRIFT_ANCHOR_MAX_MS (24 * 3600 * 1000)
+
+/* clamp of the clock drift estimate, in parts per million */
+#define SYS_TIME_DRIFT_MAX_PPM (1000)
+
+/* an error larger than this plus what drift and sample errors explain is a step of the local clock */
+#define SYS_TIME_STEP_THRESHOLD_MS (2000)
+
 /**
  * @brief data structure for system time service
+ *
+ * UTC is kept as an offset to the local clock, extended to 64 bits to survive
+ * HAL_GetTimeMs wrap around, and corrected with the drift measured against an
+ * anchor sample, once the interval is long enough for the sample errors.
  */
 typedef struct _sys_mqtt_state {
-    bool topic_sub_ok;
-    bool result_recv_ok;
-    long time;
+    bool     topic_sub_ok;
+    bool     result_recv_ok;
+    bool     request_pending;  // a time request is sent and its reply not arrived yet
+    long     time;             // server time of the last sync, in second
+    uint32_t last_tick_ms;     // last HAL_GetTimeMs value seen
+    uint64_t local_ms;         // local clock, wrap-free
+    uint64_t request_ms;       // local time the pending request is sent
+    uint64_t next_sync_ms;     // local time of the next scheduled sync
+    uint64_t base_local_ms;    // local time of the last sync
+    uint64_t base_utc_ms;      // UTC at base_local_ms
+    uint32_t base_error_ms;    // max error of base_utc_ms
+    uint64_t anchor_local_ms;  // local time of the sample the drift is measured from
+    uint64_t anchor_utc_ms;    // UTC of that sample
+    uint32_t anchor_error_ms;  // max error of anchor_utc_ms
+    int32_t  drift_ppm;        // local clock drift against server, parts per million
+    uint32_t rtt_ms;           // round trip time of the last sync
+    void *   lock;             // mutex/lock for the fields above
 } SysMQTTState;
 
+/**
+ * @brief upstream topics of the device itself, encoded once when client is initialized
+ */
+typedef enum {
+    MQTT_TOPIC_PROPERTY_UP = 0,    // $thing/up/property/{product_id}/{device_name}
+    MQTT_TOPIC_EVENT_UP,           // $thing/up/event/{product_id}/{device_name}
+    MQTT_TOPIC_ACTION_UP,          // $thing/up/action/{product_id}/{device_name}
+    MQTT_TOPIC_OTA_REPORT,         // $ota/report/{product_id}/{device_name}
+    MQTT_TOPIC_GATEWAY_OPERATION,  // $gateway/operation/{product_id}/{device_name}
+    MQTT_TOPIC_SYS_OPERATION,      // $sys/operation/{product_id}/{device_name}
+    MQTT_TOPIC_MAX
+} MQTTTopicHandle;
+
+/* topic entry: 2 bytes length as in MQTT string, topic name, '\0' */
+#define MQTT_TOPIC_ENTRY_MAX_LEN (2 + 20 + MAX_SIZE_OF_PRODUCT_ID + 1 + MAX_SIZE_OF_DEVICE_NAME + 1)
+
 /**
  * @brief MQTT QCloud IoT Client structure
  */
@@ -200,14 +349,28 @@ typedef struct Client {
     uint32_t current_reconnect_wait_interval;  // unit:ms
     uint32_t counter_network_disconnected;     // number of disconnection
 
-    size_t        write_buf_size;                         // size of MQTT write buffer
-    size_t        read_buf_size;                          // size of MQTT read buffer
-    unsigned char write_buf[QCLOUD_IOT_MQTT_TX_BUF_LEN];  // MQTT write buffer
-    unsigned char read_buf[QCLOUD_IOT_MQTT_RX_BUF_LEN];   // MQTT read buffer
+    size_t        write_buf_size;                             // size of MQTT write buffer
+    size_t        read_buf_size;                              // size of MQTT read buffer
+    unsigned char write_buf[QCLOUD_IOT_MQTT_TX_BUF_LEN];      // MQTT write buffer
+    unsigned char read_buf[QCLOUD_IOT_MQTT_RX_BUF_LEN + 1];  // MQTT read buffer, one more byte to terminate payload
+#ifdef MQTT_RX_READ_AHEAD
+    unsigned char rx_ahead[MQTT_RX_AHEAD_LEN];  // bytes received from network and not framed yet
+    size_t        rx_ahead_pos;                 // next byte to frame in rx_ahead
+    size_t        rx_ahead_len;                 // number of valid bytes in rx_ahead
+#endif
 
     void *lock_generic;    // mutex/lock for this client struture
     void *lock_write_buf;  // mutex/lock for write buffer
 
+    MQTTSendItem *send_queue[MQTT_PRIO_MAX];            // queued packets per class, newest first, pushed without lock
+    uint32_t      send_queue_len[MQTT_PRIO_MAX];        // number of queued and pending packets per class
+    MQTTSendItem *send_pending[MQTT_PRIO_MAX];          // packets taken by the writer, oldest first
+    MQTTSendItem *send_pending_tail[MQTT_PRIO_MAX];     // last packet in send_pending
+    MQTTRateLimit send_limit[MQTT_PRIO_MAX];            // rate limit per class, used by the writer
+    uint8_t       send_writer;                          // 1 while a thread is draining the queues
+    MQTTSendItem *send_pool[MQTT_SEND_POOL_SIZE];       // cached packet buffers
+    uint8_t       send_pool_busy[MQTT_SEND_POOL_SIZE];  // 1 if the cached buffer is in use
+
     void *lock_list_pub;  // mutex/lock for puback waiting list
     void *lock_list_sub;  // mutex/lock for suback waiting list
 
@@ -223,7 +386,13 @@ typedef struct Client {
     Timer ping_timer;             // MQTT ping timer
     Timer reconnect_delay_timer;  // MQTT reconnect delay timer
 
-    SubTopicHandle sub_handles[MAX_MESSAGE_HANDLERS];  // subscription handle array
+    SubHandleTable *sub_table;       // current subscription snapshot, read without lock
+    SubHandleTable *sub_retired;     // replaced snapshots, freed when no reader is active
+    uint32_t        sub_readers;     // number of threads reading a subscription snapshot
+    void *          lock_sub_table;  // mutex/lock for subscription snapshot writers
+
+    unsigned char topic_pool[MQTT_TOPIC_MAX * MQTT_TOPIC_ENTRY_MAX_LEN];  // encoded upstream topics
+    uint16_t      topic_offset[MQTT_TOPIC_MAX];                          // entry offset in topic_pool
 
     char host_addr[HOST_STR_LENGTH];
 
@@ -232,6 +401,7 @@ typedef struct Client {
     char key_file_path[FILE_PATH_MAX_LEN];   // full path of device key file
 #else
     unsigned char psk_decode[DECODE_PSK_LENGTH];
+    char          psk_id[MAX_SIZE_OF_CLIENT_ID];  // PSK identity of TLS
 #endif
 
 #ifdef MQTT_RMDUP_MSG_ENABLED
@@ -243,6 +413,12 @@ typedef struct Client {
 #ifdef SYSTEM_COMM
     SysMQTTState sys_state;
 #endif
+
+#ifdef MQTT_ASYNC_DISPATCH
+    MQTTDispatchWorker dispatch_workers[MQTT_DISPATCH_WORKERS];  // threads running message callbacks
+    uint8_t            dispatch_running;                         // 1 while the dispatch threads should run
+    uint8_t            dispatch_alive;                           // number of dispatch threads not exited yet
+#endif
 } Qcloud_IoT_Client;
 
 /**
@@ -333,6 +509,49 @@ int qcloud_iot_mqtt_disconnect(Qcloud_IoT_Client *pClient);
  */
 int qcloud_iot_mqtt_publish(Qcloud_IoT_Client *pClient, char *topicName, PublishParams *pParams);
 
+/**
+ * @brief Encode the upstream topics of the device into the client topic table
+ *
+ * @param pClient       handle to MQTT client
+ * @param productId     product id of the device
+ * @param deviceName    device name of the device
+ *
+ * @return QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int qcloud_iot_mqtt_init_topics(Qcloud_IoT_Client *pClient, const char *productId, const char *deviceName);
+
+/**
+ * @brief Publish MQTT message to a topic of the client topic table
+ *
+ * @param pClient       handle to MQTT client
+ * @param topic         topic handle
+ * @param pParams       publish parameters
+ *
+ * @return packet id (>=0) when success, or err code (<0) for failure
+ */
+int qcloud_iot_mqtt_publish_handle(Qcloud_IoT_Client *pClient, MQTTTopicHandle topic, PublishParams *pParams);
+
+/**
+ * @brief Get topic name of a topic handle
+ *
+ * @param pClient       handle to MQTT client
+ * @param topic         topic handle
+ *
+ * @return topic name
+ */
+const char *qcloud_iot_mqtt_topic_name(Qcloud_IoT_Client *pClient, MQTTTopicHandle topic);
+
+/**
+ * @brief check if the topic table was built for this device
+ *
+ * @param pClient       handle to MQTT client
+ * @param productId     product id of the device
+ * @param deviceName    device name of the device
+ *
+ * @return true if topics of the table belong to the device
+ */
+bool qcloud_iot_mqtt_topic_owned(Qcloud_IoT_Client *pClient, const char *productId, const char *deviceName);
+
 /**
  * @brief Subscribe MQTT topic
  *
@@ -344,6 +563,66 @@ int qcloud_iot_mqtt_publish(Qcloud_IoT_Client *pClient, char *topicName, Publish
  */
 int qcloud_iot_mqtt_subscribe(Qcloud_IoT_Client *pClient, char *topicFilter, SubscribeParams *pParams);
 
+/**
+ * @brief Get the current subscription snapshot for reading, without taking any lock.
+ * The snapshot and its entries stay valid until qcloud_iot_mqtt_sub_table_release
+ *
+ * @param pClient       handle to MQTT client
+ *
+ * @return subscription snapshot, NULL if nothing subscribed
+ */
+SubHandleTable *qcloud_iot_mqtt_sub_table_acquire(Qcloud_IoT_Client *pClient);
+
+/**
+ * @brief Finish reading the snapshot got from qcloud_iot_mqtt_sub_table_acquire
+ *
+ * @param pClient       handle to MQTT client
+ */
+void qcloud_iot_mqtt_sub_table_release(Qcloud_IoT_Client *pClient);
+
+/**
+ * @brief Copy the current subscription snapshot for modification. Called with lock_sub_table held
+ *
+ * @param pClient       handle to MQTT client
+ *
+ * @return new snapshot, NULL if malloc failed
+ */
+SubHandleTable *qcloud_iot_mqtt_sub_table_copy(Qcloud_IoT_Client *pClient);
+
+/**
+ * @brief Make a snapshot from qcloud_iot_mqtt_sub_table_copy current. Called with lock_sub_table held.
+ * The previous snapshot is freed once no reader can be using it
+ *
+ * @param pClient       handle to MQTT client
+ * @param table         new snapshot, NULL to drop all subscriptions
+ */
+void qcloud_iot_mqtt_sub_table_replace(Qcloud_IoT_Client *pClient, SubHandleTable *table);
+
+/**
+ * @brief Drop an entry from a snapshot under modification
+ *
+ * @param table         snapshot from qcloud_iot_mqtt_sub_table_copy
+ * @param index         index of the entry
+ */
+void qcloud_iot_mqtt_sub_table_remove(SubHandleTable *table, uint32_t index);
+
+/**
+ * @brief Store a subscription into a snapshot under modification
+ *
+ * @param table         snapshot from qcloud_iot_mqtt_sub_table_copy
+ * @param index         index of the entry to replace, table->count to append
+ * @param handle        subscription, its topic_filter is owned by the table on success
+ * @return QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int qcloud_iot_mqtt_sub_table_set(SubHandleTable *table, uint32_t index, const SubTopicHandle *handle);
+
+/**
+ * @brief Free a snapshot from qcloud_iot_mqtt_sub_table_copy that is not made current
+ *
+ * @param table         snapshot to free
+ */
+void qcloud_iot_mqtt_sub_table_free(SubHandleTable *table);
+
 /**
  * @brief Re-subscribe MQTT topics
  *
@@ -470,6 +749,55 @@ int cycle_for_read(Qcloud_IoT_Client *pClient, Timer *timer, uint8_t *packet_typ
  */
 int send_mqtt_packet(Qcloud_IoT_Client *pClient, size_t length, Timer *timer);
 
+/**
+ * @brief Get a buffer to serialize a packet for the send queue
+ *
+ * @param pClient       MQTT Client
+ * @return item with a buffer of write_buf_size bytes, NULL if out of memory
+ */
+MQTTSendItem *qcloud_iot_mqtt_send_item_get(Qcloud_IoT_Client *pClient);
+
+/**
+ * @brief Give back a send queue buffer that is not enqueued
+ *
+ * @param pClient       MQTT Client
+ * @param item          item from qcloud_iot_mqtt_send_item_get
+ */
+void qcloud_iot_mqtt_send_item_put(Qcloud_IoT_Client *pClient, MQTTSendItem *item);
+
+/**
+ * @brief Queue a serialized packet for sending
+ *
+ * Any thread may enqueue. If no other thread is writing, the caller becomes the
+ * writer and sends the queued packets, highest priority class first and
+ * coalesced into write_buf; otherwise it returns at once and the current
+ * writer sends the packet. Packets of a throttled class wait for a later flush.
+ *
+ * @param pClient       MQTT Client
+ * @param item          item from qcloud_iot_mqtt_send_item_get, owned by the queue afterwards
+ * @return QCLOUD_RET_SUCCESS for success,
+ *         QCLOUD_ERR_MQTT_PUSH_TO_LIST_FAILED if the queue stays full for command_timeout_ms,
+ *         or err code of the network write if the caller was the writer and it failed
+ */
+int qcloud_iot_mqtt_send_enqueue(Qcloud_IoT_Client *pClient, MQTTSendItem *item);
+
+/**
+ * @brief Send the queued packets unless another thread is already writing
+ *
+ * Called periodically to send the packets held back by a rate limit.
+ *
+ * @param pClient       MQTT Client
+ * @return QCLOUD_RET_SUCCESS for success, or err code of the network write
+ */
+int qcloud_iot_mqtt_send_queue_flush(Qcloud_IoT_Client *pClient);
+
+/**
+ * @brief Drop queued packets and free the send queue buffers
+ *
+ * @param pClient       MQTT Client
+ */
+void qcloud_iot_mqtt_send_queue_deinit(Qcloud_IoT_Client *pClient);
+
 /**
  * @brief wait for a specific packet with timeout
  *
@@ -543,6 +871,97 @@ void reset_repeat_packet_id_buffer(Qcloud_IoT_Client *pClient);
 
 #endif
 
+/**
+ * @brief Notify a subscription event, in a dispatch thread if MQTT_ASYNC_DISPATCH is enabled
+ *
+ * With MQTT_ASYNC_DISPATCH, an event of a subscription request not in the table
+ * must be notified with lock_sub_table or lock_list_sub held, so an unsubscribe
+ * either cancels the request first or waits for the event.
+ *
+ * @param pClient       MQTT Client
+ * @param entry         entry of the subscription in the snapshot read, NULL if not in the table
+ * @param handle        subscription
+ * @param event_type    subscription event
+ */
+void qcloud_iot_mqtt_notify_sub_event(Qcloud_IoT_Client *pClient, const SubHandleEntry *entry,
+                                      const SubTopicHandle *handle, MQTTEventType event_type);
+
+#ifdef MQTT_ASYNC_DISPATCH
+
+/**
+ * @brief Start the dispatch threads
+ *
+ * @param pClient       MQTT Client
+ * @return QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int qcloud_iot_mqtt_dispatch_init(Qcloud_IoT_Client *pClient);
+
+/**
+ * @brief Stop the dispatch threads and drop the callbacks not run yet, waits for a callback in progress
+ *
+ * Must not be called from a message callback.
+ *
+ * @param pClient       MQTT Client
+ */
+void qcloud_iot_mqtt_dispatch_deinit(Qcloud_IoT_Client *pClient);
+
+/**
+ * @brief Queue a message callback to a dispatch thread
+ *
+ * Messages and events of the same subscription always go to the same thread, so
+ * they are handled one at a time in arrival order. If the thread queue is full,
+ * the caller waits up to MQTT_DISPATCH_PUSH_WAIT_MS for room. A message of a
+ * subscription removed meanwhile is dropped.
+ *
+ * @param pClient       MQTT Client
+ * @param entry         entry matching the message, in the snapshot held by the caller
+ * @param message       received message, copied into the queue
+ * @return QCLOUD_RET_SUCCESS for success,
+ *         QCLOUD_ERR_MQTT_PUSH_TO_LIST_FAILED if the thread queue stayed full,
+ *         or err code for failure
+ */
+int qcloud_iot_mqtt_dispatch_message(Qcloud_IoT_Client *pClient, const SubHandleEntry *entry, MQTTMessage *message);
+
+/**
+ * @brief Wait for the callbacks of a topic filter queued before it was removed from the table
+ *
+ * Called after the removal, so no callback of the filter runs once it returns. If
+ * called from a callback of the same thread, the queued callbacks of the filter
+ * are dropped instead.
+ *
+ * @param pClient       MQTT Client
+ * @param topic_filter  topic filter removed, NULL for every filter
+ */
+void qcloud_iot_mqtt_dispatch_fence(Qcloud_IoT_Client *pClient, const char *topic_filter);
+
+#endif
+
+#ifdef SYSTEM_COMM
+
+/**
+ * @brief Init the state of the system time service
+ *
+ * @param pClient       MQTT Client
+ * @return QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int qcloud_iot_sys_time_init(Qcloud_IoT_Client *pClient);
+
+/**
+ * @brief Release the state of the system time service
+ *
+ * @param pClient       MQTT Client
+ */
+void qcloud_iot_sys_time_deinit(Qcloud_IoT_Client *pClient);
+
+/**
+ * @brief Send a time sync request if the scheduled resync is due, called by yield
+ *
+ * @param pClient       MQTT Client
+ */
+void qcloud_iot_sys_time_poll(Qcloud_IoT_Client *pClient);
+
+#endif
+
 size_t get_mqtt_packet_len(size_t rem_len);
 
 size_t mqtt_write_packet_rem_len(unsigned char *buf, uint32_t length);
@@ -27,6 +27,8 @@ extern "C" {
 
 #include <stdint.h>
 
+#include "config.h"
+
 void *ofc_Init(const char *url, uint32_t offset, uint32_t size);
 
 int32_t qcloud_ofc_connect(void *handle);
@@ -35,6 +37,18 @@ int32_t qcloud_ofc_fetch(void *handle, char *buf, uint32_t buf_len, uint32_t tim
 
 int qcloud_ofc_deinit(void *handle);
 
+#ifdef OTA_MQTT_FETCH
+/* download the firmware in chunks through the MQTT connection instead of HTTP */
+void *ofc_mqtt_init(void *mqtt, const char *product_id, const char *device_name, const char *version,
+                    uint32_t offset, uint32_t size);
+
+int32_t qcloud_ofc_mqtt_connect(void *handle);
+
+int32_t qcloud_ofc_mqtt_fetch(void *handle, char *buf, uint32_t buf_len, uint32_t timeout_s);
+
+int qcloud_ofc_mqtt_deinit(void *handle);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -30,10 +30,54 @@ extern "C" {
 #include "qcloud_iot_export_error.h"
 #include "qcloud_iot_export_log.h"
 
+#include <stdint.h>
+
+/**
+ * @brief base64 streaming decode context
+ */
+typedef struct {
+    uint32_t acc;   /*!< sextets of the quad being assembled */
+    uint8_t  count; /*!< number of sextets in acc */
+    uint8_t  pad;   /*!< number of '=' seen */
+} iot_base64_context;
+
 int qcloud_iot_utils_base64encode(unsigned char *dst, size_t dlen, size_t *olen, const unsigned char *src, size_t slen);
 
+/**
+ * @brief decode base64 input. dst may be the same buffer as src
+ */
 int qcloud_iot_utils_base64decode(unsigned char *dst, size_t dlen, size_t *olen, const unsigned char *src, size_t slen);
 
+/**
+ * @brief init base64 streaming decode context
+ *
+ * @param ctx   base64 context
+ */
+void qcloud_iot_utils_base64decode_init(iot_base64_context *ctx);
+
+/**
+ * @brief decode next chunk of base64 input, chunks may split at any char.
+ * Spaces and line breaks are skipped, so PEM bodies can be fed line by line.
+ *
+ * @param ctx   base64 context
+ * @param dst   output buffer, must not overlap src
+ * @param dlen  output buffer size, at least (slen + 3) / 4 * 3
+ * @param olen  number of bytes written, or the size needed on failure
+ * @param src   input chunk
+ * @param slen  input chunk length
+ * @return QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int qcloud_iot_utils_base64decode_update(iot_base64_context *ctx, unsigned char *dst, size_t dlen, size_t *olen,
+                                         const unsigned char *src, size_t slen);
+
+/**
+ * @brief check that the streamed input ended on a complete quad
+ *
+ * @param ctx   base64 context
+ * @return QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int qcloud_iot_utils_base64decode_finish(iot_base64_context *ctx);
+
 #ifdef __cplusplus
 }
 #endif
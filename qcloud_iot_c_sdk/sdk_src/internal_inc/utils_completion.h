@@ -0,0 +1,101 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub
+ available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file
+ except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software
+ distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ KIND,
+ * either express or implied. See the License for the specific language
+ governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef QCLOUD_IOT_UTILS_COMPLETION_H_
+#define QCLOUD_IOT_UTILS_COMPLETION_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "qcloud_iot_import.h"
+
+/**
+ * @brief One-shot completion signalled by a reply handler and waited on by the requester
+ *
+ * With MULTITHREAD_ENABLED it is backed by a semaphore, so a waiter blocked in
+ * iot_completion_wait wakes as soon as the reply is handled by another thread.
+ * Without it there is nobody else to signal it, and the waiter has to drive the
+ * yield loop itself and poll iot_completion_is_done.
+ */
+typedef struct {
+    void *  sem;
+    int     result;
+    uint8_t done;
+    uint8_t consumed;
+} IotCompletion;
+
+/**
+ * @brief Initialize a completion
+ *
+ * @param completion - completion to be initialized
+ * @return QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int iot_completion_init(IotCompletion *completion);
+
+/**
+ * @brief Re-arm a completion which has been completed before
+ *
+ * @param completion - completion to be reset
+ */
+void iot_completion_reset(IotCompletion *completion);
+
+/**
+ * @brief Set the result and wake up the waiter, only the first call takes effect
+ *
+ * @param completion - completion to be signalled
+ * @param result - result handed to the waiter
+ */
+void iot_completion_complete(IotCompletion *completion, int result);
+
+/**
+ * @brief Check if the completion has been signalled
+ *
+ * @param completion - completion to be checked
+ * @return bool - true = completed, false = still pending
+ */
+bool iot_completion_is_done(IotCompletion *completion);
+
+/**
+ * @brief Block until the completion is signalled or timeout
+ *
+ * Without MULTITHREAD_ENABLED it does not block and only checks the state.
+ *
+ * @param completion - completion to wait for
+ * @param timeout_ms - max time to block
+ * @return bool - true = completed, false = timeout
+ */
+bool iot_completion_wait(IotCompletion *completion, uint32_t timeout_ms);
+
+/**
+ * @brief Release a completion, it must be done or never handed to a signaller
+ *
+ * @param completion - completion to be released
+ */
+void iot_completion_deinit(IotCompletion *completion);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // QCLOUD_IOT_UTILS_COMPLETION_H_
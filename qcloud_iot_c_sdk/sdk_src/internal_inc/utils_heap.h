@@ -0,0 +1,121 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub
+ available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file
+ except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software
+ distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ KIND,
+ * either express or implied. See the License for the specific language
+ governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef QCLOUD_IOT_UTILS_HEAP_H_
+#define QCLOUD_IOT_UTILS_HEAP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "config.h"
+#include "qcloud_iot_export_variables.h"
+#include "qcloud_iot_import.h"
+#include "qcloud_iot_export_heap.h"
+
+#if defined(HEAP_ACCOUNTING) || defined(IOT_STATIC_MEMORY)
+
+#ifdef IOT_STATIC_MEMORY
+/*
+ * Classes of the static pool which replaces the heap, each with its block size
+ * (including an 8 bytes header) and block count. An allocation takes a block
+ * of the smallest class which fits and still has one free. Tune them for the
+ * application with the report of HEAP_ACCOUNTING, or override on compile line.
+ */
+#define IOT_STATIC_POOL_CLASSES (8)
+
+#ifndef IOT_STATIC_BLOCK_SIZE_0
+#define IOT_STATIC_BLOCK_SIZE_0  (32)
+#define IOT_STATIC_BLOCK_COUNT_0 (48)
+#define IOT_STATIC_BLOCK_SIZE_1  (64)
+#define IOT_STATIC_BLOCK_COUNT_1 (32)
+#define IOT_STATIC_BLOCK_SIZE_2  (128)
+#define IOT_STATIC_BLOCK_COUNT_2 (24)
+#define IOT_STATIC_BLOCK_SIZE_3  (256)
+#define IOT_STATIC_BLOCK_COUNT_3 (12)
+#define IOT_STATIC_BLOCK_SIZE_4  (512)
+#define IOT_STATIC_BLOCK_COUNT_4 (8)
+#define IOT_STATIC_BLOCK_SIZE_5  (1024)
+#ifdef OTA_MQTT_FETCH
+/* OTA over MQTT also takes one per chunk of its window */
+#define IOT_STATIC_BLOCK_COUNT_5 (8)
+#else
+#define IOT_STATIC_BLOCK_COUNT_5 (4)
+#endif
+/* queued publishes, each carries a whole write buffer */
+#define IOT_STATIC_BLOCK_SIZE_6  (QCLOUD_IOT_MQTT_TX_BUF_LEN + 256)
+#define IOT_STATIC_BLOCK_COUNT_6 (6)
+/* the MQTT client, with its read and write buffers */
+#ifdef MQTT_RX_READ_AHEAD
+#define IOT_STATIC_BLOCK_SIZE_7 (QCLOUD_IOT_MQTT_TX_BUF_LEN + QCLOUD_IOT_MQTT_RX_BUF_LEN + MQTT_RX_AHEAD_LEN + 2048)
+#else
+#define IOT_STATIC_BLOCK_SIZE_7 (QCLOUD_IOT_MQTT_TX_BUF_LEN + QCLOUD_IOT_MQTT_RX_BUF_LEN + 2048)
+#endif
+#define IOT_STATIC_BLOCK_COUNT_7 (1)
+#endif
+#endif
+
+/**
+ * @brief Allocate memory for a subsystem, from HAL_Malloc or the static pool
+ *
+ * @param tag  - subsystem which owns the memory
+ * @param size - size in bytes
+ * @return pointer to the memory, or NULL if failed
+ */
+void *iot_heap_malloc(IotHeapTag tag, uint32_t size);
+
+/**
+ * @brief Free memory allocated by iot_heap_malloc
+ *
+ * @param ptr - memory to be freed, NULL is ignored
+ */
+void iot_heap_free(void *ptr);
+
+/*
+ * A source file of SDK defines IOT_HEAP_TAG before including this header, then
+ * all of its HAL_Malloc/HAL_Free go through the accounting. HAL_Free is mapped as
+ * an object so it is also right when used as a free callback of a list.
+ */
+#ifdef IOT_HEAP_TAG
+#define HAL_Malloc(size) iot_heap_malloc(IOT_HEAP_TAG, size)
+#define HAL_Free         iot_heap_free
+#endif
+
+#endif
+
+#ifdef HEAP_ACCOUNTING
+
+/* interval of the heap report logged by MQTT yield */
+#define HEAP_REPORT_INTERVAL_MS (60 * 1000)
+
+/**
+ * @brief Log the heap report if HEAP_REPORT_INTERVAL_MS passed since the last one
+ */
+void iot_heap_poll(void);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QCLOUD_IOT_UTILS_HEAP_H_ */
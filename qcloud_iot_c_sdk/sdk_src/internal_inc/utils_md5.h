@@ -23,11 +23,17 @@
 
 #include "qcloud_iot_import.h"
 
+#if defined(HASH_USE_MBEDTLS)
+#include "mbedtls/md5.h"
+
+typedef mbedtls_md5_context iot_md5_context;
+#else
 typedef struct {
     uint32_t      total[2];   /*!< number of bytes processed  */
     uint32_t      state[4];   /*!< intermediate digest state  */
     unsigned char buffer[64]; /*!< data block being processed */
 } iot_md5_context;
+#endif
 
 /**
  * @brief init MD5 context
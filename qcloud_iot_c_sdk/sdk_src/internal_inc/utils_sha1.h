@@ -23,6 +23,11 @@
 
 #include "qcloud_iot_import.h"
 
+#if defined(HASH_USE_MBEDTLS)
+#include "mbedtls/sha1.h"
+
+typedef mbedtls_sha1_context iot_sha1_context;
+#else
 /**
  * \brief          SHA-1 context structure
  */
@@ -31,6 +36,7 @@ typedef struct {
     uint32_t      state[5];   /*!< intermediate digest state  */
     unsigned char buffer[64]; /*!< data block being processed */
 } iot_sha1_context;
+#endif
 
 /**
  * \brief          Initialize SHA-1 context
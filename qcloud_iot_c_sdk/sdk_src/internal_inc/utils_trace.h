@@ -0,0 +1,71 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub
+ available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file
+ except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software
+ distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ KIND,
+ * either express or implied. See the License for the specific language
+ governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef QCLOUD_IOT_UTILS_TRACE_H_
+#define QCLOUD_IOT_UTILS_TRACE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "config.h"
+#include "qcloud_iot_export_trace.h"
+#include "qcloud_iot_import.h"
+
+#ifdef IOT_TRACE_ENABLED
+
+/* events kept in the ring, a power of 2, about 40 bytes each */
+#ifndef IOT_TRACE_RING_SIZE
+#define IOT_TRACE_RING_SIZE (256)
+#endif
+
+/*
+ * Trace points of SDK, compiled out without IOT_TRACE_ENABLED:
+ *
+ *     IOT_TRACE_BEGIN(t);
+ *     rc = network_stack.connect(...);
+ *     IOT_TRACE_END(t, "net", "connect", rc);
+ */
+#define IOT_TRACE_BEGIN(t)                      uint64_t t = HAL_GetTimeUs()
+#define IOT_TRACE_END(t, cat, name, rc)         IOT_Trace_Span(cat, name, t, rc)
+#define IOT_TRACE_ASYNC_BEGIN(cat, name, id)    IOT_Trace_Async_Begin(cat, name, id)
+#define IOT_TRACE_ASYNC_END(cat, name, id, rc)  IOT_Trace_Async_End(cat, name, id, rc)
+#define IOT_TRACE_INSTANT(cat, name, rc)        IOT_Trace_Instant(cat, name, rc)
+
+/* id of an async span of an MQTT packet, packet ids are only unique in a client */
+#define IOT_TRACE_PACKET_ID(client, packet_id) ((uint32_t)((uintptr_t)(client) << 16) ^ (uint32_t)(packet_id))
+
+#else
+
+#define IOT_TRACE_BEGIN(t)
+#define IOT_TRACE_END(t, cat, name, rc)
+#define IOT_TRACE_ASYNC_BEGIN(cat, name, id)
+#define IOT_TRACE_ASYNC_END(cat, name, id, rc)
+#define IOT_TRACE_INSTANT(cat, name, rc)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QCLOUD_IOT_UTILS_TRACE_H_ */
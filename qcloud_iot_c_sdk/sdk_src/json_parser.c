@@ -29,6 +29,14 @@
 #include "lite-utils.h"
 #include "qcloud_iot_export_log.h"
 
+#if defined(JSON_SIMD_SCAN)
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+#endif
+
 #define json_debug Log_d
 
 typedef struct JSON_NV {
@@ -39,6 +47,73 @@ typedef struct JSON_NV {
     char *pV;
 } JSON_NV;
 
+/**
+ * @brief find the first position of mark open, mark close or end of string.
+ * With JSON_SIMD_SCAN on x86/ARMv8 hosts, 16/32 bytes are classified at a
+ * time. Vector loads are aligned so they never cross a page past the '\0'.
+ */
+static char *_json_scan_mark(char *str, char open, char close)
+{
+#if defined(JSON_SIMD_SCAN) && (defined(__AVX2__) || defined(__SSE2__) || (defined(__ARM_NEON) && defined(__aarch64__)))
+#if defined(__AVX2__)
+#define JSON_SCAN_BLOCK 32
+#else
+#define JSON_SCAN_BLOCK 16
+#endif
+    while ((uintptr_t)str & (JSON_SCAN_BLOCK - 1)) {
+        if (*str == open || *str == close || *str == '\0') {
+            return str;
+        }
+        str++;
+    }
+
+#if defined(__AVX2__)
+    const __m256i v_open  = _mm256_set1_epi8(open);
+    const __m256i v_close = _mm256_set1_epi8(close);
+    const __m256i v_zero  = _mm256_setzero_si256();
+    for (;; str += JSON_SCAN_BLOCK) {
+        __m256i  block = _mm256_load_si256((const __m256i *)str);
+        uint32_t mask  = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, v_open), _mm256_cmpeq_epi8(block, v_close)),
+            _mm256_cmpeq_epi8(block, v_zero)));
+        if (mask) {
+            return str + __builtin_ctz(mask);
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i v_open  = _mm_set1_epi8(open);
+    const __m128i v_close = _mm_set1_epi8(close);
+    const __m128i v_zero  = _mm_setzero_si128();
+    for (;; str += JSON_SCAN_BLOCK) {
+        __m128i  block = _mm_load_si128((const __m128i *)str);
+        uint32_t mask  = (uint32_t)_mm_movemask_epi8(_mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(block, v_open), _mm_cmpeq_epi8(block, v_close)), _mm_cmpeq_epi8(block, v_zero)));
+        if (mask) {
+            return str + __builtin_ctz(mask);
+        }
+    }
+#else
+    const uint8x16_t v_open  = vdupq_n_u8((uint8_t)open);
+    const uint8x16_t v_close = vdupq_n_u8((uint8_t)close);
+    for (;; str += JSON_SCAN_BLOCK) {
+        uint8x16_t block = vld1q_u8((const uint8_t *)str);
+        uint8x16_t hit   = vorrq_u8(vorrq_u8(vceqq_u8(block, v_open), vceqq_u8(block, v_close)), vceqzq_u8(block));
+        if (vmaxvq_u8(hit)) {
+            // narrow each byte to 4 bits to get a 64 bit mask of matching positions
+            uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hit), 4)), 0);
+            return str + (__builtin_ctzll(mask) >> 2);
+        }
+    }
+#endif
+#undef JSON_SCAN_BLOCK
+#else
+    while (*str != open && *str != close && *str != '\0') {
+        str++;
+    }
+    return str;
+#endif
+}
+
 char *json_get_object(int type, char *str)
 {
     char *pos = 0;
@@ -59,7 +134,6 @@ char *json_get_next_object(int type, char *str, char **key, int *key_len, char *
     char  JsonMark[JSTYPEMAX][2] = {{'\"', '\"'}, {'{', '}'}, {'[', ']'}, {'0', ' '}};
     int   iMarkDepth = 0, iValueType = JSNONE, iNameLen = 0, iValueLen = 0;
     char *p_cName = 0, *p_cValue = 0, *p_cPos = str;
-    char  lastchr = ' ';
 
     if (type == JSOBJECT) {
         /* Get Key */
@@ -80,7 +154,6 @@ char *json_get_next_object(int type, char *str, char **key, int *key_len, char *
     while (p_cPos && *p_cPos) {
         if (*p_cPos == '"') {
             iValueType = JSSTRING;
-            lastchr    = *p_cPos;
             p_cValue   = ++p_cPos;
             break;
         } else if (*p_cPos == '{') {
@@ -106,7 +179,26 @@ char *json_get_next_object(int type, char *str, char **key, int *key_len, char *
         }
         p_cPos++;
     }
-    while (p_cPos && *p_cPos && iValueType > JSNONE) {
+    if (iValueType == JSSTRING || iValueType == JSOBJECT || iValueType == JSARRAY) {
+        // only marks of the value type change state, so jump between them
+        while (*(p_cPos = _json_scan_mark(p_cPos, JsonMark[iValueType][0], JsonMark[iValueType][1]))) {
+            if (*p_cPos == JsonMark[iValueType][1]) {
+                if (iMarkDepth == 0) {
+                    iValueLen = p_cPos - p_cValue + (iValueType == JSSTRING ? 0 : 1);
+                    if ((iValueType == JSSTRING) && (*(p_cPos - 1) == '\\')) {
+                        p_cPos++;
+                        continue;
+                    }
+                    break;
+                }
+                iMarkDepth--;
+            } else {
+                iMarkDepth++;
+            }
+            p_cPos++;
+        }
+    }
+    while (p_cPos && *p_cPos && iValueType >= JSNUMBER) {
         if (iValueType == JSBOOLEAN) {
             int len = strlen(p_cValue);
 
@@ -132,27 +224,12 @@ char *json_get_next_object(int type, char *str, char **key, int *key_len, char *
             }
         } else if (iValueType == JSNUMBER) {
             // if (*p_cPos < '0' || *p_cPos > '9') {
-            if ((*p_cPos < '0' || *p_cPos > '9') && (*p_cPos != '.')) {  // support float
+            if ((*p_cPos < '0' || *p_cPos > '9') && (*p_cPos != '.') && (*p_cPos != 'e') && (*p_cPos != 'E') &&
+                (*p_cPos != '+') && (*p_cPos != '-')) {  // support float and exponent
                 iValueLen = p_cPos - p_cValue;
                 break;
             }
-        } else if (*p_cPos == JsonMark[iValueType][1]) {
-            if (iMarkDepth == 0) {
-                iValueLen = p_cPos - p_cValue + (iValueType == JSSTRING ? 0 : 1);
-                p_cPos++;
-                if ((iValueType == JSSTRING) && (lastchr == '\\')) {
-                    lastchr = *p_cPos;
-                    continue;
-                } else {
-                    break;
-                }
-            } else {
-                iMarkDepth--;
-            }
-        } else if (*p_cPos == JsonMark[iValueType][0]) {
-            iMarkDepth++;
         }
-        lastchr = *p_cPos;
         p_cPos++;
     }
 
@@ -177,12 +254,15 @@ int json_parse_name_value(char *p_cJsonStr, int iStrLen, json_parse_cb pfnCB, vo
     int   klen = 0, vlen = 0, vtype = 0;
     char  last_char = 0;
     int   ret       = JSON_RESULT_ERR;
+    int   backup;
 
     if (p_cJsonStr == NULL || iStrLen == 0 || pfnCB == NULL) {
         return ret;
     }
 
-    if (iStrLen != strlen(p_cJsonStr)) {
+    // the string is terminated at iStrLen while parsing, so the check can not be repeated to restore it
+    backup = iStrLen != strlen(p_cJsonStr);
+    if (backup) {
         Log_w("Backup last_char since %d != %d", iStrLen, (int)strlen(p_cJsonStr));
         backup_json_str_last_char(p_cJsonStr, iStrLen, last_char);
     }
@@ -197,7 +277,7 @@ int json_parse_name_value(char *p_cJsonStr, int iStrLen, json_parse_cb pfnCB, vo
         }
     }
 
-    if (iStrLen != strlen(p_cJsonStr)) {
+    if (backup) {
         restore_json_str_last_char(p_cJsonStr, iStrLen, last_char);
     }
 
@@ -238,12 +318,18 @@ int json_get_value_by_name_cb(char *p_cName, int iNameLen, char *p_cValue, int i
 }
 
 char *json_get_value_by_name(char *p_cJsonStr, int iStrLen, char *p_cName, int *p_iValueLen, int *p_iValueType)
+{
+    return json_get_value_by_name_len(p_cJsonStr, iStrLen, p_cName, strlen(p_cName), p_iValueLen, p_iValueType);
+}
+
+char *json_get_value_by_name_len(char *p_cJsonStr, int iStrLen, char *p_cName, int iNameLen, int *p_iValueLen,
+                                 int *p_iValueType)
 {
     JSON_NV stNV;
 
     memset(&stNV, 0, sizeof(stNV));
     stNV.pN   = p_cName;
-    stNV.nLen = strlen(p_cName);
+    stNV.nLen = iNameLen;
     if (JSON_RESULT_OK == json_parse_name_value(p_cJsonStr, iStrLen, json_get_value_by_name_cb, (void *)&stNV)) {
         if (p_iValueLen) {
             *p_iValueLen = stNV.vLen;
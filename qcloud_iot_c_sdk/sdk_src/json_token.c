@@ -23,13 +23,10 @@
 #include "lite-utils.h"
 #include "qcloud_iot_export_error.h"
 
-#ifndef SCNi8
-#define SCNi8 "hhi"
-#endif
+#include <float.h>
 
-#ifndef SCNu8
-#define SCNu8 "hhu"
-#endif
+#define IOT_HEAP_TAG IOT_HEAP_JSON
+#include "utils_heap.h"
 
 char *LITE_json_value_of(char *key, char *src)
 {
@@ -77,6 +74,27 @@ char *LITE_json_value_of(char *key, char *src)
     return ret;
 }
 
+char *LITE_json_value_span_of(char *key, char *src, int *value_len, int *value_type)
+{
+    char *value    = NULL;
+    char *src_iter = src;
+    char *key_iter = key;
+    char *delim;
+
+    // walk dotted path in place, no copy of key or value is made
+    while ((delim = strchr(key_iter, '.')) != NULL) {
+        value = json_get_value_by_name_len(src_iter, strlen(src_iter), key_iter, delim - key_iter, value_len, NULL);
+        if (NULL == value) {
+            return NULL;
+        }
+
+        src_iter = value;
+        key_iter = delim + 1;
+    }
+
+    return json_get_value_by_name_len(src_iter, strlen(src_iter), key_iter, strlen(key_iter), value_len, value_type);
+}
+
 list_head_t *LITE_json_keys_of(char *src, char *prefix)
 {
     static LIST_HEAD(keylist);
@@ -162,55 +180,276 @@ char *LITE_json_string_value_strip_transfer(char *key, char *src)
     return str;
 }
 
+/* powers of ten exactly representable by double */
+static const double sg_exact_pow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+#define MAX_EXACT_POW10        22
+#define MAX_EXACT_MANTISSA     ((uint64_t)1 << 53)
+#define MAX_DOUBLE_SPAN_LEN    64
+#define MAX_DECIMAL_EXP_DIGITS 4
+
+int LITE_span_get_integer(const char *src, int len, int64_t min, int64_t max, int64_t *value)
+{
+    const char *end = src + len;
+    bool        neg = false;
+    uint64_t    acc = 0;
+    unsigned    digit;
+    int64_t     result;
+
+    if (NULL == src || len <= 0) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    if (*src == '-') {
+        neg = true;
+        src++;
+    }
+
+    if (src >= end || !LITE_isdigit(*src)) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    while (src < end && LITE_isdigit(*src)) {
+        digit = *src - '0';
+        // checked before accumulating, acc * 10 may wrap around
+        if (acc > ((uint64_t)INT64_MAX + 1 - digit) / 10) {
+            return QCLOUD_ERR_FAILURE;
+        }
+        acc = acc * 10 + digit;
+        src++;
+    }
+
+    // fraction part is truncated, as the former sscanf did
+    if (src < end && *src == '.') {
+        src++;
+        while (src < end && LITE_isdigit(*src)) {
+            src++;
+        }
+    }
+
+    if (src != end) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    if (neg) {
+        result = (acc == (uint64_t)INT64_MAX + 1) ? INT64_MIN : -(int64_t)acc;
+    } else {
+        if (acc > (uint64_t)INT64_MAX) {
+            return QCLOUD_ERR_FAILURE;
+        }
+        result = (int64_t)acc;
+    }
+
+    if (result < min || result > max) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    *value = result;
+    return QCLOUD_RET_SUCCESS;
+}
+
+int LITE_span_get_double(const char *src, int len, double *value)
+{
+    const char *p         = src;
+    const char *end       = src + len;
+    bool        neg       = false;
+    bool        truncated = false;
+    uint64_t    mantissa  = 0;
+    int         exp10     = 0;
+    int         digits    = 0;
+    double      result;
+
+    if (NULL == src || len <= 0) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    if (*p == '-') {
+        neg = true;
+        p++;
+    }
+
+    for (; p < end && LITE_isdigit(*p); p++, digits++) {
+        if (mantissa < MAX_EXACT_MANTISSA) {
+            mantissa = mantissa * 10 + (*p - '0');
+        } else {
+            exp10++;
+            truncated |= (*p != '0');
+        }
+    }
+
+    if (p < end && *p == '.') {
+        for (p++; p < end && LITE_isdigit(*p); p++, digits++) {
+            if (mantissa < MAX_EXACT_MANTISSA) {
+                mantissa = mantissa * 10 + (*p - '0');
+                exp10--;
+            } else {
+                truncated |= (*p != '0');
+            }
+        }
+    }
+
+    if (0 == digits) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        bool exp_neg    = false;
+        int  exp_val    = 0;
+        int  exp_digits = 0;
+
+        p++;
+        if (p < end && (*p == '-' || *p == '+')) {
+            exp_neg = (*p == '-');
+            p++;
+        }
+        for (; p < end && LITE_isdigit(*p); p++, exp_digits++) {
+            if (exp_digits < MAX_DECIMAL_EXP_DIGITS) {
+                exp_val = exp_val * 10 + (*p - '0');
+            }
+        }
+        if (0 == exp_digits) {
+            return QCLOUD_ERR_FAILURE;
+        }
+        exp10 += exp_neg ? -exp_val : exp_val;
+    }
+
+    if (p != end) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    if (!truncated && mantissa <= MAX_EXACT_MANTISSA && exp10 >= -MAX_EXACT_POW10 && exp10 <= MAX_EXACT_POW10) {
+        // both operands are exact, so a single IEEE operation gives the correctly rounded result
+        result = (double)mantissa;
+        result = (exp10 < 0) ? result / sg_exact_pow10[-exp10] : result * sg_exact_pow10[exp10];
+    } else {
+        // rare case: too many digits or too large exponent, fall back to libc
+        char  buf[MAX_DOUBLE_SPAN_LEN];
+        char *endptr = NULL;
+
+        if (len >= MAX_DOUBLE_SPAN_LEN) {
+            return QCLOUD_ERR_FAILURE;
+        }
+        memcpy(buf, src, len);
+        buf[len] = '\0';
+        result   = strtod(buf, &endptr);
+        if (endptr != buf + len) {
+            return QCLOUD_ERR_FAILURE;
+        }
+        neg = false;
+    }
+
+    *value = neg ? -result : result;
+    return QCLOUD_RET_SUCCESS;
+}
+
+int LITE_span_get_boolean(const char *src, int len, bool *value)
+{
+    if (len == 1 && (*src == '0' || *src == '1')) {
+        *value = (*src == '1');
+    } else if (len == 4 && (!strncmp(src, "true", 4) || !strncmp(src, "TRUE", 4))) {
+        *value = true;
+    } else if (len == 5 && (!strncmp(src, "false", 5) || !strncmp(src, "FALSE", 5))) {
+        *value = false;
+    } else {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
 int LITE_get_int32(int32_t *value, char *src)
 {
-    return (sscanf(src, "%" SCNi32, value) == 1) ? QCLOUD_RET_SUCCESS : QCLOUD_ERR_FAILURE;
+    int64_t v;
+    int     rc = LITE_span_get_integer(src, strlen(src), INT32_MIN, INT32_MAX, &v);
+
+    if (rc == QCLOUD_RET_SUCCESS) {
+        *value = (int32_t)v;
+    }
+
+    return rc;
 }
 
 int LITE_get_int16(int16_t *value, char *src)
 {
-    return (sscanf(src, "%" SCNi16, value) == 1) ? QCLOUD_RET_SUCCESS : QCLOUD_ERR_FAILURE;
+    int64_t v;
+    int     rc = LITE_span_get_integer(src, strlen(src), INT16_MIN, INT16_MAX, &v);
+
+    if (rc == QCLOUD_RET_SUCCESS) {
+        *value = (int16_t)v;
+    }
+
+    return rc;
 }
 
 int LITE_get_int8(int8_t *value, char *src)
 {
-    return (sscanf(src, "%" SCNi8, value) == 1) ? QCLOUD_RET_SUCCESS : QCLOUD_ERR_FAILURE;
+    int64_t v;
+    int     rc = LITE_span_get_integer(src, strlen(src), INT8_MIN, INT8_MAX, &v);
+
+    if (rc == QCLOUD_RET_SUCCESS) {
+        *value = (int8_t)v;
+    }
+
+    return rc;
 }
 
 int LITE_get_uint32(uint32_t *value, char *src)
 {
-    return (sscanf(src, "%" SCNu32, value) == 1) ? QCLOUD_RET_SUCCESS : QCLOUD_ERR_FAILURE;
+    int64_t v;
+    int     rc = LITE_span_get_integer(src, strlen(src), 0, UINT32_MAX, &v);
+
+    if (rc == QCLOUD_RET_SUCCESS) {
+        *value = (uint32_t)v;
+    }
+
+    return rc;
 }
 
 int LITE_get_uint16(uint16_t *value, char *src)
 {
-    return (sscanf(src, "%" SCNu16, value) == 1) ? QCLOUD_RET_SUCCESS : QCLOUD_ERR_FAILURE;
+    int64_t v;
+    int     rc = LITE_span_get_integer(src, strlen(src), 0, UINT16_MAX, &v);
+
+    if (rc == QCLOUD_RET_SUCCESS) {
+        *value = (uint16_t)v;
+    }
+
+    return rc;
 }
 
 int LITE_get_uint8(uint8_t *value, char *src)
 {
-    return (sscanf(src, "%" SCNu8, value) == 1) ? QCLOUD_RET_SUCCESS : QCLOUD_ERR_FAILURE;
+    int64_t v;
+    int     rc = LITE_span_get_integer(src, strlen(src), 0, UINT8_MAX, &v);
+
+    if (rc == QCLOUD_RET_SUCCESS) {
+        *value = (uint8_t)v;
+    }
+
+    return rc;
 }
 
 int LITE_get_float(float *value, char *src)
 {
-    return (sscanf(src, "%f", value) == 1) ? QCLOUD_RET_SUCCESS : QCLOUD_ERR_FAILURE;
+    double v;
+
+    if (LITE_span_get_double(src, strlen(src), &v) != QCLOUD_RET_SUCCESS || v > FLT_MAX || v < -FLT_MAX) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    *value = (float)v;
+    return QCLOUD_RET_SUCCESS;
 }
 
 int LITE_get_double(double *value, char *src)
 {
-    return (sscanf(src, "%lf", value) == 1) ? QCLOUD_RET_SUCCESS : QCLOUD_ERR_FAILURE;
+    return LITE_span_get_double(src, strlen(src), value);
 }
 
 int LITE_get_boolean(bool *value, char *src)
 {
-    if (!strcmp(src, "false")) {
-        *value = false;
-    } else {
-        *value = true;
-    }
-
-    return QCLOUD_RET_SUCCESS;
+    return LITE_span_get_boolean(src, strlen(src), value);
 }
 
 int LITE_get_string(int8_t *value, char *src, uint16_t max_len)
@@ -41,8 +41,12 @@ extern "C" {
 #include "utils_base64.h"
 #include "utils_list.h"
 
-#if ((!defined(AUTH_WITH_NOTLS)) && (!defined(AUTH_MODE_CERT)))
-static char sg_psk_id_str[MAX_SIZE_OF_CLIENT_ID];
+#define IOT_HEAP_TAG IOT_HEAP_MQTT
+#include "utils_heap.h"
+
+#ifdef IOT_STATIC_MEMORY
+/* the client takes a block of pool class 7 with its 8 bytes header, fail the build rather than the construct */
+typedef char mqtt_client_fits_static_block[(sizeof(Qcloud_IoT_Client) + 8 <= IOT_STATIC_BLOCK_SIZE_7) ? 1 : -1];
 #endif
 
 static uint16_t _get_random_start_packet_id(void)
@@ -165,28 +169,36 @@ int IOT_MQTT_Destroy(void **pClient)
         set_client_conn_state(mqtt_client, NOTCONNECTED);
     }
 
-    int i = 0;
-    for (i = 0; i < MAX_MESSAGE_HANDLERS; ++i) {
-        /* notify this event to topic subscriber */
-        if (NULL != mqtt_client->sub_handles[i].topic_filter && NULL != mqtt_client->sub_handles[i].sub_event_handler)
-            mqtt_client->sub_handles[i].sub_event_handler(mqtt_client, MQTT_EVENT_CLIENT_DESTROY,
-                                                          mqtt_client->sub_handles[i].handler_user_data);
+#ifdef MQTT_ASYNC_DISPATCH
+    qcloud_iot_mqtt_dispatch_deinit(mqtt_client);
+#endif
 
-        if (NULL != mqtt_client->sub_handles[i].topic_filter) {
-            HAL_Free((void *)mqtt_client->sub_handles[i].topic_filter);
-            mqtt_client->sub_handles[i].topic_filter = NULL;
-        }
+    uint32_t        i     = 0;
+    SubHandleTable *table = mqtt_client->sub_table;
+    for (i = 0; table && i < table->count; ++i) {
+        /* notify this event to topic subscriber */
+        if (NULL != table->entries[i]->handle.sub_event_handler)
+            table->entries[i]->handle.sub_event_handler(mqtt_client, MQTT_EVENT_CLIENT_DESTROY,
+                                                        table->entries[i]->handle.handler_user_data);
     }
+    /* no reader is left once the client is going away */
+    qcloud_iot_mqtt_sub_table_replace(mqtt_client, NULL);
 
 #ifdef MQTT_RMDUP_MSG_ENABLED
     reset_repeat_packet_id_buffer(mqtt_client);
 #endif
 
+    qcloud_iot_mqtt_send_queue_deinit(mqtt_client);
+
     HAL_MutexDestroy(mqtt_client->lock_generic);
     HAL_MutexDestroy(mqtt_client->lock_write_buf);
 
     HAL_MutexDestroy(mqtt_client->lock_list_sub);
     HAL_MutexDestroy(mqtt_client->lock_list_pub);
+    HAL_MutexDestroy(mqtt_client->lock_sub_table);
+#ifdef SYSTEM_COMM
+    qcloud_iot_sys_time_deinit(mqtt_client);
+#endif
 
     list_destroy(mqtt_client->list_pub_wait_ack);
     list_destroy(mqtt_client->list_sub_wait_ack);
@@ -227,6 +239,28 @@ int IOT_MQTT_Publish(void *pClient, char *topicName, PublishParams *pParams)
     return qcloud_iot_mqtt_publish(mqtt_client, topicName, pParams);
 }
 
+int IOT_MQTT_SetPublishRateLimit(void *pClient, MQTTPriority priority, uint32_t rate, uint32_t burst)
+{
+    IOT_FUNC_ENTRY;
+
+    POINTER_SANITY_CHECK(pClient, QCLOUD_ERR_INVAL);
+    if (priority >= MQTT_PRIO_MAX || (rate && !burst)) {
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_INVAL);
+    }
+
+    Qcloud_IoT_Client *mqtt_client = (Qcloud_IoT_Client *)pClient;
+
+    /* the buckets belong to the send queue writer, which holds lock_write_buf */
+    HAL_MutexLock(mqtt_client->lock_write_buf);
+    mqtt_client->send_limit[priority].rate    = rate;
+    mqtt_client->send_limit[priority].burst   = burst;
+    mqtt_client->send_limit[priority].tokens  = burst * 1000;
+    mqtt_client->send_limit[priority].last_ms = HAL_GetTimeMs();
+    HAL_MutexUnlock(mqtt_client->lock_write_buf);
+
+    IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
+}
+
 int IOT_MQTT_Subscribe(void *pClient, char *topicFilter, SubscribeParams *pParams)
 {
     Qcloud_IoT_Client *mqtt_client = (Qcloud_IoT_Client *)pClient;
@@ -274,13 +308,9 @@ int qcloud_iot_mqtt_init(Qcloud_IoT_Client *pClient, MQTTInitParams *pParams)
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
     }
 
-    int i = 0;
-    for (i = 0; i < MAX_MESSAGE_HANDLERS; ++i) {
-        pClient->sub_handles[i].topic_filter      = NULL;
-        pClient->sub_handles[i].message_handler   = NULL;
-        pClient->sub_handles[i].sub_event_handler = NULL;
-        pClient->sub_handles[i].qos               = QOS0;
-        pClient->sub_handles[i].handler_user_data = NULL;
+    int rc = qcloud_iot_mqtt_init_topics(pClient, pParams->product_id, pParams->device_name);
+    if (rc != QCLOUD_RET_SUCCESS) {
+        IOT_FUNC_EXIT_RC(rc);
     }
 
     if (pParams->command_timeout < MIN_COMMAND_TIMEOUT)
@@ -318,6 +348,10 @@ int qcloud_iot_mqtt_init(Qcloud_IoT_Client *pClient, MQTTInitParams *pParams)
         Log_e("create pub list lock failed.");
         goto error;
     }
+    if ((pClient->lock_sub_table = HAL_MutexCreate()) == NULL) {
+        Log_e("create sub table lock failed.");
+        goto error;
+    }
 
     if ((pClient->list_pub_wait_ack = list_new()) == NULL) {
         Log_e("create pub wait list failed.");
@@ -358,9 +392,8 @@ int qcloud_iot_mqtt_init(Qcloud_IoT_Client *pClient, MQTTInitParams *pParams)
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_INVAL);
     }
 
-    memset(sg_psk_id_str, 0, MAX_SIZE_OF_CLIENT_ID);
-    HAL_Snprintf(sg_psk_id_str, MAX_SIZE_OF_CLIENT_ID, "%s%s", pParams->product_id, pParams->device_name);
-    pClient->network_stack.ssl_connect_params.psk_id = sg_psk_id_str;
+    HAL_Snprintf(pClient->psk_id, MAX_SIZE_OF_CLIENT_ID, "%s%s", pParams->product_id, pParams->device_name);
+    pClient->network_stack.ssl_connect_params.psk_id = pClient->psk_id;
 
     pClient->network_stack.ssl_connect_params.ca_crt     = NULL;
     pClient->network_stack.ssl_connect_params.ca_crt_len = 0;
@@ -384,9 +417,16 @@ int qcloud_iot_mqtt_init(Qcloud_IoT_Client *pClient, MQTTInitParams *pParams)
     InitTimer(&(pClient->reconnect_delay_timer));
 
 #ifdef SYSTEM_COMM
-    pClient->sys_state.result_recv_ok = false;
-    pClient->sys_state.topic_sub_ok   = false;
-    pClient->sys_state.time           = 0;
+    if (qcloud_iot_sys_time_init(pClient) != QCLOUD_RET_SUCCESS) {
+        goto error;
+    }
+#endif
+
+#ifdef MQTT_ASYNC_DISPATCH
+    if (qcloud_iot_mqtt_dispatch_init(pClient) != QCLOUD_RET_SUCCESS) {
+        Log_e("start mqtt dispatch threads failed.");
+        goto error;
+    }
 #endif
 
     IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
@@ -416,6 +456,13 @@ error:
         HAL_MutexDestroy(pClient->lock_write_buf);
         pClient->lock_write_buf = NULL;
     }
+    if (pClient->lock_sub_table) {
+        HAL_MutexDestroy(pClient->lock_sub_table);
+        pClient->lock_sub_table = NULL;
+    }
+#ifdef SYSTEM_COMM
+    qcloud_iot_sys_time_deinit(pClient);
+#endif
 
     IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE)
 }
@@ -426,11 +473,20 @@ int qcloud_iot_mqtt_fini(Qcloud_IoT_Client *mqtt_client)
 
     POINTER_SANITY_CHECK(mqtt_client, QCLOUD_ERR_INVAL);
 
+#ifdef MQTT_ASYNC_DISPATCH
+    qcloud_iot_mqtt_dispatch_deinit(mqtt_client);
+#endif
+    qcloud_iot_mqtt_send_queue_deinit(mqtt_client);
+
     HAL_MutexDestroy(mqtt_client->lock_generic);
     HAL_MutexDestroy(mqtt_client->lock_write_buf);
 
     HAL_MutexDestroy(mqtt_client->lock_list_sub);
     HAL_MutexDestroy(mqtt_client->lock_list_pub);
+    HAL_MutexDestroy(mqtt_client->lock_sub_table);
+#ifdef SYSTEM_COMM
+    qcloud_iot_sys_time_deinit(mqtt_client);
+#endif
 
     list_destroy(mqtt_client->list_pub_wait_ack);
     list_destroy(mqtt_client->list_sub_wait_ack);
@@ -26,6 +26,9 @@ extern "C" {
 #include "mqtt_client.h"
 #include "utils_list.h"
 
+#define IOT_HEAP_TAG IOT_HEAP_MQTT
+#include "utils_heap.h"
+
 /* remain waiting time after MQTT header is received (unit: ms) */
 #define QCLOUD_IOT_MQTT_MAX_REMAIN_WAIT_MS (2000)
 
@@ -537,8 +540,8 @@ int send_mqtt_packet(Qcloud_IoT_Client *pClient, size_t length, Timer *timer)
     }
 
     while (sent < length && !expired(timer)) {
-        rc = pClient->network_stack.write(&(pClient->network_stack), &pClient->write_buf[sent], length, left_ms(timer),
-                                          &sentLen);
+        rc = pClient->network_stack.write(&(pClient->network_stack), &pClient->write_buf[sent], length - sent,
+                                          left_ms(timer), &sentLen);
         if (rc != QCLOUD_RET_SUCCESS) {
             /* there was an error writing the data */
             break;
@@ -555,6 +558,348 @@ int send_mqtt_packet(Qcloud_IoT_Client *pClient, size_t length, Timer *timer)
     IOT_FUNC_EXIT_RC(rc);
 }
 
+MQTTSendItem *qcloud_iot_mqtt_send_item_get(Qcloud_IoT_Client *pClient)
+{
+    MQTTSendItem *item;
+    int           i;
+
+    for (i = 0; i < MQTT_SEND_POOL_SIZE; i++) {
+        if (__atomic_exchange_n(&pClient->send_pool_busy[i], 1, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+        /* the slot is ours until put back, so allocating it lazily is race free */
+        if (NULL == pClient->send_pool[i]) {
+            item = (MQTTSendItem *)HAL_Malloc(sizeof(MQTTSendItem) + pClient->write_buf_size);
+            if (NULL == item) {
+                __atomic_store_n(&pClient->send_pool_busy[i], 0, __ATOMIC_RELEASE);
+                break;
+            }
+            item->pool_index      = i;
+            item->buf             = (unsigned char *)item + sizeof(MQTTSendItem);
+            pClient->send_pool[i] = item;
+        }
+        pClient->send_pool[i]->next = NULL;
+        pClient->send_pool[i]->len  = 0;
+        return pClient->send_pool[i];
+    }
+
+    item = (MQTTSendItem *)HAL_Malloc(sizeof(MQTTSendItem) + pClient->write_buf_size);
+    if (NULL == item) {
+        Log_e("memory malloc failed!");
+        return NULL;
+    }
+    item->next       = NULL;
+    item->pool_index = -1;
+    item->len        = 0;
+    item->buf        = (unsigned char *)item + sizeof(MQTTSendItem);
+
+    return item;
+}
+
+void qcloud_iot_mqtt_send_item_put(Qcloud_IoT_Client *pClient, MQTTSendItem *item)
+{
+    if (item->pool_index < 0) {
+        HAL_Free(item);
+    } else {
+        __atomic_store_n(&pClient->send_pool_busy[item->pool_index], 0, __ATOMIC_RELEASE);
+    }
+}
+
+/* order in which the writer serves the priority classes */
+static const MQTTPriority sg_send_order[MQTT_PRIO_MAX] = {MQTT_PRIO_CONTROL, MQTT_PRIO_EVENT, MQTT_PRIO_TELEMETRY,
+                                                          MQTT_PRIO_LOG};
+
+static void _send_queue_take(Qcloud_IoT_Client *pClient)
+{
+    MQTTSendItem *item;
+    MQTTSendItem *fifo;
+    MQTTSendItem *next;
+    int           prio;
+
+    for (prio = 0; prio < MQTT_PRIO_MAX; prio++) {
+        item = __atomic_exchange_n(&pClient->send_queue[prio], NULL, __ATOMIC_SEQ_CST);
+        if (NULL == item) {
+            continue;
+        }
+
+        /* the queue is a LIFO stack, reverse it to send in publishing order */
+        fifo = NULL;
+        while (NULL != item) {
+            next       = item->next;
+            item->next = fifo;
+            fifo       = item;
+            item       = next;
+        }
+
+        if (NULL == pClient->send_pending[prio]) {
+            pClient->send_pending[prio] = fifo;
+        } else {
+            pClient->send_pending_tail[prio]->next = fifo;
+        }
+        while (NULL != fifo->next) {
+            fifo = fifo->next;
+        }
+        pClient->send_pending_tail[prio] = fifo;
+    }
+}
+
+static bool _send_limit_take(MQTTRateLimit *limit)
+{
+    uint32_t now;
+    uint64_t tokens;
+
+    if (0 == limit->rate) {
+        return true;
+    }
+
+    /* tokens are counted in 1/1000 packet, so a refill of ms * packets/s is exact */
+    now            = HAL_GetTimeMs();
+    tokens         = limit->tokens + (uint64_t)(uint32_t)(now - limit->last_ms) * limit->rate;
+    limit->last_ms = now;
+    if (tokens > (uint64_t)limit->burst * 1000) {
+        tokens = (uint64_t)limit->burst * 1000;
+    }
+
+    if (tokens < 1000) {
+        limit->tokens = (uint32_t)tokens;
+        return false;
+    }
+    limit->tokens = (uint32_t)(tokens - 1000);
+
+    return true;
+}
+
+/* pop the next packet that fits in room, NULL if the batch should be sent now */
+static MQTTSendItem *_send_queue_next(Qcloud_IoT_Client *pClient, size_t room)
+{
+    MQTTSendItem *item;
+    MQTTPriority  prio;
+    int           i;
+
+    for (i = 0; i < MQTT_PRIO_MAX; i++) {
+        prio = sg_send_order[i];
+        item = pClient->send_pending[prio];
+        if (NULL == item) {
+            continue;
+        }
+        /* never let a lower class overtake a higher one just because it is smaller */
+        if (item->len >= room) {
+            return NULL;
+        }
+        /* a throttled class waits for tokens while the lower classes go ahead */
+        if (!_send_limit_take(&pClient->send_limit[prio])) {
+            continue;
+        }
+
+        pClient->send_pending[prio] = item->next;
+        return item;
+    }
+
+    return NULL;
+}
+
+static void _send_queue_drop(Qcloud_IoT_Client *pClient)
+{
+    MQTTSendItem *item;
+    int           prio;
+
+    for (prio = 0; prio < MQTT_PRIO_MAX; prio++) {
+        while (NULL != (item = pClient->send_pending[prio])) {
+            pClient->send_pending[prio] = item->next;
+            qcloud_iot_mqtt_send_item_put(pClient, item);
+            __atomic_sub_fetch(&pClient->send_queue_len[prio], 1, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static int _send_queue_flush(Qcloud_IoT_Client *pClient)
+{
+    MQTTSendItem *item;
+    MQTTPriority  prio;
+    Timer         timer;
+    size_t        len;
+    int           rc = QCLOUD_RET_SUCCESS;
+
+    HAL_MutexLock(pClient->lock_write_buf);
+    for (;;) {
+        /* pick up new packets before every write, so a control reply skips the bulk backlog */
+        _send_queue_take(pClient);
+
+        /* coalesce as many packets as write_buf holds into one network write */
+        len = 0;
+        while (NULL != (item = _send_queue_next(pClient, pClient->write_buf_size - len))) {
+            memcpy(pClient->write_buf + len, item->buf, item->len);
+            len += item->len;
+
+            prio = item->priority;
+            qcloud_iot_mqtt_send_item_put(pClient, item);
+            __atomic_sub_fetch(&pClient->send_queue_len[prio], 1, __ATOMIC_RELAXED);
+        }
+
+        /* nothing left, or everything left is throttled */
+        if (0 == len) {
+            break;
+        }
+
+        InitTimer(&timer);
+        countdown_ms(&timer, pClient->command_timeout_ms);
+        rc = send_mqtt_packet(pClient, len, &timer);
+        if (QCLOUD_RET_SUCCESS != rc) {
+            /* the connection is broken, QoS1 packets are reported by publish timeout */
+            Log_e("send queued packets failed: %d, drop the rest", rc);
+            _send_queue_drop(pClient);
+            break;
+        }
+    }
+    HAL_MutexUnlock(pClient->lock_write_buf);
+
+    return rc;
+}
+
+static bool _send_queue_has_new(Qcloud_IoT_Client *pClient)
+{
+    int prio;
+
+    for (prio = 0; prio < MQTT_PRIO_MAX; prio++) {
+        if (NULL != __atomic_load_n(&pClient->send_queue[prio], __ATOMIC_SEQ_CST)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int qcloud_iot_mqtt_send_queue_flush(Qcloud_IoT_Client *pClient)
+{
+    int rc = QCLOUD_RET_SUCCESS;
+    int flush_rc;
+
+    /*
+     * Become the writer unless another thread already is. The writer checks the queue
+     * again after giving up the role, so a packet pushed while it was finishing is
+     * never left behind. Throttled packets wait for the next flush.
+     */
+    do {
+        if (__atomic_exchange_n(&pClient->send_writer, 1, __ATOMIC_SEQ_CST)) {
+            break;
+        }
+        flush_rc = _send_queue_flush(pClient);
+        if (QCLOUD_RET_SUCCESS != flush_rc) {
+            rc = flush_rc;
+        }
+        __atomic_store_n(&pClient->send_writer, 0, __ATOMIC_SEQ_CST);
+    } while (_send_queue_has_new(pClient));
+
+    return rc;
+}
+
+int qcloud_iot_mqtt_send_enqueue(Qcloud_IoT_Client *pClient, MQTTSendItem *item)
+{
+    Timer        timer;
+    MQTTPriority prio = item->priority;
+
+    if (item->len >= pClient->write_buf_size) {
+        qcloud_iot_mqtt_send_item_put(pClient, item);
+        return QCLOUD_ERR_BUF_TOO_SHORT;
+    }
+
+    /* a full queue means the writer is stuck on the network or the class is throttled, wait for it a while */
+    InitTimer(&timer);
+    countdown_ms(&timer, pClient->command_timeout_ms);
+    while (__atomic_add_fetch(&pClient->send_queue_len[prio], 1, __ATOMIC_RELAXED) > MQTT_SEND_QUEUE_MAX_LEN) {
+        __atomic_sub_fetch(&pClient->send_queue_len[prio], 1, __ATOMIC_RELAXED);
+        if (expired(&timer)) {
+            qcloud_iot_mqtt_send_item_put(pClient, item);
+            Log_e("more than %u packets in send queue %d. Queue overflow!", MQTT_SEND_QUEUE_MAX_LEN, prio);
+            return QCLOUD_ERR_MQTT_PUSH_TO_LIST_FAILED;
+        }
+        HAL_SleepMs(1);
+        /* the throttled packets are only sent by a flush */
+        qcloud_iot_mqtt_send_queue_flush(pClient);
+    }
+
+    item->next = __atomic_load_n(&pClient->send_queue[prio], __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&pClient->send_queue[prio], &item->next, item, true, __ATOMIC_SEQ_CST,
+                                        __ATOMIC_RELAXED)) {
+    }
+
+    return qcloud_iot_mqtt_send_queue_flush(pClient);
+}
+
+void qcloud_iot_mqtt_send_queue_deinit(Qcloud_IoT_Client *pClient)
+{
+    int i;
+
+    _send_queue_take(pClient);
+    _send_queue_drop(pClient);
+
+    for (i = 0; i < MQTT_SEND_POOL_SIZE; i++) {
+        HAL_Free(pClient->send_pool[i]);
+        pClient->send_pool[i]      = NULL;
+        pClient->send_pool_busy[i] = 0;
+    }
+}
+
+/**
+ * @brief Read len bytes of the MQTT stream, same return codes as network_stack.read
+ *
+ * With MQTT_RX_READ_AHEAD, whatever the network already holds is pulled into
+ * rx_ahead in one read, so small packets arriving together are framed
+ * without a select/recv for every byte of their header.
+ */
+static int _mqtt_net_read(Qcloud_IoT_Client *pClient, unsigned char *buf, size_t len, uint32_t timeout_ms,
+                          size_t *read_len)
+{
+#ifdef MQTT_RX_READ_AHEAD
+    size_t copy_len, got = 0;
+    int    rc;
+
+    *read_len = 0;
+    for (;;) {
+        copy_len = pClient->rx_ahead_len - pClient->rx_ahead_pos;
+        copy_len = copy_len > len - *read_len ? len - *read_len : copy_len;
+        memcpy(buf + *read_len, pClient->rx_ahead + pClient->rx_ahead_pos, copy_len);
+        pClient->rx_ahead_pos += copy_len;
+        *read_len += copy_len;
+        if (*read_len == len) {
+            return QCLOUD_RET_SUCCESS;
+        }
+
+        // read ahead buffer is drained, refill it unless the rest does not fit
+        pClient->rx_ahead_pos = 0;
+        pClient->rx_ahead_len = 0;
+        if (len - *read_len >= MQTT_RX_AHEAD_LEN) {
+            break;
+        }
+
+        rc = pClient->network_stack.read(&(pClient->network_stack), pClient->rx_ahead, MQTT_RX_AHEAD_LEN,
+                                         MQTT_RX_AHEAD_POLL_MS, &got);
+        pClient->rx_ahead_len = got;
+        if (0 == got) {
+            if (rc != QCLOUD_ERR_TCP_NOTHING_TO_READ && rc != QCLOUD_ERR_SSL_NOTHING_TO_READ &&
+                rc != QCLOUD_ERR_TCP_READ_TIMEOUT && rc != QCLOUD_ERR_SSL_READ_TIMEOUT && rc != QCLOUD_RET_SUCCESS) {
+                return rc;
+            }
+            // nothing arrived yet, wait for the rest below
+            break;
+        }
+    }
+
+    // wait for exactly the missing bytes so nothing is delayed by the poll
+    rc = pClient->network_stack.read(&(pClient->network_stack), buf + *read_len, len - *read_len, timeout_ms, &got);
+    *read_len += got;
+    if (*read_len > 0 && rc == QCLOUD_ERR_TCP_NOTHING_TO_READ) {
+        rc = QCLOUD_ERR_TCP_READ_TIMEOUT;
+    } else if (*read_len > 0 && rc == QCLOUD_ERR_SSL_NOTHING_TO_READ) {
+        rc = QCLOUD_ERR_SSL_READ_TIMEOUT;
+    }
+
+    return rc;
+#else
+    return pClient->network_stack.read(&(pClient->network_stack), buf, len, timeout_ms, read_len);
+#endif
+}
+
 static int _decode_packet_rem_len_with_net_read(Qcloud_IoT_Client *pClient, uint32_t *value, uint32_t timeout)
 {
     IOT_FUNC_ENTRY;
@@ -575,7 +920,7 @@ static int _decode_packet_rem_len_with_net_read(Qcloud_IoT_Client *pClient, uint
             IOT_FUNC_EXIT_RC(QCLOUD_ERR_MQTT_PACKET_READ)
         }
 
-        if ((pClient->network_stack.read(&(pClient->network_stack), &i, 1, timeout, &read_len)) != QCLOUD_RET_SUCCESS) {
+        if (_mqtt_net_read(pClient, &i, 1, timeout, &read_len) != QCLOUD_RET_SUCCESS) {
             /* The value argument is the important value. len is just used temporarily
              * and never used by the calling function for anything else */
             IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
@@ -620,7 +965,7 @@ static int _read_mqtt_packet(Qcloud_IoT_Client *pClient, Timer *timer, uint8_t *
     }
 
     // 1. read 1st byte in fixed header and check if valid
-    rc = pClient->network_stack.read(&(pClient->network_stack), pClient->read_buf, 1, timer_left_ms, &read_len);
+    rc = _mqtt_net_read(pClient, pClient->read_buf, 1, timer_left_ms, &read_len);
     if (rc == QCLOUD_ERR_SSL_NOTHING_TO_READ || rc == QCLOUD_ERR_TCP_NOTHING_TO_READ) {
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_MQTT_NOTHING_TO_READ);
     } else if (rc != QCLOUD_RET_SUCCESS) {
@@ -656,8 +1001,7 @@ static int _read_mqtt_packet(Qcloud_IoT_Client *pClient, Timer *timer, uint8_t *
 
         bytes_to_be_read = pClient->read_buf_size;
         do {
-            ret_val = pClient->network_stack.read(&(pClient->network_stack), pClient->read_buf, bytes_to_be_read,
-                                                  timer_left_ms, &read_len);
+            ret_val = _mqtt_net_read(pClient, pClient->read_buf, bytes_to_be_read, timer_left_ms, &read_len);
             if (ret_val == QCLOUD_RET_SUCCESS) {
                 total_bytes_read += read_len;
                 if ((rem_len - total_bytes_read) >= pClient->read_buf_size) {
@@ -682,7 +1026,7 @@ static int _read_mqtt_packet(Qcloud_IoT_Client *pClient, Timer *timer, uint8_t *
         }
         timer_left_ms += QCLOUD_IOT_MQTT_MAX_REMAIN_WAIT_MS;
 
-        pClient->network_stack.read(&(pClient->network_stack), pClient->read_buf, rem_len, timer_left_ms, &read_len);
+        _mqtt_net_read(pClient, pClient->read_buf, rem_len, timer_left_ms, &read_len);
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_BUF_TOO_SHORT);
     } else {
         if (rem_len > 0) {
@@ -691,8 +1035,7 @@ static int _read_mqtt_packet(Qcloud_IoT_Client *pClient, Timer *timer, uint8_t *
                 timer_left_ms = 1;
             }
             timer_left_ms += QCLOUD_IOT_MQTT_MAX_REMAIN_WAIT_MS;
-            rc = pClient->network_stack.read(&(pClient->network_stack), pClient->read_buf + len, rem_len, timer_left_ms,
-                                             &read_len);
+            rc = _mqtt_net_read(pClient, pClient->read_buf + len, rem_len, timer_left_ms, &read_len);
             if (rc != QCLOUD_RET_SUCCESS) {
                 IOT_FUNC_EXIT_RC(rc);
             }
@@ -791,24 +1134,33 @@ static int _deliver_message(Qcloud_IoT_Client *pClient, char *topicName, uint16_
     message->ptopic    = topicName;
     message->topic_len = (size_t)topicNameLen;
 
-    uint32_t i;
-    HAL_MutexLock(pClient->lock_generic);
-    for (i = 0; i < MAX_MESSAGE_HANDLERS; ++i) {
-        if ((pClient->sub_handles[i].topic_filter != NULL) &&
-            (_is_topic_equals(topicName, (char *)pClient->sub_handles[i].topic_filter) ||
-             _is_topic_matched((char *)pClient->sub_handles[i].topic_filter, topicName, topicNameLen))) {
-            HAL_MutexUnlock(pClient->lock_generic);
-            if (pClient->sub_handles[i].message_handler != NULL) {
-                pClient->sub_handles[i].message_handler(pClient, message, pClient->sub_handles[i].handler_user_data);
-                IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
+    /* the snapshot and its topic filters stay valid until release, even if unsubscribed meanwhile */
+    uint32_t        i;
+    SubHandleTable *table = qcloud_iot_mqtt_sub_table_acquire(pClient);
+    for (i = 0; table && i < table->count; ++i) {
+        SubTopicHandle *handle = &table->entries[i]->handle;
+        if ((_is_topic_equals(topicName, (char *)handle->topic_filter) ||
+             _is_topic_matched((char *)handle->topic_filter, topicName, topicNameLen)) &&
+            handle->message_handler != NULL) {
+#ifdef MQTT_ASYNC_DISPATCH
+            /* never run here, it could overtake the queued messages of the filter or race with its thread */
+            if (__atomic_load_n(&pClient->dispatch_running, __ATOMIC_ACQUIRE)) {
+                int rc = qcloud_iot_mqtt_dispatch_message(pClient, table->entries[i], message);
+                qcloud_iot_mqtt_sub_table_release(pClient);
+                IOT_FUNC_EXIT_RC(rc);
             }
-            HAL_MutexLock(pClient->lock_generic);
+#endif
+            IOT_TRACE_BEGIN(t_handler);
+            handle->message_handler(pClient, message, handle->handler_user_data);
+            IOT_TRACE_END(t_handler, "mqtt", "message_handler", QCLOUD_RET_SUCCESS);
+            qcloud_iot_mqtt_sub_table_release(pClient);
+            IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
         }
     }
 
     /* Message handler not found for topic */
     /* May be we do not care  change FAILURE  use SUCCESS*/
-    HAL_MutexUnlock(pClient->lock_generic);
+    qcloud_iot_mqtt_sub_table_release(pClient);
 
     Log_d("no matching any topic, call default handle function");
 
@@ -908,7 +1260,7 @@ static int _mask_sub_info_from(Qcloud_IoT_Client *c, unsigned int msgId, SubTopi
                 continue;
             }
 
-            if (sub_info->msg_id == msgId) {
+            if (sub_info->msg_id == msgId && MQTT_NODE_STATE_INVALID != sub_info->node_state) {
                 *messageHandler      = sub_info->handler;       /* return handle */
                 sub_info->node_state = MQTT_NODE_STATE_INVALID; /* mark as invalid node */
             }
@@ -937,6 +1289,7 @@ static int _handle_puback_packet(Qcloud_IoT_Client *pClient, Timer *timer)
     }
 
     (void)_mask_pubInfo_from(pClient, packet_id);
+    IOT_TRACE_ASYNC_END("mqtt", "publish", IOT_TRACE_PACKET_ID(pClient, packet_id), QCLOUD_RET_SUCCESS);
 
     /* notify this event to user callback */
     if (NULL != pClient->event_handle.h_fp) {
@@ -967,9 +1320,11 @@ static int _handle_suback_packet(Qcloud_IoT_Client *pClient, Timer *timer, QoS q
         IOT_FUNC_EXIT_RC(rc);
     }
 
-    int flag_dup = 0, i_free = -1;
+    uint32_t i;
     // check return code in SUBACK packet: 0x00(QOS0, SUCCESS),0x01(QOS1,
     // SUCCESS),0x02(QOS2, SUCCESS),0x80(Failure)
+    IOT_TRACE_ASYNC_END("mqtt", "subscribe", IOT_TRACE_PACKET_ID(pClient, packet_id),
+                        grantedQoS[0] == 0x80 ? QCLOUD_ERR_MQTT_SUB : QCLOUD_RET_SUCCESS);
     if (grantedQoS[0] == 0x80) {
         MQTTEventMsg msg;
 
@@ -980,67 +1335,67 @@ static int _handle_suback_packet(Qcloud_IoT_Client *pClient, Timer *timer, QoS q
         sub_nack = true;
     }
 
-    HAL_MutexLock(pClient->lock_generic);
-
     SubTopicHandle sub_handle;
     memset(&sub_handle, 0, sizeof(SubTopicHandle));
+
+    /* taken with the table locked, an unsubscribe either cancels the request or finds the handler installed */
+    HAL_MutexLock(pClient->lock_sub_table);
     (void)_mask_sub_info_from(pClient, (unsigned int)packet_id, &sub_handle);
 
-    if (/*(NULL == sub_handle.message_handler) || */ (NULL == sub_handle.topic_filter)) {
-        Log_e("sub_handle is illegal, topic is null");
-        HAL_MutexUnlock(pClient->lock_generic);
-        IOT_FUNC_EXIT_RC(QCLOUD_ERR_MQTT_SUB);
+    if (NULL == sub_handle.topic_filter) {
+        HAL_MutexUnlock(pClient->lock_sub_table);
+        Log_w("no subscribe request of packet_id: %u, timeout or cancelled", packet_id);
+        IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
     }
 
     if (sub_nack) {
-        HAL_MutexUnlock(pClient->lock_generic);
         Log_e("MQTT SUBSCRIBE failed, packet_id: %u topic: %s", packet_id, sub_handle.topic_filter);
-        /* notify this event to topic subscriber */
-        if (NULL != sub_handle.sub_event_handler)
-            sub_handle.sub_event_handler(pClient, MQTT_EVENT_SUBCRIBE_NACK, sub_handle.handler_user_data);
+        /* notify this event to topic subscriber, queued before an unsubscribe can look for the request */
+        qcloud_iot_mqtt_notify_sub_event(pClient, NULL, &sub_handle, MQTT_EVENT_SUBCRIBE_NACK);
+        HAL_MutexUnlock(pClient->lock_sub_table);
 
         HAL_Free((void *)sub_handle.topic_filter);
         sub_handle.topic_filter = NULL;
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_MQTT_SUB);
     }
 
-    int i;
-    for (i = 0; i < MAX_MESSAGE_HANDLERS; ++i) {
-        if ((NULL != pClient->sub_handles[i].topic_filter)) {
-            if (0 == _check_handle_is_identical(&pClient->sub_handles[i], &sub_handle)) {
-                flag_dup = 1;
-                Log_w("Identical topic found: %s", sub_handle.topic_filter);
-                if (pClient->sub_handles[i].handler_user_data != sub_handle.handler_user_data) {
-                    Log_w("Update handler_user_data %p -> %p!", pClient->sub_handles[i].handler_user_data,
-                          sub_handle.handler_user_data);
-                    pClient->sub_handles[i].handler_user_data = sub_handle.handler_user_data;
-                }
-                HAL_Free((void *)sub_handle.topic_filter);
-                sub_handle.topic_filter = NULL;
-                break;
-            }
-        } else {
-            if (-1 == i_free) {
-                i_free = i; /* record available element */
+    /* entries are never changed in place, a duplicated subscription gets a new entry */
+    SubHandleTable *table = qcloud_iot_mqtt_sub_table_copy(pClient);
+    if (NULL == table) {
+        HAL_MutexUnlock(pClient->lock_sub_table);
+        HAL_Free((void *)sub_handle.topic_filter);
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_MALLOC);
+    }
+
+    for (i = 0; i < table->count; ++i) {
+        if (0 == _check_handle_is_identical(&table->entries[i]->handle, &sub_handle)) {
+            Log_w("Identical topic found: %s", sub_handle.topic_filter);
+            if (table->entries[i]->handle.handler_user_data != sub_handle.handler_user_data) {
+                Log_w("Update handler_user_data %p -> %p!", table->entries[i]->handle.handler_user_data,
+                      sub_handle.handler_user_data);
             }
+            break;
         }
     }
 
-    if (0 == flag_dup) {
-        if (-1 == i_free) {
-            Log_e("NO more @sub_handles space!");
-            HAL_MutexUnlock(pClient->lock_generic);
-            IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
-        } else {
-            pClient->sub_handles[i_free].topic_filter      = sub_handle.topic_filter;
-            pClient->sub_handles[i_free].message_handler   = sub_handle.message_handler;
-            pClient->sub_handles[i_free].sub_event_handler = sub_handle.sub_event_handler;
-            pClient->sub_handles[i_free].qos               = sub_handle.qos;
-            pClient->sub_handles[i_free].handler_user_data = sub_handle.handler_user_data;
-        }
+    if (i >= MAX_MESSAGE_HANDLERS) {
+        Log_e("NO more @sub_handles space!");
+        rc = QCLOUD_ERR_FAILURE;
+    } else {
+        rc = qcloud_iot_mqtt_sub_table_set(table, i, &sub_handle);
     }
 
-    HAL_MutexUnlock(pClient->lock_generic);
+    if (QCLOUD_RET_SUCCESS != rc) {
+        qcloud_iot_mqtt_sub_table_free(table);
+        HAL_MutexUnlock(pClient->lock_sub_table);
+        HAL_Free((void *)sub_handle.topic_filter);
+        IOT_FUNC_EXIT_RC(rc);
+    }
+
+    /* sub_handle.topic_filter now belongs to the table, stay a reader until the notification is done */
+    (void)qcloud_iot_mqtt_sub_table_acquire(pClient);
+    qcloud_iot_mqtt_sub_table_replace(pClient, table);
+    HAL_MutexUnlock(pClient->lock_sub_table);
 
     /* notify this event to user callback */
     if (NULL != pClient->event_handle.h_fp) {
@@ -1051,9 +1406,9 @@ static int _handle_suback_packet(Qcloud_IoT_Client *pClient, Timer *timer, QoS q
             pClient->event_handle.h_fp(pClient, pClient->event_handle.context, &msg);
     }
 
-    /* notify this event to topic subscriber */
-    if (NULL != sub_handle.sub_event_handler)
-        sub_handle.sub_event_handler(pClient, MQTT_EVENT_SUBCRIBE_SUCCESS, sub_handle.handler_user_data);
+    /* notify this event to topic subscriber, dropped if it is unsubscribed meanwhile */
+    qcloud_iot_mqtt_notify_sub_event(pClient, table->entries[i], &sub_handle, MQTT_EVENT_SUBCRIBE_SUCCESS);
+    qcloud_iot_mqtt_sub_table_release(pClient);
 
     IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
 }
@@ -1148,6 +1503,9 @@ static int _handle_publish_packet(Qcloud_IoT_Client *pClient, Timer *timer)
         IOT_FUNC_EXIT_RC(rc);
     }
 
+    // handlers parse payload in place, the byte after read_buf_size is reserved for the terminator
+    ((char *)msg.payload)[msg.payload_len] = '\0';
+
     // topicName from packet is NOT null terminated
     char fix_topic[MAX_SIZE_OF_CLOUD_TOPIC] = {0};
 
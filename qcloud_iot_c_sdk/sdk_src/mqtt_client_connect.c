@@ -26,6 +26,9 @@ extern "C" {
 #include "qcloud_iot_common.h"
 #include "utils_hmac.h"
 
+#define IOT_HEAP_TAG IOT_HEAP_MQTT
+#include "utils_heap.h"
+
 #define MQTT_CONNECT_FLAG_USERNAME    0x80
 #define MQTT_CONNECT_FLAG_PASSWORD    0x40
 #define MQTT_CONNECT_FLAG_WILL_RETAIN 0x20
@@ -337,12 +340,21 @@ static int _mqtt_connect(Qcloud_IoT_Client *pClient, MQTTConnectParams *options)
         _copy_connect_params(&(pClient->options), options);
     }
 
+#ifdef MQTT_RX_READ_AHEAD
+    // drop the bytes left from the last connection
+    pClient->rx_ahead_pos = 0;
+    pClient->rx_ahead_len = 0;
+#endif
+
     // TCP or TLS network connect
+    IOT_TRACE_BEGIN(t_net);
     rc = pClient->network_stack.connect(&(pClient->network_stack));
+    IOT_TRACE_END(t_net, "net", "connect", rc);
     if (QCLOUD_RET_SUCCESS != rc) {
         IOT_FUNC_EXIT_RC(rc);
     }
 
+    IOT_TRACE_BEGIN(t_connack);
     HAL_MutexLock(pClient->lock_write_buf);
     // serialize CONNECT packet
     rc = _serialize_connect_packet(pClient->write_buf, pClient->write_buf_size, &(pClient->options), &len);
@@ -361,6 +373,7 @@ static int _mqtt_connect(Qcloud_IoT_Client *pClient, MQTTConnectParams *options)
 
     // wait for CONNACK
     rc = wait_for_read(pClient, CONNACK, &connect_timer, QOS0);
+    IOT_TRACE_END(t_connack, "mqtt", "connack", rc);
     if (QCLOUD_RET_SUCCESS != rc) {
         IOT_FUNC_EXIT_RC(rc);
     }
@@ -397,7 +410,9 @@ int qcloud_iot_mqtt_connect(Qcloud_IoT_Client *pClient, MQTTConnectParams *pPara
         IOT_FUNC_EXIT_RC(QCLOUD_RET_MQTT_ALREADY_CONNECTED);
     }
 
+    IOT_TRACE_BEGIN(t_connect);
     rc = _mqtt_connect(pClient, pParams);
+    IOT_TRACE_END(t_connect, "mqtt", "connect", rc);
 
     // disconnect network if connect fail
     if (rc != QCLOUD_RET_SUCCESS) {
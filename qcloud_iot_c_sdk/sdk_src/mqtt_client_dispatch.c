@@ -0,0 +1,377 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub
+ available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file
+ except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software
+ distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ KIND,
+ * either express or implied. See the License for the specific language
+ governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <string.h>
+
+#include "mqtt_client.h"
+
+#define IOT_HEAP_TAG IOT_HEAP_MQTT
+#include "utils_heap.h"
+
+#ifdef MQTT_ASYNC_DISPATCH
+
+/* how long an idle dispatch thread sleeps before checking if it should exit */
+#define MQTT_DISPATCH_IDLE_WAIT_MS (500)
+
+/* how often deinit warns while it waits for a busy dispatch thread to exit */
+#define MQTT_DISPATCH_EXIT_WAIT_MS (2000)
+
+static uint32_t _dispatch_hash(const char *topic_filter)
+{
+    /* FNV-1a, a topic filter always maps to the same thread to keep its messages and events in order */
+    uint32_t hash = 2166136261u;
+
+    while (*topic_filter) {
+        hash = (hash ^ (unsigned char)*topic_filter++) * 16777619u;
+    }
+
+    return hash;
+}
+
+/* called with the worker lock held and a snapshot acquired, so the current one is not freed meanwhile */
+static bool _dispatch_entry_current(Qcloud_IoT_Client *pClient, const SubHandleEntry *entry)
+{
+    SubHandleTable *table = __atomic_load_n(&pClient->sub_table, __ATOMIC_SEQ_CST);
+    uint32_t        i;
+
+    for (i = 0; table && i < table->count; i++) {
+        if (table->entries[i] == entry) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Queue a job, waiting for room while the ring buffer is full. A job of an entry
+ * checked under the lock is dropped if the entry left the table, an unsubscribe
+ * reads the fence of the thread after the removal, with the same lock.
+ */
+static int _dispatch_push(Qcloud_IoT_Client *pClient, MQTTDispatchJob *job, const SubHandleEntry *entry)
+{
+    MQTTDispatchWorker *worker = &pClient->dispatch_workers[job->filter_hash % MQTT_DISPATCH_WORKERS];
+    Timer               timer;
+
+    InitTimer(&timer);
+    countdown_ms(&timer, MQTT_DISPATCH_PUSH_WAIT_MS);
+    for (;;) {
+        HAL_MutexLock(worker->lock);
+        if (NULL != entry && !_dispatch_entry_current(pClient, entry)) {
+            HAL_MutexUnlock(worker->lock);
+            HAL_Free(job);
+            return QCLOUD_RET_SUCCESS;
+        }
+
+        if (worker->count < MQTT_DISPATCH_QUEUE_LEN) {
+            worker->jobs[(worker->head + worker->count) % MQTT_DISPATCH_QUEUE_LEN] = job;
+            worker->count++;
+            worker->pushed++;
+            HAL_MutexUnlock(worker->lock);
+            HAL_SemaphorePost(worker->sem);
+            return QCLOUD_RET_SUCCESS;
+        }
+
+        if (expired(&timer) || !__atomic_load_n(&pClient->dispatch_running, __ATOMIC_ACQUIRE)) {
+            HAL_MutexUnlock(worker->lock);
+            HAL_Free(job);
+            return QCLOUD_ERR_MQTT_PUSH_TO_LIST_FAILED;
+        }
+        worker->push_waiters++;
+        HAL_MutexUnlock(worker->lock);
+
+        HAL_SemaphoreWait(worker->room, left_ms(&timer));
+
+        HAL_MutexLock(worker->lock);
+        worker->push_waiters--;
+        HAL_MutexUnlock(worker->lock);
+    }
+}
+
+static MQTTDispatchJob *_dispatch_pop(MQTTDispatchWorker *worker)
+{
+    MQTTDispatchJob *job = NULL;
+    bool             wake;
+
+    HAL_MutexLock(worker->lock);
+    if (worker->count > 0) {
+        job          = worker->jobs[worker->head];
+        worker->head = (worker->head + 1) % MQTT_DISPATCH_QUEUE_LEN;
+        worker->count--;
+    }
+    wake = NULL != job && worker->push_waiters > 0;
+    HAL_MutexUnlock(worker->lock);
+
+    if (wake) {
+        HAL_SemaphorePost(worker->room);
+    }
+
+    return job;
+}
+
+static void _dispatch_finish(MQTTDispatchWorker *worker, MQTTDispatchJob *job)
+{
+    HAL_Free(job);
+
+    HAL_MutexLock(worker->lock);
+    worker->finished++;
+    HAL_MutexUnlock(worker->lock);
+}
+
+static void _dispatch_thread(void *arg)
+{
+    MQTTDispatchWorker *worker  = (MQTTDispatchWorker *)arg;
+    Qcloud_IoT_Client * pClient = (Qcloud_IoT_Client *)worker->client;
+    MQTTDispatchJob *   job;
+
+    __atomic_store_n(&worker->thread_id, HAL_ThreadGetId(), __ATOMIC_RELEASE);
+    while (__atomic_load_n(&pClient->dispatch_running, __ATOMIC_ACQUIRE)) {
+        HAL_SemaphoreWait(worker->sem, MQTT_DISPATCH_IDLE_WAIT_MS);
+
+        while (__atomic_load_n(&pClient->dispatch_running, __ATOMIC_ACQUIRE) && NULL != (job = _dispatch_pop(worker))) {
+            /* both handlers are cleared when the job is dropped by a fence */
+            if (NULL != job->message_handler) {
+                IOT_TRACE_BEGIN(t_handler);
+                job->message_handler(pClient, &job->message, job->handler_user_data);
+                IOT_TRACE_END(t_handler, "mqtt", "message_handler", QCLOUD_RET_SUCCESS);
+            } else if (NULL != job->sub_event_handler) {
+                job->sub_event_handler(pClient, job->event_type, job->handler_user_data);
+            }
+            _dispatch_finish(worker, job);
+        }
+    }
+
+    __atomic_sub_fetch(&pClient->dispatch_alive, 1, __ATOMIC_RELEASE);
+}
+
+int qcloud_iot_mqtt_dispatch_init(Qcloud_IoT_Client *pClient)
+{
+    IOT_FUNC_ENTRY;
+
+    POINTER_SANITY_CHECK(pClient, QCLOUD_ERR_INVAL);
+
+    MQTTDispatchWorker *worker;
+    int                 i;
+
+    pClient->dispatch_running = 1;
+    for (i = 0; i < MQTT_DISPATCH_WORKERS; i++) {
+        worker = &pClient->dispatch_workers[i];
+        memset(worker, 0, sizeof(MQTTDispatchWorker));
+        worker->client = pClient;
+
+        if (NULL == (worker->lock = HAL_MutexCreate()) || NULL == (worker->sem = HAL_SemaphoreCreate()) ||
+            NULL == (worker->room = HAL_SemaphoreCreate())) {
+            Log_e("create dispatch lock failed.");
+            goto error;
+        }
+
+        worker->thread.thread_func    = _dispatch_thread;
+        worker->thread.thread_name    = "mqtt_dispatch_thread";
+        worker->thread.user_arg       = worker;
+        worker->thread.stack_size     = MQTT_DISPATCH_STACK_SIZE;
+        worker->thread.priority_class = THREAD_PRIO_DISPATCH;
+        worker->thread.core_mask      = QCLOUD_IOT_THREAD_CORE_MASK;
+
+        __atomic_add_fetch(&pClient->dispatch_alive, 1, __ATOMIC_RELEASE);
+        if (QCLOUD_RET_SUCCESS != HAL_ThreadCreate(&worker->thread)) {
+            __atomic_sub_fetch(&pClient->dispatch_alive, 1, __ATOMIC_RELEASE);
+            Log_e("create mqtt_dispatch_thread failed.");
+            goto error;
+        }
+    }
+
+    IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
+
+error:
+    qcloud_iot_mqtt_dispatch_deinit(pClient);
+    IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
+}
+
+void qcloud_iot_mqtt_dispatch_deinit(Qcloud_IoT_Client *pClient)
+{
+    MQTTDispatchWorker *worker;
+    MQTTDispatchJob *   job;
+    Timer               timer;
+    int                 i;
+
+    __atomic_store_n(&pClient->dispatch_running, 0, __ATOMIC_RELEASE);
+    for (i = 0; i < MQTT_DISPATCH_WORKERS; i++) {
+        if (NULL != pClient->dispatch_workers[i].sem) {
+            HAL_SemaphorePost(pClient->dispatch_workers[i].sem);
+        }
+        if (NULL != pClient->dispatch_workers[i].room) {
+            HAL_SemaphorePost(pClient->dispatch_workers[i].room);
+        }
+    }
+
+    /* a thread busy in a slow callback finishes it before it sees the stop, the workers live in pClient */
+    InitTimer(&timer);
+    countdown_ms(&timer, MQTT_DISPATCH_EXIT_WAIT_MS);
+    while (__atomic_load_n(&pClient->dispatch_alive, __ATOMIC_ACQUIRE) > 0) {
+        if (expired(&timer)) {
+            Log_w("%u dispatch threads still busy in callback, waiting", pClient->dispatch_alive);
+            countdown_ms(&timer, MQTT_DISPATCH_EXIT_WAIT_MS);
+        }
+        HAL_SleepMs(10);
+    }
+
+    for (i = 0; i < MQTT_DISPATCH_WORKERS; i++) {
+        worker = &pClient->dispatch_workers[i];
+        if (NULL != worker->lock) {
+            while (NULL != (job = _dispatch_pop(worker))) {
+                _dispatch_finish(worker, job);
+            }
+            HAL_MutexDestroy(worker->lock);
+            worker->lock = NULL;
+        }
+        if (NULL != worker->sem) {
+            HAL_SemaphoreDestroy(worker->sem);
+            worker->sem = NULL;
+        }
+        if (NULL != worker->room) {
+            HAL_SemaphoreDestroy(worker->room);
+            worker->room = NULL;
+        }
+    }
+}
+
+int qcloud_iot_mqtt_dispatch_message(Qcloud_IoT_Client *pClient, const SubHandleEntry *entry, MQTTMessage *message)
+{
+    MQTTDispatchJob *job;
+    char *           data;
+    int              rc;
+
+    /* topic and payload point into read_buf, which is reused by the next packet */
+    job = (MQTTDispatchJob *)HAL_Malloc(sizeof(MQTTDispatchJob) + message->topic_len + message->payload_len + 2);
+    if (NULL == job) {
+        Log_e("memory malloc failed!");
+        return QCLOUD_ERR_MALLOC;
+    }
+
+    job->message_handler   = entry->handle.message_handler;
+    job->sub_event_handler = NULL;
+    job->handler_user_data = entry->handle.handler_user_data;
+    job->filter_hash       = _dispatch_hash(entry->handle.topic_filter);
+    job->message           = *message;
+
+    data = (char *)job + sizeof(MQTTDispatchJob);
+    memcpy(data, message->ptopic, message->topic_len);
+    data[message->topic_len] = '\0';
+    job->message.ptopic      = data;
+
+    data += message->topic_len + 1;
+    memcpy(data, message->payload, message->payload_len);
+    data[message->payload_len] = '\0';
+    job->message.payload       = data;
+
+    rc = _dispatch_push(pClient, job, entry);
+    if (QCLOUD_RET_SUCCESS != rc) {
+        Log_e("dispatch queue full for %u ms, message of topic %.*s dropped", MQTT_DISPATCH_PUSH_WAIT_MS,
+              (int)message->topic_len, message->ptopic);
+    }
+
+    return rc;
+}
+
+void qcloud_iot_mqtt_dispatch_fence(Qcloud_IoT_Client *pClient, const char *topic_filter)
+{
+    MQTTDispatchWorker *worker;
+    MQTTDispatchJob *   job;
+    Timer               timer;
+    uint32_t            hash = topic_filter ? _dispatch_hash(topic_filter) : 0;
+    uint32_t            fence, i;
+    int                 w;
+
+    for (w = 0; w < MQTT_DISPATCH_WORKERS; w++) {
+        worker = &pClient->dispatch_workers[w];
+        if (NULL == worker->lock || (NULL != topic_filter && hash % MQTT_DISPATCH_WORKERS != (uint32_t)w)) {
+            continue;
+        }
+
+        HAL_MutexLock(worker->lock);
+        fence = worker->pushed;
+        if (HAL_ThreadGetId() == __atomic_load_n(&worker->thread_id, __ATOMIC_ACQUIRE)) {
+            /* called from a callback of this thread, which can not wait for itself */
+            for (i = 0; i < worker->count; i++) {
+                job = worker->jobs[(worker->head + i) % MQTT_DISPATCH_QUEUE_LEN];
+                if (NULL == topic_filter || job->filter_hash == hash) {
+                    job->message_handler   = NULL;
+                    job->sub_event_handler = NULL;
+                }
+            }
+            HAL_MutexUnlock(worker->lock);
+            continue;
+        }
+        HAL_MutexUnlock(worker->lock);
+
+        InitTimer(&timer);
+        countdown_ms(&timer, MQTT_DISPATCH_EXIT_WAIT_MS);
+        while ((int32_t)(__atomic_load_n(&worker->finished, __ATOMIC_ACQUIRE) - fence) < 0 &&
+               __atomic_load_n(&pClient->dispatch_alive, __ATOMIC_ACQUIRE) > 0) {
+            if (expired(&timer)) {
+                Log_w("dispatch thread still busy in callback, unsubscribe waiting");
+                countdown_ms(&timer, MQTT_DISPATCH_EXIT_WAIT_MS);
+            }
+            HAL_SleepMs(1);
+        }
+    }
+}
+
+#endif
+
+void qcloud_iot_mqtt_notify_sub_event(Qcloud_IoT_Client *pClient, const SubHandleEntry *entry,
+                                      const SubTopicHandle *handle, MQTTEventType event_type)
+{
+    if (NULL == handle->sub_event_handler) {
+        return;
+    }
+
+#ifdef MQTT_ASYNC_DISPATCH
+    if (__atomic_load_n(&pClient->dispatch_running, __ATOMIC_ACQUIRE)) {
+        MQTTDispatchJob *job = (MQTTDispatchJob *)HAL_Malloc(sizeof(MQTTDispatchJob));
+        if (NULL == job) {
+            Log_e("memory malloc failed, event %d of topic %s dropped", event_type, handle->topic_filter);
+            return;
+        }
+        memset(job, 0, sizeof(MQTTDispatchJob));
+        job->sub_event_handler = handle->sub_event_handler;
+        job->event_type        = event_type;
+        job->handler_user_data = handle->handler_user_data;
+        job->filter_hash       = _dispatch_hash(handle->topic_filter);
+
+        /* queued behind the messages of the same topic filter, never run here to keep them in order */
+        if (QCLOUD_RET_SUCCESS != _dispatch_push(pClient, job, entry)) {
+            Log_e("dispatch queue full for %u ms, event %d of topic %s dropped", MQTT_DISPATCH_PUSH_WAIT_MS,
+                  event_type, handle->topic_filter);
+        }
+        return;
+    }
+#endif
+
+    handle->sub_event_handler(pClient, event_type, handle->handler_user_data);
+}
+
+#ifdef __cplusplus
+}
+#endif
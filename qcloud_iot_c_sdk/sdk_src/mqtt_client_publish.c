@@ -24,6 +24,9 @@ extern "C" {
 #include "mqtt_client.h"
 #include "utils_list.h"
 
+#define IOT_HEAP_TAG IOT_HEAP_MQTT
+#include "utils_heap.h"
+
 /**
  * @param mqttstring the MQTTString structure into which the data is to be read
  * @param pptr pointer to the output buffer - incremented by the number of bytes
@@ -59,23 +62,24 @@ static int _read_string_with_len(char **string, uint16_t *stringLen, unsigned ch
  * Determines the length of the MQTT publish packet that would be produced using
  * the supplied parameters
  * @param qos the MQTT QoS of the publish (packetid is omitted for QoS 0)
- * @param topicName the topic name to be used in the publish
+ * @param topicLen the length of topic name to be used in the publish
  * @param payload_len the length of the payload to be sent
  * @return the length of buffer needed to contain the serialized version of the
  * packet
  */
-static uint32_t _get_publish_packet_len(uint8_t qos, char *topicName, size_t payload_len)
+static uint32_t _get_publish_packet_len(uint8_t qos, uint16_t topicLen, size_t payload_len)
 {
     size_t len = 0;
 
-    len += 2 + strlen(topicName) + payload_len;
+    len += 2 + topicLen + payload_len;
     if (qos > 0) {
         len += 2; /* packetid */
     }
     return (uint32_t)len;
 }
 
-static int _mask_push_pubInfo_to(Qcloud_IoT_Client *c, int len, unsigned short msgId, ListNode **node)
+static int _mask_push_pubInfo_to(Qcloud_IoT_Client *c, const unsigned char *buf, int len, unsigned short msgId,
+                                 ListNode **node)
 {
     IOT_FUNC_ENTRY;
 
@@ -112,7 +116,7 @@ static int _mask_push_pubInfo_to(Qcloud_IoT_Client *c, int len, unsigned short m
 
     repubInfo->buf = (unsigned char *)repubInfo + sizeof(QcloudIotPubInfo);
 
-    memcpy(repubInfo->buf, c->write_buf, len);
+    memcpy(repubInfo->buf, buf, len);
 
     *node = list_node_new(repubInfo);
     if (NULL == *node) {
@@ -254,12 +258,15 @@ int serialize_pub_ack_packet(unsigned char *buf, size_t buf_len, MessageTypes pa
  * @param retained integer - the MQTT retained flag
  * @param packet_id integer - the MQTT packet identifier
  * @param topicName MQTTString - the MQTT topic in the publish
+ * @param topicLen integer - the length of topicName
+ * @param topicField topic already encoded with its length prefix, or NULL to encode topicName
  * @param payload byte buffer - the MQTT publish payload
  * @param payload_len integer - the length of the MQTT payload
  * @return the length of the serialized data.  <= 0 indicates error
  */
 static int _serialize_publish_packet(unsigned char *buf, size_t buf_len, uint8_t dup, QoS qos, uint8_t retained,
-                                     uint16_t packet_id, char *topicName, unsigned char *payload, size_t payload_len,
+                                     uint16_t packet_id, const char *topicName, uint16_t topicLen,
+                                     const unsigned char *topicField, unsigned char *payload, size_t payload_len,
                                      uint32_t *serialized_len)
 {
     IOT_FUNC_ENTRY;
@@ -272,7 +279,7 @@ static int _serialize_publish_packet(unsigned char *buf, size_t buf_len, uint8_t
     uint32_t       rem_len = 0;
     int            rc;
 
-    rem_len = _get_publish_packet_len(qos, topicName, payload_len);
+    rem_len = _get_publish_packet_len(qos, topicLen, payload_len);
     if (get_mqtt_packet_len(rem_len) > buf_len) {
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_BUF_TOO_SHORT);
     }
@@ -287,7 +294,15 @@ static int _serialize_publish_packet(unsigned char *buf, size_t buf_len, uint8_t
     ptr += mqtt_write_packet_rem_len(ptr, rem_len); /* write remaining length */
     ;
 
-    mqtt_write_utf8_string(&ptr, topicName); /* Variable Header: Topic Name */
+    /* Variable Header: Topic Name */
+    if (topicField) {
+        memcpy(ptr, topicField, topicLen + 2);
+        ptr += topicLen + 2;
+    } else {
+        mqtt_write_uint_16(&ptr, topicLen);
+        memcpy(ptr, topicName, topicLen);
+        ptr += topicLen;
+    }
 
     if (qos > 0) {
         mqtt_write_uint_16(&ptr, packet_id); /* Variable Header: Topic Name */
@@ -301,38 +316,37 @@ static int _serialize_publish_packet(unsigned char *buf, size_t buf_len, uint8_t
     IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
 }
 
-int qcloud_iot_mqtt_publish(Qcloud_IoT_Client *pClient, char *topicName, PublishParams *pParams)
+static int _mqtt_publish(Qcloud_IoT_Client *pClient, const char *topicName, uint16_t topicLen,
+                         const unsigned char *topicField, PublishParams *pParams)
 {
     IOT_FUNC_ENTRY;
 
-    POINTER_SANITY_CHECK(pClient, QCLOUD_ERR_INVAL);
-    POINTER_SANITY_CHECK(pParams, QCLOUD_ERR_INVAL);
-    STRING_PTR_SANITY_CHECK(topicName, QCLOUD_ERR_INVAL);
-
-    Timer    timer;
-    uint32_t len = 0;
-    int      rc;
+    int rc;
 
-    ListNode *node = NULL;
-
-    size_t topicLen = strlen(topicName);
-    if (topicLen > MAX_SIZE_OF_CLOUD_TOPIC) {
-        IOT_FUNC_EXIT_RC(QCLOUD_ERR_MAX_TOPIC_LENGTH);
-    }
+    ListNode *    node = NULL;
+    MQTTSendItem *item = NULL;
 
     if (pParams->qos == QOS2) {
         Log_e("QoS2 is not supported currently");
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_MQTT_QOS_NOT_SUPPORT);
     }
 
+    if (pParams->priority >= MQTT_PRIO_MAX) {
+        Log_e("invalid publish priority: %d", pParams->priority);
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_INVAL);
+    }
+
     if (!get_client_conn_state(pClient)) {
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_MQTT_NO_CONN);
     }
 
-    InitTimer(&timer);
-    countdown_ms(&timer, pClient->command_timeout_ms);
+    /* serialize into a buffer of our own, the network write happens in the send queue */
+    item = qcloud_iot_mqtt_send_item_get(pClient);
+    if (NULL == item) {
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_MALLOC);
+    }
+    item->priority = pParams->priority;
 
-    HAL_MutexLock(pClient->lock_write_buf);
     if (pParams->qos == QOS1) {
         pParams->id = get_next_packet_id(pClient);
         if (IOT_Log_Get_Level() <= eLOG_DEBUG) {
@@ -348,41 +362,115 @@ int qcloud_iot_mqtt_publish(Qcloud_IoT_Client *pClient, char *topicName, Publish
         }
     }
 
-    rc = _serialize_publish_packet(pClient->write_buf, pClient->write_buf_size, 0, pParams->qos, pParams->retained,
-                                   pParams->id, topicName, (unsigned char *)pParams->payload, pParams->payload_len,
-                                   &len);
+    rc = _serialize_publish_packet(item->buf, pClient->write_buf_size, 0, pParams->qos, pParams->retained,
+                                   pParams->id, topicName, topicLen, topicField, (unsigned char *)pParams->payload,
+                                   pParams->payload_len, &item->len);
     if (QCLOUD_RET_SUCCESS != rc) {
-        HAL_MutexUnlock(pClient->lock_write_buf);
+        qcloud_iot_mqtt_send_item_put(pClient, item);
         IOT_FUNC_EXIT_RC(rc);
     }
 
     if (pParams->qos > QOS0) {
-        rc = _mask_push_pubInfo_to(pClient, len, pParams->id, &node);
+        rc = _mask_push_pubInfo_to(pClient, item->buf, item->len, pParams->id, &node);
         if (QCLOUD_RET_SUCCESS != rc) {
             Log_e("push publish into to pubInfolist failed!");
-            HAL_MutexUnlock(pClient->lock_write_buf);
+            qcloud_iot_mqtt_send_item_put(pClient, item);
             IOT_FUNC_EXIT_RC(rc);
         }
+        /* begun before queued, PUBACK may be handled by the yield thread before enqueue returns */
+        IOT_TRACE_ASYNC_BEGIN("mqtt", "publish", IOT_TRACE_PACKET_ID(pClient, pParams->id));
     }
 
-    /* send the publish packet */
-    rc = send_mqtt_packet(pClient, len, &timer);
+    /* queue the publish packet, it is sent by whichever thread is writing */
+    rc = qcloud_iot_mqtt_send_enqueue(pClient, item);
     if (QCLOUD_RET_SUCCESS != rc) {
-        if (pParams->qos > QOS0) {
+        /* the packet itself never went out if it was not queued */
+        if (pParams->qos > QOS0 && (QCLOUD_ERR_MQTT_PUSH_TO_LIST_FAILED == rc || QCLOUD_ERR_BUF_TOO_SHORT == rc)) {
             HAL_MutexLock(pClient->lock_list_pub);
             list_remove(pClient->list_pub_wait_ack, node);
             HAL_MutexUnlock(pClient->lock_list_pub);
+            IOT_TRACE_ASYNC_END("mqtt", "publish", IOT_TRACE_PACKET_ID(pClient, pParams->id), rc);
         }
 
-        HAL_MutexUnlock(pClient->lock_write_buf);
         IOT_FUNC_EXIT_RC(rc);
     }
 
-    HAL_MutexUnlock(pClient->lock_write_buf);
-
     IOT_FUNC_EXIT_RC(pParams->id);
 }
 
+int qcloud_iot_mqtt_publish(Qcloud_IoT_Client *pClient, char *topicName, PublishParams *pParams)
+{
+    IOT_FUNC_ENTRY;
+
+    POINTER_SANITY_CHECK(pClient, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(pParams, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(topicName, QCLOUD_ERR_INVAL);
+
+    size_t topicLen = strlen(topicName);
+    if (topicLen > MAX_SIZE_OF_CLOUD_TOPIC) {
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_MAX_TOPIC_LENGTH);
+    }
+
+    IOT_FUNC_EXIT_RC(_mqtt_publish(pClient, topicName, (uint16_t)topicLen, NULL, pParams));
+}
+
+int qcloud_iot_mqtt_publish_handle(Qcloud_IoT_Client *pClient, MQTTTopicHandle topic, PublishParams *pParams)
+{
+    IOT_FUNC_ENTRY;
+
+    POINTER_SANITY_CHECK(pClient, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(pParams, QCLOUD_ERR_INVAL);
+    if ((unsigned)topic >= MQTT_TOPIC_MAX) {
+        Log_e("invalid topic handle: %d", topic);
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_INVAL);
+    }
+
+    const unsigned char *entry = pClient->topic_pool + pClient->topic_offset[topic];
+
+    IOT_FUNC_EXIT_RC(
+        _mqtt_publish(pClient, (const char *)entry + 2, (uint16_t)((entry[0] << 8) | entry[1]), entry, pParams));
+}
+
+int qcloud_iot_mqtt_init_topics(Qcloud_IoT_Client *pClient, const char *productId, const char *deviceName)
+{
+    IOT_FUNC_ENTRY;
+
+    static const char *topic_prefix[MQTT_TOPIC_MAX] = {"$thing/up/property/", "$thing/up/event/",
+                                                       "$thing/up/action/",   "$ota/report/",
+                                                       "$gateway/operation/", "$sys/operation/"};
+
+    unsigned char *entry = pClient->topic_pool;
+    int            i, size;
+
+    for (i = 0; i < MQTT_TOPIC_MAX; i++) {
+        size = HAL_Snprintf((char *)entry + 2, MQTT_TOPIC_ENTRY_MAX_LEN - 2, "%s%s/%s", topic_prefix[i], productId,
+                            deviceName);
+        if (size < 0 || size > MQTT_TOPIC_ENTRY_MAX_LEN - 3) {
+            Log_e("buf size < topic length!");
+            IOT_FUNC_EXIT_RC(QCLOUD_ERR_MAX_TOPIC_LENGTH);
+        }
+
+        pClient->topic_offset[i] = (uint16_t)(entry - pClient->topic_pool);
+        mqtt_write_uint_16(&entry, (uint16_t)size);
+        entry += size + 1;
+    }
+
+    IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
+}
+
+const char *qcloud_iot_mqtt_topic_name(Qcloud_IoT_Client *pClient, MQTTTopicHandle topic)
+{
+    return (const char *)pClient->topic_pool + pClient->topic_offset[topic] + 2;
+}
+
+bool qcloud_iot_mqtt_topic_owned(Qcloud_IoT_Client *pClient, const char *productId, const char *deviceName)
+{
+    const char *id  = qcloud_iot_mqtt_topic_name(pClient, MQTT_TOPIC_PROPERTY_UP) + sizeof("$thing/up/property/") - 1;
+    size_t      len = strlen(productId);
+
+    return !strncmp(id, productId, len) && id[len] == '/' && !strcmp(id + len + 1, deviceName);
+}
+
 #ifdef __cplusplus
 }
 #endif
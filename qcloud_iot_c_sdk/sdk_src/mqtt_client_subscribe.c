@@ -22,6 +22,9 @@ extern "C" {
 
 #include "mqtt_client.h"
 
+#define IOT_HEAP_TAG IOT_HEAP_MQTT
+#include "utils_heap.h"
+
 /**
  * Determines the length of the MQTT subscribe packet that would be produced
  * using the supplied parameters
@@ -171,11 +174,13 @@ int qcloud_iot_mqtt_subscribe(Qcloud_IoT_Client *pClient, char *topicFilter, Sub
     }
 
     // send SUBSCRIBE packet
+    IOT_TRACE_ASYNC_BEGIN("mqtt", "subscribe", IOT_TRACE_PACKET_ID(pClient, packet_id));
     rc = send_mqtt_packet(pClient, len, &timer);
     if (QCLOUD_RET_SUCCESS != rc) {
         HAL_MutexLock(pClient->lock_list_sub);
         list_remove(pClient->list_sub_wait_ack, node);
         HAL_MutexUnlock(pClient->lock_list_sub);
+        IOT_TRACE_ASYNC_END("mqtt", "subscribe", IOT_TRACE_PACKET_ID(pClient, packet_id), rc);
 
         HAL_MutexUnlock(pClient->lock_write_buf);
         HAL_Free(topic_filter_stored);
@@ -197,6 +202,7 @@ int qcloud_iot_mqtt_resubscribe(Qcloud_IoT_Client *pClient)
     uint32_t        itr   = 0;
     char *          topic = NULL;
     SubscribeParams temp_param;
+    SubHandleTable *table;
 
     if (NULL == pClient) {
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_INVAL);
@@ -206,22 +212,22 @@ int qcloud_iot_mqtt_resubscribe(Qcloud_IoT_Client *pClient)
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_MQTT_NO_CONN);
     }
 
-    for (itr = 0; itr < MAX_MESSAGE_HANDLERS; itr++) {
-        topic = (char *)pClient->sub_handles[itr].topic_filter;
-        if (topic == NULL) {
-            continue;
-        }
-        temp_param.on_message_handler   = pClient->sub_handles[itr].message_handler;
-        temp_param.on_sub_event_handler = pClient->sub_handles[itr].sub_event_handler;
-        temp_param.qos                  = pClient->sub_handles[itr].qos;
-        temp_param.user_data            = pClient->sub_handles[itr].handler_user_data;
+    table = qcloud_iot_mqtt_sub_table_acquire(pClient);
+    for (itr = 0; table && itr < table->count; itr++) {
+        topic                           = (char *)table->entries[itr]->handle.topic_filter;
+        temp_param.on_message_handler   = table->entries[itr]->handle.message_handler;
+        temp_param.on_sub_event_handler = table->entries[itr]->handle.sub_event_handler;
+        temp_param.qos                  = table->entries[itr]->handle.qos;
+        temp_param.user_data            = table->entries[itr]->handle.handler_user_data;
 
         rc = qcloud_iot_mqtt_subscribe(pClient, topic, &temp_param);
         if (rc < 0) {
             Log_e("resubscribe failed %d, topic: %s", rc, topic);
+            qcloud_iot_mqtt_sub_table_release(pClient);
             IOT_FUNC_EXIT_RC(rc);
         }
     }
+    qcloud_iot_mqtt_sub_table_release(pClient);
 
     IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
 }
@@ -237,18 +243,136 @@ bool qcloud_iot_mqtt_is_sub_ready(Qcloud_IoT_Client *pClient, char *topicFilter)
         return false;
     }
 
-    int i = 0;
-    HAL_MutexLock(pClient->lock_generic);
-    for (i = 0; i < MAX_MESSAGE_HANDLERS; ++i) {
-        if ((pClient->sub_handles[i].topic_filter != NULL &&
-             !strcmp(pClient->sub_handles[i].topic_filter, topicFilter)) ||
-            strstr(topicFilter, "/#") != NULL || strstr(topicFilter, "/+") != NULL) {
-            HAL_MutexUnlock(pClient->lock_generic);
-            return true;
+    uint32_t        i;
+    bool            ready = false;
+    SubHandleTable *table;
+
+    if (strstr(topicFilter, "/#") != NULL || strstr(topicFilter, "/+") != NULL) {
+        return true;
+    }
+
+    table = qcloud_iot_mqtt_sub_table_acquire(pClient);
+    for (i = 0; table && i < table->count; ++i) {
+        if (!strcmp(table->entries[i]->handle.topic_filter, topicFilter)) {
+            ready = true;
+            break;
+        }
+    }
+    qcloud_iot_mqtt_sub_table_release(pClient);
+
+    return ready;
+}
+
+/*
+ * Readers announce themselves in sub_readers before loading sub_table, and writers
+ * only free replaced snapshots after seeing sub_readers at 0. Both sides use
+ * sequentially consistent atomics, so a reader that was not counted can only
+ * load the new snapshot.
+ */
+SubHandleTable *qcloud_iot_mqtt_sub_table_acquire(Qcloud_IoT_Client *pClient)
+{
+    __atomic_add_fetch(&pClient->sub_readers, 1, __ATOMIC_SEQ_CST);
+    return __atomic_load_n(&pClient->sub_table, __ATOMIC_SEQ_CST);
+}
+
+void qcloud_iot_mqtt_sub_table_release(Qcloud_IoT_Client *pClient)
+{
+    __atomic_sub_fetch(&pClient->sub_readers, 1, __ATOMIC_SEQ_CST);
+}
+
+static void _sub_entry_put(SubHandleEntry *entry)
+{
+    if (--entry->ref_cnt == 0) {
+        HAL_Free((void *)entry->handle.topic_filter);
+        HAL_Free(entry);
+    }
+}
+
+void qcloud_iot_mqtt_sub_table_free(SubHandleTable *table)
+{
+    uint32_t i;
+
+    if (NULL == table) {
+        return;
+    }
+
+    for (i = 0; i < table->count; i++) {
+        _sub_entry_put(table->entries[i]);
+    }
+    HAL_Free(table);
+}
+
+SubHandleTable *qcloud_iot_mqtt_sub_table_copy(Qcloud_IoT_Client *pClient)
+{
+    SubHandleTable *cur   = pClient->sub_table;
+    SubHandleTable *table = (SubHandleTable *)HAL_Malloc(sizeof(SubHandleTable));
+    uint32_t        i;
+
+    if (NULL == table) {
+        Log_e("malloc subscription table failed");
+        return NULL;
+    }
+    memset(table, 0, sizeof(SubHandleTable));
+
+    for (i = 0; cur && i < cur->count; i++) {
+        table->entries[i] = cur->entries[i];
+        table->entries[i]->ref_cnt++;
+    }
+    table->count = cur ? cur->count : 0;
+
+    return table;
+}
+
+void qcloud_iot_mqtt_sub_table_remove(SubHandleTable *table, uint32_t index)
+{
+    _sub_entry_put(table->entries[index]);
+
+    table->count--;
+    memmove(&table->entries[index], &table->entries[index + 1], (table->count - index) * sizeof(SubHandleEntry *));
+}
+
+int qcloud_iot_mqtt_sub_table_set(SubHandleTable *table, uint32_t index, const SubTopicHandle *handle)
+{
+    SubHandleEntry *entry;
+
+    if (index > table->count || index >= MAX_MESSAGE_HANDLERS) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    entry = (SubHandleEntry *)HAL_Malloc(sizeof(SubHandleEntry));
+    if (NULL == entry) {
+        Log_e("malloc subscription entry failed");
+        return QCLOUD_ERR_MALLOC;
+    }
+    entry->ref_cnt = 1;
+    entry->handle  = *handle;
+
+    if (index < table->count) {
+        _sub_entry_put(table->entries[index]);
+    } else {
+        table->count++;
+    }
+    table->entries[index] = entry;
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+void qcloud_iot_mqtt_sub_table_replace(Qcloud_IoT_Client *pClient, SubHandleTable *table)
+{
+    SubHandleTable *old = __atomic_exchange_n(&pClient->sub_table, table, __ATOMIC_SEQ_CST);
+
+    if (NULL != old) {
+        old->retired_next     = pClient->sub_retired;
+        pClient->sub_retired = old;
+    }
+
+    /* a reader still active may hold any retired snapshot, try again on next change */
+    if (0 == __atomic_load_n(&pClient->sub_readers, __ATOMIC_SEQ_CST)) {
+        while (NULL != (old = pClient->sub_retired)) {
+            pClient->sub_retired = old->retired_next;
+            qcloud_iot_mqtt_sub_table_free(old);
         }
     }
-    HAL_MutexUnlock(pClient->lock_generic);
-    return false;
 }
 
 #ifdef __cplusplus
@@ -22,6 +22,9 @@ extern "C" {
 
 #include "mqtt_client.h"
 
+#define IOT_HEAP_TAG IOT_HEAP_MQTT
+#include "utils_heap.h"
+
 /**
  * Determines the length of the MQTT unsubscribe packet that would be produced
  * using the supplied parameters
@@ -94,6 +97,41 @@ static int _serialize_unsubscribe_packet(unsigned char *buf, size_t buf_len, uin
     IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
 }
 
+/**
+ * @brief cancel the subscribe requests of topicFilter still waiting for SUBACK, so a late SUBACK does not
+ * install the handler after it is unsubscribed. Called with lock_sub_table held.
+ *
+ * @return true if any request is cancelled
+ */
+static bool _cancel_pending_subscribe(Qcloud_IoT_Client *pClient, const char *topicFilter)
+{
+    ListIterator *    iter;
+    ListNode *        node;
+    QcloudIotSubInfo *sub_info;
+    bool              cancelled = false;
+
+    HAL_MutexLock(pClient->lock_list_sub);
+    if (pClient->list_sub_wait_ack->len && NULL != (iter = list_iterator_new(pClient->list_sub_wait_ack, LIST_TAIL))) {
+        while (NULL != (node = list_iterator_next(iter))) {
+            sub_info = (QcloudIotSubInfo *)node->val;
+            if (NULL == sub_info || SUBSCRIBE != sub_info->type || MQTT_NODE_STATE_INVALID == sub_info->node_state ||
+                NULL == sub_info->handler.topic_filter || strcmp(sub_info->handler.topic_filter, topicFilter)) {
+                continue;
+            }
+
+            /* removed by qcloud_iot_mqtt_sub_info_proc, the topic filter is no longer passed to the table */
+            sub_info->node_state = MQTT_NODE_STATE_INVALID;
+            HAL_Free((void *)sub_info->handler.topic_filter);
+            sub_info->handler.topic_filter = NULL;
+            cancelled                      = true;
+        }
+        list_iterator_destroy(iter);
+    }
+    HAL_MutexUnlock(pClient->lock_list_sub);
+
+    return cancelled;
+}
+
 int qcloud_iot_mqtt_unsubscribe(Qcloud_IoT_Client *pClient, char *topicFilter)
 {
     IOT_FUNC_ENTRY;
@@ -102,7 +140,7 @@ int qcloud_iot_mqtt_unsubscribe(Qcloud_IoT_Client *pClient, char *topicFilter)
     POINTER_SANITY_CHECK(pClient, QCLOUD_ERR_INVAL);
     STRING_PTR_SANITY_CHECK(topicFilter, QCLOUD_ERR_INVAL);
 
-    int      i = 0;
+    uint32_t i = 0;
     Timer    timer;
     uint32_t len          = 0;
     uint16_t packet_id    = 0;
@@ -115,27 +153,41 @@ int qcloud_iot_mqtt_unsubscribe(Qcloud_IoT_Client *pClient, char *topicFilter)
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_MAX_TOPIC_LENGTH);
     }
 
-    /* Remove from message handler array */
-    HAL_MutexLock(pClient->lock_generic);
-    for (i = 0; i < MAX_MESSAGE_HANDLERS; ++i) {
-        if ((pClient->sub_handles[i].topic_filter != NULL &&
-             !strcmp(pClient->sub_handles[i].topic_filter, topicFilter)) ||
-            strstr(topicFilter, "/#") != NULL || strstr(topicFilter, "/+") != NULL) {
+    /* Remove from message handler table, readers keep the old snapshot until they are done */
+    bool wildcard = strstr(topicFilter, "/#") != NULL || strstr(topicFilter, "/+") != NULL;
+    suber_exists  = wildcard;
+    HAL_MutexLock(pClient->lock_sub_table);
+    SubHandleTable *table = qcloud_iot_mqtt_sub_table_copy(pClient);
+    if (NULL == table) {
+        HAL_MutexUnlock(pClient->lock_sub_table);
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_MALLOC);
+    }
+    i = 0;
+    while (i < table->count) {
+        SubTopicHandle *handle = &table->entries[i]->handle;
+        if (wildcard || !strcmp(handle->topic_filter, topicFilter)) {
             /* notify this event to topic subscriber */
-            if (NULL != pClient->sub_handles[i].sub_event_handler)
-                pClient->sub_handles[i].sub_event_handler(pClient, MQTT_EVENT_UNSUBSCRIBE,
-                                                          pClient->sub_handles[i].handler_user_data);
-
-            /* Free the topic filter malloced in qcloud_iot_mqtt_subscribe */
-            HAL_Free((void *)pClient->sub_handles[i].topic_filter);
-            pClient->sub_handles[i].topic_filter = NULL;
+            if (NULL != handle->sub_event_handler)
+                handle->sub_event_handler(pClient, MQTT_EVENT_UNSUBSCRIBE, handle->handler_user_data);
 
             /* We don't want to break here, if the same topic is registered
              * with 2 callbacks. Unlikely scenario */
+            qcloud_iot_mqtt_sub_table_remove(table, i);
             suber_exists = true;
+            continue;
         }
+        i++;
     }
-    HAL_MutexUnlock(pClient->lock_generic);
+    if (_cancel_pending_subscribe(pClient, topicFilter)) {
+        suber_exists = true;
+    }
+    qcloud_iot_mqtt_sub_table_replace(pClient, table);
+    HAL_MutexUnlock(pClient->lock_sub_table);
+
+#ifdef MQTT_ASYNC_DISPATCH
+    /* the caller may free the user data once this returns, let the callbacks already queued finish */
+    qcloud_iot_mqtt_dispatch_fence(pClient, wildcard ? NULL : topicFilter);
+#endif
 
     if (suber_exists == false) {
         Log_e("subscription does not exists: %s", topicFilter);
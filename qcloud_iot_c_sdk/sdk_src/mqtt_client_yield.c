@@ -23,6 +23,9 @@ extern "C" {
 #include "mqtt_client.h"
 #include "qcloud_iot_import.h"
 
+#define IOT_HEAP_TAG IOT_HEAP_MQTT
+#include "utils_heap.h"
+
 static uint32_t _get_random_interval(void)
 {
     srand((unsigned)HAL_GetTimeMs());
@@ -223,6 +226,9 @@ int qcloud_iot_mqtt_yield(Qcloud_IoT_Client *pClient, uint32_t timeout_ms)
     int     rc = QCLOUD_RET_SUCCESS;
     Timer   timer;
     uint8_t packet_type;
+#ifdef MQTT_RX_READ_AHEAD
+    int burst = 0;
+#endif
 
     POINTER_SANITY_CHECK(pClient, QCLOUD_ERR_INVAL);
     NUMBERIC_SANITY_CHECK(timeout_ms, QCLOUD_ERR_INVAL);
@@ -254,7 +260,19 @@ int qcloud_iot_mqtt_yield(Qcloud_IoT_Client *pClient, uint32_t timeout_ms)
 
         rc = cycle_for_read(pClient, &timer, &packet_type, QOS0);
 
+#ifdef MQTT_RX_READ_AHEAD
+        /* frame the packets already received before the housekeeping */
+        if (rc == QCLOUD_RET_SUCCESS && pClient->rx_ahead_pos < pClient->rx_ahead_len &&
+            ++burst < MQTT_RX_AHEAD_BURST) {
+            continue;
+        }
+        burst = 0;
+#endif
+
         if (rc == QCLOUD_RET_SUCCESS) {
+            /* send the packets held back by publish rate limits */
+            qcloud_iot_mqtt_send_queue_flush(pClient);
+
             /* check list of wait publish ACK to remove node that is ACKED or timeout
              */
             qcloud_iot_mqtt_pub_info_proc(pClient);
@@ -263,6 +281,16 @@ int qcloud_iot_mqtt_yield(Qcloud_IoT_Client *pClient, uint32_t timeout_ms)
              * ACKED or timeout */
             qcloud_iot_mqtt_sub_info_proc(pClient);
 
+#ifdef SYSTEM_COMM
+            /* resync the local clock when it is due */
+            qcloud_iot_sys_time_poll(pClient);
+#endif
+
+#ifdef HEAP_ACCOUNTING
+            /* log the heap usage of SDK when it is due */
+            iot_heap_poll();
+#endif
+
             rc = _mqtt_keep_alive(pClient);
         } else if (rc == QCLOUD_ERR_SSL_READ_TIMEOUT || rc == QCLOUD_ERR_SSL_READ ||
                    rc == QCLOUD_ERR_TCP_PEER_SHUTDOWN || rc == QCLOUD_ERR_TCP_READ_FAIL) {
@@ -359,6 +387,9 @@ int qcloud_iot_mqtt_pub_info_proc(Qcloud_IoT_Client *pClient)
             countdown_ms(&repubInfo->pub_start_time, pClient->command_timeout_ms);
             HAL_MutexLock(pClient->lock_list_pub);
 
+            IOT_TRACE_ASYNC_END("mqtt", "publish", IOT_TRACE_PACKET_ID(pClient, repubInfo->msg_id),
+                                QCLOUD_ERR_MQTT_REQUEST_TIMEOUT);
+
             /* notify timeout event */
             if (NULL != pClient->event_handle.h_fp) {
                 MQTTEventMsg msg;
@@ -447,6 +478,10 @@ int qcloud_iot_mqtt_sub_info_proc(Qcloud_IoT_Client *pClient)
             /* When arrive here, it means timeout to wait ACK */
             packet_id = sub_info->msg_id;
             msg_type  = sub_info->type;
+            if (SUBSCRIBE == msg_type) {
+                IOT_TRACE_ASYNC_END("mqtt", "subscribe", IOT_TRACE_PACKET_ID(pClient, packet_id),
+                                    QCLOUD_ERR_MQTT_REQUEST_TIMEOUT);
+            }
 
             /* Wait MQTT SUBSCRIBE ACK timeout */
             if (NULL != pClient->event_handle.h_fp) {
@@ -458,9 +493,7 @@ int qcloud_iot_mqtt_sub_info_proc(Qcloud_IoT_Client *pClient)
                     msg.msg        = (void *)(uintptr_t)packet_id;
 
                     /* notify this event to topic subscriber */
-                    if (NULL != sub_info->handler.sub_event_handler)
-                        sub_info->handler.sub_event_handler(pClient, MQTT_EVENT_SUBCRIBE_TIMEOUT,
-                                                            sub_info->handler.handler_user_data);
+                    qcloud_iot_mqtt_notify_sub_event(pClient, NULL, &sub_info->handler, MQTT_EVENT_SUBCRIBE_TIMEOUT);
 
                 } else {
                     /* unsubscribe timeout */
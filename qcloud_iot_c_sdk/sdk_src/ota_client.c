@@ -33,6 +33,10 @@ extern "C" {
 #include "qcloud_iot_export.h"
 #include "utils_param_check.h"
 #include "utils_timer.h"
+#include "utils_trace.h"
+
+#define IOT_HEAP_TAG IOT_HEAP_OTA
+#include "utils_heap.h"
 
 #define OTA_VERSION_STR_LEN_MIN (1)
 #define OTA_VERSION_STR_LEN_MAX (32)
@@ -54,6 +58,9 @@ typedef struct {
     void *md5;       /* MD5 handle */
     void *ch_signal; /* channel handle of signal exchanged with OTA server */
     void *ch_fetch;  /* channel handle of download */
+#ifdef OTA_MQTT_FETCH
+    void *mqtt; /* MQTT client the firmware is downloaded through */
+#endif
 
     int err; /* last error code */
 
@@ -295,6 +302,9 @@ void *IOT_OTA_Init(const char *product_id, const char *device_name, void *ch_sig
 
     h_ota->product_id  = product_id;
     h_ota->device_name = device_name;
+#ifdef OTA_MQTT_FETCH
+    h_ota->mqtt = ch_signal;
+#endif
     h_ota->state       = IOT_OTAS_INITED;
 #ifdef OTA_MQTT_CHANNEL
     h_ota->current_signal_type = MQTT_CHANNEL;
@@ -339,7 +349,11 @@ int IOT_OTA_Destroy(void *handle)
     }
 
     qcloud_osc_deinit(h_ota->ch_signal);
+#ifdef OTA_MQTT_FETCH
+    qcloud_ofc_mqtt_deinit(h_ota->ch_fetch);
+#else
     qcloud_ofc_deinit(h_ota->ch_fetch);
+#endif
     qcloud_otalib_md5_deinit(h_ota->md5);
 
     if (NULL != h_ota->purl) {
@@ -373,14 +387,25 @@ int IOT_OTA_StartDownload(void *handle, uint32_t offset, uint32_t size)
     }
 
     // reinit ofc
+#ifdef OTA_MQTT_FETCH
+    qcloud_ofc_mqtt_deinit(h_ota->ch_fetch);
+    h_ota->ch_fetch = ofc_mqtt_init(h_ota->mqtt, h_ota->product_id, h_ota->device_name, h_ota->version, offset, size);
+#else
     qcloud_ofc_deinit(h_ota->ch_fetch);
     h_ota->ch_fetch     = ofc_Init(h_ota->purl, offset, size);
+#endif
     if (NULL == h_ota->ch_fetch) {
         Log_e("Initialize fetch module failed");
         return QCLOUD_ERR_FAILURE;
     }
 
+    IOT_TRACE_BEGIN(t_connect);
+#ifdef OTA_MQTT_FETCH
+    Ret = qcloud_ofc_mqtt_connect(h_ota->ch_fetch);
+#else
     Ret = qcloud_ofc_connect(h_ota->ch_fetch);
+#endif
+    IOT_TRACE_END(t_connect, "ota", "connect", Ret);
     if (QCLOUD_RET_SUCCESS != Ret) {
         Log_e("Connect fetch module failed");
         h_ota->state = IOT_OTAS_DISCONNECTED;
@@ -554,7 +579,14 @@ int IOT_OTA_FetchYield(void *handle, char *buf, uint32_t buf_len, uint32_t timeo
         return IOT_OTA_ERR_INVALID_STATE;
     }
 
+    IOT_TRACE_BEGIN(t_fetch);
+#ifdef OTA_MQTT_FETCH
+    ret = qcloud_ofc_mqtt_fetch(h_ota->ch_fetch, buf, buf_len, timeout_s);
+#else
     ret = qcloud_ofc_fetch(h_ota->ch_fetch, buf, buf_len, timeout_s);
+#endif
+    // result is the bytes fetched or the error
+    IOT_TRACE_END(t_fetch, "ota", "fetch", ret);
     if (ret < 0) {
         h_ota->state = IOT_OTAS_FETCHED;
         h_ota->err   = IOT_OTA_ERR_FETCH_FAILED;
@@ -595,7 +627,9 @@ int IOT_OTA_FetchYield(void *handle, char *buf, uint32_t buf_len, uint32_t timeo
         h_ota->state = IOT_OTAS_FETCHED;
     }
 
+    IOT_TRACE_BEGIN(t_md5);
     qcloud_otalib_md5_update(h_ota->md5, buf, ret);
+    IOT_TRACE_END(t_md5, "ota", "md5", ret);
 
     return ret;
 }
@@ -31,6 +31,9 @@ extern "C" {
 #include "qcloud_iot_import.h"
 #include "utils_httpc.h"
 
+#define IOT_HEAP_TAG IOT_HEAP_OTA
+#include "utils_heap.h"
+
 #define OTA_HTTP_HEAD_CONTENT_LEN 256
 
 /* ofc, OTA fetch channel */
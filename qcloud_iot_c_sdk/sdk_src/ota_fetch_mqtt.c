@@ -0,0 +1,479 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub
+ available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file
+ except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software
+ distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ KIND,
+ * either express or implied. See the License for the specific language
+ governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "ota_fetch.h"
+#include "qcloud_iot_export.h"
+#include "qcloud_iot_import.h"
+#include "utils_timer.h"
+
+#define IOT_HEAP_TAG IOT_HEAP_OTA
+#include "utils_heap.h"
+
+#ifdef OTA_MQTT_FETCH
+
+/* topics of user defined in the console, a server relays the chunks of the firmware */
+#define OTA_MQTT_TOPIC_CHUNK_GET  "%s/%s/ota/chunk/get"
+#define OTA_MQTT_TOPIC_CHUNK_DATA "%s/%s/ota/chunk/data"
+#define OTA_MQTT_TOPIC_LEN        (MAX_SIZE_OF_PRODUCT_ID + MAX_SIZE_OF_DEVICE_NAME + 20)
+
+/* size of data in a chunk, a chunk message must fit in the MQTT read buffer */
+#ifndef OTA_MQTT_CHUNK_SIZE
+#ifdef IOT_STATIC_MEMORY
+/* the data of a chunk takes a block of pool class 5 with its 8 bytes header */
+#define OTA_MQTT_CHUNK_SIZE (IOT_STATIC_BLOCK_SIZE_5 - 8)
+#else
+#define OTA_MQTT_CHUNK_SIZE (1024)
+#endif
+#endif
+
+/* chunks requested and not delivered at most, the window grows up to it */
+#ifndef OTA_MQTT_WINDOW_MAX
+#define OTA_MQTT_WINDOW_MAX (4)
+#endif
+
+#define OTA_MQTT_CHUNK_HEAD_LEN      (10)  // offset(4) length(2) crc32(4), big endian
+#define OTA_MQTT_CHUNK_RETRY_MAX     (5)
+#define OTA_MQTT_CHUNK_TIMEOUT_MIN   (1000)
+#define OTA_MQTT_CHUNK_TIMEOUT_MAX   (10000)
+#define OTA_MQTT_CHUNK_TIMEOUT_START (3000)
+#define OTA_MQTT_POLL_MS             (20)
+#define OTA_MQTT_REQUEST_LEN         (128)
+
+#if OTA_MQTT_CHUNK_SIZE + OTA_MQTT_CHUNK_HEAD_LEN + OTA_MQTT_TOPIC_LEN + 8 > QCLOUD_IOT_MQTT_RX_BUF_LEN
+#error "OTA_MQTT_CHUNK_SIZE does not fit in QCLOUD_IOT_MQTT_RX_BUF_LEN"
+#endif
+
+typedef struct {
+    uint32_t offset;
+    uint16_t len;
+    uint8_t  retries;
+    bool     received;
+    uint32_t request_time;  // for the round trip time
+    Timer    timer;         // requested again when expired
+    char *   data;          // OTA_MQTT_CHUNK_SIZE bytes, allocated on its own to fit the static pool
+} OTAMQTTChunk;
+
+/* ofc over MQTT, chunks are requested in a sliding window and delivered in order */
+typedef struct {
+    void *mqtt;
+    void *lock;  // chunks are filled by the MQTT message handler
+    bool  subscribed;
+
+    char topic_get[OTA_MQTT_TOPIC_LEN];
+    char topic_data[OTA_MQTT_TOPIC_LEN];
+    char version[OTA_MQTT_REQUEST_LEN / 2];
+
+    uint32_t offset_request;  // offset of the next chunk to request
+    uint32_t size;            // end of the download
+
+    OTAMQTTChunk chunks[OTA_MQTT_WINDOW_MAX];
+    uint16_t     head;      // chunk to deliver next
+    uint16_t     count;     // chunks requested
+    uint16_t     read_pos;  // data of the head chunk delivered
+
+    /* window grows by one per window of chunks, halves on a timeout, like TCP congestion control */
+    uint16_t window;
+    uint16_t window_acked;
+    uint32_t srtt;  // smoothed round trip time in ms
+    uint32_t rttvar;
+} OTAMQTTStruct;
+
+#ifdef IOT_STATIC_MEMORY
+/* the handle takes a block of the general pool classes, the MQTT client owns class 7 */
+typedef char ota_mqtt_fits_static_block[(sizeof(OTAMQTTStruct) + 8 <= IOT_STATIC_BLOCK_SIZE_6) ? 1 : -1];
+typedef char ota_mqtt_chunk_fits_static_block[(OTA_MQTT_CHUNK_SIZE + 8 <= IOT_STATIC_BLOCK_SIZE_6) ? 1 : -1];
+#endif
+
+static uint32_t _ota_crc32(const unsigned char *buf, size_t len)
+{
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+    uint32_t crc = 0xFFFFFFFF;
+
+    while (len--) {
+        crc ^= *buf++;
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+
+    return crc ^ 0xFFFFFFFF;
+}
+
+static inline uint32_t _ota_get_be32(const unsigned char *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint32_t _ota_chunk_timeout(OTAMQTTStruct *h_ofc)
+{
+    uint32_t rto;
+
+    if (0 == h_ofc->srtt) {
+        return OTA_MQTT_CHUNK_TIMEOUT_START;
+    }
+
+    rto = h_ofc->srtt + 4 * h_ofc->rttvar;
+    if (rto < OTA_MQTT_CHUNK_TIMEOUT_MIN) {
+        rto = OTA_MQTT_CHUNK_TIMEOUT_MIN;
+    } else if (rto > OTA_MQTT_CHUNK_TIMEOUT_MAX) {
+        rto = OTA_MQTT_CHUNK_TIMEOUT_MAX;
+    }
+
+    return rto;
+}
+
+/* called with the lock held, the round trip time is sampled only for chunks not requested again */
+static void _ota_update_rtt(OTAMQTTStruct *h_ofc, OTAMQTTChunk *chunk)
+{
+    uint32_t rtt = HAL_GetTimeMs() - chunk->request_time;
+    uint32_t err;
+
+    if (chunk->retries) {
+        return;
+    }
+
+    if (0 == h_ofc->srtt) {
+        h_ofc->srtt   = rtt ? rtt : 1;
+        h_ofc->rttvar = rtt / 2;
+    } else {
+        err           = rtt > h_ofc->srtt ? rtt - h_ofc->srtt : h_ofc->srtt - rtt;
+        h_ofc->rttvar = (3 * h_ofc->rttvar + err) / 4;
+        h_ofc->srtt   = (7 * h_ofc->srtt + rtt) / 8;
+    }
+
+    if (++h_ofc->window_acked >= h_ofc->window) {
+        h_ofc->window_acked = 0;
+        if (h_ofc->window < OTA_MQTT_WINDOW_MAX) {
+            h_ofc->window++;
+        }
+    }
+}
+
+static void _ota_chunk_data_cb(void *pClient, MQTTMessage *message, void *pUserData)
+{
+    OTAMQTTStruct *      h_ofc = (OTAMQTTStruct *)pUserData;
+    const unsigned char *msg   = (const unsigned char *)message->payload;
+    OTAMQTTChunk *       chunk;
+    uint32_t             offset, crc;
+    uint16_t             len, i;
+    bool                 corrupted;
+
+    if (message->payload_len < OTA_MQTT_CHUNK_HEAD_LEN) {
+        Log_e("chunk message too short: %u", (unsigned)message->payload_len);
+        return;
+    }
+
+    offset = _ota_get_be32(msg);
+    len    = ((uint16_t)msg[4] << 8) | msg[5];
+    crc    = _ota_get_be32(msg + 6);
+    corrupted =
+        message->payload_len != OTA_MQTT_CHUNK_HEAD_LEN + len || _ota_crc32(msg + OTA_MQTT_CHUNK_HEAD_LEN, len) != crc;
+
+    HAL_MutexLock(h_ofc->lock);
+    for (i = 0; i < h_ofc->count; i++) {
+        chunk = &h_ofc->chunks[(h_ofc->head + i) % OTA_MQTT_WINDOW_MAX];
+        if (chunk->offset != offset || chunk->received) {
+            continue;
+        }
+
+        if (corrupted || chunk->len != len) {
+            /* request it again without waiting for the timeout */
+            Log_e("chunk at %u is corrupted", (unsigned)offset);
+            countdown_ms(&chunk->timer, 0);
+        } else {
+            memcpy(chunk->data, msg + OTA_MQTT_CHUNK_HEAD_LEN, len);
+            chunk->received = true;
+            _ota_update_rtt(h_ofc, chunk);
+        }
+        break;
+    }
+    if (i == h_ofc->count) {
+        Log_d("chunk at %u is duplicated or not expected", (unsigned)offset);
+    }
+    HAL_MutexUnlock(h_ofc->lock);
+}
+
+static void _ota_chunk_event_cb(void *pClient, MQTTEventType event_type, void *pUserData)
+{
+    OTAMQTTStruct *h_ofc = (OTAMQTTStruct *)pUserData;
+
+    if (MQTT_EVENT_SUBCRIBE_SUCCESS == event_type) {
+        h_ofc->subscribed = true;
+    }
+}
+
+/* wait for the chunks in the MQTT message handler */
+static void _ota_chunk_wait(OTAMQTTStruct *h_ofc)
+{
+#ifdef MULTITHREAD_ENABLED
+    HAL_SleepMs(OTA_MQTT_POLL_MS);
+#else
+    IOT_MQTT_Yield(h_ofc->mqtt, OTA_MQTT_POLL_MS);
+#endif
+}
+
+static int _ota_chunk_request(OTAMQTTStruct *h_ofc, OTAMQTTChunk *chunk)
+{
+    char          request[OTA_MQTT_REQUEST_LEN];
+    PublishParams pub_params = DEFAULT_PUB_PARAMS;
+    int           rc;
+
+    rc = HAL_Snprintf(request, sizeof(request), "{\"type\":\"get_chunk\",\"version\":\"%s\",\"offset\":%u,\"size\":%u}",
+                      h_ofc->version, (unsigned)chunk->offset, (unsigned)chunk->len);
+    if (rc < 0 || rc >= sizeof(request)) {
+        return IOT_OTA_ERR_STR_TOO_LONG;
+    }
+
+    pub_params.qos         = QOS0;
+    pub_params.payload     = request;
+    pub_params.payload_len = rc;
+
+    chunk->request_time = HAL_GetTimeMs();
+    countdown_ms(&chunk->timer, _ota_chunk_timeout(h_ofc));
+
+    rc = IOT_MQTT_Publish(h_ofc->mqtt, h_ofc->topic_get, &pub_params);
+    return rc < 0 ? rc : QCLOUD_RET_SUCCESS;
+}
+
+/* called with the lock held, request new chunks in the window and the expired ones again */
+static int _ota_chunk_fill_window(OTAMQTTStruct *h_ofc)
+{
+    OTAMQTTChunk *chunk;
+    uint16_t      i;
+    int           rc;
+
+    for (i = 0; i < h_ofc->count; i++) {
+        chunk = &h_ofc->chunks[(h_ofc->head + i) % OTA_MQTT_WINDOW_MAX];
+        if (chunk->received || !expired(&chunk->timer)) {
+            continue;
+        }
+
+        if (++chunk->retries > OTA_MQTT_CHUNK_RETRY_MAX) {
+            Log_e("chunk at %u timeout", (unsigned)chunk->offset);
+            return IOT_OTA_ERR_FETCH_TIMEOUT;
+        }
+
+        /* a loss slows down the sending like TCP does */
+        h_ofc->window       = h_ofc->window > 1 ? h_ofc->window / 2 : 1;
+        h_ofc->window_acked = 0;
+        Log_d("request chunk at %u again, window %u", (unsigned)chunk->offset, h_ofc->window);
+
+        rc = _ota_chunk_request(h_ofc, chunk);
+        if (QCLOUD_RET_SUCCESS != rc) {
+            return rc;
+        }
+    }
+
+    while (h_ofc->count < h_ofc->window && h_ofc->offset_request < h_ofc->size) {
+        chunk           = &h_ofc->chunks[(h_ofc->head + h_ofc->count) % OTA_MQTT_WINDOW_MAX];
+        chunk->offset   = h_ofc->offset_request;
+        chunk->len      = h_ofc->size - h_ofc->offset_request > OTA_MQTT_CHUNK_SIZE
+                              ? OTA_MQTT_CHUNK_SIZE
+                              : (uint16_t)(h_ofc->size - h_ofc->offset_request);
+        chunk->retries  = 0;
+        chunk->received = false;
+
+        rc = _ota_chunk_request(h_ofc, chunk);
+        if (QCLOUD_RET_SUCCESS != rc) {
+            return rc;
+        }
+        h_ofc->offset_request += chunk->len;
+        h_ofc->count++;
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+/* frees the handle with the chunk buffers allocated */
+static void _ota_chunks_free(OTAMQTTStruct *h_ofc)
+{
+    int i;
+
+    for (i = 0; i < OTA_MQTT_WINDOW_MAX; i++) {
+        HAL_Free(h_ofc->chunks[i].data);
+    }
+    HAL_Free(h_ofc);
+}
+
+void *ofc_mqtt_init(void *mqtt, const char *product_id, const char *device_name, const char *version,
+                    uint32_t offset, uint32_t size)
+{
+    OTAMQTTStruct *h_ofc;
+    int            i;
+
+    if (NULL == mqtt || NULL == version || strlen(version) >= sizeof(h_ofc->version)) {
+        Log_e("invalid parameter of MQTT fetch");
+        return NULL;
+    }
+
+    if (NULL == (h_ofc = HAL_Malloc(sizeof(OTAMQTTStruct)))) {
+        Log_e("allocate for h_ofc failed");
+        return NULL;
+    }
+    memset(h_ofc, 0, sizeof(OTAMQTTStruct));
+
+    for (i = 0; i < OTA_MQTT_WINDOW_MAX; i++) {
+        if (NULL == (h_ofc->chunks[i].data = HAL_Malloc(OTA_MQTT_CHUNK_SIZE))) {
+            Log_e("allocate for chunk failed");
+            _ota_chunks_free(h_ofc);
+            return NULL;
+        }
+    }
+
+    h_ofc->lock = HAL_MutexCreate();
+    if (NULL == h_ofc->lock) {
+        _ota_chunks_free(h_ofc);
+        return NULL;
+    }
+
+    HAL_Snprintf(h_ofc->topic_get, OTA_MQTT_TOPIC_LEN, OTA_MQTT_TOPIC_CHUNK_GET, product_id, device_name);
+    HAL_Snprintf(h_ofc->topic_data, OTA_MQTT_TOPIC_LEN, OTA_MQTT_TOPIC_CHUNK_DATA, product_id, device_name);
+    strcpy(h_ofc->version, version);
+
+    h_ofc->mqtt           = mqtt;
+    h_ofc->offset_request = offset;
+    h_ofc->size           = size;
+    h_ofc->window         = 1;
+
+    return h_ofc;
+}
+
+int32_t qcloud_ofc_mqtt_connect(void *handle)
+{
+    IOT_FUNC_ENTRY;
+
+    OTAMQTTStruct * h_ofc      = (OTAMQTTStruct *)handle;
+    SubscribeParams sub_params = DEFAULT_SUB_PARAMS;
+    int             wait_cnt   = 10;
+    int             rc;
+
+    sub_params.on_message_handler   = _ota_chunk_data_cb;
+    sub_params.on_sub_event_handler = _ota_chunk_event_cb;
+    sub_params.qos                  = QOS0;
+    sub_params.user_data            = h_ofc;
+
+    rc = IOT_MQTT_Subscribe(h_ofc->mqtt, h_ofc->topic_data, &sub_params);
+    if (rc < 0) {
+        Log_e("subscribe %s failed: %d", h_ofc->topic_data, rc);
+        IOT_FUNC_EXIT_RC(rc);
+    }
+
+    while (!h_ofc->subscribed && wait_cnt-- > 0) {
+#ifdef MULTITHREAD_ENABLED
+        HAL_SleepMs(500);
+#else
+        IOT_MQTT_Yield(h_ofc->mqtt, 200);
+#endif
+    }
+
+    if (!h_ofc->subscribed) {
+        Log_e("subscribe %s timeout", h_ofc->topic_data);
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_MQTT_REQUEST_TIMEOUT);
+    }
+
+    IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
+}
+
+int32_t qcloud_ofc_mqtt_fetch(void *handle, char *buf, uint32_t buf_len, uint32_t timeout_s)
+{
+    IOT_FUNC_ENTRY;
+
+    OTAMQTTStruct *h_ofc = (OTAMQTTStruct *)handle;
+    OTAMQTTChunk * chunk;
+    Timer          timer;
+    uint32_t       len = 0;
+    int            rc;
+
+    InitTimer(&timer);
+    countdown(&timer, timeout_s);
+
+    HAL_MutexLock(h_ofc->lock);
+    for (;;) {
+        rc = _ota_chunk_fill_window(h_ofc);
+        if (QCLOUD_RET_SUCCESS != rc) {
+            HAL_MutexUnlock(h_ofc->lock);
+            IOT_FUNC_EXIT_RC(rc);
+        }
+
+        if (0 == h_ofc->count) {  // all delivered
+            break;
+        }
+
+        chunk = &h_ofc->chunks[h_ofc->head];
+        if (chunk->received) {
+            len = chunk->len - h_ofc->read_pos;
+            len = len > buf_len ? buf_len : len;
+            memcpy(buf, chunk->data + h_ofc->read_pos, len);
+
+            h_ofc->read_pos += len;
+            if (h_ofc->read_pos == chunk->len) {
+                h_ofc->head     = (h_ofc->head + 1) % OTA_MQTT_WINDOW_MAX;
+                h_ofc->read_pos = 0;
+                h_ofc->count--;
+                _ota_chunk_fill_window(h_ofc);
+            }
+            break;
+        }
+
+        if (expired(&timer)) {
+            HAL_MutexUnlock(h_ofc->lock);
+            IOT_FUNC_EXIT_RC(IOT_OTA_ERR_FETCH_TIMEOUT);
+        }
+
+        HAL_MutexUnlock(h_ofc->lock);
+        _ota_chunk_wait(h_ofc);
+        HAL_MutexLock(h_ofc->lock);
+    }
+    HAL_MutexUnlock(h_ofc->lock);
+
+    IOT_FUNC_EXIT_RC(len);
+}
+
+int qcloud_ofc_mqtt_deinit(void *handle)
+{
+    OTAMQTTStruct *h_ofc = (OTAMQTTStruct *)handle;
+
+    if (NULL == handle) {
+        return QCLOUD_RET_SUCCESS;
+    }
+
+    /* also cancels a subscribe still waiting for SUBACK, whose handler would refer to h_ofc */
+    IOT_MQTT_Unsubscribe(h_ofc->mqtt, h_ofc->topic_data);
+
+    HAL_MutexDestroy(h_ofc->lock);
+    _ota_chunks_free(h_ofc);
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
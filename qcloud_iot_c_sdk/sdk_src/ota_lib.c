@@ -33,6 +33,9 @@ extern "C" {
 #include "qcloud_iot_import.h"
 #include "utils_md5.h"
 
+#define IOT_HEAP_TAG IOT_HEAP_OTA
+#include "utils_heap.h"
+
 /* Get the specific @key value, and copy to @dest */
 /* 0, successful; -1, failed */
 static int _qcloud_otalib_get_firmware_fixlen_para(const char *json_doc, const char *key, char *dest, size_t dest_len)
@@ -23,6 +23,9 @@
 #include "qcloud_iot_export_log.h"
 #include "qcloud_iot_import.h"
 
+#define IOT_HEAP_TAG IOT_HEAP_JSON
+#include "utils_heap.h"
+
 char *LITE_format_string(const char *fmt, ...)
 {
 #define TEMP_STRING_MAXLEN (512)
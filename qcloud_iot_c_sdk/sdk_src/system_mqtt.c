@@ -0,0 +1,379 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub
+ available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file
+ except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software
+ distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ KIND,
+ * either express or implied. See the License for the specific language
+ governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <string.h>
+
+#include "lite-utils.h"
+#include "mqtt_client.h"
+#include "qcloud_iot_export_system.h"
+
+#ifdef SYSTEM_COMM
+
+#define SYS_TIME_REQUEST_PAYLOAD  "{\"type\":\"get\",\"resource\":[\"time\"]}"
+#define SYS_TIME_RESULT_TOPIC_FMT "$sys/operation/result/%s"
+#define SYS_TIME_RX_BUF_LEN       256
+
+/* how long IOT_Get_SysTime yields at a time while waiting for the first sync */
+#define SYS_TIME_YIELD_SLICE_MS (20)
+
+static uint64_t _sys_time_local_ms(SysMQTTState *state)
+{
+    uint32_t tick = HAL_GetTimeMs();
+
+    /* unsigned difference is still right when the 32 bits tick wraps */
+    state->local_ms += (uint32_t)(tick - state->last_tick_ms);
+    state->last_tick_ms = tick;
+
+    return state->local_ms;
+}
+
+static uint64_t _sys_time_utc_ms(SysMQTTState *state, uint64_t local_ms)
+{
+    int64_t elapsed = (int64_t)(local_ms - state->base_local_ms);
+
+    return state->base_utc_ms + elapsed + elapsed * state->drift_ppm / 1000000;
+}
+
+static bool _sys_time_get_integer(char *json, char *key, int64_t *value)
+{
+    int   value_len = 0;
+    char *span      = LITE_json_value_span_of(key, json, &value_len, NULL);
+
+    return NULL != span && QCLOUD_RET_SUCCESS == LITE_span_get_integer(span, value_len, 0, INT64_MAX, value);
+}
+
+/* start measuring the drift from this sample */
+static void _sys_time_set_anchor(SysMQTTState *state, uint64_t local_ms, uint64_t utc, uint32_t error_ms)
+{
+    state->anchor_local_ms = local_ms;
+    state->anchor_utc_ms   = utc;
+    state->anchor_error_ms = error_ms;
+}
+
+/* drift over the interval from the anchor, if the sample errors are small enough against it */
+static void _sys_time_update_drift(SysMQTTState *state, uint64_t local_ms, uint64_t utc, uint32_t error_ms)
+{
+    int64_t interval = (int64_t)(local_ms - state->anchor_local_ms);
+    int64_t drift;
+
+    /* the two sample errors over the interval stay within a quarter of the clamp */
+    if ((int64_t)(state->anchor_error_ms + error_ms) * 1000000 * 4 > interval * SYS_TIME_DRIFT_MAX_PPM) {
+        return;
+    }
+
+    drift = ((int64_t)(utc - state->anchor_utc_ms) - interval) * 1000000 / interval;
+    if (drift > SYS_TIME_DRIFT_MAX_PPM) {
+        drift = SYS_TIME_DRIFT_MAX_PPM;
+    } else if (drift < -SYS_TIME_DRIFT_MAX_PPM) {
+        drift = -SYS_TIME_DRIFT_MAX_PPM;
+    }
+    state->drift_ppm = (int32_t)drift;
+
+    if (interval >= SYS_TIME_DRIFT_ANCHOR_MAX_MS) {
+        _sys_time_set_anchor(state, local_ms, utc, error_ms);
+    }
+}
+
+/**
+ * @brief take a time sample, NTP style
+ *
+ * t0 and t3 are the local time the request is sent and the reply received,
+ * t1 and t2 the server time the request is received and the reply sent. The
+ * network delay is assumed symmetric, so UTC at t3 is t2 plus half the RTT,
+ * within half the RTT. If the server only returns its time in seconds,
+ * t1 = t2 = the middle of it, within another 500 ms.
+ *
+ * The local time is only corrected by the part of its error that the sample
+ * error does not explain, so it does not jump back and forth with the samples.
+ */
+static void _sys_time_update(SysMQTTState *state, int64_t server_sec, int64_t t1, int64_t t2)
+{
+    uint64_t t3 = _sys_time_local_ms(state);
+    int64_t  rtt, elapsed, error, bound;
+    uint32_t sample_error = 0;
+    uint64_t utc, predicted;
+
+    if (t1 <= 0 || t2 < t1) {
+        t1 = t2      = server_sec * 1000 + SYS_TIME_SEC_ERROR_MS;
+        sample_error = SYS_TIME_SEC_ERROR_MS;
+    }
+
+    rtt = (int64_t)(t3 - state->request_ms) - (t2 - t1);
+    if (rtt < 0) {
+        rtt = 0;
+    }
+    utc = (uint64_t)(t2 + rtt / 2);
+    sample_error += (uint32_t)(rtt / 2);
+
+    if (!state->result_recv_ok) {
+        predicted = utc;
+        _sys_time_set_anchor(state, t3, utc, sample_error);
+    } else {
+        elapsed   = (int64_t)(t3 - state->base_local_ms);
+        predicted = _sys_time_utc_ms(state, t3);
+        error     = (int64_t)(utc - predicted);
+
+        /* both the estimate and the real drift are within the clamp */
+        bound = SYS_TIME_STEP_THRESHOLD_MS + state->base_error_ms + sample_error +
+                elapsed * 2 * SYS_TIME_DRIFT_MAX_PPM / 1000000;
+        if (error > bound || error < -bound) {
+            Log_w("local clock stepped by %ld ms, drift estimate reset", (long)error);
+            state->drift_ppm = 0;
+            predicted        = utc;
+            _sys_time_set_anchor(state, t3, utc, sample_error);
+        } else {
+            _sys_time_update_drift(state, t3, utc, sample_error);
+            if (error > (int64_t)sample_error) {
+                predicted += error - sample_error;
+            } else if (error < -(int64_t)sample_error) {
+                predicted -= -error - sample_error;
+            }
+        }
+    }
+
+    state->base_local_ms   = t3;
+    state->base_utc_ms     = predicted;
+    state->base_error_ms   = sample_error;
+    state->time            = (long)(predicted / 1000);
+    state->rtt_ms          = (uint32_t)rtt;
+    state->result_recv_ok  = true;
+    state->request_pending = false;
+    state->next_sync_ms    = t3 + SYS_TIME_RESYNC_INTERVAL_MS;
+}
+
+static void _sys_result_handler(void *pClient, MQTTMessage *message, void *pUserData)
+{
+    Qcloud_IoT_Client *mqtt_client = (Qcloud_IoT_Client *)pClient;
+    SysMQTTState *     state       = &mqtt_client->sys_state;
+    char               rcv_buf[SYS_TIME_RX_BUF_LEN + 1];
+    int64_t            server_sec, t1 = 0, t2 = 0;
+
+    if (message->payload_len > SYS_TIME_RX_BUF_LEN) {
+        Log_e("payload len exceed buffer size");
+        return;
+    }
+    memcpy(rcv_buf, message->payload, message->payload_len);
+    rcv_buf[message->payload_len] = '\0';
+
+    if (!_sys_time_get_integer(rcv_buf, "time", &server_sec)) {
+        Log_e("parse time failed: %s", rcv_buf);
+        return;
+    }
+    /* receive and send time of the server in ms, if it gives them */
+    if (!_sys_time_get_integer(rcv_buf, "ntptime1", &t1) || !_sys_time_get_integer(rcv_buf, "ntptime2", &t2)) {
+        t1 = t2 = 0;
+    }
+
+    HAL_MutexLock(state->lock);
+    if (state->request_pending) {
+        _sys_time_update(state, server_sec, t1, t2);
+        Log_d("time synced: %ld, rtt %u ms, drift %d ppm", state->time, state->rtt_ms, state->drift_ppm);
+    }
+    HAL_MutexUnlock(state->lock);
+}
+
+static void _sys_sub_event_handler(void *pClient, MQTTEventType event_type, void *pUserData)
+{
+    Qcloud_IoT_Client *mqtt_client = (Qcloud_IoT_Client *)pClient;
+    SysMQTTState *     state       = &mqtt_client->sys_state;
+
+    HAL_MutexLock(state->lock);
+    switch (event_type) {
+        case MQTT_EVENT_SUBCRIBE_SUCCESS:
+            state->topic_sub_ok = true;
+            state->next_sync_ms = 0;
+            break;
+
+        case MQTT_EVENT_SUBCRIBE_TIMEOUT:
+        case MQTT_EVENT_SUBCRIBE_NACK:
+            Log_e("subscribe sys result topic failed");
+            state->topic_sub_ok = false;
+            break;
+
+        default:
+            break;
+    }
+    HAL_MutexUnlock(state->lock);
+}
+
+static int _sys_subscribe(Qcloud_IoT_Client *pClient)
+{
+    char            topic[MAX_SIZE_OF_CLOUD_TOPIC + 1];
+    SubscribeParams sub_params = DEFAULT_SUB_PARAMS;
+    int             size;
+
+    /* the sys operation topic ends with {product_id}/{device_name} */
+    size = HAL_Snprintf(topic, sizeof(topic), SYS_TIME_RESULT_TOPIC_FMT,
+                        qcloud_iot_mqtt_topic_name(pClient, MQTT_TOPIC_SYS_OPERATION) + sizeof("$sys/operation/") - 1);
+    if (size < 0 || size > MAX_SIZE_OF_CLOUD_TOPIC) {
+        Log_e("buf size < topic length!");
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    sub_params.on_message_handler   = _sys_result_handler;
+    sub_params.on_sub_event_handler = _sys_sub_event_handler;
+    sub_params.qos                  = QOS0;
+
+    return IOT_MQTT_Subscribe(pClient, topic, &sub_params);
+}
+
+static int _sys_request_time(Qcloud_IoT_Client *pClient)
+{
+    PublishParams pub_params = DEFAULT_PUB_PARAMS;
+
+    pub_params.qos         = QOS0;
+    pub_params.payload     = SYS_TIME_REQUEST_PAYLOAD;
+    pub_params.payload_len = sizeof(SYS_TIME_REQUEST_PAYLOAD) - 1;
+    /* time spent in the send queue counts as network delay, keep it short */
+    pub_params.priority = MQTT_PRIO_CONTROL;
+
+    return qcloud_iot_mqtt_publish_handle(pClient, MQTT_TOPIC_SYS_OPERATION, &pub_params);
+}
+
+int qcloud_iot_sys_time_init(Qcloud_IoT_Client *pClient)
+{
+    SysMQTTState *state = &pClient->sys_state;
+
+    memset(state, 0, sizeof(SysMQTTState));
+    state->last_tick_ms = HAL_GetTimeMs();
+
+    state->lock = HAL_MutexCreate();
+    if (NULL == state->lock) {
+        Log_e("create sys time lock failed.");
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+void qcloud_iot_sys_time_deinit(Qcloud_IoT_Client *pClient)
+{
+    if (NULL != pClient->sys_state.lock) {
+        HAL_MutexDestroy(pClient->sys_state.lock);
+        pClient->sys_state.lock = NULL;
+    }
+}
+
+void qcloud_iot_sys_time_poll(Qcloud_IoT_Client *pClient)
+{
+    SysMQTTState *state = &pClient->sys_state;
+    uint64_t      now;
+    bool          subscribe = false, request = false;
+
+    HAL_MutexLock(state->lock);
+    now = _sys_time_local_ms(state);
+    if (state->request_pending && now - state->request_ms > SYS_TIME_RETRY_INTERVAL_MS) {
+        Log_w("time sync request timeout");
+        state->request_pending = false;
+    }
+    if (!state->request_pending && now >= state->next_sync_ms) {
+        /* retried at this pace until the subscription is acked or the reply arrives */
+        state->next_sync_ms = now + SYS_TIME_RETRY_INTERVAL_MS;
+        if (!state->topic_sub_ok) {
+            subscribe = true;
+        } else {
+            request                = true;
+            state->request_pending = true;
+            state->request_ms      = now;
+        }
+    }
+    HAL_MutexUnlock(state->lock);
+
+    if (subscribe && _sys_subscribe(pClient) < 0) {
+        Log_e("subscribe sys result topic failed");
+    }
+
+    if (request && _sys_request_time(pClient) < 0) {
+        Log_e("publish time sync request failed");
+        HAL_MutexLock(state->lock);
+        state->request_pending = false;
+        HAL_MutexUnlock(state->lock);
+    }
+}
+
+int IOT_Get_SysTime_Ms(void *pClient, uint64_t *time_ms)
+{
+    POINTER_SANITY_CHECK(pClient, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(time_ms, QCLOUD_ERR_INVAL);
+
+    SysMQTTState *state = &((Qcloud_IoT_Client *)pClient)->sys_state;
+    int           rc    = QCLOUD_ERR_FAILURE;
+
+    HAL_MutexLock(state->lock);
+    if (state->result_recv_ok) {
+        *time_ms = _sys_time_utc_ms(state, _sys_time_local_ms(state));
+        rc       = QCLOUD_RET_SUCCESS;
+    }
+    HAL_MutexUnlock(state->lock);
+
+    return rc;
+}
+
+int IOT_Get_SysTime(void *pClient, long *time)
+{
+    IOT_FUNC_ENTRY;
+
+    POINTER_SANITY_CHECK(pClient, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(time, QCLOUD_ERR_INVAL);
+
+    Qcloud_IoT_Client *mqtt_client = (Qcloud_IoT_Client *)pClient;
+    SysMQTTState *     state       = &mqtt_client->sys_state;
+    uint64_t           time_ms;
+    Timer              timer;
+    int                rc;
+
+    if (QCLOUD_RET_SUCCESS == IOT_Get_SysTime_Ms(pClient, &time_ms)) {
+        *time = (long)(time_ms / 1000);
+        IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
+    }
+
+    /* not synced yet, skip the retry wait and drive the yield loop until the first sample */
+    HAL_MutexLock(state->lock);
+    if (!state->request_pending) {
+        state->next_sync_ms = 0;
+    }
+    HAL_MutexUnlock(state->lock);
+
+    InitTimer(&timer);
+    countdown_ms(&timer, mqtt_client->command_timeout_ms * 2);
+    while (QCLOUD_RET_SUCCESS != IOT_Get_SysTime_Ms(pClient, &time_ms)) {
+        if (expired(&timer)) {
+            Log_e("time sync timeout");
+            IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
+        }
+        rc = IOT_MQTT_Yield(pClient, SYS_TIME_YIELD_SLICE_MS);
+        if (QCLOUD_RET_SUCCESS != rc && QCLOUD_RET_MQTT_RECONNECTED != rc) {
+            IOT_FUNC_EXIT_RC(rc);
+        }
+    }
+
+    *time = (long)(time_ms / 1000);
+    IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
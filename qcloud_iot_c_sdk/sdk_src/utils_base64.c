@@ -17,7 +17,6 @@
  * limitations under the License.
  *
  */
-
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -26,22 +25,178 @@ extern "C" {
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(BASE64_SIMD_CODEC)
+#if defined(__SSSE3__)
+#include <immintrin.h>
+#define BASE64_SIMD_SSSE3
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define BASE64_SIMD_NEON
+#endif
+#endif
+
+/* sextet to base64 char, usable in constant initializers */
+#define B64_CHR(v) \
+    ((v) < 26 ? 'A' + (v) : (v) < 52 ? 'a' + ((v)-26) : (v) < 62 ? '0' + ((v)-52) : (v) == 62 ? '+' : '/')
+
+#define B64_PAIR(h, l)     {B64_CHR(h), B64_CHR(l)}
+#define B64_PAIR_X4(h, l)  B64_PAIR(h, l), B64_PAIR(h, l + 1), B64_PAIR(h, l + 2), B64_PAIR(h, l + 3)
+#define B64_PAIR_X16(h, l) B64_PAIR_X4(h, l), B64_PAIR_X4(h, l + 4), B64_PAIR_X4(h, l + 8), B64_PAIR_X4(h, l + 12)
+#define B64_PAIR_ROW(h)    B64_PAIR_X16(h, 0), B64_PAIR_X16(h, 16), B64_PAIR_X16(h, 32), B64_PAIR_X16(h, 48)
+#define B64_PAIR_ROW_X4(h) B64_PAIR_ROW(h), B64_PAIR_ROW(h + 1), B64_PAIR_ROW(h + 2), B64_PAIR_ROW(h + 3)
+#define B64_PAIR_ROW_X16(h) \
+    B64_PAIR_ROW_X4(h), B64_PAIR_ROW_X4(h + 4), B64_PAIR_ROW_X4(h + 8), B64_PAIR_ROW_X4(h + 12)
 
 static const unsigned char base64_enc_map[64] = {
     'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P', 'Q', 'R', 'S', 'T', 'U', 'V',
     'W', 'X', 'Y', 'Z', 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r',
     's', 't', 'u', 'v', 'w', 'x', 'y', 'z', '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', '+', '/'};
 
-static const unsigned char base64_dec_map[128] = {
+/* 12 bits of input to 2 output chars, so 3 bytes are encoded with 2 lookups */
+static const unsigned char base64_enc_map12[4096][2] = {B64_PAIR_ROW_X16(0), B64_PAIR_ROW_X16(16),
+                                                         B64_PAIR_ROW_X16(32), B64_PAIR_ROW_X16(48)};
+
+/* 0-63: sextet value, 64: '=', 127: invalid */
+static const unsigned char base64_dec_map[256] = {
     127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127,
     127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 62,
     127, 127, 127, 63,  52,  53,  54,  55,  56,  57,  58,  59,  60,  61,  127, 127, 127, 64,  127, 127, 127, 0,
     1,   2,   3,   4,   5,   6,   7,   8,   9,   10,  11,  12,  13,  14,  15,  16,  17,  18,  19,  20,  21,  22,
     23,  24,  25,  127, 127, 127, 127, 127, 127, 26,  27,  28,  29,  30,  31,  32,  33,  34,  35,  36,  37,  38,
-    39,  40,  41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51,  127, 127, 127, 127, 127};
+    39,  40,  41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51,  127, 127, 127, 127, 127, 127, 127, 127, 127,
+    127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127,
+    127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127,
+    127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127,
+    127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127,
+    127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127,
+    127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127};
+
+/* any of these bits set in OR-ed map values means '=' or an invalid char */
+#define BASE64_DEC_BAD_MASK 0xC0
 
 #define BASE64_SIZE_T_MAX ((size_t)-1) /* SIZE_T_MAX is not standard */
 
+#if defined(BASE64_SIMD_SSSE3)
+/* encode 12 bytes to 16 chars per round, reads 16 bytes of input */
+static size_t _base64_encode_simd(unsigned char *dst, const unsigned char *src, size_t slen)
+{
+    const __m128i shuf  = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    const __m128i shift = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                        '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    size_t        i     = 0;
+
+    for (; slen - i >= 16; i += 12, dst += 16) {
+        __m128i in  = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + i)), shuf);
+        __m128i hi  = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+        __m128i lo  = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+        __m128i idx = _mm_or_si128(hi, lo);
+        __m128i sel = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+
+        sel = _mm_or_si128(sel, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), idx), _mm_set1_epi8(13)));
+        _mm_storeu_si128((__m128i *)dst, _mm_add_epi8(idx, _mm_shuffle_epi8(shift, sel)));
+    }
+
+    return i;
+}
+
+/* decode 16 chars to 12 bytes per round, writes 16 bytes of output */
+static size_t _base64_decode_simd(unsigned char *dst, size_t dlen, const unsigned char *src, size_t slen)
+{
+    const __m128i shift_lut = _mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask_lut  = _mm_setr_epi8((char)0xa8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+                                           (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf0, 0x54, 0x50,
+                                           0x50, 0x50, 0x54);
+    const __m128i bit_lut   = _mm_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80, 0, 0, 0, 0, 0, 0,
+                                          0, 0);
+    const __m128i pack      = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    size_t        i = 0, o = 0;
+
+    for (; slen - i >= 16 && dlen - o >= 16; i += 16, o += 12) {
+        __m128i in    = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i hi    = _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0f));
+        __m128i lo    = _mm_and_si128(in, _mm_set1_epi8(0x0f));
+        __m128i valid = _mm_and_si128(_mm_shuffle_epi8(mask_lut, lo), _mm_shuffle_epi8(bit_lut, hi));
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(valid, _mm_setzero_si128()))) {
+            break;
+        }
+
+        /* '+' and '/' share the high nibble, '/' needs 3 less */
+        __m128i sh = _mm_add_epi8(_mm_shuffle_epi8(shift_lut, hi),
+                                  _mm_and_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8('/')), _mm_set1_epi8(-3)));
+        __m128i v  = _mm_maddubs_epi16(_mm_add_epi8(in, sh), _mm_set1_epi32(0x01400140));
+
+        v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+        _mm_storeu_si128((__m128i *)(dst + o), _mm_shuffle_epi8(v, pack));
+    }
+
+    return i;
+}
+#elif defined(BASE64_SIMD_NEON)
+/* encode 48 bytes to 64 chars per round */
+static size_t _base64_encode_simd(unsigned char *dst, const unsigned char *src, size_t slen)
+{
+    const uint8x16_t mask = vdupq_n_u8(0x3F);
+    uint8x16x4_t     tbl, out;
+    size_t           i = 0;
+
+    tbl.val[0] = vld1q_u8(base64_enc_map);
+    tbl.val[1] = vld1q_u8(base64_enc_map + 16);
+    tbl.val[2] = vld1q_u8(base64_enc_map + 32);
+    tbl.val[3] = vld1q_u8(base64_enc_map + 48);
+
+    for (; slen - i >= 48; i += 48, dst += 64) {
+        uint8x16x3_t in = vld3q_u8(src + i);
+
+        out.val[0] = vqtbl4q_u8(tbl, vshrq_n_u8(in.val[0], 2));
+        out.val[1] = vqtbl4q_u8(tbl, vandq_u8(vorrq_u8(vshlq_n_u8(in.val[0], 4), vshrq_n_u8(in.val[1], 4)), mask));
+        out.val[2] = vqtbl4q_u8(tbl, vandq_u8(vorrq_u8(vshlq_n_u8(in.val[1], 2), vshrq_n_u8(in.val[2], 6)), mask));
+        out.val[3] = vqtbl4q_u8(tbl, vandq_u8(in.val[2], mask));
+        vst4q_u8(dst, out);
+    }
+
+    return i;
+}
+
+/* decode 64 chars to 48 bytes per round */
+static size_t _base64_decode_simd(unsigned char *dst, size_t dlen, const unsigned char *src, size_t slen)
+{
+    const uint8x16_t bad = vdupq_n_u8(BASE64_DEC_BAD_MASK);
+    uint8x16x4_t     tbl_lo, tbl_hi, v;
+    uint8x16x3_t     out;
+    size_t           i = 0, o = 0;
+    int              k;
+
+    for (k = 0; k < 4; k++) {
+        tbl_lo.val[k] = vld1q_u8(base64_dec_map + k * 16);
+        tbl_hi.val[k] = vld1q_u8(base64_dec_map + 64 + k * 16);
+    }
+
+    for (; slen - i >= 64 && dlen - o >= 48; i += 64, o += 48) {
+        uint8x16x4_t in  = vld4q_u8(src + i);
+        uint8x16_t   err = vdupq_n_u8(0);
+
+        for (k = 0; k < 4; k++) {
+            v.val[k] = vqtbx4q_u8(vqtbl4q_u8(tbl_lo, in.val[k]), tbl_hi, vsubq_u8(in.val[k], vdupq_n_u8(64)));
+            /* chars >= 128 miss both tables, catch them by their top bit */
+            err = vorrq_u8(err, vorrq_u8(v.val[k], vandq_u8(in.val[k], vdupq_n_u8(0x80))));
+        }
+        if (vmaxvq_u8(vandq_u8(err, bad))) {
+            break;
+        }
+
+        out.val[0] = vorrq_u8(vshlq_n_u8(v.val[0], 2), vshrq_n_u8(v.val[1], 4));
+        out.val[1] = vorrq_u8(vshlq_n_u8(v.val[1], 4), vshrq_n_u8(v.val[2], 2));
+        out.val[2] = vorrq_u8(vshlq_n_u8(v.val[2], 6), v.val[3]);
+        vst3q_u8(dst + o, out);
+    }
+
+    return i;
+}
+#endif
+
 int qcloud_iot_utils_base64encode(unsigned char *dst, size_t dlen, size_t *olen, const unsigned char *src, size_t slen)
 {
     size_t         i, n;
@@ -67,22 +222,26 @@ int qcloud_iot_utils_base64encode(unsigned char *dst, size_t dlen, size_t *olen,
     }
 
     n = (slen / 3) * 3;
+    i = 0;
+    p = dst;
 
-    int C1, C2, C3;
-    for (i = 0, p = dst; i < n; i += 3) {
-        C1 = *src++;
-        C2 = *src++;
-        C3 = *src++;
+#if defined(BASE64_SIMD_SSSE3) || defined(BASE64_SIMD_NEON)
+    i = _base64_encode_simd(p, src, slen);
+    p += i / 3 * 4;
+#endif
 
-        *p++ = base64_enc_map[(C1 >> 2) & 0x3F];
-        *p++ = base64_enc_map[(((C1 & 3) << 4) + (C2 >> 4)) & 0x3F];
-        *p++ = base64_enc_map[(((C2 & 15) << 2) + (C3 >> 6)) & 0x3F];
-        *p++ = base64_enc_map[C3 & 0x3F];
+    uint32_t x;
+    for (; i < n; i += 3) {
+        x = ((uint32_t)src[i] << 16) | ((uint32_t)src[i + 1] << 8) | src[i + 2];
+
+        memcpy(p, base64_enc_map12[x >> 12], 2);
+        memcpy(p + 2, base64_enc_map12[x & 0xFFF], 2);
+        p += 4;
     }
 
     if (i < slen) {
-        C1 = *src++;
-        C2 = ((i + 1) < slen) ? *src++ : 0;
+        int C1 = src[i];
+        int C2 = ((i + 1) < slen) ? src[i + 1] : 0;
 
         *p++ = base64_enc_map[(C1 >> 2) & 0x3F];
         *p++ = base64_enc_map[(((C1 & 3) << 4) + (C2 >> 4)) & 0x3F];
@@ -101,12 +260,92 @@ int qcloud_iot_utils_base64encode(unsigned char *dst, size_t dlen, size_t *olen,
     return (0);
 }
 
+/*
+ * Decode well formed input (no white space, length multiple of 4) with one
+ * table lookup per char. Returns -1 so the caller falls back to the checking
+ * decoder on anything else.
+ */
+static int _base64_decode_quads(unsigned char *dst, size_t dlen, size_t *olen, const unsigned char *src, size_t slen)
+{
+    size_t         i = 0, n, pad;
+    unsigned char *p = dst;
+    uint32_t       a, b, c, d;
+
+    if (slen == 0 || (slen & 3) != 0 || dst == NULL) {
+        return -1;
+    }
+
+    pad = (src[slen - 1] == '=') + (src[slen - 1] == '=' && src[slen - 2] == '=');
+    n   = slen / 4 * 3 - pad;
+    if (dlen < n) {
+        return -1;
+    }
+
+    /* decoding in place overwrites the input, so it must not fail after the first write */
+    if ((uintptr_t)dst < (uintptr_t)(src + slen) && (uintptr_t)src < (uintptr_t)(dst + dlen)) {
+        for (a = 0; i < slen - pad; i++) {
+            a |= base64_dec_map[src[i]];
+        }
+        if (a & BASE64_DEC_BAD_MASK) {
+            return -1;
+        }
+        i = 0;
+    }
+
+    if (pad) {
+        slen -= 4;
+    }
+
+#if defined(BASE64_SIMD_SSSE3) || defined(BASE64_SIMD_NEON)
+    i = _base64_decode_simd(p, dlen, src, slen);
+    p += i / 4 * 3;
+#endif
+
+    for (; i < slen; i += 4) {
+        a = base64_dec_map[src[i]];
+        b = base64_dec_map[src[i + 1]];
+        c = base64_dec_map[src[i + 2]];
+        d = base64_dec_map[src[i + 3]];
+        if ((a | b | c | d) & BASE64_DEC_BAD_MASK) {
+            return -1;
+        }
+
+        a    = (a << 18) | (b << 12) | (c << 6) | d;
+        *p++ = (unsigned char)(a >> 16);
+        *p++ = (unsigned char)(a >> 8);
+        *p++ = (unsigned char)(a);
+    }
+
+    if (pad) {
+        a = base64_dec_map[src[i]];
+        b = base64_dec_map[src[i + 1]];
+        c = (pad == 1) ? base64_dec_map[src[i + 2]] : 0;
+        if ((a | b | c) & BASE64_DEC_BAD_MASK) {
+            return -1;
+        }
+
+        a    = (a << 18) | (b << 12) | (c << 6);
+        *p++ = (unsigned char)(a >> 16);
+        if (pad == 1) {
+            *p++ = (unsigned char)(a >> 8);
+        }
+    }
+
+    *olen = p - dst;
+
+    return 0;
+}
+
 int qcloud_iot_utils_base64decode(unsigned char *dst, size_t dlen, size_t *olen, const unsigned char *src, size_t slen)
 {
     size_t         i, n;
     uint32_t       j, x;
     unsigned char *p;
 
+    if (_base64_decode_quads(dst, dlen, olen, src, slen) == 0) {
+        return (0);
+    }
+
     /* First pass: check for validity and get output length */
     for (i = n = j = 0; i < slen; i++) {
         /* Skip spaces before checking for EOL */
@@ -133,7 +372,7 @@ int qcloud_iot_utils_base64decode(unsigned char *dst, size_t dlen, size_t *olen,
         if (src[i] == '=' && ++j > 2)
             return (QCLOUD_ERR_FAILURE);
 
-        if (src[i] > 127 || base64_dec_map[src[i]] == 127)
+        if (base64_dec_map[src[i]] == 127)
             return (QCLOUD_ERR_FAILURE);
 
         if (base64_dec_map[src[i]] < 64 && j != 0)
@@ -178,6 +417,90 @@ int qcloud_iot_utils_base64decode(unsigned char *dst, size_t dlen, size_t *olen,
     return (0);
 }
 
+void qcloud_iot_utils_base64decode_init(iot_base64_context *ctx)
+{
+    memset(ctx, 0, sizeof(iot_base64_context));
+}
+
+int qcloud_iot_utils_base64decode_update(iot_base64_context *ctx, unsigned char *dst, size_t dlen, size_t *olen,
+                                         const unsigned char *src, size_t slen)
+{
+    size_t         i = 0, n;
+    unsigned char *p = dst;
+    uint32_t       a, b, c, d;
+
+    n = (ctx->count + slen) / 4 * 3;
+    if (n > 0 && (dst == NULL || dlen < n)) {
+        *olen = n;
+        return (QCLOUD_ERR_FAILURE);
+    }
+
+    while (i < slen) {
+        /* whole quads on a quad boundary, the common case for PEM lines */
+        while (ctx->count == 0 && slen - i >= 4) {
+            a = base64_dec_map[src[i]];
+            b = base64_dec_map[src[i + 1]];
+            c = base64_dec_map[src[i + 2]];
+            d = base64_dec_map[src[i + 3]];
+            if ((a | b | c | d) & BASE64_DEC_BAD_MASK) {
+                break;
+            }
+            if (ctx->pad) {
+                return (QCLOUD_ERR_FAILURE);
+            }
+
+            a    = (a << 18) | (b << 12) | (c << 6) | d;
+            *p++ = (unsigned char)(a >> 16);
+            *p++ = (unsigned char)(a >> 8);
+            *p++ = (unsigned char)(a);
+            i += 4;
+        }
+        if (i == slen) {
+            break;
+        }
+
+        a = base64_dec_map[src[i++]];
+        if (a == 127) {
+            if (src[i - 1] == '\r' || src[i - 1] == '\n' || src[i - 1] == ' ') {
+                continue;
+            }
+            return (QCLOUD_ERR_FAILURE);
+        }
+
+        if (a == 64) {
+            if (ctx->count < 2 || ++ctx->pad > 2) {
+                return (QCLOUD_ERR_FAILURE);
+            }
+            a = 0;
+        } else if (ctx->pad) {
+            /* data after padding */
+            return (QCLOUD_ERR_FAILURE);
+        }
+
+        ctx->acc = (ctx->acc << 6) | a;
+        if (++ctx->count == 4) {
+            *p++ = (unsigned char)(ctx->acc >> 16);
+            if (ctx->pad < 2) {
+                *p++ = (unsigned char)(ctx->acc >> 8);
+            }
+            if (ctx->pad < 1) {
+                *p++ = (unsigned char)(ctx->acc);
+            }
+            ctx->acc   = 0;
+            ctx->count = 0;
+        }
+    }
+
+    *olen = p - dst;
+
+    return (0);
+}
+
+int qcloud_iot_utils_base64decode_finish(iot_base64_context *ctx)
+{
+    return (ctx->count == 0) ? 0 : QCLOUD_ERR_FAILURE;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,118 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub
+ available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file
+ except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software
+ distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ KIND,
+ * either express or implied. See the License for the specific language
+ governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "utils_completion.h"
+
+#include <string.h>
+
+#include "qcloud_iot_export_error.h"
+
+/* how long deinit waits for a signaller which has set done but not posted yet */
+#define IOT_COMPLETION_DRAIN_WAIT_MS (1000)
+
+int iot_completion_init(IotCompletion *completion)
+{
+    memset(completion, 0, sizeof(IotCompletion));
+
+#ifdef MULTITHREAD_ENABLED
+    completion->sem = HAL_SemaphoreCreate();
+    if (NULL == completion->sem) {
+        return QCLOUD_ERR_FAILURE;
+    }
+#endif
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+void iot_completion_reset(IotCompletion *completion)
+{
+#ifdef MULTITHREAD_ENABLED
+    /* drop a post left over by a previous signaller the waiter gave up on */
+    if (NULL != completion->sem) {
+        while (QCLOUD_RET_SUCCESS == HAL_SemaphoreWait(completion->sem, 0)) {
+        }
+    }
+#endif
+
+    completion->result   = 0;
+    completion->consumed = 0;
+    __atomic_store_n(&completion->done, 0, __ATOMIC_RELEASE);
+}
+
+void iot_completion_complete(IotCompletion *completion, int result)
+{
+    if (__atomic_load_n(&completion->done, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    completion->result = result;
+    __atomic_store_n(&completion->done, 1, __ATOMIC_RELEASE);
+
+#ifdef MULTITHREAD_ENABLED
+    /* the last access, the waiter may release the completion right after it */
+    if (NULL != completion->sem) {
+        HAL_SemaphorePost(completion->sem);
+    }
+#endif
+}
+
+bool iot_completion_is_done(IotCompletion *completion)
+{
+    return __atomic_load_n(&completion->done, __ATOMIC_ACQUIRE) != 0;
+}
+
+bool iot_completion_wait(IotCompletion *completion, uint32_t timeout_ms)
+{
+#ifdef MULTITHREAD_ENABLED
+    if (NULL != completion->sem && !completion->consumed) {
+        if (QCLOUD_RET_SUCCESS != HAL_SemaphoreWait(completion->sem, timeout_ms)) {
+            return false;
+        }
+        completion->consumed = 1;
+    }
+#endif
+
+    return iot_completion_is_done(completion);
+}
+
+void iot_completion_deinit(IotCompletion *completion)
+{
+#ifdef MULTITHREAD_ENABLED
+    if (NULL == completion->sem) {
+        return;
+    }
+
+    /* done is seen by polling, make sure the signaller is out of HAL_SemaphorePost */
+    if (iot_completion_is_done(completion) && !completion->consumed) {
+        HAL_SemaphoreWait(completion->sem, IOT_COMPLETION_DRAIN_WAIT_MS);
+    }
+
+    HAL_SemaphoreDestroy(completion->sem);
+    completion->sem = NULL;
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,346 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub
+ available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file
+ except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software
+ distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ KIND,
+ * either express or implied. See the License for the specific language
+ governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "qcloud_iot_export_error.h"
+#include "qcloud_iot_export_log.h"
+#include "qcloud_iot_import.h"
+#include "utils_heap.h"
+#include "utils_param_check.h"
+
+#if defined(HEAP_ACCOUNTING) || defined(IOT_STATIC_MEMORY)
+
+/* placed before every block to find its size, owner and pool class on free, keeps the block aligned */
+typedef union {
+    struct {
+        uint32_t size;
+        uint16_t tag;
+        uint16_t pool;
+    } info;
+    long long align_ll;
+    double    align_d;
+    void *    align_p;
+} HeapBlockHeader;
+
+#ifdef IOT_STATIC_MEMORY
+
+#define STATIC_BLOCK_ALIGN(size) (((size) + 7) & ~7)
+
+#define STATIC_POOL_STORAGE(n) \
+    static uint64_t sg_static_pool_##n[STATIC_BLOCK_ALIGN(IOT_STATIC_BLOCK_SIZE_##n) / 8 * IOT_STATIC_BLOCK_COUNT_##n]
+
+#define STATIC_POOL_CLASS(n) \
+    {(uint8_t *)sg_static_pool_##n, STATIC_BLOCK_ALIGN(IOT_STATIC_BLOCK_SIZE_##n), IOT_STATIC_BLOCK_COUNT_##n, NULL, 0, 0}
+
+typedef struct {
+    uint8_t *base;
+    uint32_t block_size;
+    uint32_t block_count;
+    void *   free_list;  // free blocks linked through their first word
+    uint32_t used;
+    uint32_t peak_used;
+} StaticPoolClass;
+
+STATIC_POOL_STORAGE(0);
+STATIC_POOL_STORAGE(1);
+STATIC_POOL_STORAGE(2);
+STATIC_POOL_STORAGE(3);
+STATIC_POOL_STORAGE(4);
+STATIC_POOL_STORAGE(5);
+STATIC_POOL_STORAGE(6);
+STATIC_POOL_STORAGE(7);
+
+static StaticPoolClass sg_static_pools[IOT_STATIC_POOL_CLASSES] = {
+    STATIC_POOL_CLASS(0), STATIC_POOL_CLASS(1), STATIC_POOL_CLASS(2), STATIC_POOL_CLASS(3),
+    STATIC_POOL_CLASS(4), STATIC_POOL_CLASS(5), STATIC_POOL_CLASS(6), STATIC_POOL_CLASS(7)};
+
+static void *sg_static_pool_lock;
+static bool  sg_static_pool_inited;
+
+static void _static_pool_lock(void)
+{
+    void *lock;
+
+    if (NULL == __atomic_load_n(&sg_static_pool_lock, __ATOMIC_ACQUIRE)) {
+        /* created on first allocation, the loser of a creation race drops its own */
+        lock           = HAL_MutexCreate();
+        void *expected = NULL;
+        if (!__atomic_compare_exchange_n(&sg_static_pool_lock, &expected, lock, false, __ATOMIC_ACQ_REL,
+                                         __ATOMIC_ACQUIRE)) {
+            HAL_MutexDestroy(lock);
+        }
+    }
+    HAL_MutexLock(sg_static_pool_lock);
+
+    if (!sg_static_pool_inited) {
+        StaticPoolClass *pool;
+        uint32_t         i, j;
+
+        for (i = 0; i < IOT_STATIC_POOL_CLASSES; i++) {
+            pool = &sg_static_pools[i];
+            for (j = pool->block_count; j > 0; j--) {
+                void **block    = (void **)(pool->base + (j - 1) * pool->block_size);
+                *block          = pool->free_list;
+                pool->free_list = block;
+            }
+        }
+        sg_static_pool_inited = true;
+    }
+}
+
+static HeapBlockHeader *_static_pool_alloc(uint32_t size)
+{
+    StaticPoolClass *pool;
+    HeapBlockHeader *header = NULL;
+    uint16_t         i;
+
+    _static_pool_lock();
+    for (i = 0; i < IOT_STATIC_POOL_CLASSES; i++) {
+        pool = &sg_static_pools[i];
+        if (pool->block_size >= size && NULL != pool->free_list) {
+            header          = (HeapBlockHeader *)pool->free_list;
+            pool->free_list = *(void **)pool->free_list;
+            if (++pool->used > pool->peak_used) {
+                pool->peak_used = pool->used;
+            }
+            header->info.pool = i;
+            break;
+        }
+    }
+    HAL_MutexUnlock(sg_static_pool_lock);
+
+    if (NULL == header) {
+        Log_e("static pool has no free block of %u bytes", size);
+    }
+
+    return header;
+}
+
+static void _static_pool_free(HeapBlockHeader *header)
+{
+    StaticPoolClass *pool = &sg_static_pools[header->info.pool];
+
+    _static_pool_lock();
+    *(void **)header = pool->free_list;
+    pool->free_list  = header;
+    pool->used--;
+    HAL_MutexUnlock(sg_static_pool_lock);
+}
+
+#endif
+
+#ifdef HEAP_ACCOUNTING
+
+/* one for each subsystem, and the last one for the total */
+static IotHeapStats sg_heap_stats[IOT_HEAP_TAG_MAX + 1];
+
+static uint32_t sg_heap_last_report;
+
+static const char *sg_heap_tag_names[IOT_HEAP_TAG_MAX + 1] = {
+    "mqtt", "template", "event", "action", "ota", "httpc", "tls", "json", "other", "total"};
+
+static int _heap_hist_bucket(uint32_t size)
+{
+    uint32_t limit = 32;
+    int      i     = 0;
+
+    while (i < IOT_HEAP_HIST_BUCKETS - 1 && size > limit) {
+        limit <<= 1;
+        i++;
+    }
+
+    return i;
+}
+
+static void _heap_account_alloc(IotHeapStats *stats, uint32_t size, int bucket)
+{
+    uint32_t live = __atomic_add_fetch(&stats->live_bytes, size, __ATOMIC_RELAXED);
+    uint32_t peak = __atomic_load_n(&stats->peak_bytes, __ATOMIC_RELAXED);
+
+    while (live > peak &&
+           !__atomic_compare_exchange_n(&stats->peak_bytes, &peak, live, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+
+    __atomic_add_fetch(&stats->alloc_count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats->size_hist[bucket], 1, __ATOMIC_RELAXED);
+}
+
+static void _heap_account_free(IotHeapStats *stats, uint32_t size)
+{
+    __atomic_sub_fetch(&stats->live_bytes, size, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats->free_count, 1, __ATOMIC_RELAXED);
+}
+
+#endif
+
+void *iot_heap_malloc(IotHeapTag tag, uint32_t size)
+{
+    HeapBlockHeader *header = NULL;
+
+    if ((unsigned)tag >= IOT_HEAP_TAG_MAX) {
+        tag = IOT_HEAP_OTHER;
+    }
+
+    if (size <= UINT32_MAX - sizeof(HeapBlockHeader)) {
+#ifdef IOT_STATIC_MEMORY
+        header = _static_pool_alloc(sizeof(HeapBlockHeader) + size);
+#else
+        header = (HeapBlockHeader *)HAL_Malloc(sizeof(HeapBlockHeader) + size);
+#endif
+    }
+
+#ifdef HEAP_ACCOUNTING
+    if (NULL == header) {
+        __atomic_add_fetch(&sg_heap_stats[tag].fail_count, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&sg_heap_stats[IOT_HEAP_TAG_MAX].fail_count, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    int bucket = _heap_hist_bucket(size);
+    _heap_account_alloc(&sg_heap_stats[tag], size, bucket);
+    _heap_account_alloc(&sg_heap_stats[IOT_HEAP_TAG_MAX], size, bucket);
+#else
+    if (NULL == header) {
+        return NULL;
+    }
+#endif
+
+    header->info.size = size;
+    header->info.tag  = tag;
+
+    return header + 1;
+}
+
+void iot_heap_free(void *ptr)
+{
+    HeapBlockHeader *header;
+
+    if (NULL == ptr) {
+        return;
+    }
+
+    header = (HeapBlockHeader *)ptr - 1;
+#ifdef HEAP_ACCOUNTING
+    _heap_account_free(&sg_heap_stats[header->info.tag], header->info.size);
+    _heap_account_free(&sg_heap_stats[IOT_HEAP_TAG_MAX], header->info.size);
+#endif
+
+#ifdef IOT_STATIC_MEMORY
+    _static_pool_free(header);
+#else
+    HAL_Free(header);
+#endif
+}
+
+#ifdef HEAP_ACCOUNTING
+
+int IOT_Heap_Get_Stats(IotHeapTag tag, IotHeapStats *pStats)
+{
+    POINTER_SANITY_CHECK(pStats, QCLOUD_ERR_INVAL);
+    if ((unsigned)tag > IOT_HEAP_TAG_MAX) {
+        Log_e("invalid heap tag %d", tag);
+        return QCLOUD_ERR_INVAL;
+    }
+
+    /* fields are read one by one, they may be off by an allocation in flight */
+    IotHeapStats *stats = &sg_heap_stats[tag];
+    int           i;
+
+    pStats->live_bytes  = __atomic_load_n(&stats->live_bytes, __ATOMIC_RELAXED);
+    pStats->peak_bytes  = __atomic_load_n(&stats->peak_bytes, __ATOMIC_RELAXED);
+    pStats->alloc_count = __atomic_load_n(&stats->alloc_count, __ATOMIC_RELAXED);
+    pStats->free_count  = __atomic_load_n(&stats->free_count, __ATOMIC_RELAXED);
+    pStats->fail_count  = __atomic_load_n(&stats->fail_count, __ATOMIC_RELAXED);
+    for (i = 0; i < IOT_HEAP_HIST_BUCKETS; i++) {
+        pStats->size_hist[i] = __atomic_load_n(&stats->size_hist[i], __ATOMIC_RELAXED);
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+const char *IOT_Heap_Tag_Name(IotHeapTag tag)
+{
+    return ((unsigned)tag <= IOT_HEAP_TAG_MAX) ? sg_heap_tag_names[tag] : "unknown";
+}
+
+void IOT_Heap_Reset_Peak(void)
+{
+    int i;
+
+    for (i = 0; i <= IOT_HEAP_TAG_MAX; i++) {
+        __atomic_store_n(&sg_heap_stats[i].peak_bytes, __atomic_load_n(&sg_heap_stats[i].live_bytes, __ATOMIC_RELAXED),
+                         __ATOMIC_RELAXED);
+    }
+}
+
+void IOT_Heap_Report(void)
+{
+    IotHeapStats stats;
+    int          i;
+
+    for (i = 0; i <= IOT_HEAP_TAG_MAX; i++) {
+        IOT_Heap_Get_Stats((IotHeapTag)i, &stats);
+        if (0 == stats.alloc_count && 0 == stats.fail_count) {
+            continue;
+        }
+
+        Log_i("heap %-8s live %u peak %u alloc %u free %u fail %u hist %u/%u/%u/%u/%u/%u/%u/%u/%u",
+              sg_heap_tag_names[i], stats.live_bytes, stats.peak_bytes, stats.alloc_count, stats.free_count,
+              stats.fail_count, stats.size_hist[0], stats.size_hist[1], stats.size_hist[2], stats.size_hist[3],
+              stats.size_hist[4], stats.size_hist[5], stats.size_hist[6], stats.size_hist[7], stats.size_hist[8]);
+    }
+
+#ifdef IOT_STATIC_MEMORY
+    for (i = 0; i < IOT_STATIC_POOL_CLASSES; i++) {
+        Log_i("heap pool of %u bytes used %u peak %u of %u", sg_static_pools[i].block_size, sg_static_pools[i].used,
+              sg_static_pools[i].peak_used, sg_static_pools[i].block_count);
+    }
+#endif
+}
+
+void iot_heap_poll(void)
+{
+    uint32_t now  = HAL_GetTimeMs();
+    uint32_t last = __atomic_load_n(&sg_heap_last_report, __ATOMIC_RELAXED);
+
+    if (now - last < HEAP_REPORT_INTERVAL_MS) {
+        return;
+    }
+
+    /* only one of the clients yielding at the same time prints it */
+    if (__atomic_compare_exchange_n(&sg_heap_last_report, &last, now, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        IOT_Heap_Report();
+    }
+}
+
+#endif
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -31,7 +31,9 @@ extern "C" {
 #include "qcloud_iot_common.h"
 #include "qcloud_iot_export.h"
 #include "qcloud_iot_import.h"
+#include "utils_base64.h"
 #include "utils_timer.h"
+#include "utils_trace.h"
 
 #define HTTP_CLIENT_MIN(x, y) (((x) < (y)) ? (x) : (y))
 #define HTTP_CLIENT_MAX(x, y) (((x) > (y)) ? (x) : (y))
@@ -50,27 +52,6 @@ extern "C" {
 #define DEBUG_LEVEL 2
 #endif
 
-static void _http_client_base64enc(char *out, const char *in)
-{
-    const char code[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/=";
-    int        i = 0, x = 0, l = 0;
-
-    for (; *in; in++) {
-        x = x << 8 | *in;
-        for (l += 8; l >= 6; l -= 6) {
-            out[i++] = code[(x >> (l - 6)) & 0x3f];
-        }
-    }
-    if (l > 0) {
-        x <<= 6 - l;
-        out[i++] = code[x & 0x3f];
-    }
-    for (; i % 4;) {
-        out[i++] = '=';
-    }
-    out[i] = '\0';
-}
-
 static int _http_client_parse_url(const char *url, char *scheme, uint32_t max_scheme_len, char *host,
                                   uint32_t maxhost_len, int *port, char *path, uint32_t max_path_len)
 {
@@ -209,15 +190,20 @@ static int _http_client_get_info(HTTPClient *client, unsigned char *send_buf, in
 
 static int _http_client_send_auth(HTTPClient *client, unsigned char *send_buf, int *send_idx)
 {
-    char b_auth[(int)((HTTP_CLIENT_AUTHB_SIZE + 3) * 4 / 3 + 1)];
-    char base64buff[HTTP_CLIENT_AUTHB_SIZE + 3];
+    char   b_auth[(HTTP_CLIENT_AUTHB_SIZE + 3 + 2) / 3 * 4 + 2];
+    char   base64buff[HTTP_CLIENT_AUTHB_SIZE + 3];
+    size_t len = 0;
 
     _http_client_get_info(client, send_buf, send_idx, "Authorization: Basic ", 0);
     HAL_Snprintf(base64buff, sizeof(base64buff), "%s:%s", client->auth_user, client->auth_password);
 
-    _http_client_base64enc(b_auth, base64buff);
-    b_auth[strlen(b_auth) + 1] = '\0';
-    b_auth[strlen(b_auth)]     = '\n';
+    /* keep one byte for the trailing '\n' */
+    if (qcloud_iot_utils_base64encode((unsigned char *)b_auth, sizeof(b_auth) - 1, &len,
+                                      (const unsigned char *)base64buff, strlen(base64buff))) {
+        return QCLOUD_ERR_FAILURE;
+    }
+    b_auth[len]     = '\n';
+    b_auth[len + 1] = '\0';
 
     _http_client_get_info(client, send_buf, send_idx, b_auth, 0);
 
@@ -629,7 +615,12 @@ static int _http_client_response_parse(HTTPClient *client, char *data, int len,
 
 static int _http_client_connect(HTTPClient *client)
 {
-    if (QCLOUD_RET_SUCCESS != client->network_stack.connect(&client->network_stack)) {
+    int rc;
+
+    IOT_TRACE_BEGIN(t_connect);
+    rc = client->network_stack.connect(&client->network_stack);
+    IOT_TRACE_END(t_connect, "http", "connect", rc);
+    if (QCLOUD_RET_SUCCESS != rc) {
         return QCLOUD_ERR_HTTP_CONN;
     }
 
@@ -641,15 +632,18 @@ static int _http_client_send_request(HTTPClient *client, const char *url, HttpMe
 {
     int rc;
 
+    IOT_TRACE_BEGIN(t_request);
     rc = _http_client_send_header(client, url, method, client_data);
     if (rc != 0) {
         Log_e("httpclient_send_header is error, rc = %d", rc);
+        IOT_TRACE_END(t_request, "http", "request", rc);
         return rc;
     }
 
     if (method == HTTP_POST || method == HTTP_PUT) {
         rc = _http_client_send_userdata(client, client_data);
     }
+    IOT_TRACE_END(t_request, "http", "request", rc);
 
     return rc;
 }
@@ -788,7 +782,9 @@ int qcloud_http_recv_data(HTTPClient *client, uint32_t timeout_ms, HTTPClientDat
     countdown_ms(&timer, (unsigned int)timeout_ms);
 
     if ((NULL != client_data->response_buf) && (0 != client_data->response_buf_len)) {
+        IOT_TRACE_BEGIN(t_response);
         rc = _http_client_recv_response(client, left_ms(&timer), client_data);
+        IOT_TRACE_END(t_response, "http", "response", rc);
         if (rc < 0) {
             Log_e("http_client_recv_response is error,rc = %d", rc);
             qcloud_http_client_close(client);
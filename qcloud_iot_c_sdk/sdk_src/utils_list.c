@@ -27,6 +27,9 @@ extern "C" {
 #include "qcloud_iot_export_log.h"
 #include "qcloud_iot_import.h"
 
+#define IOT_HEAP_TAG IOT_HEAP_OTHER
+#include "utils_heap.h"
+
 /*
  * create list, return NULL if fail
  */
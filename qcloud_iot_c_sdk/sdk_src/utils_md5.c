@@ -32,6 +32,61 @@ extern "C" {
 
 #define MD5_DIGEST_SIZE 16
 
+#if defined(HASH_USE_MBEDTLS)
+#include "mbedtls/version.h"
+
+/* mbedtls 2.x keeps the int returning API under the _ret suffix */
+#if MBEDTLS_VERSION_NUMBER < 0x03000000
+#define IOT_MBEDTLS_MD5_STARTS mbedtls_md5_starts_ret
+#define IOT_MBEDTLS_MD5_UPDATE mbedtls_md5_update_ret
+#define IOT_MBEDTLS_MD5_FINISH mbedtls_md5_finish_ret
+#else
+#define IOT_MBEDTLS_MD5_STARTS mbedtls_md5_starts
+#define IOT_MBEDTLS_MD5_UPDATE mbedtls_md5_update
+#define IOT_MBEDTLS_MD5_FINISH mbedtls_md5_finish
+#endif
+
+void utils_md5_init(iot_md5_context *ctx)
+{
+    mbedtls_md5_init(ctx);
+}
+
+void utils_md5_free(iot_md5_context *ctx)
+{
+    if (ctx == NULL) {
+        return;
+    }
+
+    mbedtls_md5_free(ctx);
+}
+
+void utils_md5_clone(iot_md5_context *dst, const iot_md5_context *src)
+{
+    mbedtls_md5_clone(dst, src);
+}
+
+void utils_md5_starts(iot_md5_context *ctx)
+{
+    IOT_MBEDTLS_MD5_STARTS(ctx);
+}
+
+void utils_md5_process(iot_md5_context *ctx, const unsigned char data[64])
+{
+    mbedtls_internal_md5_process(ctx, data);
+}
+
+void utils_md5_update(iot_md5_context *ctx, const unsigned char *input, size_t ilen)
+{
+    IOT_MBEDTLS_MD5_UPDATE(ctx, input, ilen);
+}
+
+void utils_md5_finish(iot_md5_context *ctx, unsigned char output[16])
+{
+    IOT_MBEDTLS_MD5_FINISH(ctx, output);
+}
+
+#else
+
 /* Implementation that should never be optimized out by the compiler */
 static void _utils_md5_zeroize(void *v, size_t n)
 {
@@ -289,6 +344,8 @@ void utils_md5_finish(iot_md5_context *ctx, unsigned char output[16])
     IOT_MD5_PUT_UINT32_LE(ctx->state[3], output, 12);
 }
 
+#endif /* HASH_USE_MBEDTLS */
+
 /*
  * output = MD5( input buffer )
  */
@@ -26,6 +26,73 @@
 #include "qcloud_iot_export_log.h"
 #include "qcloud_iot_import.h"
 
+#if defined(HASH_USE_MBEDTLS)
+#include "mbedtls/version.h"
+
+/* mbedtls 2.x keeps the int returning API under the _ret suffix */
+#if MBEDTLS_VERSION_NUMBER < 0x03000000
+#define IOT_MBEDTLS_SHA1_STARTS mbedtls_sha1_starts_ret
+#define IOT_MBEDTLS_SHA1_UPDATE mbedtls_sha1_update_ret
+#define IOT_MBEDTLS_SHA1_FINISH mbedtls_sha1_finish_ret
+#else
+#define IOT_MBEDTLS_SHA1_STARTS mbedtls_sha1_starts
+#define IOT_MBEDTLS_SHA1_UPDATE mbedtls_sha1_update
+#define IOT_MBEDTLS_SHA1_FINISH mbedtls_sha1_finish
+#endif
+
+/*
+ * SHA-1 routed to mbedtls, which uses the SHA accelerator through the
+ * MBEDTLS_SHA1_ALT hooks when the platform provides them (ESP32)
+ */
+void utils_sha1_init(iot_sha1_context *ctx)
+{
+    mbedtls_sha1_init(ctx);
+}
+
+void utils_sha1_free(iot_sha1_context *ctx)
+{
+    if (ctx == NULL) {
+        return;
+    }
+
+    mbedtls_sha1_free(ctx);
+}
+
+void utils_sha1_clone(iot_sha1_context *dst, const iot_sha1_context *src)
+{
+    mbedtls_sha1_clone(dst, src);
+}
+
+void utils_sha1_starts(iot_sha1_context *ctx)
+{
+    IOT_MBEDTLS_SHA1_STARTS(ctx);
+}
+
+void utils_sha1_process(iot_sha1_context *ctx, const unsigned char data[64])
+{
+    mbedtls_internal_sha1_process(ctx, data);
+}
+
+void utils_sha1_update(iot_sha1_context *ctx, const unsigned char *input, size_t ilen)
+{
+    IOT_MBEDTLS_SHA1_UPDATE(ctx, input, ilen);
+}
+
+void utils_sha1_finish(iot_sha1_context *ctx, unsigned char output[20])
+{
+    IOT_MBEDTLS_SHA1_FINISH(ctx, output);
+}
+
+#else
+
+#if defined(HASH_CPU_ACCEL) && defined(__SHA__) && defined(__SSSE3__)
+#include <immintrin.h>
+#define IOT_SHA1_X86_SHA_NI
+#elif defined(HASH_CPU_ACCEL) && (defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_SHA2))
+#include <arm_neon.h>
+#define IOT_SHA1_ARMV8_CE
+#endif
+
 /* Implementation that should never be optimized out by the compiler */
 static void utils_sha1_zeroize(void *v, size_t n)
 {
@@ -90,8 +157,133 @@ void utils_sha1_starts(iot_sha1_context *ctx)
     ctx->state[4] = 0xC3D2E1F0;
 }
 
+#if defined(IOT_SHA1_X86_SHA_NI)
+/*
+ * 4 rounds with Intel SHA extensions. Group g of the 20 groups alternates
+ * E0/E1 and schedules the message words 1-3 groups ahead.
+ */
+#define IOT_SHA1_NI_ROUNDS(g, f)                                                                          \
+    {                                                                                                     \
+        E[(g)&1] = ((g) == 0) ? _mm_add_epi32(E[0], MSG[0]) : _mm_sha1nexte_epu32(E[(g)&1], MSG[(g)&3]); \
+        E[((g) + 1) & 1] = ABCD;                                                                          \
+        if ((g) >= 3 && (g) <= 18)                                                                        \
+            MSG[((g) + 1) & 3] = _mm_sha1msg2_epu32(MSG[((g) + 1) & 3], MSG[(g)&3]);                      \
+        ABCD = _mm_sha1rnds4_epu32(ABCD, E[(g)&1], f);                                                    \
+        if ((g) >= 1 && (g) <= 16)                                                                        \
+            MSG[((g) + 3) & 3] = _mm_sha1msg1_epu32(MSG[((g) + 3) & 3], MSG[(g)&3]);                      \
+        if ((g) >= 2 && (g) <= 17)                                                                        \
+            MSG[((g) + 2) & 3] = _mm_xor_si128(MSG[((g) + 2) & 3], MSG[(g)&3]);                           \
+    }
+
+static void _utils_sha1_process_accel(uint32_t state[5], const unsigned char data[64])
+{
+    const __m128i MASK = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+    __m128i       ABCD, ABCD_SAVE, E0_SAVE, E[2], MSG[4];
+    int           i;
+
+    ABCD      = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1B);
+    E[0]      = _mm_set_epi32(state[4], 0, 0, 0);
+    ABCD_SAVE = ABCD;
+    E0_SAVE   = E[0];
+
+    for (i = 0; i < 4; i++) {
+        MSG[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + i * 16)), MASK);
+    }
+
+    IOT_SHA1_NI_ROUNDS(0, 0);
+    IOT_SHA1_NI_ROUNDS(1, 0);
+    IOT_SHA1_NI_ROUNDS(2, 0);
+    IOT_SHA1_NI_ROUNDS(3, 0);
+    IOT_SHA1_NI_ROUNDS(4, 0);
+    IOT_SHA1_NI_ROUNDS(5, 1);
+    IOT_SHA1_NI_ROUNDS(6, 1);
+    IOT_SHA1_NI_ROUNDS(7, 1);
+    IOT_SHA1_NI_ROUNDS(8, 1);
+    IOT_SHA1_NI_ROUNDS(9, 1);
+    IOT_SHA1_NI_ROUNDS(10, 2);
+    IOT_SHA1_NI_ROUNDS(11, 2);
+    IOT_SHA1_NI_ROUNDS(12, 2);
+    IOT_SHA1_NI_ROUNDS(13, 2);
+    IOT_SHA1_NI_ROUNDS(14, 2);
+    IOT_SHA1_NI_ROUNDS(15, 3);
+    IOT_SHA1_NI_ROUNDS(16, 3);
+    IOT_SHA1_NI_ROUNDS(17, 3);
+    IOT_SHA1_NI_ROUNDS(18, 3);
+    IOT_SHA1_NI_ROUNDS(19, 3);
+
+    E[0] = _mm_sha1nexte_epu32(E[0], E0_SAVE);
+    ABCD = _mm_add_epi32(ABCD, ABCD_SAVE);
+
+    _mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(ABCD, 0x1B));
+    state[4] = (uint32_t)_mm_cvtsi128_si32(_mm_shuffle_epi32(E[0], 0xFF));
+}
+#undef IOT_SHA1_NI_ROUNDS
+#elif defined(IOT_SHA1_ARMV8_CE)
+/*
+ * 4 rounds with ARMv8 crypto extensions. W+K of group g+2 is prepared while
+ * group g runs, and the message words are scheduled 3 groups ahead.
+ */
+#define IOT_SHA1_CE_ROUNDS(g, F, K)                                                                   \
+    {                                                                                                 \
+        E[((g) + 1) & 1] = vsha1h_u32(vgetq_lane_u32(ABCD, 0));                                       \
+        ABCD             = F(ABCD, E[(g)&1], TMP[(g)&1]);                                             \
+        if ((g) <= 17)                                                                                \
+            TMP[(g)&1] = vaddq_u32(MSG[((g) + 2) & 3], vdupq_n_u32(K));                               \
+        if ((g) >= 1 && (g) <= 16)                                                                    \
+            MSG[((g)-1) & 3] = vsha1su1q_u32(MSG[((g)-1) & 3], MSG[((g) + 2) & 3]);                   \
+        if ((g) <= 15)                                                                                \
+            MSG[(g)&3] = vsha1su0q_u32(MSG[(g)&3], MSG[((g) + 1) & 3], MSG[((g) + 2) & 3]);           \
+    }
+
+static void _utils_sha1_process_accel(uint32_t state[5], const unsigned char data[64])
+{
+    uint32x4_t ABCD, ABCD_SAVE, MSG[4], TMP[2];
+    uint32_t   E[2], E0_SAVE;
+    int        i;
+
+    ABCD      = vld1q_u32(state);
+    E[0]      = state[4];
+    ABCD_SAVE = ABCD;
+    E0_SAVE   = E[0];
+
+    for (i = 0; i < 4; i++) {
+        MSG[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + i * 16)));
+    }
+    TMP[0] = vaddq_u32(MSG[0], vdupq_n_u32(0x5A827999));
+    TMP[1] = vaddq_u32(MSG[1], vdupq_n_u32(0x5A827999));
+
+    IOT_SHA1_CE_ROUNDS(0, vsha1cq_u32, 0x5A827999);
+    IOT_SHA1_CE_ROUNDS(1, vsha1cq_u32, 0x5A827999);
+    IOT_SHA1_CE_ROUNDS(2, vsha1cq_u32, 0x5A827999);
+    IOT_SHA1_CE_ROUNDS(3, vsha1cq_u32, 0x6ED9EBA1);
+    IOT_SHA1_CE_ROUNDS(4, vsha1cq_u32, 0x6ED9EBA1);
+    IOT_SHA1_CE_ROUNDS(5, vsha1pq_u32, 0x6ED9EBA1);
+    IOT_SHA1_CE_ROUNDS(6, vsha1pq_u32, 0x6ED9EBA1);
+    IOT_SHA1_CE_ROUNDS(7, vsha1pq_u32, 0x6ED9EBA1);
+    IOT_SHA1_CE_ROUNDS(8, vsha1pq_u32, 0x8F1BBCDC);
+    IOT_SHA1_CE_ROUNDS(9, vsha1pq_u32, 0x8F1BBCDC);
+    IOT_SHA1_CE_ROUNDS(10, vsha1mq_u32, 0x8F1BBCDC);
+    IOT_SHA1_CE_ROUNDS(11, vsha1mq_u32, 0x8F1BBCDC);
+    IOT_SHA1_CE_ROUNDS(12, vsha1mq_u32, 0x8F1BBCDC);
+    IOT_SHA1_CE_ROUNDS(13, vsha1mq_u32, 0xCA62C1D6);
+    IOT_SHA1_CE_ROUNDS(14, vsha1mq_u32, 0xCA62C1D6);
+    IOT_SHA1_CE_ROUNDS(15, vsha1pq_u32, 0xCA62C1D6);
+    IOT_SHA1_CE_ROUNDS(16, vsha1pq_u32, 0xCA62C1D6);
+    IOT_SHA1_CE_ROUNDS(17, vsha1pq_u32, 0xCA62C1D6);
+    IOT_SHA1_CE_ROUNDS(18, vsha1pq_u32, 0);
+    IOT_SHA1_CE_ROUNDS(19, vsha1pq_u32, 0);
+
+    vst1q_u32(state, vaddq_u32(ABCD, ABCD_SAVE));
+    state[4] = E[0] + E0_SAVE;
+}
+#undef IOT_SHA1_CE_ROUNDS
+#endif
+
 void utils_sha1_process(iot_sha1_context *ctx, const unsigned char data[64])
 {
+#if defined(IOT_SHA1_X86_SHA_NI) || defined(IOT_SHA1_ARMV8_CE)
+    _utils_sha1_process_accel(ctx->state, data);
+#else
     uint32_t temp, W[16], A, B, C, D, E;
 
     IOT_SHA1_GET_UINT32_BE(W[0], data, 0);
@@ -241,6 +433,7 @@ void utils_sha1_process(iot_sha1_context *ctx, const unsigned char data[64])
     ctx->state[2] += C;
     ctx->state[3] += D;
     ctx->state[4] += E;
+#endif
 }
 
 /*
@@ -316,6 +509,8 @@ void utils_sha1_finish(iot_sha1_context *ctx, unsigned char output[20])
     IOT_SHA1_PUT_UINT32_BE(ctx->state[4], output, 16);
 }
 
+#endif /* HASH_USE_MBEDTLS */
+
 /*
  * output = SHA-1( input buffer )
  */
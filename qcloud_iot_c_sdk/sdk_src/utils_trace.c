@@ -0,0 +1,278 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub
+ available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file
+ except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software
+ distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ KIND,
+ * either express or implied. See the License for the specific language
+ governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "qcloud_iot_export_error.h"
+#include "qcloud_iot_export_log.h"
+#include "qcloud_iot_import.h"
+#include "utils_param_check.h"
+#include "utils_trace.h"
+
+#ifdef IOT_TRACE_ENABLED
+
+/* text of one event in Chrome trace-event JSON */
+#define TRACE_EVENT_JSON_LEN (256)
+
+#define TRACE_RING_MASK (IOT_TRACE_RING_SIZE - 1)
+
+#if (IOT_TRACE_RING_SIZE & TRACE_RING_MASK)
+#error "IOT_TRACE_RING_SIZE should be a power of 2"
+#endif
+
+typedef struct {
+    uint32_t    seq;     // index + 1 of the event in the slot, 0 while it is written
+    char        phase;   // Chrome phase: 'X' span, 'b'/'e' async begin/end, 'i' instant
+    int32_t     result;  // result code
+    uint32_t    id;      // id of async span
+    uint32_t    dur_us;  // duration of span
+    uint64_t    ts_us;   // start time
+    size_t      tid;     // thread which recorded it
+    const char *category;
+    const char *name;
+} TraceEvent;
+
+static TraceEvent sg_trace_ring[IOT_TRACE_RING_SIZE];
+static uint32_t   sg_trace_head;         // index of the next event to record
+static uint32_t   sg_trace_tail;         // events before it are dropped by IOT_Trace_Reset
+static uint32_t   sg_trace_stream_next;  // index of the next event to stream
+static bool       sg_trace_enabled = true;
+
+/* lock free, a writer owns its slot from the index it takes until the seq is stored */
+static void _trace_record(char phase, const char *category, const char *name, uint64_t ts_us, uint32_t dur_us,
+                          uint32_t id, int32_t result)
+{
+    uint32_t    index;
+    TraceEvent *event;
+
+    if (!__atomic_load_n(&sg_trace_enabled, __ATOMIC_RELAXED)) {
+        return;
+    }
+
+    index = __atomic_fetch_add(&sg_trace_head, 1, __ATOMIC_RELAXED);
+    event = &sg_trace_ring[index & TRACE_RING_MASK];
+
+    __atomic_store_n(&event->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    event->phase    = phase;
+    event->result   = result;
+    event->id       = id;
+    event->dur_us   = dur_us;
+    event->ts_us    = ts_us;
+    event->tid      = HAL_ThreadGetId();
+    event->category = category;
+    event->name     = name;
+
+    __atomic_store_n(&event->seq, index + 1, __ATOMIC_RELEASE);
+}
+
+typedef enum { TRACE_READ_OK, TRACE_READ_PENDING, TRACE_READ_LOST } TraceReadResult;
+
+/* copy the event of index, PENDING if it is still being written, LOST if it is overwritten */
+static TraceReadResult _trace_read(uint32_t index, TraceEvent *out)
+{
+    TraceEvent *event = &sg_trace_ring[index & TRACE_RING_MASK];
+    uint32_t    seq   = __atomic_load_n(&event->seq, __ATOMIC_ACQUIRE);
+
+    if (seq != index + 1) {
+        return (0 == seq || (int32_t)(seq - (index + 1)) < 0) ? TRACE_READ_PENDING : TRACE_READ_LOST;
+    }
+
+    memcpy(out, event, sizeof(TraceEvent));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    return (__atomic_load_n(&event->seq, __ATOMIC_RELAXED) == seq) ? TRACE_READ_OK : TRACE_READ_LOST;
+}
+
+static int _trace_format(const TraceEvent *event, char *buf, size_t size)
+{
+    int len;
+
+    len = HAL_Snprintf(buf, size, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%" PRIu64 ",\"pid\":1,\"tid\":%lu",
+                       event->name, event->category, event->phase, event->ts_us, (unsigned long)event->tid);
+    if (len < 0 || len >= (int)size) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    switch (event->phase) {
+        case 'X':
+            len += HAL_Snprintf(buf + len, size - len, ",\"dur\":%u,\"args\":{\"rc\":%d}}", (unsigned)event->dur_us,
+                                (int)event->result);
+            break;
+        case 'b':
+            len += HAL_Snprintf(buf + len, size - len, ",\"id\":\"0x%x\"}", (unsigned)event->id);
+            break;
+        case 'e':
+            len += HAL_Snprintf(buf + len, size - len, ",\"id\":\"0x%x\",\"args\":{\"rc\":%d}}", (unsigned)event->id,
+                                (int)event->result);
+            break;
+        default:
+            len += HAL_Snprintf(buf + len, size - len, ",\"s\":\"t\",\"args\":{\"rc\":%d}}", (int)event->result);
+            break;
+    }
+
+    return len < (int)size ? len : QCLOUD_ERR_FAILURE;
+}
+
+static void _trace_printf(void *context, const char *data, size_t len)
+{
+    HAL_Printf("%.*s", (int)len, data);
+}
+
+void IOT_Trace_Enable(bool enable)
+{
+    __atomic_store_n(&sg_trace_enabled, enable, __ATOMIC_RELAXED);
+}
+
+void IOT_Trace_Reset(void)
+{
+    uint32_t head = __atomic_load_n(&sg_trace_head, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&sg_trace_tail, head, __ATOMIC_RELAXED);
+    __atomic_store_n(&sg_trace_stream_next, head, __ATOMIC_RELAXED);
+}
+
+void IOT_Trace_Span(const char *category, const char *name, uint64_t start_us, int32_t result)
+{
+    _trace_record('X', category, name, start_us, (uint32_t)(HAL_GetTimeUs() - start_us), 0, result);
+}
+
+void IOT_Trace_Async_Begin(const char *category, const char *name, uint32_t id)
+{
+    _trace_record('b', category, name, HAL_GetTimeUs(), 0, id, 0);
+}
+
+void IOT_Trace_Async_End(const char *category, const char *name, uint32_t id, int32_t result)
+{
+    _trace_record('e', category, name, HAL_GetTimeUs(), 0, id, result);
+}
+
+void IOT_Trace_Instant(const char *category, const char *name, int32_t result)
+{
+    _trace_record('i', category, name, HAL_GetTimeUs(), 0, 0, result);
+}
+
+uint32_t IOT_Trace_Id(const char *str)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*str) {
+        hash = (hash ^ (unsigned char)*str++) * 16777619u;
+    }
+
+    return hash;
+}
+
+int IOT_Trace_Dump_Chrome(TraceOutputFun output, void *context)
+{
+    char       buf[TRACE_EVENT_JSON_LEN + 2];
+    TraceEvent event;
+    uint32_t   head, index;
+    int        len, count = 0;
+
+    POINTER_SANITY_CHECK(output, QCLOUD_ERR_INVAL);
+
+    head  = __atomic_load_n(&sg_trace_head, __ATOMIC_ACQUIRE);
+    index = __atomic_load_n(&sg_trace_tail, __ATOMIC_RELAXED);
+    if (head - index > IOT_TRACE_RING_SIZE) {
+        index = head - IOT_TRACE_RING_SIZE;
+    }
+
+    output(context, "{\"traceEvents\":[\n", strlen("{\"traceEvents\":[\n"));
+    for (; index != head; index++) {
+        if (TRACE_READ_OK != _trace_read(index, &event)) {
+            continue;
+        }
+        // separator before each event but the first
+        buf[0] = ',';
+        buf[1] = '\n';
+        len    = _trace_format(&event, buf + 2, TRACE_EVENT_JSON_LEN);
+        if (len < 0) {
+            continue;
+        }
+        output(context, count ? buf : buf + 2, count ? len + 2 : len);
+        count++;
+    }
+    output(context, "\n],\"displayTimeUnit\":\"ms\"}\n", strlen("\n],\"displayTimeUnit\":\"ms\"}\n"));
+
+    return count;
+}
+
+int IOT_Trace_Stream(TraceOutputFun output, void *context)
+{
+    char            buf[TRACE_EVENT_JSON_LEN + 8];
+    TraceEvent      event;
+    TraceReadResult ret;
+    uint32_t        head, index, lost = 0;
+    int             len, count = 0;
+
+    if (NULL == output) {
+        output = _trace_printf;
+    }
+
+    head  = __atomic_load_n(&sg_trace_head, __ATOMIC_ACQUIRE);
+    index = __atomic_load_n(&sg_trace_stream_next, __ATOMIC_RELAXED);
+    if (head - index > IOT_TRACE_RING_SIZE) {
+        lost += head - IOT_TRACE_RING_SIZE - index;
+        index = head - IOT_TRACE_RING_SIZE;
+    }
+
+    for (; index != head; index++) {
+        ret = _trace_read(index, &event);
+        if (TRACE_READ_PENDING == ret) {
+            // the writer is not done yet, continue from it next time
+            break;
+        } else if (TRACE_READ_LOST == ret) {
+            lost++;
+            continue;
+        }
+
+        memcpy(buf, "TRACE ", 6);
+        len = _trace_format(&event, buf + 6, TRACE_EVENT_JSON_LEN);
+        if (len < 0) {
+            continue;
+        }
+        buf[6 + len]     = ',';
+        buf[6 + len + 1] = '\n';
+        output(context, buf, 6 + len + 2);
+        count++;
+    }
+    __atomic_store_n(&sg_trace_stream_next, index, __ATOMIC_RELAXED);
+
+    if (lost) {
+        Log_w("%u trace events overwritten before streamed", (unsigned)lost);
+    }
+
+    return count;
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
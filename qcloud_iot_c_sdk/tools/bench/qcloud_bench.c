@@ -0,0 +1,275 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub
+ available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file
+ except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software
+ distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ KIND,
+ * either express or implied. See the License for the specific language
+ governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * qcloud-bench: throughput of the SDK's hot utility paths on a Linux host, to
+ * compare builds with different feature flags, e.g. the C and the SHA-NI SHA1,
+ * or the scalar and the JSON_SIMD_SCAN JSON value scan.
+ * Each case checks its output against a known answer before it is timed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "qcloud_iot_export.h"
+#include "qcloud_iot_import.h"
+#include "json_parser.h"
+#include "utils_getopt.h"
+#include "utils_md5.h"
+#include "utils_sha1.h"
+
+#define BENCH_HASH_LEN (1024 * 1024)
+
+/* members of the generated JSON documents */
+#define BENCH_JSON_MEMBERS (300)
+
+typedef struct {
+    const char *name;
+    int (*run)(int rounds);
+} BenchCase;
+
+static uint64_t _now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void _report(const char *name, uint64_t bytes, uint64_t ops, uint64_t elapsed_us)
+{
+    double s = elapsed_us / 1e6;
+
+    printf("%-16s %10.1f MB/s %12.0f ops/s\n", name, bytes / s / 1e6, ops / s);
+}
+
+static int _hex_equals(const unsigned char *digest, size_t len, const char *hex)
+{
+    char   buf[41];
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        sprintf(buf + i * 2, "%02x", digest[i]);
+    }
+    return !strcmp(buf, hex);
+}
+
+static unsigned char *_hash_input(void)
+{
+    unsigned char *buf = malloc(BENCH_HASH_LEN);
+    size_t         i;
+
+    for (i = 0; buf && i < BENCH_HASH_LEN; i++) {
+        buf[i] = (unsigned char)(i * 131 + (i >> 8));
+    }
+    return buf;
+}
+
+static int _bench_md5(int rounds)
+{
+    unsigned char  digest[16];
+    unsigned char *buf;
+    uint64_t       start;
+    int            i;
+
+    utils_md5((const unsigned char *)"abc", 3, digest);
+    if (!_hex_equals(digest, 16, "900150983cd24fb0d6963f7d28e17f72")) {
+        printf("md5: wrong digest\n");
+        return -1;
+    }
+
+    if (NULL == (buf = _hash_input())) {
+        return -1;
+    }
+    start = _now_us();
+    for (i = 0; i < rounds; i++) {
+        utils_md5(buf, BENCH_HASH_LEN, digest);
+    }
+    _report("md5 1MB", (uint64_t)rounds * BENCH_HASH_LEN, rounds, _now_us() - start);
+    free(buf);
+
+    return 0;
+}
+
+static int _bench_sha1(int rounds)
+{
+    unsigned char  digest[20];
+    unsigned char *buf;
+    uint64_t       start;
+    int            i;
+
+    utils_sha1((const unsigned char *)"abc", 3, digest);
+    if (!_hex_equals(digest, 20, "a9993e364706816aba3e25717850c26c9cd0d89d")) {
+        printf("sha1: wrong digest\n");
+        return -1;
+    }
+
+    if (NULL == (buf = _hash_input())) {
+        return -1;
+    }
+    start = _now_us();
+    for (i = 0; i < rounds; i++) {
+        utils_sha1(buf, BENCH_HASH_LEN, digest);
+    }
+    _report("sha1 1MB", (uint64_t)rounds * BENCH_HASH_LEN, rounds, _now_us() - start);
+    free(buf);
+
+    return 0;
+}
+
+/* a template report of members holding a string of str_len bytes and a nested object */
+static char *_json_doc(int str_len, size_t *doc_len)
+{
+    size_t cap = BENCH_JSON_MEMBERS * (str_len + 96) + 64;
+    char * doc = malloc(cap);
+    size_t len;
+    int    i;
+
+    if (NULL == doc) {
+        return NULL;
+    }
+    len = sprintf(doc, "{\"method\":\"report\",\"clientToken\":\"bench-1\",\"params\":{");
+    for (i = 0; i < BENCH_JSON_MEMBERS; i++) {
+        len += sprintf(doc + len, "%s\"p%d\":{\"s\":\"", i ? "," : "", i);
+        memset(doc + len, 'a' + i % 26, str_len);
+        len += str_len;
+        len += sprintf(doc + len, "\",\"v\":{\"n\":%d,\"on\":true,\"a\":[1,2,3]}}", i);
+    }
+    len += sprintf(doc + len, "}}");
+    *doc_len = len;
+
+    return doc;
+}
+
+static int _json_count_cb(char *p_cName, int iNameLen, char *p_cValue, int iValueLen, int iValueType,
+                          void *p_Result)
+{
+    (*(int *)p_Result)++;
+    return JSON_PARSE_OK;
+}
+
+/* iterate the members of params, then look up the last one by name */
+static int _bench_json_doc(const char *name, int str_len, int rounds)
+{
+    char     last[16];
+    char *   doc, *params, *val;
+    size_t   doc_len;
+    uint64_t start;
+    int      params_len, val_len, val_type, count, i;
+
+    // params is parsed in place of the document, do not time the log line about it
+    IOT_Log_Set_Level(eLOG_ERROR);
+    if (NULL == (doc = _json_doc(str_len, &doc_len))) {
+        return -1;
+    }
+    HAL_Snprintf(last, sizeof(last), "p%d", BENCH_JSON_MEMBERS - 1);
+    params = json_get_value_by_name(doc, doc_len, "params", &params_len, &val_type);
+    count  = 0;
+    if (NULL == params || JSOBJECT != val_type ||
+        JSON_RESULT_OK != json_parse_name_value(params, params_len, _json_count_cb, &count) ||
+        BENCH_JSON_MEMBERS != count || NULL == json_get_value_by_name(params, params_len, last, &val_len, &val_type) ||
+        JSOBJECT != val_type) {
+        printf("%s: wrong parse result\n", name);
+        free(doc);
+        return -1;
+    }
+
+    start = _now_us();
+    for (i = 0; i < rounds; i++) {
+        params = json_get_value_by_name(doc, doc_len, "params", &params_len, &val_type);
+        json_parse_name_value(params, params_len, _json_count_cb, &count);
+        val = json_get_value_by_name(params, params_len, last, &val_len, &val_type);
+        if (NULL == val) {
+            break;
+        }
+    }
+    _report(name, (uint64_t)rounds * doc_len * 3, (uint64_t)rounds, _now_us() - start);
+    free(doc);
+
+    return 0;
+}
+
+static int _bench_json(int rounds)
+{
+    int rc = _bench_json_doc("json short str", 8, rounds);
+
+    return rc ? rc : _bench_json_doc("json 300B str", 300, rounds);
+}
+
+static const BenchCase sg_cases[] = {
+    {"md5", _bench_md5},
+    {"sha1", _bench_sha1},
+    {"json", _bench_json},
+};
+
+static void _usage(const char *name)
+{
+    size_t i;
+
+    printf(
+        "usage: %s [-n rounds] [-c case]...\n"
+        "  -n rounds    rounds of each case, default 100\n"
+        "  -c case      run only this case, may be repeated, default all of:",
+        name);
+    for (i = 0; i < sizeof(sg_cases) / sizeof(sg_cases[0]); i++) {
+        printf(" %s", sg_cases[i].name);
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *only[sizeof(sg_cases) / sizeof(sg_cases[0])];
+    int         only_num = 0;
+    int         rounds   = 100;
+    int         rc       = 0;
+    int         c, selected;
+    size_t      i;
+
+    while ((c = utils_getopt(argc, argv, "n:c:h")) != EOF) {
+        switch (c) {
+            case 'n':
+                rounds = atoi(utils_optarg);
+                break;
+            case 'c':
+                if (only_num < (int)(sizeof(only) / sizeof(only[0]))) {
+                    only[only_num++] = utils_optarg;
+                }
+                break;
+            default:
+                _usage(argv[0]);
+                return c == 'h' ? 0 : 1;
+        }
+    }
+
+    for (i = 0; i < sizeof(sg_cases) / sizeof(sg_cases[0]); i++) {
+        selected = !only_num;
+        for (c = 0; c < only_num; c++) {
+            selected |= !strcmp(only[c], sg_cases[i].name);
+        }
+        if (selected && sg_cases[i].run(rounds)) {
+            rc = 1;
+        }
+    }
+
+    return rc;
+}
@@ -0,0 +1,430 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+#
+# Tencent is pleased to support the open source community by making IoT Hub available.
+# Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+#
+# Licensed under the MIT License (the "License"); you may not use this file except in
+# compliance with the License. You may obtain a copy of the License at
+# http://opensource.org/licenses/MIT
+#
+# Unless required by applicable law or agreed to in writing, software distributed under the License is
+# distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+# either express or implied. See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Compile the data template JSON of a product into typed C bindings.
+
+    python3 tools/codegen.py -c product.json [-d output_dir] [-p prefix]
+
+It writes <prefix>_data_template.h/.c with:
+  - a struct holding every property with its C type, and the index/mask of each one
+  - the constant key table, and a perfect hash from key to property index
+  - a decoder and an encoder specialized for each property, range checked by
+    the min/max of its definition
+  - <prefix>_codec, to be passed to IOT_Template_Register_Codec
+
+Control messages are then decoded in one pass over the params object, and a
+report of any set of properties is built by IOT_Template_JSON_ConstructReportMask.
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+
+FNV_PRIME = 16777619
+FNV_BASIS = 2166136261
+MAX_PROPERTIES = 32
+MAX_SEED = 100000
+
+INT32_MIN = -2147483648
+INT32_MAX = 2147483647
+
+
+class Property(object):
+    def __init__(self, index, node):
+        self.index = index
+        self.id = node["id"]
+        if not re.match(r"^[A-Za-z_][A-Za-z0-9_]*$", self.id):
+            raise ValueError("property id '%s' is not a valid C identifier" % self.id)
+
+        define = node.get("define", {})
+        self.type = define.get("type")
+        self.name = node.get("name", "")
+        self.mode = node.get("mode", "rw")
+
+        if self.type in ("int", "enum", "timestamp"):
+            if self.type == "enum":
+                keys = [int(k) for k in define.get("mapping", {}).keys()] or [0]
+                self.min, self.max = min(keys), max(keys)
+            elif self.type == "timestamp":
+                self.min, self.max = 0, 4294967295
+            else:
+                self.min = int(float(define.get("min", INT32_MIN)))
+                self.max = int(float(define.get("max", INT32_MAX)))
+        elif self.type == "float":
+            self.min = float(define.get("min", "-3.402823466e+38"))
+            self.max = float(define.get("max", "3.402823466e+38"))
+        elif self.type == "string":
+            self.max = int(define.get("max", 64))
+        elif self.type != "bool":
+            raise ValueError("property '%s' has type '%s' which is not supported" % (self.id, self.type))
+
+    @property
+    def writable(self):
+        return self.mode != "r"
+
+    @property
+    def upper(self):
+        return self.id.upper()
+
+    def field(self, prefix):
+        c_type = {
+            "bool": "TYPE_DEF_TEMPLATE_BOOL",
+            "int": "TYPE_DEF_TEMPLATE_INT",
+            "enum": "TYPE_DEF_TEMPLATE_ENUM",
+            "float": "TYPE_DEF_TEMPLATE_FLOAT",
+            "timestamp": "TYPE_DEF_TEMPLATE_TIME",
+            "string": "TYPE_DEF_TEMPLATE_STRING",
+        }[self.type]
+        if self.type == "string":
+            return "%s %s[%s_%s_MAX_LEN + 1];" % (c_type, self.id, prefix.upper(), self.upper)
+        return "%s %s;" % (c_type, self.id)
+
+
+def fnv1a(key, seed):
+    h = FNV_BASIS ^ seed
+    for c in key.encode("utf-8"):
+        h = ((h ^ c) * FNV_PRIME) & 0xFFFFFFFF
+    return h
+
+
+def find_perfect_hash(keys):
+    # smallest table first, then the first seed without collisions
+    for slots in range(len(keys), 4 * len(keys) + 1):
+        for seed in range(MAX_SEED):
+            used = set()
+            for key in keys:
+                slot = fnv1a(key, seed) % slots
+                if slot in used:
+                    break
+                used.add(slot)
+            else:
+                return seed, slots
+    raise ValueError("no perfect hash found for the property keys")
+
+
+def gen_header(props, prefix, guard, source):
+    P = prefix.upper()
+    out = []
+    out.append("/* Generated by tools/codegen.py from %s, do not edit. */" % source)
+    out.append("")
+    out.append("#ifndef %s" % guard)
+    out.append("#define %s" % guard)
+    out.append("")
+    out.append("#ifdef __cplusplus")
+    out.append('extern "C" {')
+    out.append("#endif")
+    out.append("")
+    out.append("#include <stdint.h>")
+    out.append("")
+    out.append('#include "qcloud_iot_export.h"')
+    out.append("")
+    out.append("#define %s_PROPERTY_COUNT (%d)" % (P, len(props)))
+    out.append("")
+    for p in props:
+        if p.type == "string":
+            out.append("#define %s_%s_MAX_LEN (%d)" % (P, p.upper, p.max))
+    out.append("")
+    out.append("typedef enum {")
+    for p in props:
+        out.append("    %s_PROP_%s = %d," % (P, p.upper, p.index))
+    out.append("} %sPropertyIndex;" % _camel(prefix))
+    out.append("")
+    for p in props:
+        out.append("#define %s_MASK_%s (1u << %s_PROP_%s)" % (P, p.upper, P, p.upper))
+    out.append("#define %s_MASK_ALL (0x%08xu)" % (P, (1 << len(props)) - 1 if len(props) < 32 else 0xFFFFFFFF))
+    out.append("")
+    out.append("typedef struct {")
+    for p in props:
+        comment = " // %s" % p.name if p.name else ""
+        out.append("    %s%s" % (p.field(prefix), comment))
+    out.append("} %sData;" % _camel(prefix))
+    out.append("")
+    out.append("extern const char *const %s_property_keys[%s_PROPERTY_COUNT];" % (prefix, P))
+    out.append("")
+    out.append("extern const TemplateCodec %s_codec;" % prefix)
+    out.append("")
+    out.append("/**")
+    out.append(" * @brief Find the index of a property by its key")
+    out.append(" *")
+    out.append(" * @param key       key of property, not necessarily NULL terminated")
+    out.append(" * @param key_len   length of key")
+    out.append(" * @return          index of the property, or -1 if not found")
+    out.append(" */")
+    out.append("int %s_property_index(const char *key, int key_len);" % prefix)
+    out.append("")
+    out.append("/**")
+    out.append(" * @brief Update data from the params object of a control message")
+    out.append(" *")
+    out.append(" * @param data          %sData to be updated" % _camel(prefix))
+    out.append(" * @param params        params object, may be modified temporarily during the call")
+    out.append(" * @param params_len    length of params")
+    out.append(" * @return              mask of the updated properties")
+    out.append(" */")
+    out.append("uint32_t %s_decode(void *data, char *params, int params_len);" % prefix)
+    out.append("")
+    out.append("/**")
+    out.append(" * @brief Write properties as \"key\":value pairs, each followed by a comma")
+    out.append(" *")
+    out.append(" * @param data      %sData to be reported" % _camel(prefix))
+    out.append(" * @param mask      properties to be written")
+    out.append(" * @param buf       output buffer")
+    out.append(" * @param size      size of buf")
+    out.append(" * @return          length written, or QCLOUD_ERR_JSON_BUFFER_TOO_SMALL")
+    out.append(" */")
+    out.append("int %s_encode(const void *data, uint32_t mask, char *buf, size_t size);" % prefix)
+    out.append("")
+    out.append("#ifdef __cplusplus")
+    out.append("}")
+    out.append("#endif")
+    out.append("")
+    out.append("#endif /* %s */" % guard)
+    return "\n".join(out) + "\n"
+
+
+def _camel(prefix):
+    return "".join(w.capitalize() for w in prefix.split("_"))
+
+
+def _decoder(p, data_type):
+    out = []
+    out.append("static int _decode_%s(%s *data, const char *val, int val_len)" % (p.id, data_type))
+    out.append("{")
+    if p.type == "bool":
+        out.append("    bool v;")
+        out.append("")
+        out.append("    if (QCLOUD_RET_SUCCESS != LITE_span_get_boolean(val, val_len, &v)) {")
+        out.append("        return QCLOUD_ERR_FAILURE;")
+        out.append("    }")
+        out.append("    data->%s = v ? 1 : 0;" % p.id)
+    elif p.type in ("int", "enum", "timestamp"):
+        cast = "uint32_t" if p.type == "timestamp" else "int32_t"
+        out.append("    int64_t v;")
+        out.append("")
+        out.append("    if (QCLOUD_RET_SUCCESS != LITE_span_get_integer(val, val_len, %dLL, %dLL, &v)) {" %
+                   (p.min, p.max))
+        out.append("        return QCLOUD_ERR_FAILURE;")
+        out.append("    }")
+        out.append("    data->%s = (%s)v;" % (p.id, cast))
+    elif p.type == "float":
+        out.append("    double v;")
+        out.append("")
+        out.append("    if (QCLOUD_RET_SUCCESS != LITE_span_get_double(val, val_len, &v) || v < %r || v > %r) {" %
+                   (p.min, p.max))
+        out.append("        return QCLOUD_ERR_FAILURE;")
+        out.append("    }")
+        out.append("    data->%s = (float)v;" % p.id)
+    elif p.type == "string":
+        out.append("    if (val_len > (int)sizeof(data->%s) - 1) {" % p.id)
+        out.append("        return QCLOUD_ERR_FAILURE;")
+        out.append("    }")
+        out.append("    memcpy(data->%s, val, val_len);" % p.id)
+        out.append("    data->%s[val_len] = '\\0';" % p.id)
+    out.append("")
+    out.append("    return QCLOUD_RET_SUCCESS;")
+    out.append("}")
+    return out
+
+
+def _encoder(p, data_type):
+    fmt, arg = {
+        "bool": ("%u", "data->%s ? 1 : 0"),
+        "int": ("%\" PRIi32 \"", "data->%s"),
+        "enum": ("%\" PRIi32 \"", "data->%s"),
+        "timestamp": ("%\" PRIu32 \"", "data->%s"),
+        "float": ("%f", "data->%s"),
+        "string": ("\\\"%s\\\"", "data->%s"),
+    }[p.type]
+    out = []
+    out.append("static int _encode_%s(const %s *data, char *buf, size_t size)" % (p.id, data_type))
+    out.append("{")
+    out.append("    return HAL_Snprintf(buf, size, \"\\\"%s\\\":%s,\", %s);" % (p.id, fmt, arg % p.id))
+    out.append("}")
+    return out
+
+
+def gen_source(props, prefix, header_name, source, seed, slots):
+    P = prefix.upper()
+    data_type = "%sData" % _camel(prefix)
+    table = [-1] * slots
+    for p in props:
+        table[fnv1a(p.id, seed) % slots] = p.index
+
+    out = []
+    out.append("/* Generated by tools/codegen.py from %s, do not edit. */" % source)
+    out.append("")
+    out.append("#include <inttypes.h>")
+    out.append("#include <stdbool.h>")
+    out.append("#include <string.h>")
+    out.append("")
+    out.append('#include "%s"' % header_name)
+    out.append('#include "json_parser.h"')
+    out.append('#include "lite-utils.h"')
+    out.append("")
+    out.append("#define %s_KEY_HASH_SEED  (%du)" % (P, seed))
+    out.append("#define %s_KEY_HASH_SLOTS (%d)" % (P, slots))
+    out.append("")
+    out.append("typedef int (*%sDecoder)(%s *data, const char *val, int val_len);" % (_camel(prefix), data_type))
+    out.append("typedef int (*%sEncoder)(const %s *data, char *buf, size_t size);" % (_camel(prefix), data_type))
+    out.append("")
+    out.append("typedef struct {")
+    out.append("    %s *data;" % data_type)
+    out.append("    uint32_t%s mask;" % (" " * (len(data_type) - 7)))
+    out.append("} %sDecodeState;" % _camel(prefix))
+    out.append("")
+    out.append("const char *const %s_property_keys[%s_PROPERTY_COUNT] = {" % (prefix, P))
+    for p in props:
+        out.append('    "%s",' % p.id)
+    out.append("};")
+    out.append("")
+    out.append("static const uint8_t sg_%s_key_lens[%s_PROPERTY_COUNT] = {" % (prefix, P))
+    out.append("    " + ", ".join(str(len(p.id.encode("utf-8"))) for p in props) + ",")
+    out.append("};")
+    out.append("")
+    out.append("/* slot of the perfect hash to property index */")
+    out.append("static const int8_t sg_%s_key_slots[%s_KEY_HASH_SLOTS] = {" % (prefix, P))
+    out.append("    " + ", ".join(str(i) for i in table) + ",")
+    out.append("};")
+    out.append("")
+    for p in props:
+        if p.writable:
+            out.extend(_decoder(p, data_type))
+            out.append("")
+    for p in props:
+        out.extend(_encoder(p, data_type))
+        out.append("")
+    out.append("static const %sDecoder sg_%s_decoders[%s_PROPERTY_COUNT] = {" % (_camel(prefix), prefix, P))
+    for p in props:
+        out.append("    _decode_%s," % p.id if p.writable else "    NULL, /* %s is read only */" % p.id)
+    out.append("};")
+    out.append("")
+    out.append("static const %sEncoder sg_%s_encoders[%s_PROPERTY_COUNT] = {" % (_camel(prefix), prefix, P))
+    for p in props:
+        out.append("    _encode_%s," % p.id)
+    out.append("};")
+    out.append("")
+    out.append("int %s_property_index(const char *key, int key_len)" % prefix)
+    out.append("{")
+    out.append("    uint32_t hash = 2166136261u ^ %s_KEY_HASH_SEED;" % P)
+    out.append("    int      i;")
+    out.append("")
+    out.append("    for (i = 0; i < key_len; i++) {")
+    out.append("        hash = (hash ^ (unsigned char)key[i]) * 16777619u;")
+    out.append("    }")
+    out.append("")
+    out.append("    i = sg_%s_key_slots[hash %% %s_KEY_HASH_SLOTS];" % (prefix, P))
+    out.append("    if (i < 0 || key_len != sg_%s_key_lens[i] || memcmp(key, %s_property_keys[i], key_len)) {" %
+               (prefix, prefix))
+    out.append("        return -1;")
+    out.append("    }")
+    out.append("")
+    out.append("    return i;")
+    out.append("}")
+    out.append("")
+    out.append("static int _%s_decode_kv(char *key, int key_len, char *val, int val_len, int val_type, void *arg)" %
+               prefix)
+    out.append("{")
+    out.append("    %sDecodeState *state = (%sDecodeState *)arg;" % (_camel(prefix), _camel(prefix)))
+    out.append("    int%s index = %s_property_index(key, key_len);" % (" " * (len(_camel(prefix)) + 9), prefix))
+    out.append("")
+    out.append("    if (index < 0) {")
+    out.append('        Log_w("unknown property %.*s", key_len, key);')
+    out.append("    } else if (NULL == sg_%s_decoders[index]) {" % prefix)
+    out.append('        Log_w("property %s is read only", ' + "%s_property_keys[index]);" % prefix)
+    out.append("    } else if (QCLOUD_RET_SUCCESS == sg_%s_decoders[index](state->data, val, val_len)) {" % prefix)
+    out.append("        state->mask |= 1u << index;")
+    out.append("    } else {")
+    out.append('        Log_e("property %s parse value %.*s failed", ' + "%s_property_keys[index], val_len, val);" % prefix)
+    out.append("    }")
+    out.append("")
+    out.append("    return JSON_PARSE_OK;")
+    out.append("}")
+    out.append("")
+    out.append("uint32_t %s_decode(void *data, char *params, int params_len)" % prefix)
+    out.append("{")
+    out.append("    %sDecodeState state = {(%s *)data, 0};" % (_camel(prefix), data_type))
+    out.append("")
+    out.append("    json_parse_name_value(params, params_len, _%s_decode_kv, &state);" % prefix)
+    out.append("")
+    out.append("    return state.mask;")
+    out.append("}")
+    out.append("")
+    out.append("int %s_encode(const void *data, uint32_t mask, char *buf, size_t size)" % prefix)
+    out.append("{")
+    out.append("    size_t len = 0;")
+    out.append("    int    index, rc;")
+    out.append("")
+    out.append("    mask &= %s_MASK_ALL;" % P)
+    out.append("    while (mask) {")
+    out.append("        index = __builtin_ctz(mask);")
+    out.append("        mask &= mask - 1;")
+    out.append("")
+    out.append("        rc = sg_%s_encoders[index]((const %s *)data, buf + len, size - len);" % (prefix, data_type))
+    out.append("        if (rc < 0 || (size_t)rc >= size - len) {")
+    out.append("            return QCLOUD_ERR_JSON_BUFFER_TOO_SMALL;")
+    out.append("        }")
+    out.append("        len += rc;")
+    out.append("    }")
+    out.append("")
+    out.append("    return (int)len;")
+    out.append("}")
+    out.append("")
+    out.append("const TemplateCodec %s_codec = {%s_decode, %s_encode};" % (prefix, prefix, prefix))
+    return "\n".join(out) + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate typed C bindings from the data template JSON")
+    parser.add_argument("-c", "--config", required=True, help="data template JSON downloaded from the console")
+    parser.add_argument("-d", "--dest", default=".", help="output directory")
+    parser.add_argument("-p", "--prefix", default="product", help="prefix of the generated names")
+    args = parser.parse_args()
+
+    if not re.match(r"^[a-z_][a-z0-9_]*$", args.prefix):
+        print("prefix must be a lower case C identifier")
+        return 1
+
+    with open(args.config, "r", encoding="utf-8") as f:
+        template = json.load(f)
+
+    try:
+        props = [Property(i, node) for i, node in enumerate(template.get("properties", []))]
+        if not props:
+            raise ValueError("no property is defined")
+        if len(props) > MAX_PROPERTIES:
+            raise ValueError("at most %d properties are supported" % MAX_PROPERTIES)
+        seed, slots = find_perfect_hash([p.id for p in props])
+    except ValueError as err:
+        print("error: %s" % err)
+        return 1
+
+    source = os.path.basename(args.config)
+    header_name = "%s_data_template.h" % args.prefix
+    guard = "%s_DATA_TEMPLATE_H_" % args.prefix.upper()
+
+    if not os.path.isdir(args.dest):
+        os.makedirs(args.dest)
+    with open(os.path.join(args.dest, header_name), "w") as f:
+        f.write(gen_header(props, args.prefix, guard, source))
+    with open(os.path.join(args.dest, "%s_data_template.c" % args.prefix), "w") as f:
+        f.write(gen_source(props, args.prefix, header_name, source, seed, slots))
+
+    print("%d properties, hash seed %d in %d slots, written to %s" % (len(props), seed, slots, args.dest))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
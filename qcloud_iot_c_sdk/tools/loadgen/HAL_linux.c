@@ -0,0 +1,624 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub
+ available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file
+ except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software
+ distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ KIND,
+ * either express or implied. See the License for the specific language
+ governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* Linux HAL of qcloud-loadgen: pthread, BSD socket and OpenSSL TLS-PSK */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+#include "qcloud_iot_export.h"
+#include "qcloud_iot_import.h"
+#include "utils_trace.h"
+
+/* broker every connection goes to, NULL for the host the SDK asks for */
+const char *g_loadgen_broker_host = NULL;
+uint16_t    g_loadgen_broker_port = 0;
+
+void HAL_SleepMs(uint32_t ms)
+{
+    usleep(ms * 1000);
+}
+
+void HAL_DelayMs(uint32_t ms)
+{
+    usleep(ms * 1000);
+}
+
+void HAL_Printf(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+
+    fflush(stdout);
+}
+
+int HAL_Snprintf(char *str, const int len, const char *fmt, ...)
+{
+    va_list args;
+    int     rc;
+
+    va_start(args, fmt);
+    rc = vsnprintf(str, len, fmt, args);
+    va_end(args);
+
+    return rc;
+}
+
+int HAL_Vsnprintf(char *str, const int len, const char *format, va_list ap)
+{
+    return vsnprintf(str, len, format, ap);
+}
+
+void *HAL_Malloc(uint32_t size)
+{
+    return malloc(size);
+}
+
+void HAL_Free(void *ptr)
+{
+    free(ptr);
+}
+
+void *HAL_MutexCreate(void)
+{
+    pthread_mutex_t *mutex = malloc(sizeof(pthread_mutex_t));
+
+    if (NULL != mutex && 0 != pthread_mutex_init(mutex, NULL)) {
+        free(mutex);
+        return NULL;
+    }
+
+    return mutex;
+}
+
+void HAL_MutexDestroy(void *mutex)
+{
+    pthread_mutex_destroy((pthread_mutex_t *)mutex);
+    free(mutex);
+}
+
+void HAL_MutexLock(void *mutex)
+{
+    pthread_mutex_lock((pthread_mutex_t *)mutex);
+}
+
+int HAL_MutexTryLock(void *mutex)
+{
+    return pthread_mutex_trylock((pthread_mutex_t *)mutex);
+}
+
+void HAL_MutexUnlock(void *mutex)
+{
+    pthread_mutex_unlock((pthread_mutex_t *)mutex);
+}
+
+void *HAL_SemaphoreCreate(void)
+{
+    sem_t *sem = malloc(sizeof(sem_t));
+
+    if (NULL != sem && 0 != sem_init(sem, 0, 0)) {
+        free(sem);
+        return NULL;
+    }
+
+    return sem;
+}
+
+void HAL_SemaphoreDestroy(void *sem)
+{
+    sem_destroy((sem_t *)sem);
+    free(sem);
+}
+
+void HAL_SemaphorePost(void *sem)
+{
+    sem_post((sem_t *)sem);
+}
+
+int HAL_SemaphoreWait(void *sem, uint32_t timeout_ms)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout_ms / 1000;
+    ts.tv_nsec += (timeout_ms % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+
+    while (0 != sem_timedwait((sem_t *)sem, &ts)) {
+        if (EINTR != errno) {
+            return QCLOUD_ERR_FAILURE;
+        }
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+static void *_HAL_thread_func_wrapper_(void *ptr)
+{
+    ThreadParams *params = (ThreadParams *)ptr;
+
+    params->thread_func(params->user_arg);
+
+    return NULL;
+}
+
+int HAL_ThreadCreate(ThreadParams *params)
+{
+    pthread_attr_t attr;
+    pthread_t      thread;
+    int            ret;
+
+    if (params == NULL)
+        return QCLOUD_ERR_INVAL;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (params->stack) {
+        pthread_attr_setstack(&attr, params->stack, params->stack_size);
+    }
+    if (params->core_mask) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (int i = 0; i < 8; i++) {
+            if (params->core_mask & (1 << i)) {
+                CPU_SET(i, &cpus);
+            }
+        }
+        pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+    }
+
+    ret = pthread_create(&thread, &attr, _HAL_thread_func_wrapper_, params);
+    pthread_attr_destroy(&attr);
+    if (0 != ret) {
+        HAL_Printf("%s: pthread_create failed: %d\n", __FUNCTION__, ret);
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    params->thread_id = (size_t)thread;
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+int HAL_ThreadDestroy(void *thread_t)
+{
+    return QCLOUD_RET_SUCCESS;
+}
+
+uint32_t HAL_GetTimeMs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+#ifdef IOT_TRACE_ENABLED
+uint64_t HAL_GetTimeUs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+#endif
+
+#if defined(IOT_TRACE_ENABLED) || defined(MQTT_ASYNC_DISPATCH)
+size_t HAL_ThreadGetId(void)
+{
+    return (size_t)syscall(SYS_gettid);
+}
+#endif
+
+long HAL_Timer_current_sec(void)
+{
+    return time(NULL);
+}
+
+char *HAL_Timer_current(char *time_str)
+{
+    time_t    now = time(NULL);
+    struct tm tm_tmp;
+
+    localtime_r(&now, &tm_tmp);
+    strftime(time_str, TIME_FORMAT_STR_LEN, "%F %T", &tm_tmp);
+
+    return time_str;
+}
+
+bool HAL_Timer_expired(Timer *timer)
+{
+    struct timeval now, res;
+
+    gettimeofday(&now, NULL);
+    timersub(&timer->end_time, &now, &res);
+
+    return res.tv_sec < 0 || (res.tv_sec == 0 && res.tv_usec <= 0);
+}
+
+void HAL_Timer_countdown_ms(Timer *timer, unsigned int timeout_ms)
+{
+    struct timeval now, interval = {timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+
+    gettimeofday(&now, NULL);
+    timeradd(&now, &interval, &timer->end_time);
+}
+
+void HAL_Timer_countdown(Timer *timer, unsigned int timeout)
+{
+    struct timeval now, interval = {timeout, 0};
+
+    gettimeofday(&now, NULL);
+    timeradd(&now, &interval, &timer->end_time);
+}
+
+int HAL_Timer_remain(Timer *timer)
+{
+    struct timeval now, res;
+
+    gettimeofday(&now, NULL);
+    timersub(&timer->end_time, &now, &res);
+
+    return (res.tv_sec < 0) ? 0 : res.tv_sec * 1000 + res.tv_usec / 1000;
+}
+
+void HAL_Timer_init(Timer *timer)
+{
+    timer->end_time = (struct timeval){0, 0};
+}
+
+static int _time_left(uint32_t t_end)
+{
+    int left = (int)(t_end - HAL_GetTimeMs());
+
+    return left > 0 ? left : 0;
+}
+
+/* wait until the socket is readable (POLLIN) or writable (POLLOUT), 0 on timeout */
+static int _wait_fd(int fd, short events, uint32_t t_end)
+{
+    struct pollfd pfd = {fd, events, 0};
+    int           ret;
+
+    do {
+        ret = poll(&pfd, 1, _time_left(t_end));
+    } while (ret < 0 && EINTR == errno);
+
+    return ret;
+}
+
+static int _connect_socket(const char *host, uint16_t port)
+{
+    struct addrinfo  hints, *addrs, *cur;
+    char             port_str[8];
+    int              fd = -1, ret;
+
+    if (g_loadgen_broker_host) {
+        host = g_loadgen_broker_host;
+        port = g_loadgen_broker_port;
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    snprintf(port_str, sizeof(port_str), "%u", port);
+
+    IOT_TRACE_BEGIN(t_dns);
+    ret = getaddrinfo(host, port_str, &hints, &addrs);
+    IOT_TRACE_END(t_dns, "net", "dns", ret ? QCLOUD_ERR_TCP_UNKNOWN_HOST : QCLOUD_RET_SUCCESS);
+    if (0 != ret) {
+        Log_e("getaddrinfo %s failed", host);
+        return -1;
+    }
+
+    IOT_TRACE_BEGIN(t_connect);
+    for (cur = addrs; cur != NULL; cur = cur->ai_next) {
+        fd = socket(cur->ai_family, cur->ai_socktype, cur->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (0 == connect(fd, cur->ai_addr, cur->ai_addrlen)) {
+            // MQTT packets are small, do not hold them back for the ACK of the last one
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addrs);
+    IOT_TRACE_END(t_connect, "net", "tcp_connect", fd < 0 ? QCLOUD_ERR_TCP_CONNECT : QCLOUD_RET_SUCCESS);
+
+    if (fd < 0) {
+        Log_e("connect %s:%u failed", host, port);
+    }
+
+    return fd;
+}
+
+int HAL_TCP_Connect_Socket(const char *host, uint16_t port)
+{
+    return _connect_socket(host, port);
+}
+
+uintptr_t HAL_TCP_Connect(const char *host, uint16_t port)
+{
+    int fd = _connect_socket(host, port);
+
+    if (fd < 0) {
+        return 0;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    // 0 means failure to the SDK
+    return (uintptr_t)fd + 1;
+}
+
+int HAL_TCP_Disconnect(uintptr_t fd)
+{
+    return close((int)fd - 1);
+}
+
+int HAL_TCP_Write(uintptr_t fd, const unsigned char *buf, uint32_t len, uint32_t timeout_ms, size_t *written_len)
+{
+    uint32_t t_end = HAL_GetTimeMs() + timeout_ms;
+    ssize_t  ret;
+
+    *written_len = 0;
+    while (*written_len < len) {
+        ret = send((int)fd - 1, buf + *written_len, len - *written_len, MSG_NOSIGNAL);
+        if (ret > 0) {
+            *written_len += ret;
+        } else if (ret < 0 && (EAGAIN == errno || EINTR == errno)) {
+            if (0 == _wait_fd((int)fd - 1, POLLOUT, t_end)) {
+                return QCLOUD_ERR_TCP_WRITE_TIMEOUT;
+            }
+        } else {
+            return QCLOUD_ERR_TCP_WRITE_FAIL;
+        }
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+int HAL_TCP_Read(uintptr_t fd, unsigned char *buf, uint32_t len, uint32_t timeout_ms, size_t *read_len)
+{
+    uint32_t t_end = HAL_GetTimeMs() + timeout_ms;
+    ssize_t  ret;
+
+    *read_len = 0;
+    while (*read_len < len) {
+        ret = recv((int)fd - 1, buf + *read_len, len - *read_len, 0);
+        if (ret > 0) {
+            *read_len += ret;
+        } else if (0 == ret) {
+            return QCLOUD_ERR_TCP_PEER_SHUTDOWN;
+        } else if (EAGAIN == errno || EINTR == errno) {
+            if (0 == _wait_fd((int)fd - 1, POLLIN, t_end)) {
+                return *read_len ? QCLOUD_ERR_TCP_READ_TIMEOUT : QCLOUD_ERR_TCP_NOTHING_TO_READ;
+            }
+        } else {
+            return QCLOUD_ERR_TCP_READ_FAIL;
+        }
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+#ifndef AUTH_WITH_NOTLS
+
+typedef struct {
+    int      fd;
+    SSL *    ssl;
+    char     psk_id[MAX_SIZE_OF_CLIENT_ID + 1];
+    uint8_t  psk[64];
+    unsigned psk_len;
+} TLSHandle;
+
+static SSL_CTX *sg_ssl_ctx;
+static int      sg_ssl_index = -1;
+
+static unsigned int _psk_client_cb(SSL *ssl, const char *hint, char *identity, unsigned int max_identity_len,
+                                   unsigned char *psk, unsigned int max_psk_len)
+{
+    TLSHandle *handle = SSL_get_ex_data(ssl, sg_ssl_index);
+
+    if (strlen(handle->psk_id) >= max_identity_len || handle->psk_len > max_psk_len) {
+        return 0;
+    }
+    strcpy(identity, handle->psk_id);
+    memcpy(psk, handle->psk, handle->psk_len);
+
+    return handle->psk_len;
+}
+
+static void _ssl_init_once(void)
+{
+    sg_ssl_ctx = SSL_CTX_new(TLS_client_method());
+    if (NULL == sg_ssl_ctx) {
+        return;
+    }
+    // IoT Hub serves TLS 1.2 PSK cipher suites
+    SSL_CTX_set_max_proto_version(sg_ssl_ctx, TLS1_2_VERSION);
+    SSL_CTX_set_cipher_list(sg_ssl_ctx, "PSK:@SECLEVEL=0");
+    SSL_CTX_set_psk_client_callback(sg_ssl_ctx, _psk_client_cb);
+    SSL_CTX_set_mode(sg_ssl_ctx, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    sg_ssl_index = SSL_get_ex_new_index(0, NULL, NULL, NULL, NULL);
+}
+
+void HAL_TLS_Disconnect(uintptr_t handle)
+{
+    TLSHandle *tls = (TLSHandle *)handle;
+
+    if (NULL == tls) {
+        return;
+    }
+    if (tls->ssl) {
+        SSL_shutdown(tls->ssl);
+        SSL_free(tls->ssl);
+    }
+    if (tls->fd >= 0) {
+        close(tls->fd);
+    }
+    free(tls);
+}
+
+uintptr_t HAL_TLS_Connect(TLSConnectParams *pConnectParams, const char *host, int port)
+{
+    static pthread_once_t once  = PTHREAD_ONCE_INIT;
+    uint32_t              t_end = HAL_GetTimeMs() + pConnectParams->timeout_ms;
+    TLSHandle *           tls;
+    int                   ret;
+
+    pthread_once(&once, _ssl_init_once);
+    if (NULL == sg_ssl_ctx || NULL == (tls = calloc(1, sizeof(TLSHandle)))) {
+        return 0;
+    }
+
+    if (pConnectParams->psk_length > sizeof(tls->psk)) {
+        free(tls);
+        return 0;
+    }
+    snprintf(tls->psk_id, sizeof(tls->psk_id), "%s", pConnectParams->psk_id);
+    memcpy(tls->psk, pConnectParams->psk, pConnectParams->psk_length);
+    tls->psk_len = pConnectParams->psk_length;
+
+    tls->fd = _connect_socket(host, port);
+    if (tls->fd < 0) {
+        free(tls);
+        return 0;
+    }
+    fcntl(tls->fd, F_SETFL, fcntl(tls->fd, F_GETFL) | O_NONBLOCK);
+
+    tls->ssl = SSL_new(sg_ssl_ctx);
+    SSL_set_ex_data(tls->ssl, sg_ssl_index, tls);
+    SSL_set_fd(tls->ssl, tls->fd);
+    SSL_set_tlsext_host_name(tls->ssl, host);
+
+    IOT_TRACE_BEGIN(t_handshake);
+    while ((ret = SSL_connect(tls->ssl)) != 1) {
+        int err = SSL_get_error(tls->ssl, ret);
+        if ((SSL_ERROR_WANT_READ != err && SSL_ERROR_WANT_WRITE != err) ||
+            0 >= _wait_fd(tls->fd, SSL_ERROR_WANT_READ == err ? POLLIN : POLLOUT, t_end)) {
+            Log_e("TLS handshake with %s failed: %s", host, ERR_reason_error_string(ERR_get_error()));
+            IOT_TRACE_END(t_handshake, "tls", "handshake", QCLOUD_ERR_SSL_CONNECT);
+            HAL_TLS_Disconnect((uintptr_t)tls);
+            return 0;
+        }
+    }
+    IOT_TRACE_END(t_handshake, "tls", "handshake", QCLOUD_RET_SUCCESS);
+
+    return (uintptr_t)tls;
+}
+
+int HAL_TLS_Write(uintptr_t handle, unsigned char *msg, size_t totalLen, uint32_t timeout_ms, size_t *written_len)
+{
+    TLSHandle *tls   = (TLSHandle *)handle;
+    uint32_t   t_end = HAL_GetTimeMs() + timeout_ms;
+    int        ret, err;
+
+    *written_len = 0;
+    while (*written_len < totalLen) {
+        ret = SSL_write(tls->ssl, msg + *written_len, totalLen - *written_len);
+        if (ret > 0) {
+            *written_len += ret;
+            continue;
+        }
+        err = SSL_get_error(tls->ssl, ret);
+        if (SSL_ERROR_WANT_READ != err && SSL_ERROR_WANT_WRITE != err) {
+            return QCLOUD_ERR_SSL_WRITE;
+        }
+        if (0 >= _wait_fd(tls->fd, SSL_ERROR_WANT_READ == err ? POLLIN : POLLOUT, t_end)) {
+            return QCLOUD_ERR_SSL_WRITE_TIMEOUT;
+        }
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+int HAL_TLS_Read(uintptr_t handle, unsigned char *msg, size_t totalLen, uint32_t timeout_ms, size_t *read_len)
+{
+    TLSHandle *tls   = (TLSHandle *)handle;
+    uint32_t   t_end = HAL_GetTimeMs() + timeout_ms;
+    int        ret, err;
+
+    *read_len = 0;
+    while (*read_len < totalLen) {
+        ret = SSL_read(tls->ssl, msg + *read_len, totalLen - *read_len);
+        if (ret > 0) {
+            *read_len += ret;
+            continue;
+        }
+        err = SSL_get_error(tls->ssl, ret);
+        if (SSL_ERROR_WANT_READ != err && SSL_ERROR_WANT_WRITE != err) {
+            return QCLOUD_ERR_SSL_READ;
+        }
+        if (0 >= _wait_fd(tls->fd, SSL_ERROR_WANT_READ == err ? POLLIN : POLLOUT, t_end)) {
+            return *read_len ? QCLOUD_ERR_SSL_READ_TIMEOUT : QCLOUD_ERR_SSL_NOTHING_TO_READ;
+        }
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+#endif
+
+int HAL_GetDevInfo(void *pdevInfo)
+{
+    return QCLOUD_ERR_FAILURE;
+}
+
+int HAL_SetDevInfo(void *pdevInfo)
+{
+    return QCLOUD_ERR_FAILURE;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,795 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub
+ available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file
+ except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software
+ distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ KIND,
+ * either express or implied. See the License for the specific language
+ governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * qcloud-loadgen: run N simulated devices on the SDK, each with a mix of property
+ * reports, events, action replies and gateway sub-device churn at target rates,
+ * and report the achieved throughput, latency percentiles, CPU and RSS per device.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "qcloud_iot_export.h"
+#include "qcloud_iot_import.h"
+#include "utils_getopt.h"
+
+#define LOADGEN_MAX_DEVICES  (4096)
+#define LOADGEN_PENDING_MAX  (64)  // QoS1 publishes waiting for PUBACK per device
+#define LOADGEN_HIST_SUB     (16)  // sub-buckets of each power of two of the latency histogram
+#define LOADGEN_HIST_BUCKETS (LOADGEN_HIST_SUB * 28)
+#define LOADGEN_YIELD_MAX_MS (50)
+#define LOADGEN_PAYLOAD_LEN  (512)
+#define LOADGEN_TOPIC_LEN    (128)
+#define LOADGEN_TOKEN_LEN    (64)
+
+/* defined in HAL_linux.c */
+extern const char *g_loadgen_broker_host;
+extern uint16_t    g_loadgen_broker_port;
+
+typedef enum { LOAD_REPORT = 0, LOAD_EVENT, LOAD_ACTION, LOAD_CHURN, LOAD_MAX } LoadOpType;
+
+static const char *sg_op_names[LOAD_MAX] = {"report", "event", "action", "churn"};
+
+/* log-linear latency histogram in microseconds, 1/16 relative precision */
+typedef struct {
+    uint32_t count;
+    uint32_t buckets[LOADGEN_HIST_BUCKETS];
+} LatencyHist;
+
+typedef struct {
+    uint32_t    sent;
+    uint32_t    done;
+    uint32_t    failed;
+    LatencyHist hist;
+} OpStats;
+
+typedef struct {
+    uint16_t packet_id;
+    uint8_t  op;
+    uint64_t sent_us;
+} PendingPub;
+
+typedef struct {
+    char product_id[MAX_SIZE_OF_PRODUCT_ID + 1];
+    char device_name[MAX_SIZE_OF_DEVICE_NAME + 1];
+    char device_secret[MAX_SIZE_OF_DEVICE_SECRET + 1];
+    char subdev_product_id[MAX_SIZE_OF_PRODUCT_ID + 1];
+    char subdev_device_name[MAX_SIZE_OF_DEVICE_NAME + 1];
+
+    pthread_t thread;
+    void *    client;   // MQTT client, or gateway if churn is enabled
+    void *    mqtt;     // MQTT client of the gateway
+    bool      connected;
+    bool      subdev_online;
+    uint32_t  seq;
+
+    PendingPub pending[LOADGEN_PENDING_MAX];
+    OpStats    stats[LOAD_MAX];
+    uint32_t   disconnects;
+    double     active_s;
+    double     cpu_s;
+} LoadDevice;
+
+typedef struct {
+    const char *csv_file;
+    const char *product_id;
+    const char *device_secret;
+    const char *name_prefix;
+    const char *region;
+    int         device_num;
+    double      rate[LOAD_MAX];  // per device per second, action is driven by the cloud
+    bool        action_reply;
+    int         duration_s;
+    int         ramp_ms;
+    int         log_level;
+    const char *trace_file;
+} LoadConfig;
+
+static LoadConfig   sg_config = {NULL, NULL, NULL, "loadgen", "china", 0, {1, 0, 0, 0}, false, 30, 10, eLOG_WARN, NULL};
+static LoadDevice * sg_devices;
+static volatile int sg_stop;
+
+static uint64_t _now_us(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int _hist_index(uint64_t v)
+{
+    int e;
+
+    if (v < LOADGEN_HIST_SUB) {
+        return (int)v;
+    }
+    e = 63 - __builtin_clzll(v);  // >= 4
+    v = (e - 3) * LOADGEN_HIST_SUB + ((v >> (e - 4)) & (LOADGEN_HIST_SUB - 1));
+
+    return v < LOADGEN_HIST_BUCKETS ? (int)v : LOADGEN_HIST_BUCKETS - 1;
+}
+
+static uint64_t _hist_value(int index)
+{
+    int e = index / LOADGEN_HIST_SUB + 3;
+
+    if (index < LOADGEN_HIST_SUB) {
+        return index;
+    }
+    // middle of the bucket
+    return ((uint64_t)(LOADGEN_HIST_SUB + index % LOADGEN_HIST_SUB) << (e - 4)) + ((1ULL << (e - 4)) >> 1);
+}
+
+static void _hist_add(LatencyHist *hist, uint64_t us)
+{
+    hist->buckets[_hist_index(us)]++;
+    hist->count++;
+}
+
+static void _hist_merge(LatencyHist *to, const LatencyHist *from)
+{
+    for (int i = 0; i < LOADGEN_HIST_BUCKETS; i++) {
+        to->buckets[i] += from->buckets[i];
+    }
+    to->count += from->count;
+}
+
+/* percentile in milliseconds */
+static double _hist_percentile(const LatencyHist *hist, double p)
+{
+    uint64_t rank = (uint64_t)(hist->count * p / 100 + 0.5), seen = 0;
+
+    if (0 == hist->count) {
+        return 0;
+    }
+    if (rank < 1) {
+        rank = 1;
+    }
+    for (int i = 0; i < LOADGEN_HIST_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            return _hist_value(i) / 1000.0;
+        }
+    }
+
+    return _hist_value(LOADGEN_HIST_BUCKETS - 1) / 1000.0;
+}
+
+static void _track_publish(LoadDevice *dev, LoadOpType op, int rc)
+{
+    dev->stats[op].sent++;
+    if (rc < 0) {
+        dev->stats[op].failed++;
+        return;
+    }
+
+    for (int i = 0; i < LOADGEN_PENDING_MAX; i++) {
+        if (0 == dev->pending[i].packet_id) {
+            dev->pending[i].packet_id = (uint16_t)rc;
+            dev->pending[i].op        = op;
+            dev->pending[i].sent_us   = _now_us(CLOCK_MONOTONIC);
+            return;
+        }
+    }
+    // more in flight than tracked, it is counted but not timed
+}
+
+static void _ack_publish(LoadDevice *dev, uint16_t packet_id, bool success)
+{
+    for (int i = 0; i < LOADGEN_PENDING_MAX; i++) {
+        PendingPub *pub = &dev->pending[i];
+        if (pub->packet_id != packet_id) {
+            continue;
+        }
+        if (success) {
+            dev->stats[pub->op].done++;
+            _hist_add(&dev->stats[pub->op].hist, _now_us(CLOCK_MONOTONIC) - pub->sent_us);
+        } else {
+            dev->stats[pub->op].failed++;
+        }
+        pub->packet_id = 0;
+        return;
+    }
+}
+
+static void _event_handler(void *pclient, void *handle_context, MQTTEventMsg *msg)
+{
+    LoadDevice *dev       = (LoadDevice *)handle_context;
+    uintptr_t   packet_id = (uintptr_t)msg->msg;
+
+    switch (msg->event_type) {
+        case MQTT_EVENT_DISCONNECT:
+            dev->connected = false;
+            dev->disconnects++;
+            break;
+
+        case MQTT_EVENT_RECONNECT:
+            dev->connected = true;
+            break;
+
+        case MQTT_EVENT_PUBLISH_SUCCESS:
+            _ack_publish(dev, (uint16_t)packet_id, true);
+            break;
+
+        case MQTT_EVENT_PUBLISH_TIMEOUT:
+        case MQTT_EVENT_PUBLISH_NACK:
+            _ack_publish(dev, (uint16_t)packet_id, false);
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void _gateway_event_handler(void *client, void *context, void *msg)
+{
+    _event_handler(client, context, (MQTTEventMsg *)msg);
+}
+
+/* value of a string field in a flat JSON object, not unescaped */
+static int _json_string_of(const char *json, const char *key, char *buf, int size)
+{
+    char        pattern[32];
+    const char *start, *end;
+
+    HAL_Snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+    start = strstr(json, pattern);
+    if (NULL == start) {
+        return QCLOUD_ERR_FAILURE;
+    }
+    start += strlen(pattern);
+    start += strspn(start, " \t\r\n");
+    if (':' != *start++) {
+        return QCLOUD_ERR_FAILURE;
+    }
+    start += strspn(start, " \t\r\n");
+    if ('"' != *start++) {
+        return QCLOUD_ERR_FAILURE;
+    }
+    end = strchr(start, '"');
+    if (NULL == end || end - start >= size) {
+        return QCLOUD_ERR_FAILURE;
+    }
+    memcpy(buf, start, end - start);
+    buf[end - start] = '\0';
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+static void _on_action_message(void *pClient, MQTTMessage *message, void *pUserData)
+{
+    LoadDevice *  dev                                  = (LoadDevice *)pUserData;
+    uint64_t      start                                = _now_us(CLOCK_MONOTONIC);
+    char          topic[LOADGEN_TOPIC_LEN]   = {0};
+    char          payload[LOADGEN_PAYLOAD_LEN]         = {0};
+    char          client_token[LOADGEN_TOKEN_LEN];
+    PublishParams pub_params                           = DEFAULT_PUB_PARAMS;
+    int           rc;
+
+    // payload is terminated by '\0'
+    if (QCLOUD_RET_SUCCESS !=
+        _json_string_of((char *)message->payload, "clientToken", client_token, sizeof(client_token))) {
+        return;
+    }
+
+    HAL_Snprintf(topic, sizeof(topic), "$thing/up/action/%s/%s", dev->product_id, dev->device_name);
+    pub_params.qos         = QOS0;
+    pub_params.priority    = MQTT_PRIO_CONTROL;
+    pub_params.payload     = payload;
+    pub_params.payload_len = HAL_Snprintf(payload, sizeof(payload),
+                                          "{\"method\":\"action_reply\",\"clientToken\":\"%s\",\"code\":0,"
+                                          "\"status\":\"ok\",\"response\":{}}",
+                                          client_token);
+
+    rc = IOT_MQTT_Publish(pClient, topic, &pub_params);
+    dev->stats[LOAD_ACTION].sent++;
+    if (rc < 0) {
+        dev->stats[LOAD_ACTION].failed++;
+    } else {
+        // a reply is QoS0, it is timed from the request to the reply being queued
+        dev->stats[LOAD_ACTION].done++;
+        _hist_add(&dev->stats[LOAD_ACTION].hist, _now_us(CLOCK_MONOTONIC) - start);
+    }
+}
+
+static int _publish_property(LoadDevice *dev)
+{
+    char          topic[LOADGEN_TOPIC_LEN] = {0};
+    char          payload[LOADGEN_PAYLOAD_LEN]       = {0};
+    PublishParams pub_params                         = DEFAULT_PUB_PARAMS;
+
+    HAL_Snprintf(topic, sizeof(topic), "$thing/up/property/%s/%s", dev->product_id, dev->device_name);
+    pub_params.qos         = QOS1;
+    pub_params.payload     = payload;
+    pub_params.payload_len = HAL_Snprintf(payload, sizeof(payload),
+                                          "{\"method\":\"report\",\"clientToken\":\"%s-%u\",\"params\":"
+                                          "{\"power_switch\":%u,\"brightness\":%u}}",
+                                          dev->product_id, dev->seq, dev->seq & 1, dev->seq % 101);
+    dev->seq++;
+
+    return IOT_MQTT_Publish(dev->mqtt, topic, &pub_params);
+}
+
+static int _publish_event(LoadDevice *dev)
+{
+    char          topic[LOADGEN_TOPIC_LEN] = {0};
+    char          payload[LOADGEN_PAYLOAD_LEN]       = {0};
+    PublishParams pub_params                         = DEFAULT_PUB_PARAMS;
+
+    HAL_Snprintf(topic, sizeof(topic), "$thing/up/event/%s/%s", dev->product_id, dev->device_name);
+    pub_params.qos         = QOS1;
+    pub_params.priority    = MQTT_PRIO_EVENT;
+    pub_params.payload     = payload;
+    pub_params.payload_len = HAL_Snprintf(payload, sizeof(payload),
+                                          "{\"method\":\"event_post\",\"clientToken\":\"%s-%u\",\"version\":\"1.0\","
+                                          "\"eventId\":\"status_report\",\"type\":\"info\",\"timestamp\":%ld,"
+                                          "\"params\":{\"status\":0,\"message\":\"loadgen\"}}",
+                                          dev->product_id, dev->seq, (long)time(NULL));
+    dev->seq++;
+
+    return IOT_MQTT_Publish(dev->mqtt, topic, &pub_params);
+}
+
+/* toggle the sub-device online/offline, timed to the reply of the gateway service */
+static void _churn_subdev(LoadDevice *dev)
+{
+    GatewayParam param = DEFAULT_GATEWAY_PARAMS;
+    uint64_t     start = _now_us(CLOCK_MONOTONIC);
+    int          rc;
+
+    param.product_id         = dev->product_id;
+    param.device_name        = dev->device_name;
+    param.subdev_product_id  = dev->subdev_product_id;
+    param.subdev_device_name = dev->subdev_device_name;
+
+    rc = dev->subdev_online ? IOT_Gateway_Subdev_Offline(dev->client, &param)
+                            : IOT_Gateway_Subdev_Online(dev->client, &param);
+
+    dev->stats[LOAD_CHURN].sent++;
+    if (QCLOUD_RET_SUCCESS == rc) {
+        dev->subdev_online = !dev->subdev_online;
+        dev->stats[LOAD_CHURN].done++;
+        _hist_add(&dev->stats[LOAD_CHURN].hist, _now_us(CLOCK_MONOTONIC) - start);
+    } else {
+        dev->stats[LOAD_CHURN].failed++;
+    }
+}
+
+static int _device_connect(LoadDevice *dev)
+{
+    MQTTInitParams init_params = DEFAULT_MQTTINIT_PARAMS;
+
+    init_params.region              = (char *)sg_config.region;
+    init_params.product_id          = dev->product_id;
+    init_params.device_name         = dev->device_name;
+    init_params.device_secret       = dev->device_secret;
+    init_params.event_handle.h_fp   = _event_handler;
+    init_params.event_handle.context = dev;
+
+    if (sg_config.rate[LOAD_CHURN] > 0) {
+        GatewayInitParam gw_params = DEFAULT_GATEWAY_INIT_PARAMS;
+
+        gw_params.init_param    = init_params;
+        gw_params.event_context = dev;
+        gw_params.event_handler = _gateway_event_handler;
+
+        dev->client = IOT_Gateway_Construct(&gw_params);
+        dev->mqtt   = dev->client ? IOT_Gateway_Get_Mqtt_Client(dev->client) : NULL;
+    } else {
+        dev->client = IOT_MQTT_Construct(&init_params);
+        dev->mqtt   = dev->client;
+    }
+
+    if (NULL == dev->client) {
+        Log_e("%s/%s connect failed", dev->product_id, dev->device_name);
+        return QCLOUD_ERR_FAILURE;
+    }
+    dev->connected = true;
+
+    if (sg_config.action_reply) {
+        char            topic[LOADGEN_TOPIC_LEN] = {0};
+        SubscribeParams sub_params                         = DEFAULT_SUB_PARAMS;
+
+        HAL_Snprintf(topic, sizeof(topic), "$thing/down/action/%s/%s", dev->product_id, dev->device_name);
+        sub_params.qos                = QOS1;
+        sub_params.on_message_handler = _on_action_message;
+        sub_params.user_data          = dev;
+        if (IOT_MQTT_Subscribe(dev->mqtt, topic, &sub_params) < 0) {
+            Log_e("%s/%s subscribe action failed", dev->product_id, dev->device_name);
+        }
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+static void *_device_thread(void *arg)
+{
+    LoadDevice *dev = (LoadDevice *)arg;
+    uint64_t    due[LOAD_MAX], period[LOAD_MAX], now, start, next;
+    int         op, wait_ms;
+
+    if (QCLOUD_RET_SUCCESS != _device_connect(dev)) {
+        return NULL;
+    }
+
+    start = now = _now_us(CLOCK_MONOTONIC);
+    for (op = 0; op < LOAD_MAX; op++) {
+        period[op] = sg_config.rate[op] > 0 ? (uint64_t)(1000000 / sg_config.rate[op]) : 0;
+        // spread the first operation of the devices over one period
+        due[op] = period[op] ? now + (uint64_t)rand() % period[op] : UINT64_MAX;
+    }
+
+    while (!sg_stop) {
+        now  = _now_us(CLOCK_MONOTONIC);
+        next = UINT64_MAX;
+        for (op = 0; op < LOAD_MAX; op++) {
+            if (due[op] > now) {
+                next = due[op] < next ? due[op] : next;
+                continue;
+            }
+            // keep the target rate, a late device catches up by at most one period
+            due[op] = (now - due[op] > period[op]) ? now + period[op] : due[op] + period[op];
+            next    = due[op] < next ? due[op] : next;
+            if (!dev->connected) {
+                dev->stats[op].sent++;
+                dev->stats[op].failed++;
+            } else if (LOAD_REPORT == op) {
+                _track_publish(dev, LOAD_REPORT, _publish_property(dev));
+            } else if (LOAD_EVENT == op) {
+                _track_publish(dev, LOAD_EVENT, _publish_event(dev));
+            } else if (LOAD_CHURN == op) {
+                _churn_subdev(dev);
+            }
+        }
+
+        now     = _now_us(CLOCK_MONOTONIC);
+        wait_ms = next > now ? (int)((next - now + 999) / 1000) : 0;
+        wait_ms = wait_ms > LOADGEN_YIELD_MAX_MS ? LOADGEN_YIELD_MAX_MS : wait_ms;
+        if (dev->mqtt == dev->client) {
+            IOT_MQTT_Yield(dev->client, wait_ms ? wait_ms : 1);
+        } else {
+            IOT_Gateway_Yield(dev->client, wait_ms ? wait_ms : 1);
+        }
+    }
+
+    dev->active_s = (_now_us(CLOCK_MONOTONIC) - start) / 1e6;
+    dev->cpu_s    = _now_us(CLOCK_THREAD_CPUTIME_ID) / 1e6;
+
+    if (dev->mqtt == dev->client) {
+        IOT_MQTT_Destroy(&dev->client);
+    } else {
+        IOT_Gateway_Destroy(dev->client);
+    }
+
+    return NULL;
+}
+
+static long _rss_kb(void)
+{
+    long  pages = 0, rss = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+
+    if (fp) {
+        if (2 != fscanf(fp, "%ld %ld", &pages, &rss)) {
+            rss = 0;
+        }
+        fclose(fp);
+    }
+
+    return rss * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/* product_id,device_name,device_secret[,subdev_product_id,subdev_device_name] per line */
+static int _load_csv(const char *file)
+{
+    char  line[512];
+    int   num = 0;
+    FILE *fp  = fopen(file, "r");
+
+    if (NULL == fp) {
+        Log_e("open %s failed", file);
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    while (fgets(line, sizeof(line), fp) && num < sg_config.device_num) {
+        LoadDevice *dev       = &sg_devices[num];
+        char *      fields[5] = {NULL}, *save = NULL, *tok;
+        int         n         = 0;
+
+        if ('#' == line[0] || '\n' == line[0] || '\r' == line[0]) {
+            continue;
+        }
+        for (tok = strtok_r(line, ",\r\n", &save); tok && n < 5; tok = strtok_r(NULL, ",\r\n", &save)) {
+            fields[n++] = tok;
+        }
+        if (n < 3) {
+            Log_w("skip line without credentials: %s", line);
+            continue;
+        }
+        HAL_Snprintf(dev->product_id, sizeof(dev->product_id), "%s", fields[0]);
+        HAL_Snprintf(dev->device_name, sizeof(dev->device_name), "%s", fields[1]);
+        HAL_Snprintf(dev->device_secret, sizeof(dev->device_secret), "%s", fields[2]);
+        if (n == 5) {
+            HAL_Snprintf(dev->subdev_product_id, sizeof(dev->subdev_product_id), "%s", fields[3]);
+            HAL_Snprintf(dev->subdev_device_name, sizeof(dev->subdev_device_name), "%s", fields[4]);
+        }
+        num++;
+    }
+    fclose(fp);
+
+    return num;
+}
+
+/* devices of one product named <prefix>_<n>, for a local broker stand-in */
+static int _make_devices(void)
+{
+    for (int i = 0; i < sg_config.device_num; i++) {
+        LoadDevice *dev = &sg_devices[i];
+
+        HAL_Snprintf(dev->product_id, sizeof(dev->product_id), "%s", sg_config.product_id);
+        HAL_Snprintf(dev->device_name, sizeof(dev->device_name), "%s_%d", sg_config.name_prefix, i);
+        HAL_Snprintf(dev->device_secret, sizeof(dev->device_secret), "%s", sg_config.device_secret);
+        HAL_Snprintf(dev->subdev_product_id, sizeof(dev->subdev_product_id), "%s", sg_config.product_id);
+        HAL_Snprintf(dev->subdev_device_name, sizeof(dev->subdev_device_name), "%s_%d_sub", sg_config.name_prefix, i);
+    }
+
+    return sg_config.device_num;
+}
+
+static void _print_row(const char *op, const OpStats *stats, double seconds)
+{
+    printf("  %-24s %-7s %8u %8u %7u %9.1f %8.2f %8.2f %8.2f\n", "", op, stats->sent, stats->done, stats->failed,
+           seconds > 0 ? stats->done / seconds : 0, _hist_percentile(&stats->hist, 50),
+           _hist_percentile(&stats->hist, 90), _hist_percentile(&stats->hist, 99));
+}
+
+static void _report(int num, long rss_base_kb, long rss_kb, double wall_s)
+{
+    OpStats  total[LOAD_MAX];
+    double   cpu_s = 0;
+    uint32_t disconnects = 0;
+    char     name[MAX_SIZE_OF_PRODUCT_ID + MAX_SIZE_OF_DEVICE_NAME + 2];
+
+    memset(total, 0, sizeof(total));
+    printf("\n%-26s %-7s %8s %8s %7s %9s %8s %8s %8s\n", "device", "op", "sent", "done", "failed", "done/s",
+           "p50 ms", "p90 ms", "p99 ms");
+
+    for (int i = 0; i < num; i++) {
+        LoadDevice *dev = &sg_devices[i];
+
+        HAL_Snprintf(name, sizeof(name), "%s/%s", dev->product_id, dev->device_name);
+        printf("%s  cpu %.3fs (%.1f%%) rss %ldKB disconnects %u\n", name, dev->cpu_s,
+               dev->active_s > 0 ? dev->cpu_s * 100 / dev->active_s : 0, (rss_kb - rss_base_kb) / num,
+               dev->disconnects);
+        for (int op = 0; op < LOAD_MAX; op++) {
+            if (0 == dev->stats[op].sent) {
+                continue;
+            }
+            _print_row(sg_op_names[op], &dev->stats[op], dev->active_s);
+
+            total[op].sent += dev->stats[op].sent;
+            total[op].done += dev->stats[op].done;
+            total[op].failed += dev->stats[op].failed;
+            _hist_merge(&total[op].hist, &dev->stats[op].hist);
+        }
+        cpu_s += dev->cpu_s;
+        disconnects += dev->disconnects;
+    }
+
+    printf("total of %d devices in %.1fs  cpu %.3fs (%.1f%% of one core) rss %ldKB (%ldKB at start) disconnects %u\n",
+           num, wall_s, cpu_s, wall_s > 0 ? cpu_s * 100 / wall_s : 0, rss_kb, rss_base_kb, disconnects);
+    for (int op = 0; op < LOAD_MAX; op++) {
+        if (total[op].sent) {
+            _print_row(sg_op_names[op], &total[op], wall_s);
+        }
+    }
+}
+
+#ifdef IOT_TRACE_ENABLED
+static void _trace_write(void *context, const char *data, size_t len)
+{
+    fwrite(data, 1, len, (FILE *)context);
+}
+
+static void _dump_trace(const char *file)
+{
+    FILE *fp = fopen(file, "w");
+    int   count;
+
+    if (NULL == fp) {
+        Log_e("open %s failed", file);
+        return;
+    }
+    count = IOT_Trace_Dump_Chrome(_trace_write, fp);
+    fclose(fp);
+    printf("%d trace events written to %s\n", count, file);
+}
+#endif
+
+static void _usage(const char *name)
+{
+    printf(
+        "usage: %s [options]\n"
+        "  -c file      CSV of product_id,device_name,device_secret[,subdev_product_id,subdev_device_name]\n"
+        "  -p pid       product id of generated devices, when there is no CSV\n"
+        "  -s secret    device secret shared by generated devices\n"
+        "  -d prefix    device name prefix of generated devices, default %s\n"
+        "  -n num       number of devices, default all of the CSV\n"
+        "  -r rate      property reports per second per device, default %.1f\n"
+        "  -e rate      events per second per device, default 0\n"
+        "  -g rate      sub-device online/offline per second per gateway, default 0\n"
+        "  -a           reply to actions\n"
+        "  -t seconds   duration, default %d\n"
+        "  -w ms        delay between device starts, default %d\n"
+        "  -b host:port broker to connect instead, e.g. a local stand-in with the same PSK\n"
+        "  -R region    region, default %s\n"
+        "  -l level     log level 0-4, default %d\n",
+        name, sg_config.name_prefix, sg_config.rate[LOAD_REPORT], sg_config.duration_s, sg_config.ramp_ms,
+        sg_config.region, sg_config.log_level);
+#ifdef IOT_TRACE_ENABLED
+    printf("  -T file      write the trace of the run in Chrome trace-event JSON\n");
+#endif
+}
+
+static int _parse_arguments(int argc, char **argv)
+{
+    int   c;
+    char *port;
+
+    while ((c = utils_getopt(argc, argv, "c:p:s:d:n:r:e:g:at:w:b:R:l:T:h")) != EOF) {
+        switch (c) {
+            case 'c':
+                sg_config.csv_file = utils_optarg;
+                break;
+            case 'p':
+                sg_config.product_id = utils_optarg;
+                break;
+            case 's':
+                sg_config.device_secret = utils_optarg;
+                break;
+            case 'd':
+                sg_config.name_prefix = utils_optarg;
+                break;
+            case 'n':
+                sg_config.device_num = atoi(utils_optarg);
+                break;
+            case 'r':
+                sg_config.rate[LOAD_REPORT] = atof(utils_optarg);
+                break;
+            case 'e':
+                sg_config.rate[LOAD_EVENT] = atof(utils_optarg);
+                break;
+            case 'g':
+                sg_config.rate[LOAD_CHURN] = atof(utils_optarg);
+                break;
+            case 'a':
+                sg_config.action_reply = true;
+                break;
+            case 't':
+                sg_config.duration_s = atoi(utils_optarg);
+                break;
+            case 'w':
+                sg_config.ramp_ms = atoi(utils_optarg);
+                break;
+            case 'b':
+                port = strrchr(utils_optarg, ':');
+                if (NULL == port) {
+                    printf("broker should be host:port\n");
+                    return QCLOUD_ERR_INVAL;
+                }
+                *port++               = '\0';
+                g_loadgen_broker_host = utils_optarg;
+                g_loadgen_broker_port = (uint16_t)atoi(port);
+                break;
+            case 'R':
+                sg_config.region = utils_optarg;
+                break;
+            case 'l':
+                sg_config.log_level = atoi(utils_optarg);
+                break;
+#ifdef IOT_TRACE_ENABLED
+            case 'T':
+                sg_config.trace_file = utils_optarg;
+                break;
+#endif
+            default:
+                _usage(argv[0]);
+                return QCLOUD_ERR_INVAL;
+        }
+    }
+
+    if (NULL == sg_config.csv_file && (NULL == sg_config.product_id || NULL == sg_config.device_secret)) {
+        printf("either -c or both of -p and -s are required\n");
+        return QCLOUD_ERR_INVAL;
+    }
+    if (NULL == sg_config.csv_file && sg_config.device_num <= 0) {
+        sg_config.device_num = 1;
+    }
+    if (sg_config.device_num <= 0 || sg_config.device_num > LOADGEN_MAX_DEVICES) {
+        sg_config.device_num = LOADGEN_MAX_DEVICES;
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    int      num, started = 0;
+    long     rss_base_kb, rss_kb;
+    uint64_t start_us;
+
+    if (QCLOUD_RET_SUCCESS != _parse_arguments(argc, argv)) {
+        return 1;
+    }
+    IOT_Log_Set_Level(sg_config.log_level);
+
+    sg_devices = calloc(sg_config.device_num, sizeof(LoadDevice));
+    if (NULL == sg_devices) {
+        return 1;
+    }
+    num = sg_config.csv_file ? _load_csv(sg_config.csv_file) : _make_devices();
+    if (num <= 0) {
+        free(sg_devices);
+        return 1;
+    }
+
+    srand((unsigned)time(NULL));
+    rss_base_kb = _rss_kb();
+    start_us    = _now_us(CLOCK_MONOTONIC);
+    printf("starting %d devices for %ds\n", num, sg_config.duration_s);
+
+    for (int i = 0; i < num; i++) {
+        if (0 != pthread_create(&sg_devices[i].thread, NULL, _device_thread, &sg_devices[i])) {
+            Log_e("create thread of device %d failed", i);
+            break;
+        }
+        started++;
+        if (sg_config.ramp_ms > 0) {
+            HAL_SleepMs(sg_config.ramp_ms);
+        }
+    }
+
+    while (_now_us(CLOCK_MONOTONIC) - start_us < (uint64_t)sg_config.duration_s * 1000000) {
+        HAL_SleepMs(100);
+    }
+    // sampled before the clients are destroyed
+    rss_kb  = _rss_kb();
+    sg_stop = 1;
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(sg_devices[i].thread, NULL);
+    }
+
+    _report(started, rss_base_kb, rss_kb, (_now_us(CLOCK_MONOTONIC) - start_us) / 1e6);
+#ifdef IOT_TRACE_ENABLED
+    if (sg_config.trace_file) {
+        _dump_trace(sg_config.trace_file);
+    }
+#endif
+    free(sg_devices);
+
+    return 0;
+}